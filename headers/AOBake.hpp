@@ -0,0 +1,31 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "MeshCache.hpp"
+
+class TriangleBVH;
+class ThreadPool;
+
+//Per-vertex ambient occlusion, ray traced once against the model's own BVH and kept in
+//the mesh cache so later runs just upload it as vertex attribute 3.
+//Each vertex fires `samples` cosine-weighted rays over its normal's hemisphere (one
+//Hammersley set, spun by a per-vertex Philox angle so neighbours don't band) and stores
+//the fraction that escape within `distance` (a fraction of the bounding diagonal).
+//Vertices sharing position and normal are traced once: OBJ imports repeat them per face.
+namespace AOBake {
+    constexpr uint32_t CACHE_TAG = FourCC('A', 'O', 'V', 'X');
+
+    struct Settings {
+        int samples = 32;
+        float distance = 0.08f;
+    };
+
+    //one value per vertex over all meshes in order: 1 = open, 0 = enclosed
+    void Bake(const std::vector<MeshData>& meshes, const TriangleBVH& bvh, const Settings& settings,
+              ThreadPool* pool, std::vector<float>& ao);
+
+    void Serialize(const Settings& settings, const std::vector<float>& ao, std::vector<uint8_t>& out);
+    //false when the blob was baked with other settings or for another vertex count
+    bool Deserialize(const std::vector<uint8_t>& in, const Settings& settings, size_t vertexCount,
+                     std::vector<float>& ao);
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <vector>
+#include "Lantern.hpp"
+#include "Model.hpp"
+#include "Shader.hpp"
+
+//Lanterns kept only as what they were spawned with: position + spawn time, velocity +
+//wind phase (2 x vec4 per lantern in a ring buffer). The vertex and light shaders get
+//the current position from lantern_trajectory.glsl, so after the spawn upload the CPU
+//does nothing per lantern per frame. Every lantern lives exactly maxAge seconds, so the
+//ring's oldest slot is always the first to expire.
+class AnalyticLanterns {
+public:
+    static constexpr int CAPACITY = 65536;
+    static constexpr int RECORD_TEXELS = 2;
+    static constexpr float REFERENCE_FPS = 60.0f; //frame rate the 0.9985 damping is tuned for
+
+    float maxAge = 40.0f;
+    float maxHeight = 60.0f;
+    float maxDistance = 200.0f;
+    float scale = 0.06f;
+
+    void init();
+    void Spawn(const Lantern& L, float now);
+    void Update(); //uploads this frame's spawns, the only per-frame CPU work
+
+    //uniforms lantern_trajectory.glsl needs, for every program that includes it
+    void SetUniforms(Shader& s, float now, const glm::vec3& boatPos) const;
+    void DrawMeshes(Shader& lit, const Model& lanternModel) const;
+    void DrawCasters(Shader& cascadeShader, const Model& lanternModel) const;
+
+    GLuint RecordTexture() const { return recordTex; }
+    int UsedSlots() const { return used; }
+
+    //CPU copy of the closed form in lantern_trajectory.glsl
+    static float Damping();
+    static glm::vec3 Evaluate(const glm::vec3& pos0, const glm::vec3& vel0, float phase, float age);
+
+private:
+    GLuint vbo = 0, recordTex = 0;
+    int head = 0;
+    int used = 0;
+    std::vector<glm::vec4> pending;
+
+    void bindInstances(Shader& s, const Model& lanternModel) const;
+};
+
+//integrates lanterns with the main.cpp stepper at several frame rates and prints the
+//mean / p99 / max distance to the closed form over their whole lifetime
+void RunTrajectoryBenchmark();
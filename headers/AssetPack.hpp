@@ -0,0 +1,32 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+//One file holding every shader, image and cached binary (meshes, bakes, compressed texture
+//levels) the game reads, built by tools/asset_packer. Entries are named by the relative
+//path the game would otherwise open (shaders/lighting.frag, cache/assets_models_boat.obj.mcache)
+//and start on a page boundary. The runtime maps the pack read-only and hands out pointers
+//into the mapping, so a cached texture level goes to GL straight from the page cache.
+//Anything the pack lacks is read from disk as before. Pack entries are trusted: the
+//packer built them from the current sources and the build reruns it when those change.
+namespace AssetPack {
+    struct View {
+        const uint8_t* data = nullptr;
+        size_t size = 0;
+        explicit operator bool() const { return data != nullptr; }
+    };
+
+    bool Open(const std::string& path); //false: missing or not a pack (the game then reads files)
+    void Close();
+    View Find(const std::string& name);  //empty when not packed
+    //madvise(WILLNEED): the kernel starts reading the entry in now, ahead of its first use
+    void Prefetch(const std::string& name);
+    size_t EntryCount();
+    size_t MappedBytes();
+
+    //the pack format's writer, for tools/asset_packer: (name, file on disk) pairs
+    bool Write(const std::string& path, const std::vector<std::pair<std::string, std::string>>& files);
+}
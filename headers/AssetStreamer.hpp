@@ -0,0 +1,138 @@
+#pragma once
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "Frustum.hpp"
+
+struct GLFWwindow;
+
+//Loader thread with its own GL context, sharing objects with the main window's.
+//Posted jobs run on it in order, so model import and bakes happen while the main thread
+//keeps drawing. Uploads they ask for only allocate the GL object at once; the data is
+//queued as a transfer in the current batch and goes up in chunks through one staging
+//buffer cut into segments: with ARB_buffer_storage it is mapped once, persistently, and
+//each segment gets a fence that the next write to it waits on; without, every chunk
+//orphans the buffer and maps it again. The GPU copies each chunk into its buffer
+//(glCopyBufferSubData) or texture (pixel unpack buffer).
+//Transfers are time sliced: every BeginFrame hands the loader that frame's byte and time
+//budget, and the batch the camera sees, nearest first, goes next. A batch is fenced once
+//its last chunk is issued.
+//Buffers and textures are shared between the contexts, vertex arrays and framebuffers are
+//not: the main thread builds those itself once BatchReady says so.
+class AssetStreamer {
+public:
+    struct Budget {
+        size_t bytesPerFrame = size_t(8) << 20;
+        double msPerFrame = 2.0; //loader time spent staging and issuing chunks
+    };
+    struct Backlog {
+        size_t bytes = 0;       //queued, not yet issued
+        int batches = 0;        //with transfers left
+        size_t maxFrameBytes = 0;
+        double maxFrameMs = 0.0;
+        int frames = 0;         //that moved anything
+    };
+
+    AssetStreamer() = default;
+    ~AssetStreamer(); //Stop()
+    AssetStreamer(const AssetStreamer&) = delete;
+    AssetStreamer& operator=(const AssetStreamer&) = delete;
+
+    //main thread, with the window's context current and GLEW initialised; false when no
+    //shared context could be created (then nothing is running and callers load in place)
+    bool Start(GLFWwindow* mainWindow, size_t stagingBytes = size_t(2) << 20);
+    //runs the jobs already posted and every queued transfer, budget or not, then joins the
+    //thread; main thread, before glfwTerminate
+    void Stop();
+    bool Running() const { return thread.joinable(); }
+    void Post(std::function<void()> job);
+
+    void SetBudget(const Budget& b);
+    //main thread, once per frame: this frame's budget and the view transfers are ranked by
+    void BeginFrame(const glm::mat4& viewProj, const glm::vec3& eye);
+    Backlog Pending();
+
+    //loader thread: the uploads in between form one batch, ranked by its world bounds
+    void BeginBatch(const glm::vec3& worldMin, const glm::vec3& worldMax);
+    int EndBatch();
+    //loader thread: a GL buffer of `bytes`, filled later from `data`, which must stay
+    //untouched until its batch is ready
+    GLuint CreateBuffer(const void* data, size_t bytes);
+    //loader thread: allocates level `level` of the 2D texture, filled later in row bands
+    //from `pixels` (same rule as above)
+    void TexImage2D(GLuint tex, GLint level, GLint internalFormat, int width, int height,
+                    GLenum format, GLenum type, const void* pixels, int bytesPerTexel);
+
+    //main thread: every chunk of the batch is in place; -1 (no batch) always is
+    bool BatchReady(int batch);
+
+    size_t BytesStreamed() const { return bytesStreamed.load(); }
+    bool Persistent() const { return persistent; } //staging kind, valid once a job has run
+
+private:
+    static const int SEGMENTS = 8;
+
+    struct Transfer {
+        GLuint object;
+        GLenum format = 0; //0 = buffer, otherwise texture upload format / type / level
+        GLenum type = 0;
+        GLint level = 0;
+        int width = 0;
+        size_t rowBytes = 0;
+        const unsigned char* src;
+        size_t bytes, done = 0;
+    };
+    struct Batch {
+        glm::vec3 bmin, bmax;
+        std::deque<Transfer> transfers;
+        size_t pendingBytes = 0;
+        bool closed = false;
+        GLsync fence = 0;
+        bool ready = false;
+    };
+
+    GLFWwindow* context = nullptr;
+    std::thread thread;
+    std::deque<std::function<void()>> jobs;
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool stopping = false;
+
+    //transfer queue and this frame's budget, under mutex
+    std::vector<Batch> batches;
+    int openBatch = -1;
+    Budget budget;
+    Frustum frustum;
+    glm::vec3 eye{0.0f};
+    bool haveView = false;
+    size_t creditBytes = 0;
+    double creditMs = 0.0;
+    bool unlimited = false; //Stop() flushes everything
+    size_t frameBytes = 0;
+    double frameMs = 0.0;
+    Backlog stats;
+
+    //staging, touched by the loader thread only
+    GLuint staging = 0;
+    size_t segmentBytes = 0;
+    unsigned char* mapped = nullptr; //persistent mapping
+    GLsync segmentFence[SEGMENTS] = {};
+    int nextSegment = 0;
+    bool persistent = false;
+    std::atomic<size_t> bytesStreamed{0};
+
+    void threadLoop();
+    bool canTransfer() const; //a batch has work and the frame has budget, under mutex
+    int pickBatch() const;    //under mutex
+    void queue(const Transfer& t);
+    void fenceIfDone(Batch& b); //under mutex, loader thread
+    size_t stage(const void* data, size_t bytes); //copies into staging, bound to GL_COPY_READ_BUFFER; returns the offset
+    void retire();                                //after the GL command reading the staged chunk
+};
@@ -0,0 +1,66 @@
+#pragma once
+#include "ThreadPool.hpp"
+#include <functional>
+#include <vector>
+
+//Build scaffolding shared by LightBVH and TriangleBVH (internal, for their .cpp files).
+//Both build a binary tree top-down in one node array, root at 0: the top levels split on
+//the calling thread (their binning goes wide), the ranges below `subtreeMax` are built as
+//independent subtrees on the pool and stitched back in.
+namespace BVHBuild {
+    //runs fn(begin, end) on the pool when there's enough work, inline otherwise
+    inline void Range(ThreadPool* pool, size_t n, size_t parallelMin,
+                      const std::function<void(size_t, size_t)>& fn) {
+        if (pool && n >= parallelMin) pool->ParallelFor(n, parallelMin / 2, fn);
+        else fn(0, n);
+    }
+
+    //where a subtree's nodes go: its root replaces the placeholder at `at`, local node
+    //k > 0 lands at base + k - 1
+    struct Placement {
+        int at, base;
+        int operator()(int k) const { return k == 0 ? at : base + k - 1; }
+    };
+
+    //split(node, begin, end, left) partitions [begin, end), fills in `node` as the parent
+    //of the fresh nodes left, left + 1 and returns the middle. subtree(local, begin, end)
+    //builds into `local`, its root already at 0. remap(node, placement) rewrites a subtree
+    //node's links before it is stored; `nodes[placement.at]` is still the placeholder.
+    template <class Node, class Split, class Subtree, class Remap>
+    void Build(std::vector<Node>& nodes, int count, int subtreeMax, ThreadPool* pool,
+               Split split, Subtree subtree, Remap remap) {
+        struct Item { int node, begin, end; };
+        std::vector<Item> work{{0, 0, count}}, subtrees;
+        nodes.resize(1);
+        while (!work.empty()) {
+            Item it = work.back();
+            work.pop_back();
+            if (it.end - it.begin <= subtreeMax) { subtrees.push_back(it); continue; }
+            int left = (int)nodes.size();
+            nodes.resize(nodes.size() + 2);
+            int mid = split(it.node, it.begin, it.end, left);
+            work.push_back({left, it.begin, mid});
+            work.push_back({left + 1, mid, it.end});
+        }
+
+        std::vector<std::vector<Node>> local(subtrees.size());
+        auto buildSubtrees = [&](size_t b, size_t e) {
+            for (size_t i = b; i < e; ++i) {
+                local[i].resize(1);
+                subtree(local[i], subtrees[i].begin, subtrees[i].end);
+            }
+        };
+        if (pool) pool->ParallelFor(subtrees.size(), 1, buildSubtrees);
+        else buildSubtrees(0, subtrees.size());
+
+        for (size_t s = 0; s < subtrees.size(); ++s) {
+            const Placement to{subtrees[s].node, (int)nodes.size()};
+            for (size_t k = 0; k < local[s].size(); ++k) {
+                Node node = local[s][k];
+                remap(node, to);
+                if (k == 0) nodes[to.at] = node;
+                else nodes.push_back(node);
+            }
+        }
+    }
+}
@@ -0,0 +1,25 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class ThreadPool;
+
+//4x4 block compression of RGBA8 images, run once at import and kept in the texture cache.
+//BC1 is 4 bits per texel (opaque), BC3 adds an interpolated alpha block (8 bits), BC7 is
+//mode 6 only (8 bits, one RGBA line with 16 steps and per-endpoint parity bits).
+//Each block starts from the principal axis of its texels, picks indices, refits the two
+//endpoints by least squares and keeps whichever came out closer. The nearest-palette
+//search, where the time goes, compares four texels per SSE op.
+//Decode expands the blocks the way the GPU does, for drivers that can't sample a format.
+namespace BlockCompress {
+    enum Format : uint32_t { RGBA8, BC1, BC3, BC7 };
+
+    size_t LevelBytes(Format format, int width, int height);
+    //rgba is width*height*4, edge texels repeat into partial blocks; block rows are
+    //spread over the pool when there is one
+    void Encode(Format format, const uint8_t* rgba, int width, int height, ThreadPool* pool,
+                std::vector<uint8_t>& out);
+    void Decode(Format format, const uint8_t* blocks, int width, int height, std::vector<uint8_t>& rgba);
+    const char* Name(Format format);
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <cstddef>
+
+//Cascaded shadow maps for the directional moonlight, one depth layer per cascade.
+//Cascade 0 covers the first few meters of the view and is redrawn every frame with
+//every caster. The far cascades only hold the castle and island: they are rendered
+//with some padding and kept until the camera's slice no longer fits inside what was
+//rendered, so the big static meshes aren't drawn again every frame. Cascade centers
+//are snapped to whole shadow texels so the edges don't shimmer while moving.
+struct CascadedShadow {
+    static const int NUM_CASCADES = 4;
+
+    struct Cascade {
+        glm::mat4 viewProj{1.0f}; //light view-projection it was rendered with
+        glm::vec3 centerLS{0.0f}; //snapped center in light space
+        float radius = 0.0f;      //half extent of the rendered box
+        float splitFar = 0.0f;    //view distance where this cascade ends
+        float texelWorld = 0.0f;  //size of one shadow texel in meters
+        bool valid = false;
+    };
+
+    GLuint fbo = 0;
+    GLuint tex = 0; //GL_TEXTURE_2D_ARRAY, depth compare on
+    int size = 1024;
+    float splitLambda = 0.75f; //0 = uniform splits, 1 = logarithmic
+    float padding = 1.3f;      //far cascades render this much wider than needed
+    float depthExtra = 80.0f;  //casters this far outside a slice along the light still count
+    Cascade cascades[NUM_CASCADES];
+
+    void init(int size);
+    void release();
+    //fits the cascades to the camera, returns a bit per cascade that must be re-rendered
+    unsigned int Update(const glm::mat4& view, float fovY, float aspect, float nearP, float shadowDistance,
+                        const glm::vec3& lightDir);
+    void Invalidate();
+    void BeginCascade(int i) const; //binds the layer for rendering, clears it
+    size_t memoryBytes() const;
+};
@@ -0,0 +1,11 @@
+#pragma once
+#include <glm/glm.hpp>
+
+//view frustum planes pulled out of a projection * view matrix
+struct Frustum {
+    glm::vec4 planes[6]; //xyz = inward normal, w = distance
+
+    static Frustum FromMatrix(const glm::mat4& viewProj);
+    bool SphereVisible(const glm::vec3& center, float radius) const;
+    bool BoxVisible(const glm::vec3& bmin, const glm::vec3& bmax) const;
+};
@@ -0,0 +1,50 @@
+#pragma once
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <memory>
+#include <vector>
+#include "Lantern.hpp"
+#include "Model.hpp"
+#include "Shader.hpp"
+
+//Lantern simulation that lives on the GPU.
+//State is a ring of CAPACITY records (3 x vec4: position + alive, velocity + age, phase)
+//in two buffers; each Step runs lantern_sim.vert over the ring with transform feedback
+//from one buffer into the other. New lanterns are queued with Spawn and written into
+//the ring in one upload at the next Step, overwriting the oldest slots. After that the
+//CPU never sees them again: the mesh is drawn instanced straight from the state buffer
+//and lighting reads it as a texture buffer.
+class GpuLanterns {
+public:
+    static constexpr int CAPACITY = 65536;
+    static constexpr int RECORD_TEXELS = 3; //vec4s per lantern
+
+    float maxAge = 40.0f;       //same culls as the CPU path
+    float maxHeight = 60.0f;
+    float maxDistance = 200.0f;
+    float scale = 0.06f;
+
+    void init();
+    void Spawn(const Lantern& L) { pending.push_back(L); }
+    void Step(float dt, const glm::vec3& boatPos);
+
+    //instanced lantern meshes through lighting.frag (isLantern etc. set by the caller)
+    void DrawMeshes(Shader& lit, const Model& lanternModel) const;
+
+    GLuint StateTexture() const { return stateTex[current]; } //RGBA32F buffer texture
+    int UsedSlots() const { return used; } //slots ever written, the rest are never touched
+    size_t memoryBytes() const { return 2 * size_t(CAPACITY) * RECORD_TEXELS * sizeof(glm::vec4); }
+
+private:
+    GLuint vbo[2] = {0, 0};
+    GLuint vao[2] = {0, 0};
+    GLuint stateTex[2] = {0, 0};
+    int current = 0;
+    int head = 0;
+    int used = 0;
+    std::vector<Lantern> pending;
+    std::vector<glm::vec4> staging;
+    std::unique_ptr<Shader> sim;
+
+    void flushSpawns();
+};
@@ -0,0 +1,43 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+
+//sampling helpers shared by the CPU bakers (AOBake, Lightmap)
+
+//base-2 radical inverse (van der Corput) in [0, 1)
+inline float RadicalInverse(uint32_t bits) {
+    bits = (bits << 16) | (bits >> 16);
+    bits = ((bits & 0x55555555u) << 1) | ((bits & 0xAAAAAAAAu) >> 1);
+    bits = ((bits & 0x33333333u) << 2) | ((bits & 0xCCCCCCCCu) >> 2);
+    bits = ((bits & 0x0F0F0F0Fu) << 4) | ((bits & 0xF0F0F0F0u) >> 4);
+    bits = ((bits & 0x00FF00FFu) << 8) | ((bits & 0xFF00FF00u) >> 8);
+    return float(bits) * 2.3283064365386963e-10f;
+}
+
+//n cosine-weighted directions (Hammersley) around +z
+inline std::vector<glm::vec3> CosineHemisphere(int n) {
+    std::vector<glm::vec3> dirs(n);
+    for (int s = 0; s < n; ++s) {
+        float u = (s + 0.5f) / n, r = std::sqrt(u), phi = 6.2831853f * RadicalInverse(uint32_t(s));
+        dirs[s] = glm::vec3(r * std::cos(phi), r * std::sin(phi), std::sqrt(std::max(0.0f, 1.0f - u)));
+    }
+    return dirs;
+}
+
+//orthonormal t, b around unit n (Duff et al. 2017)
+inline void TangentBasis(const glm::vec3& n, glm::vec3& t, glm::vec3& b) {
+    float sign = n.z >= 0.0f ? 1.0f : -1.0f;
+    float a = -1.0f / (sign + n.z);
+    float c = n.x * n.y * a;
+    t = glm::vec3(1.0f + sign * n.x * n.x * a, sign * c, -sign * n.x);
+    b = glm::vec3(c, sign + n.y * n.y * a, -n.y);
+}
+
+//direction d (around +z) spun by angle (cos c, sin s) and placed around n
+inline glm::vec3 ToHemisphere(const glm::vec3& d, float c, float s, const glm::vec3& n,
+                              const glm::vec3& t, const glm::vec3& b) {
+    return t * (c * d.x - s * d.y) + b * (s * d.x + c * d.y) + n * d.z;
+}
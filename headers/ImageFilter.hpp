@@ -0,0 +1,15 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+//Resampling of sRGB-encoded RGBA8 images for texture import: the downscale to an asset's
+//texel budget and every mip level below it.
+//Texels are decoded to linear light and premultiplied by alpha before filtering, so dark
+//or transparent texels don't bleed into their neighbours, then encoded back. The filter
+//is a separable Mitchell-Netravali (B = C = 1/3) stretched over the scale factor; each
+//RGBA texel is one SSE register in both passes.
+namespace ImageFilter {
+    //dstWidth x dstHeight, at most the source size on each axis
+    void Downsample(const uint8_t* rgba, int width, int height, int dstWidth, int dstHeight,
+                    std::vector<uint8_t>& out);
+}
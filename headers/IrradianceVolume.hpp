@@ -0,0 +1,61 @@
+#pragma once
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <unordered_map>
+#include <vector>
+#include "Lantern.hpp"
+#include "Shader.hpp"
+
+class ThreadPool;
+
+//Coarse 3D grid of lantern glow around the boat and the castle.
+//Every cell stores the summed lantern irradiance as L0 (a) plus an L1 direction (rgb),
+//so lighting.frag gets the whole sky's worth of lanterns from one texture fetch.
+//Lanterns are splatted on the worker threads (each thread owns a slab of z rows, the
+//rows themselves are 4 cells at a time with SSE). Only lanterns that moved more than
+//moveThreshold cells get re-splatted: their old contribution is subtracted and the new
+//one added, and the dirty z range is all that goes back to the GPU.
+class IrradianceVolume {
+public:
+    static const int NX = 48, NY = 16, NZ = 48;
+
+    bool enabled = true;
+    float cellSize = 4.0f;
+    float splatRadius = 24.0f;     //a lantern stops adding glow past this
+    float moveThreshold = 0.5f;    //in cells
+    float strength = 0.35f;        //how much of a lantern's light comes back as glow
+    int rebuildAfterUpdates = 900; //clear and re-splat everything to flush float drift
+
+    void init();
+    //`focus` is where the volume should be centred (between the boat and the castle)
+    void Update(const std::vector<Lantern>& lanterns, const glm::vec3& focus, ThreadPool& pool);
+    //sampler + transform for lighting.frag, always call so the sampler has a unit
+    void Bind(Shader& lit, int unit) const;
+    size_t memoryBytes() const;
+
+private:
+    struct Splat {
+        glm::vec3 pos;
+        unsigned int stamp;
+    };
+    struct Op {
+        glm::vec3 pos;
+        float sign; //+1 add, -1 take back
+    };
+
+    GLuint tex = 0;
+    glm::vec3 origin{0.0f};
+    bool originValid = false;
+    unsigned int stamp = 0;
+    int updatesSinceRebuild = 0;
+
+    //structure of arrays, x fastest, so a row is contiguous for SIMD
+    std::vector<float> l0, l1x, l1y, l1z;
+    std::unordered_map<unsigned int, Splat> splatted; //lantern id -> where it was splatted
+    std::vector<Op> ops;
+    std::vector<glm::vec4> upload;
+
+    void clear();
+    void splat(ThreadPool& pool, int& zMin, int& zMax);
+    void uploadSlices(int zMin, int zMax);
+};
@@ -0,0 +1,19 @@
+#pragma once
+#include <glm/glm.hpp>
+
+struct Lantern {
+    glm::vec3 pos;
+    glm::vec3 vel;
+    float t;
+    float phase;
+    unsigned int id; //stable across frames, unlike the index in the vector
+};
+
+//point light shared by every lantern
+static const glm::vec3 LANTERN_LIGHT_COLOR(1.0f, 0.62f, 0.28f);
+static const float LANTERN_ATTEN_CONSTANT  = 1.0f;
+static const float LANTERN_ATTEN_LINEAR    = 0.14f;
+static const float LANTERN_ATTEN_QUADRATIC = 0.07f;
+
+//distance where the lantern attenuation drops below `threshold`
+float LanternInfluenceRadius(float threshold = 4.0f / 256.0f);
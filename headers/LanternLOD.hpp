@@ -0,0 +1,56 @@
+#pragma once
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <memory>
+#include <vector>
+#include "Lantern.hpp"
+#include "Model.hpp"
+#include "Shader.hpp"
+
+class ThreadPool;
+
+enum LanternLodLevel {
+    LOD_MESH,     //lantern.obj with the emblem texture
+    LOD_IMPOSTOR, //camera-facing quad with a view of the mesh baked at startup
+    LOD_SPRITE,   //additive point, a few pixels of glow
+    LOD_COUNT
+};
+
+//Picks a level of detail per lantern from its height on screen and draws each level
+//as one instanced batch (instance = vec4 position + scale).
+class LanternLOD {
+public:
+    float scale = 0.06f;          //lantern model scale
+    float meshPixels = 28.0f;     //taller than this on screen: full mesh
+    float impostorPixels = 5.0f;  //taller than this: impostor, below: sprite
+    glm::vec3 glow{0.7f, 0.595f, 0.315f}; //lanternTint * lanternEmissive
+
+    //bakes the impostor from `lanternModel` (drawn with `lanternTex`), hooks up instancing
+    void init(Model& lanternModel, GLuint lanternTex);
+    //frustum cull + bucket by projected size, then upload the three batches
+    void Classify(const std::vector<Lantern>& lanterns, const glm::mat4& view,
+                  const glm::mat4& proj, int viewportHeight, ThreadPool& pool);
+
+    //full meshes through lighting.frag (isLantern etc. set by the caller)
+    void DrawMeshes(Shader& lit, const Model& lanternModel) const;
+    //writes depth, draw with the opaque geometry
+    void DrawImpostors(const glm::mat4& view, const glm::mat4& proj, const glm::vec3& eye) const;
+    //additive and no depth writes, draw after the sky
+    void DrawSprites(const glm::mat4& view, const glm::mat4& proj, int viewportHeight) const;
+
+    int Count(LanternLodLevel level) const { return (int)batch[level].size(); }
+
+private:
+    GLuint instanceBuf[LOD_COUNT] = {0, 0, 0};
+    std::vector<glm::vec4> batch[LOD_COUNT];
+
+    GLuint impostorTex = 0;
+    GLuint quadVAO = 0, quadVBO = 0, spriteVAO = 0;
+    glm::vec3 boundsMin{0.0f}, boundsMax{0.0f}; //lantern model space
+    glm::vec2 impostorSize{1.0f};
+    glm::vec3 impostorOffset{0.0f};
+
+    std::unique_ptr<Shader> impostorShader, spriteShader;
+
+    void bakeImpostor(Model& lanternModel, GLuint lanternTex);
+};
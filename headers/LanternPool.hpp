@@ -0,0 +1,61 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "Lantern.hpp"
+
+//Fixed-capacity lantern storage. Live lanterns stay packed at the front of Live(), so
+//every consumer that walks a std::vector<Lantern> keeps working and never sees a dead
+//slot; Despawn moves the last lantern into the hole. Lantern.id is a handle (slot index +
+//generation) that survives those moves and goes stale once its slot is reused.
+//Everything is allocated in the constructor, spawning and despawning never touch the heap.
+class LanternPool {
+public:
+    using Handle = uint32_t;
+    static constexpr Handle INVALID = 0;
+    static constexpr int MAX_CAPACITY = 1 << 16; //slot index lives in the low 16 bits
+
+    explicit LanternPool(int capacity = MAX_CAPACITY);
+
+    //INVALID when the pool is full
+    Handle Spawn(const Lantern& L);
+    //n new lanterns at the back of Live(), for the caller to fill; returns how many
+    //fit (first points at them). Their ids are already set, leave them alone.
+    int SpawnBatch(int n, Lantern*& first);
+    bool Despawn(Handle h);
+
+    Lantern* Get(Handle h); //nullptr for stale handles
+    bool Alive(Handle h) const { return Get(h) != nullptr; }
+    const Lantern* Get(Handle h) const;
+
+    //despawn every lantern `dead(L)` picks, one pass over live lanterns only
+    template <class Pred>
+    void RemoveIf(Pred dead) {
+        for (size_t i = 0; i < live.size();) {
+            if (dead(live[i])) removeAt(i);
+            else ++i;
+        }
+    }
+
+    std::vector<Lantern>& Live() { return live; }
+    const std::vector<Lantern>& Live() const { return live; }
+    size_t Size() const { return live.size(); }
+    int Capacity() const { return (int)slots.size(); }
+    void Clear();
+
+private:
+    struct Slot {
+        uint32_t dense;      //index in `live`, or the next free slot while unused
+        uint16_t generation; //bumped on every despawn, never 0
+    };
+    static constexpr uint32_t NO_SLOT = 0xFFFFFFFFu;
+
+    std::vector<Lantern> live; //reserved to capacity, so push_back never reallocates
+    std::vector<Slot> slots;
+    uint32_t freeHead = NO_SLOT;
+
+    Handle allocate(uint32_t denseIndex);
+    void removeAt(size_t i);
+};
+
+//spawns and expires millions of lanterns, checks the storage never moved and prints timings
+void RunPoolBenchmark();
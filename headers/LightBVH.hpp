@@ -0,0 +1,62 @@
+#pragma once
+#include <vector>
+#include <glm/glm.hpp>
+#include "Lantern.hpp"
+#include "Frustum.hpp"
+
+class ThreadPool;
+
+struct LightNode {
+    glm::vec3 bmin, bmax; //bounds of the lantern positions below
+    glm::vec3 center;     //power-weighted mean position, where a cluster shines from
+    float power = 0.0f;   //summed lantern intensity (1 per lantern for now)
+    int parent = -1;
+    int first = 0;        //inner: left child (right child is first + 1), leaf: first entry in prims
+    int count = 0;        //lanterns in a leaf, 0 for inner nodes
+};
+
+//one entry of a light cut: a single lantern or a whole cluster standing in for it
+struct CutLight {
+    glm::vec3 pos;
+    float intensity; //multiplies LANTERN_LIGHT_COLOR
+    int lantern;     //index into the lantern vector, -1 for a cluster
+};
+
+//Bounding volume hierarchy over lantern positions.
+//Built top-down with binned SAH (the big top-level nodes bin on the pool, the subtrees
+//below are built as independent tasks), and refit bottom-up every tick while the
+//lanterns drift. It only rebuilds when the lantern set changes or the refit tree has
+//grown too loose. Children always sit after their parent in `nodes`.
+class LightBVH {
+public:
+    int leafSize = 4;
+    float rebuildRatio = 1.5f; //rebuild once the refit SAH cost grows past built * this
+
+    //rebuild or refit for this frame's lanterns
+    void Update(const std::vector<Lantern>& lanterns, ThreadPool& pool);
+    void Build(const std::vector<Lantern>& lanterns, ThreadPool& pool);
+    void Refit(const std::vector<Lantern>& lanterns, ThreadPool& pool);
+
+    //the k lanterns closest to p, nearest first
+    void Nearest(const glm::vec3& p, int k, std::vector<int>& out) const;
+    //lanterns whose sphere of `radius` touches the frustum
+    void QuerySpheres(const Frustum& frustum, float radius, std::vector<int>& out) const;
+    //lightcut seen from p: at most maxLights entries, the clusters with the largest
+    //possible error get split first. `forced` lanterns always come out individually.
+    void Cut(const glm::vec3& p, int maxLights, const std::vector<int>& forced,
+             std::vector<CutLight>& out) const;
+
+    const std::vector<LightNode>& Nodes() const { return nodes; }
+    int Rebuilds() const { return rebuilds; }
+
+private:
+    std::vector<LightNode> nodes;
+    std::vector<int> prims;      //lantern indices, leaves own contiguous ranges
+    std::vector<int> leafOf;     //lantern index -> leaf node
+    std::vector<glm::vec3> points;
+    float builtCost = 0.0f;
+    int rebuilds = 0;
+
+    float sahCost() const;
+    void refitLeaf(LightNode& n) const;
+};
@@ -0,0 +1,56 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+#include "MeshCache.hpp"
+
+class AssetStreamer;
+class CollisionScene;
+class Model;
+class ThreadPool;
+
+//Baked moonlight for the models that never move.
+//Unwrap gives every vertex a second UV set in one atlas per model: triangles are grouped
+//into charts (edge-connected, same dominant normal axis), each chart is projected along
+//that axis and the charts are shelf-packed with a gutter. A vertex used by two charts is
+//split, so Unwrap can grow the vertex arrays: it runs before the other cached stages.
+//Bake maps every atlas texel back onto its triangle and ray traces it in world space
+//against the whole CollisionScene (so the castle shadows the island): direct moonlight,
+//its shadow and one diffuse bounce. Texels are RGBA8, rgb = irradiance / RANGE and
+//a = moon visibility, which still masks the view-dependent highlight at runtime.
+namespace Lightmap {
+    constexpr uint32_t UV_TAG = FourCC('L', 'M', 'U', 'V');
+    constexpr float RANGE = 2.0f;
+
+    struct Atlas {
+        int size = 0;              //texels per side, 0 = no lightmap
+        std::vector<glm::vec2> uv; //per vertex over all meshes
+    };
+    //false when the charts don't fit at any sensible density; meshes may be split anyway
+    bool Unwrap(std::vector<MeshData>& meshes, int size, Atlas& atlas);
+    void SerializeAtlas(const Atlas& atlas, std::vector<uint8_t>& out);
+    bool DeserializeAtlas(const std::vector<uint8_t>& in, int size, size_t vertexCount, Atlas& atlas);
+
+    struct Target {
+        const Model* model;
+        glm::mat4 toWorld;
+        int sceneInstance;             //the same model in the CollisionScene
+        std::vector<glm::vec3> albedo; //per mesh, colours the bounce off it
+    };
+    struct Settings {
+        int bounceSamples = 16;
+        float bounceDistance = 30.0f; //world units
+        float bias = 0.02f;           //ray start offset along the normal
+    };
+
+    //texels[i] (size^2 RGBA8) for targets[i]; read from cache/<model>.lmap when everything
+    //that went into it (light, transforms, atlases, settings) hashes the same
+    void Bake(const std::vector<Target>& targets, const CollisionScene& scene, const glm::vec3& lightDir,
+              const glm::vec3& lightColor, const Settings& settings, ThreadPool& pool,
+              std::vector<std::vector<uint8_t>>& texels);
+
+    //RGBA8 texture with linear filtering; 0 for an empty atlas. With a streamer the texels
+    //are queued in its open batch (call from its loader thread) and must stay until it's ready
+    unsigned int CreateTexture(const std::vector<uint8_t>& texels, int size, AssetStreamer* streamer = nullptr);
+}
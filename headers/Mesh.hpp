@@ -4,6 +4,8 @@
 #include <GL/glew.h>
 #include "Shader.hpp"
 
+class AssetStreamer;
+
 struct Vertex {
     glm::vec3 Position;
     glm::vec3 Normal;
@@ -14,12 +16,32 @@ class Mesh {
 public:
     std::vector<Vertex> vertices;
     std::vector<unsigned int> indices;
-    unsigned int VAO;
+    unsigned int VAO = 0;
 
-    Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices);
+    //createGL false: nothing touches GL until Upload and CreateVertexArray
+    Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices, bool createGL = true);
+    //buffers through the streamer, on its loader thread, as one batch ranked by these world bounds
+    void Upload(AssetStreamer& streamer, const glm::vec3& worldMin, const glm::vec3& worldMax);
+    int StreamBatch() const { return streamBatch; } //-1 when not streamed
+    //main thread, once the batch is ready: vertex arrays aren't shared between contexts.
+    //Until then Draw does nothing
+    void CreateVertexArray();
     void Draw(Shader& shader) const;
+    //per-instance vec4 (position, scale) from `buffer` at attribute 5, `stride` bytes apart;
+    //records with more than one vec4 continue on attributes 6, 7, ...
+    void SetInstanceBuffer(GLuint buffer, GLsizei stride = sizeof(glm::vec4), int vec4s = 1) const;
+    void DrawInstanced(int count) const;
+    //baked ambient occlusion, one float per vertex at attribute 3 (see AOBake)
+    void SetVertexAO(const float* ao);
+    bool HasVertexAO() const { return aoVBO != 0 || !pendingAO.empty(); }
+    //lightmap atlas coordinates, one vec2 per vertex at attribute 4 (see Lightmap)
+    void SetLightmapUV(const glm::vec2* uv);
 
 private:
-    unsigned int VBO, EBO;
+    unsigned int VBO = 0, EBO = 0;
+    unsigned int aoVBO = 0, uv2VBO = 0;
+    std::vector<float> pendingAO;      //kept while there is no vertex array, the streamer reads them
+    std::vector<glm::vec2> pendingUV;
+    int streamBatch = -1;
     void setupMesh();
 };
\ No newline at end of file
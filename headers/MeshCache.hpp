@@ -0,0 +1,72 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "Mesh.hpp"
+
+class ThreadPool;
+
+//CPU side of one imported mesh, before anything touches GL
+struct MeshData {
+    std::vector<Vertex> vertices;
+    std::vector<unsigned int> indices;
+};
+
+//fourcc tag of a cache section
+constexpr uint32_t FourCC(char a, char b, char c, char d) {
+    return uint32_t(uint8_t(a)) | uint32_t(uint8_t(b)) << 8 | uint32_t(uint8_t(c)) << 16 | uint32_t(uint8_t(d)) << 24;
+}
+
+//everything cached for one source model: the meshes plus tagged blobs that later
+//import stages add (triangle BVH, baked data, ...)
+struct CachedModel {
+    struct Section {
+        uint32_t tag;
+        std::vector<uint8_t> bytes;
+    };
+    std::vector<MeshData> meshes;
+    std::vector<Section> sections;
+    bool draco = false; //the meshes were read Draco-encoded
+
+    const Section* Find(uint32_t tag) const;
+    std::vector<uint8_t>& Put(uint32_t tag); //replaces a section with the same tag
+};
+
+//Binary model cache under cache/: one file per source model, valid while the source's
+//size and mtime match what was recorded. A warm start reads the meshes straight into
+//their vectors instead of running assimp over the OBJ.
+//The meshes are stored raw or, with SetEncoding({true, ...}), Draco-encoded: every attribute
+//quantized to its own bit count and the connectivity entropy coded. Draco's sequential
+//method is used, not edgebreaker, as it keeps the vertex and triangle order the other
+//sections (BVH, AO, lightmap UVs) index by. Read takes either; each mesh decodes on its own
+//worker.
+namespace MeshCache {
+    struct Encoding {
+        bool draco = false;
+        int positionBits = 14; //of the model's bounding box
+        int normalBits = 10;   //octahedral
+        int texCoordBits = 12;
+        int speed = 5;         //Draco encode / decode speed, 0 (smallest) .. 10 (fastest)
+    };
+    //how Write stores meshes from now on; set before any loading starts
+    void SetEncoding(const Encoding& encoding);
+    const Encoding& GetEncoding();
+
+    std::string PathFor(const std::string& source, const char* extension = ".mcache");
+    //false: missing, stale or corrupt; pool decodes Draco meshes in parallel
+    bool Read(const std::string& source, CachedModel& out, ThreadPool* pool = nullptr);
+    //model-space bounds from a current cache file's header alone, without reading the meshes
+    bool Peek(const std::string& source, glm::vec3& bmin, glm::vec3& bmax);
+    bool Write(const std::string& source, const CachedModel& model, ThreadPool* pool = nullptr);
+    //the file Write would make for `source`, but at `path` and stored as `encoding` whatever
+    //SetEncoding said: the packer's Draco copies, which leave cache/ as the game keeps it
+    bool WriteAs(const std::string& path, const std::string& source, const CachedModel& model,
+                 const Encoding& encoding, ThreadPool* pool = nullptr);
+    //assimp import into MeshData (what Model used to do inline), no GL
+    bool Import(const std::string& source, std::vector<MeshData>& meshes);
+}
+
+//imports the model, then writes and reads it back raw and Draco-encoded at a few quantization
+//settings: file size, encode time, cold (page cache dropped) and warm read + decode, serial and
+//over the pool, and the largest position error
+void RunMeshCacheBenchmark(const char* path);
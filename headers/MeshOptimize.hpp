@@ -0,0 +1,38 @@
+#pragma once
+#include <cstddef>
+#include <string>
+#include <vector>
+#include "MeshCache.hpp"
+
+class ThreadPool;
+
+//Import stage that reorders a model's meshes for the GPU; the mesh cache keeps the result.
+//Weld merges bit-identical vertices through a hash table (assimp hands OBJ faces over with
+//three vertices of their own). OptimizeVertexCache orders triangles by Forsyth's scoring
+//(vertices recently used and with few triangles left go first) for post-transform cache
+//hits. OptimizeOverdraw then cuts that order into clusters where the cache would start
+//over anyway and draws the outward facing ones first (Sander et al.), kept only while the
+//cache misses grow by no more than `threshold`. OptimizeVertexFetch finally renumbers the
+//vertices in order of first use, so the vertex fetch streams through memory.
+namespace MeshOptimize {
+    struct Stats {
+        size_t triangles = 0, vertices = 0;
+        float acmr = 0.0f;     //post-transform cache misses per triangle (FIFO, 16 entries); 0.5 is ideal
+        float atvr = 0.0f;     //misses per vertex; 1.0 is ideal
+        float overdraw = 0.0f; //fragments shaded per pixel covered, six axis views; 1.0 is ideal
+    };
+
+    size_t Weld(MeshData& mesh); //returns the vertices removed
+    void OptimizeVertexCache(std::vector<unsigned int>& indices, size_t vertexCount);
+    void OptimizeOverdraw(std::vector<unsigned int>& indices, const std::vector<Vertex>& vertices,
+                          float threshold = 1.05f);
+    void OptimizeVertexFetch(MeshData& mesh);
+
+    //all four on every mesh, each mesh on its own worker with a pool
+    void Optimize(std::vector<MeshData>& meshes, ThreadPool* pool = nullptr);
+    //the meshes drawn in order, a cache flush between them; overdraw over all of them at once
+    Stats Analyze(const std::vector<MeshData>& meshes, ThreadPool* pool = nullptr);
+}
+
+//imports each model and prints ACMR, ATVR, overdraw and timings before and after every stage
+void RunMeshOptimizeBenchmark(const std::vector<std::string>& models);
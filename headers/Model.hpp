@@ -1,22 +1,51 @@
 #pragma once
 #include <vector>
 #include <string>
-#include <assimp/scene.h>
 #include <unordered_map>
 #include "Mesh.hpp"
 #include "Shader.hpp"
+#include "TriangleBVH.hpp"
+#include "Lightmap.hpp"
+
+class ThreadPool;
+class AssetStreamer;
+struct CachedModel;
+
+//extra import stages, each built once and then loaded from the mesh cache
+enum ModelBake : unsigned {
+    MODEL_COLLISION = 1, //triangle BVH for Collision()
+    MODEL_AO = 2,        //per-vertex ambient occlusion on attribute 3 (needs the BVH, builds it)
+    MODEL_LIGHTMAP = 4,  //lightmap atlas UVs on attribute 4; the texels come from Lightmap::Bake
+};
 
 class Model {
 public:
-    Model(const std::string& path);
+    //streamer: the meshes' buffers go up through it (call from its loader thread), one batch
+    //per mesh ranked by its bounds under toWorld; the vertex arrays wait for CreateVertexArrays
+    Model(const std::string& path, unsigned bake = 0, ThreadPool* pool = nullptr, AssetStreamer* streamer = nullptr,
+          const glm::mat4& toWorld = glm::mat4(1.0f));
+    //main thread: vertex arrays for the meshes whose batches are ready, returns how many still wait
+    size_t CreateVertexArrays(AssetStreamer* streamer = nullptr);
     void Draw(Shader& shader);
+    void SetInstanceBuffer(GLuint buffer, GLsizei stride = sizeof(glm::vec4), int vec4s = 1) const; //see Mesh
+    void DrawInstanced(int count) const;
+    void Bounds(glm::vec3& bmin, glm::vec3& bmax) const; //model space, all meshes
     size_t MeshCount() const { return meshes.size(); }
     const std::vector<Mesh>& getMeshes() const { return meshes; }
+    const TriangleBVH& Collision() const { return collision; } //model space, empty without MODEL_COLLISION
+    bool HasVertexAO() const { return !meshes.empty() && meshes[0].HasVertexAO(); }
+    const Lightmap::Atlas& LightmapAtlas() const { return lightmapAtlas; } //size 0 without MODEL_LIGHTMAP
+    const std::string& Source() const { return source; }
+    //the GL-free import stages alone, leaving the mesh cache current for `bake`
+    //(what tools/asset_packer packs); false when the model can't be imported or cached
+    static bool Prepare(const std::string& path, unsigned bake = 0, ThreadPool* pool = nullptr);
 private:
     std::vector<Mesh> meshes;
-    std::string directory;
+    std::string source, directory;
     std::unordered_map<std::string, glm::vec3> materialColorOverride;
-    void loadModel(std::string path);
-    void processNode(aiNode* node, const aiScene* scene);
-    Mesh processMesh(aiMesh* mesh, const aiScene* scene);
-};
\ No newline at end of file
+    TriangleBVH collision;
+    Lightmap::Atlas lightmapAtlas;
+    static bool importStages(const std::string& path, unsigned bake, ThreadPool* pool, CachedModel& cached,
+                             TriangleBVH& collision, Lightmap::Atlas& lightmapAtlas, std::vector<float>& ao);
+    void loadModel(const std::string& path, unsigned bake, ThreadPool* pool, AssetStreamer* streamer, const glm::mat4& toWorld);
+};
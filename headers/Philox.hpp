@@ -0,0 +1,30 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+//Counter-based random numbers (Philox4x32-10, Salmon et al. 2011).
+//There is no generator state: the numbers are a pure function of (key, counter), so any
+//lantern of any burst can be initialised on any thread, in any order, and comes out the
+//same every run with the same seed. Key = (seed, stream), counter = (item, block, burst, 0);
+//each (item, block) gives 4 floats.
+struct RandomKey {
+    uint32_t seed;
+    uint32_t stream; //what is being generated, so two users of one seed never overlap
+    uint32_t burst;  //spawn event, e.g. the n-th castle burst
+};
+
+void Philox4x32(const uint32_t ctr[4], uint32_t key0, uint32_t key1, uint32_t out[4]);
+
+//top 24 bits scaled to [0, 1), exact in float so the SIMD and scalar paths agree bit for bit
+inline float ToUnitFloat(uint32_t bits) { return float(bits >> 8) * (1.0f / 16777216.0f); }
+
+//4 floats in [0, 1) for one item
+void RandomFloats4(const RandomKey& key, uint32_t item, uint32_t block, float out[4]);
+//the same floats for items [first, first + n), four items per SSE2 step, written SoA:
+//out[k * n + i] is float k of item first + i
+void RandomFloats4Batch(const RandomKey& key, uint32_t first, size_t n, uint32_t block, float* out);
+//n uniform floats in [lo, hi) as one flat stream (float i is word i % 4 of item i / 4)
+void FillUniform(float* out, size_t n, float lo, float hi, const RandomKey& key);
+
+//known-answer + SIMD/scalar agreement check and floats/s against std::mt19937
+void RunRandomBenchmark();
@@ -0,0 +1,40 @@
+#pragma once
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <array>
+#include <cstddef>
+#include "Shader.hpp"
+
+enum ShadowProjection {
+    SHADOW_CUBE,            //6 faces, 90 degree perspective each
+    SHADOW_DUAL_PARABOLOID  //2 hemispheres (+Y / -Y), one view each
+};
+
+struct ShadowFormat {
+    GLenum depthFormat = GL_DEPTH_COMPONENT32F; //or GL_DEPTH_COMPONENT16 / GL_DEPTH_COMPONENT24
+    ShadowProjection projection = SHADOW_CUBE;
+};
+
+//omni-directional shadow: depth texels hold distance/farP to the light.
+//A cube map for SHADOW_CUBE, a 2-layer 2D array for SHADOW_DUAL_PARABOLOID.
+struct PointShadow {
+    GLuint fbo = 0;
+    GLuint tex = 0;
+    int size = 0; //0 while no storage is allocated
+    ShadowFormat format;
+    float nearP = 0.1f;
+    float farP  = 150.0f;
+    glm::vec3 lightPos{0,5,0};
+
+    void init(int size, const ShadowFormat& format); //(re)allocates when size or format change
+    void release();       //frees the texture, the slot costs nothing afterwards
+    size_t memoryBytes() const;
+    int views() const { return format.projection == SHADOW_CUBE ? 6 : 2; }
+    GLenum target() const { return format.projection == SHADOW_CUBE ? GL_TEXTURE_CUBE_MAP : GL_TEXTURE_2D_ARRAY; }
+};
+
+std::array<glm::mat4,6> ShadowMatrices(const PointShadow& s);
+//binds the fbo and sets the shadow shader up to render the masked views of `s`
+void BeginShadowPass(Shader& shadowShader, const PointShadow& s, unsigned int viewMask);
+size_t DepthBytesPerTexel(GLenum depthFormat);
+const char* ShadowFormatName(const ShadowFormat& format);
@@ -1,11 +1,14 @@
 #pragma once
 #include <string>
+#include <vector>
 #include <glm/glm.hpp>
 
 class Shader {
 public:
     unsigned int ID;
-    Shader(const char* vertexPath, const char* fragmentPath);
+    Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr);
+    //vertex-only program whose outputs are captured with transform feedback (interleaved)
+    Shader(const char* vertexPath, const std::vector<std::string>& feedbackVaryings);
     void use() const;
     void setBool(const std::string &name, bool value) const;
     void setInt(const std::string &name, int value) const;
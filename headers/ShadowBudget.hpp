@@ -0,0 +1,52 @@
+#pragma once
+#include <vector>
+#include <glm/glm.hpp>
+#include "Lantern.hpp"
+#include "PointShadow.hpp"
+#include "ShadowCache.hpp"
+#include "LightBVH.hpp"
+
+//one shadow-casting lantern; the cube is only allocated while the slot is in use
+struct ShadowSlot {
+    PointShadow shadow;
+    ShadowCache cache; //static-caster layer + face round-robin for `shadow`
+    bool active = false;
+    unsigned int lanternId = 0;
+    int lanternIndex = -1; //index into the lantern vector, refreshed every Update
+    float score = 0.0f;
+    int heldFrames = 0;    //frames since the current lantern took the slot
+    int idleFrames = 0;    //frames since the slot went empty
+    int smallerFrames = 0; //frames a lower resolution has been enough
+};
+
+//Picks which lanterns get a shadow cube each frame.
+//Lanterns are scored by how much of the screen their light can reach, the current
+//holders get a bonus so slots don't flip between two lanterns at similar distance,
+//and the cube resolution follows the rank (the best lantern gets the biggest cube).
+//A GL_TEXTURE_CUBE_MAP_ARRAY would need GL 4.0 and one size for every layer, so the
+//"atlas" is one cube per slot sized independently.
+class ShadowBudget {
+public:
+    static const int MAX_SLOTS = 5;
+
+    float hysteresis = 1.3f;      //score multiplier for a lantern already holding a slot
+    int minHoldFrames = 20;       //a visible holder can't be evicted before this
+    int shrinkAfterFrames = 30;   //resolution only drops after being too big this long
+    int releaseAfterFrames = 120; //idle slots free their cube after this
+
+    ShadowFormat format; //depth bits + cube / dual-paraboloid, shared by every slot
+
+    ShadowSlot slots[MAX_SLOTS];
+
+    //`tree` (built over `lanterns`) replaces the linear visibility scan when given
+    void Update(const std::vector<Lantern>& lanterns, const glm::mat4& viewProj,
+                const glm::vec3& eye, const LightBVH* tree = nullptr);
+    int SlotOf(int lanternIndex) const; //-1 when the lantern casts no shadow
+    size_t MemoryBytes() const;
+    void ReleaseAll();
+
+    static int SizeForRank(int rank);
+
+private:
+    std::vector<int> slotOfLantern;
+};
@@ -0,0 +1,39 @@
+#pragma once
+#include <glm/glm.hpp>
+#include "PointShadow.hpp"
+
+//what a shadow slot has to redraw this frame
+struct ShadowCacheUpdate {
+    bool staticDirty;       //re-render castle + island into the static layer
+    unsigned int faceMask;  //views (cube faces / hemispheres) to rebuild as static copy + dynamic casters
+};
+
+//Keeps the depth of the static casters (castle, island) per light so it isn't
+//re-rendered every frame. The light position is pinned to `origin` until the lantern
+//drifts further than moveTolerance; meanwhile only a few faces per frame get the
+//dynamic casters (boat, flower, lanterns) composited on top, round-robin, plus the
+//faces the boat is in since it's the one thing that moves fast.
+//With dual-paraboloid shadows the "faces" are the two hemispheres.
+struct ShadowCache {
+    PointShadow staticLayer;
+    glm::vec3 origin{0.0f};
+    unsigned int lanternId = 0;
+    GLuint liveTex = 0; //texture the composite went into, a resize means starting over
+    bool valid = false;
+    int nextFace = 0;
+
+    float moveTolerance = 0.25f;
+    int facesPerFrame = 2;
+
+    ShadowCacheUpdate Begin(PointShadow& live, unsigned int lanternId, const glm::vec3& lightPos,
+                            const glm::vec3& moverPos, float moverRadius);
+    void release();
+    size_t memoryBytes() const { return staticLayer.memoryBytes(); }
+};
+
+//cube face (GL order +X,-X,+Y,-Y,+Z,-Z) a direction falls into
+int CubeFace(const glm::vec3& dir);
+//view of a point shadow a direction falls into: cube face, or hemisphere 0 (+Y) / 1 (-Y)
+int ShadowViewOf(const glm::vec3& dir, ShadowProjection projection);
+//depth copy of the masked views from one shadow to another of the same size and format
+void CopyShadowViews(const PointShadow& src, const PointShadow& dst, unsigned int viewMask);
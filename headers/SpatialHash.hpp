@@ -0,0 +1,90 @@
+#pragma once
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <glm/glm.hpp>
+#include "Lantern.hpp"
+
+class ThreadPool;
+
+//Uniform grid over lantern positions, hashed into a table of ~2 buckets per lantern so
+//its size follows the lantern count, not the world. Rebuilt from scratch every tick with
+//a counting sort (count, prefix sum, scatter) on the pool; inside a bucket lanterns stay
+//in index order so the result doesn't depend on thread timing. Positions are copied in
+//bucket order, so a query walks contiguous memory. Every entry keeps its cell key, which
+//filters out other cells that share a bucket (and with them any double visits).
+class SpatialHash {
+public:
+    float cellSize = 1.0f; //queries up to cellSize / 2 touch at most 2x2x2 cells
+
+    void Build(const std::vector<Lantern>& lanterns, ThreadPool& pool);
+    void Build(const glm::vec3* points, size_t n, ThreadPool& pool);
+
+    //fn(index, offset from p, distance^2) for every point within radius of p (p itself included)
+    template <class Fn>
+    void Query(const glm::vec3& p, float radius, Fn fn) const;
+
+    //push-apart force per point: sum of (1 - d/radius) * direction away from every
+    //neighbour closer than radius, times strength. out is indexed like the input.
+    void Separation(float radius, float strength, std::vector<glm::vec3>& out, ThreadPool& pool) const;
+
+    size_t Size() const { return sortedIndex.size(); }
+    size_t Buckets() const { return mask + 1; }
+
+private:
+    uint32_t mask = 0;                    //bucket count - 1
+    std::vector<uint32_t> start;          //bucket b holds sorted entries [start[b], start[b + 1])
+    std::vector<uint32_t> sortedIndex;    //input index of each sorted entry
+    std::vector<glm::vec3> sortedPos;
+    std::vector<uint64_t> sortedCell;     //packed cell of each sorted entry
+    std::vector<uint32_t> keys;           //bucket of each input point
+    std::vector<glm::vec3> gathered;      //lantern positions for Build
+    std::unique_ptr<std::atomic<uint32_t>[]> counts; //per-bucket counters, reused as scatter cursors
+    size_t countsCapacity = 0;
+
+    glm::ivec3 cellOf(const glm::vec3& p) const {
+        return glm::ivec3(int(std::floor(p.x / cellSize)), int(std::floor(p.y / cellSize)),
+                          int(std::floor(p.z / cellSize)));
+    }
+    static uint64_t cellKey(const glm::ivec3& c) { //21 bits per axis, plenty at lantern scale
+        return (uint64_t(uint32_t(c.x) & 0x1FFFFFu) << 42) | (uint64_t(uint32_t(c.y) & 0x1FFFFFu) << 21)
+             | uint64_t(uint32_t(c.z) & 0x1FFFFFu);
+    }
+    uint32_t bucketOf(const glm::ivec3& c) const {
+        return (uint32_t(c.x) * 73856093u ^ uint32_t(c.y) * 19349663u ^ uint32_t(c.z) * 83492791u) & mask;
+    }
+};
+
+template <class Fn>
+void SpatialHash::Query(const glm::vec3& p, float radius, Fn fn) const {
+    if (sortedIndex.empty()) return;
+    const glm::ivec3 lo = cellOf(p - glm::vec3(radius)), hi = cellOf(p + glm::vec3(radius));
+    const float r2 = radius * radius;
+    const glm::ivec3 span = hi - lo + 1;
+    if ((int64_t)span.x * span.y * span.z > 64) { //radius far above cellSize: just scan
+        for (size_t e = 0; e < sortedPos.size(); ++e) {
+            glm::vec3 d = sortedPos[e] - p;
+            float d2 = glm::dot(d, d);
+            if (d2 <= r2) fn(sortedIndex[e], d, d2);
+        }
+        return;
+    }
+    for (int z = lo.z; z <= hi.z; ++z)
+        for (int y = lo.y; y <= hi.y; ++y)
+            for (int x = lo.x; x <= hi.x; ++x) {
+                const glm::ivec3 c(x, y, z);
+                const uint32_t b = bucketOf(c);
+                const uint64_t key = cellKey(c);
+                for (uint32_t e = start[b]; e < start[b + 1]; ++e) {
+                    if (sortedCell[e] != key) continue; //another cell hashed here
+                    glm::vec3 d = sortedPos[e] - p;
+                    float d2 = glm::dot(d, d);
+                    if (d2 <= r2) fn(sortedIndex[e], d, d2);
+                }
+            }
+}
+
+//builds, queries and separation at 10k..200k lanterns, brute force for reference
+void RunSpatialHashBenchmark();
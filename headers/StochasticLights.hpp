@@ -0,0 +1,60 @@
+#pragma once
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <memory>
+#include <vector>
+#include "Lantern.hpp"
+#include "Shader.hpp"
+
+//Many-light mode: instead of looping over the 64 nearest lanterns, every pixel draws
+//a fixed handful of lanterns (alias table, probability ~ power / distance^2 to the
+//camera), keeps the best per reservoir by its own power / distance^2 (RIS), and shades
+//only those. The noisy result goes to its own render target, gets accumulated over
+//frames with reprojection, filtered with a depth-aware blur and composited back, so the
+//cost per pixel stays the same for 50 or 50,000 lanterns.
+class StochasticLights {
+public:
+    bool enabled = false;
+    float historyBlend = 0.1f; //weight of the new frame in the accumulation
+
+    void init();
+    //alias table + light buffer for this frame, O(lanterns) on the CPU
+    void BuildLightTables(const std::vector<Lantern>& lanterns, const glm::vec3& eye);
+    //lights that already live in a GPU buffer texture (xyz = position, w = power every
+    //`stride` texels); sampled uniformly since there is no alias table for them.
+    //analytic: the texels are AnalyticLanterns spawn records, positions come from
+    //lantern_trajectory.glsl (whose uniforms the caller sets on lit)
+    void UseExternalLights(GLuint bufferTexture, size_t count, int stride, bool analytic = false);
+    //samplers and counts lighting.frag needs; always call, even when disabled
+    void BindForShading(Shader& lit, int lightUnit, int aliasUnit) const;
+    //scene target: color, lantern light (albedo divided out), albedo, depth
+    void BeginScene(int width, int height);
+    //accumulate, denoise, composite into the default framebuffer (writes depth too)
+    void Resolve(const glm::mat4& viewProj);
+    size_t LightCount() const { return lightCount; }
+    void Reset() { historyValid = false; } //drop the accumulated history (mode switch, teleport)
+
+private:
+    GLuint lightBuf = 0, lightTex = 0;
+    GLuint aliasBuf = 0, aliasTex = 0;
+    size_t lightCount = 0;
+    GLuint externalTex = 0; //set by UseExternalLights, cleared by BuildLightTables
+    int externalStride = 1;
+    bool externalAnalytic = false;
+    int frameIndex = 0;
+
+    GLuint sceneFbo = 0, colorTex = 0, lightingTex = 0, albedoTex = 0, depthTex = 0;
+    GLuint historyFbo[2] = {0, 0}, historyTex[2] = {0, 0};
+    GLuint filterFbo = 0, filterTex = 0;
+    int width = 0, height = 0;
+    int historyIndex = 0;
+    bool historyValid = false;
+    glm::mat4 prevViewProj{1.0f};
+    GLuint emptyVAO = 0;
+
+    std::unique_ptr<Shader> temporal, denoise, composite;
+    std::vector<glm::vec4> lightTexels, aliasTexels;
+
+    void allocTargets(int w, int h);
+    void releaseTargets();
+};
@@ -0,0 +1,22 @@
+#pragma once
+
+class Model;
+
+//How many texels per UV unit a textured model can ever put on screen.
+//Every triangle gives world units per UV unit, sqrt(world area / UV area); the analysis
+//takes the 95th percentile by world area, so a few squashed UV triangles don't decide it.
+//One texel should cover at most one pixel at the closest the camera gets: the distance the
+//caller's movement limits allow, but never nearer than where the model's bounding sphere
+//fills the viewport height (past that the texture is magnified whatever its size).
+namespace TextureDensity {
+    struct Estimate {
+        float worldPerUV = 0.0f; //world units per UV unit
+        float radius = 0.0f;     //bounding sphere, world units
+        float closest = 0.0f;    //camera to nearest surface, as assumed
+        int size = 0;            //texels per UV unit, a power of two; 0 = no estimate
+    };
+
+    //scale: uniform model scale; closestCenter: nearest the camera comes to the model's
+    //origin (0 when nothing limits it)
+    Estimate Analyze(const Model& model, float scale, float closestCenter, float fovY, int viewportHeight);
+}
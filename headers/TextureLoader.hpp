@@ -0,0 +1,97 @@
+#pragma once
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+#include "BlockCompress.hpp"
+
+class ThreadPool;
+
+//Texture files decoded on the worker threads.
+//Request hands the file to the pool and returns at once, so decoding overlaps shader
+//compilation and model import; Texture2D / Cubemap wait for their images and upload them
+//on the calling (GL) thread. An image larger than its request's texel budget (see
+//TextureDensity) is downscaled first, a 2D image gets its whole mip chain (both with the
+//sRGB-correct ImageFilter) and every level is block compressed (see BlockCompress): BC1 when the image is opaque and
+//BC3 when it has alpha, or BC7 for everything. A driver without S3TC / BPTC gets the blocks
+//expanded back to RGBA8 at upload.
+//Finished levels are kept in cache/<file>.tex under a 64-bit hash of the file's bytes, so a
+//warm start reads them back instead of decoding and encoding; an edited file just redoes it.
+//A .tex in the asset pack is used as it is, its levels pointing into the mapping.
+class TextureLoader {
+public:
+    enum Kind { TEXTURE_2D, CUBE_FACE };
+    enum Compression { COMPRESS_NONE, COMPRESS_S3TC, COMPRESS_BC7 };
+
+    //one mip level: owned bytes, or a span of the mapped asset pack (no copy on the way to GL)
+    struct Level {
+        std::vector<uint8_t> bytes;
+        const uint8_t* mapped = nullptr;
+        size_t mappedSize = 0;
+
+        Level() = default;
+        Level(std::vector<uint8_t> b) : bytes(std::move(b)) {}
+        const uint8_t* data() const { return mapped ? mapped : bytes.data(); }
+        size_t size() const { return mapped ? mappedSize : bytes.size(); }
+    };
+
+    struct Image {
+        int width = 0, height = 0;
+        int sourceWidth = 0, sourceHeight = 0;    //of the file, before the texel budget
+        BlockCompress::Format format = BlockCompress::RGBA8;
+        std::vector<Level> levels;                //level 0 first, empty = failed
+        bool fromCache = false;
+        double ms = 0.0;                          //decode + encode or cache read on the worker
+    };
+
+    explicit TextureLoader(ThreadPool& pool, Compression compression = COMPRESS_S3TC)
+        : pool(pool), compression(compression) {}
+    ~TextureLoader(); //waits for decodes still in flight
+    TextureLoader(const TextureLoader&) = delete;
+    TextureLoader& operator=(const TextureLoader&) = delete;
+
+    //ticket for Texture2D / Cubemap; maxSize caps each axis (0 = the file's size)
+    int Request(const std::string& path, Kind kind, int maxSize = 0);
+    //repeat, trilinear; 0 when the file didn't decode
+    unsigned int Texture2D(int ticket);
+    //six consecutive tickets from firstFace, in +X -X +Y -Y +Z -Z order; linear, clamped
+    unsigned int Cubemap(int firstFace);
+
+    //one image on the calling thread, encoding over `pool` when given; readCache = false
+    //always decodes (and rewrites the cache)
+    static void Decode(const std::string& path, Kind kind, Compression compression, int maxSize,
+                       bool readCache, ThreadPool* pool, Image& image);
+
+    //compression and texel budget the file's cache/ entry was built with; false when there is
+    //none or the file changed since (what tools/asset_packer checks before packing it)
+    static bool CachedRequest(const std::string& path, Compression& compression, int& maxSize);
+
+    //texture memory of everything uploaded so far against the files' own sizes
+    void PrintVramReport() const;
+
+private:
+    struct Job {
+        std::string path;
+        Kind kind;
+        int maxSize;
+        Image image;
+        bool done = false;
+        size_t vram = 0, vramAtSource = 0; //filled in at upload
+    };
+
+    ThreadPool& pool;
+    Compression compression;
+    std::deque<std::unique_ptr<Job>> jobs;
+    std::mutex mutex;
+    std::condition_variable finished;
+
+    Job& wait(int ticket);
+};
+
+//decodes the files one after another, then over the pool with every compression and a
+//warm cache; prints wall time, size and PSNR against the uncompressed images
+void RunTextureBenchmark(const std::vector<std::pair<std::string, TextureLoader::Kind>>& files);
@@ -0,0 +1,35 @@
+#pragma once
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+//Fixed set of worker threads fed from one queue.
+//ParallelFor also runs chunks on the calling thread, so it is safe to call from
+//inside a task and never waits on a pool that is busy with its own caller.
+class ThreadPool {
+public:
+    explicit ThreadPool(unsigned int threads = 0); //0 = hardware threads - 1
+    ~ThreadPool();
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    void Submit(std::function<void()> task);
+    //fn(begin, end) over [0, count) in chunks of at least `grain`, returns when all are done
+    void ParallelFor(size_t count, size_t grain, const std::function<void(size_t, size_t)>& fn);
+    void WaitIdle(); //every submitted task has finished
+    unsigned int Size() const { return (unsigned int)workers.size(); }
+
+private:
+    std::vector<std::thread> workers;
+    std::queue<std::function<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable wake, idle;
+    size_t busy = 0;
+    bool stopping = false;
+
+    bool runOne(std::unique_lock<std::mutex>& lock); //pops and runs a task if there is one
+    void workerLoop();
+};
@@ -0,0 +1,99 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+#include "MeshCache.hpp"
+
+class ThreadPool;
+
+struct RayHit {
+    float t = 0.0f;         //origin + t * dir, in units of the (unnormalised) dir
+    uint32_t triangle = 0;  //index over all meshes, in mesh order
+    glm::vec3 normal{0.0f}; //geometric, facing the ray
+};
+
+struct SphereContact {
+    glm::vec3 point{0.0f};  //closest surface point to the centre
+    glm::vec3 normal{0.0f}; //from the surface towards the centre
+    float depth = 0.0f;     //radius - distance
+    uint32_t triangle = 0;
+};
+
+//4-wide BVH over static triangles.
+//Built as a binary binned-SAH tree (top levels split on the caller with the binning on
+//the pool, the subtrees below as independent tasks) and then collapsed so every node
+//holds 4 child boxes in SoA form: one SSE slab test checks all four. Triangles are
+//stored in leaf order as (v0, edge1, edge2), so a leaf is one contiguous run.
+//Serialize / Deserialize go into the mesh cache next to the meshes it was built from.
+class TriangleBVH {
+public:
+    static constexpr uint32_t CACHE_TAG = FourCC('B', 'V', 'H', '4');
+    static constexpr int MAX_LEAF = 4;
+
+    struct alignas(16) Node {
+        float bminX[4], bminY[4], bminZ[4];
+        float bmaxX[4], bmaxY[4], bmaxZ[4];
+        int32_t child[4];  //>= 0: inner node, < 0: leaf whose triangles start at ~child
+        uint32_t count[4]; //triangles in a leaf child, 0 for inner and empty slots
+    };
+    struct Triangle {
+        glm::vec3 v0, e1, e2;
+        uint32_t id;
+    };
+
+    void Build(const std::vector<MeshData>& meshes, ThreadPool* pool);
+    void Build(const std::vector<glm::vec3>& positions, const std::vector<uint32_t>& indices, ThreadPool* pool);
+
+    //closest hit with 0 < t < tMax, both faces count
+    bool Raycast(const glm::vec3& origin, const glm::vec3& dir, float tMax, RayHit& hit) const;
+    //any hit with 0 < t < tMax (shadow / occlusion rays stop at the first one)
+    bool Occluded(const glm::vec3& origin, const glm::vec3& dir, float tMax) const;
+    //deepest contact of a sphere with the surface, false when it touches nothing
+    bool SphereQuery(const glm::vec3& center, float radius, SphereContact& contact) const;
+
+    void Serialize(std::vector<uint8_t>& out) const;
+    bool Deserialize(const std::vector<uint8_t>& in);
+
+    bool Empty() const { return nodes.empty(); }
+    size_t NodeCount() const { return nodes.size(); }
+    size_t TriangleCount() const { return tris.size(); }
+    glm::vec3 BoundsMin() const { return bmin; }
+    glm::vec3 BoundsMax() const { return bmax; }
+
+private:
+    std::vector<Node> nodes; //root first, children after their parent
+    std::vector<Triangle> tris;
+    glm::vec3 bmin{0.0f}, bmax{0.0f};
+
+    template <bool ANY>
+    bool traceRay(const glm::vec3& origin, const glm::vec3& dir, float tMax, RayHit* hit) const;
+};
+
+//A few static BVHs placed in the world (castle, island). Rays are taken into each model's
+//space, so non-uniform scale is exact for them. Spheres become ellipsoids under such a
+//scale, so they're tested with the largest local radius and the contact re-measured in
+//world space: conservative, and exact for uniform scale.
+class CollisionScene {
+public:
+    void Add(const TriangleBVH& bvh, const glm::mat4& modelToWorld);
+    void Clear() { instances.clear(); }
+
+    //world space; instance gets the index of the model that was hit
+    bool Raycast(const glm::vec3& origin, const glm::vec3& dir, float tMax, RayHit& hit, int* instance = nullptr) const;
+    bool Occluded(const glm::vec3& origin, const glm::vec3& dir, float tMax) const;
+    bool SphereQuery(const glm::vec3& center, float radius, SphereContact& contact) const;
+
+private:
+    struct Instance {
+        const TriangleBVH* bvh;
+        glm::mat4 toWorld, toLocal;
+        glm::mat3 normalToWorld;
+        float localRadiusScale; //largest stretch of toLocal
+        glm::vec3 worldMin, worldMax;
+    };
+    std::vector<Instance> instances;
+};
+
+//build time, rays/s and sphere queries/s on one thread and on the pool, checked
+//against a brute-force triangle loop. Uses `path` if it imports, a generated mesh otherwise.
+void RunTriangleBVHBenchmark(const char* path);
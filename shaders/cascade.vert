@@ -0,0 +1,22 @@
+#version 330 core
+layout (location=0) in vec3 aPos;
+layout (location=5) in vec4 aInstance;  //analytic lanterns: spawn position + time
+layout (location=6) in vec4 aInstance2; //initial velocity + wind phase
+
+uniform mat4 model;
+uniform mat4 lightViewProj;
+uniform bool instanceAnalytic;
+uniform float instanceScale;
+
+#include "lantern_trajectory.glsl"
+
+void main() {
+    mat4 M = model;
+    if (instanceAnalytic) {
+        vec4 inst = lanternPosition(aInstance, aInstance2);
+        float s = inst.w * instanceScale;
+        M = mat4(vec4(s, 0.0, 0.0, 0.0), vec4(0.0, s, 0.0, 0.0),
+                 vec4(0.0, 0.0, s, 0.0), vec4(inst.xyz, 1.0));
+    }
+    gl_Position = lightViewProj * M * vec4(aPos, 1.0);
+}
@@ -0,0 +1,12 @@
+#version 330 core
+in vec2 UV;
+out vec4 FragColor;
+
+uniform sampler2D diffuseTex;
+uniform vec3 glow; //lanternTint * lanternEmissive, what lighting.frag adds to a lantern
+
+void main() {
+    //roughly how a lantern looks at night in lighting.frag: dim albedo plus its own glow
+    vec3 albedo = texture(diffuseTex, UV).rgb;
+    FragColor = vec4(0.3 * albedo + glow, 1.0);
+}
@@ -0,0 +1,12 @@
+#version 330 core
+layout (location=0) in vec3 aPos;
+layout (location=2) in vec2 aTexCoords;
+
+out vec2 UV;
+
+uniform mat4 viewProj;
+
+void main() {
+    UV = aTexCoords;
+    gl_Position = viewProj * vec4(aPos, 1.0);
+}
@@ -0,0 +1,11 @@
+#version 330 core
+in vec2 UV;
+out vec4 FragColor;
+
+uniform sampler2D impostorTex;
+
+void main() {
+    vec4 c = texture(impostorTex, UV);
+    if (c.a < 0.5) discard;
+    FragColor = vec4(c.rgb, 1.0);
+}
@@ -0,0 +1,26 @@
+#version 330 core
+layout (location=0) in vec2 aCorner;   //x in [-0.5, 0.5], y in [0, 1]
+layout (location=1) in vec4 aInstance; //xyz = lantern position, w = scale
+
+out vec2 UV;
+
+uniform mat4 view, projection;
+uniform vec3 viewPos;
+uniform float impostorWidth;  //model-space size of the baked view
+uniform float impostorHeight;
+uniform vec3  impostorOffset; //model-space bottom centre of the baked view
+
+void main() {
+    vec3 base = aInstance.xyz + impostorOffset * aInstance.w;
+
+    //turn around the lantern's up axis only, it is (nearly) round
+    vec3 toCam = viewPos - base;
+    toCam.y = 0.0;
+    vec3 fwd = dot(toCam, toCam) > 1e-8 ? normalize(toCam) : vec3(0.0, 0.0, 1.0);
+    vec3 right = vec3(fwd.z, 0.0, -fwd.x);
+
+    vec3 p = base + right * (aCorner.x * impostorWidth * aInstance.w)
+                  + vec3(0.0, aCorner.y * impostorHeight * aInstance.w, 0.0);
+    UV = vec2(aCorner.x + 0.5, aCorner.y);
+    gl_Position = projection * view * vec4(p, 1.0);
+}
@@ -0,0 +1,41 @@
+#version 330 core
+//one lantern per vertex, advanced with transform feedback (no rasterization)
+layout (location=0) in vec4 aPosAlive; //xyz = position, w = 1 alive / 0 free slot
+layout (location=1) in vec4 aVelAge;   //xyz = velocity, w = age in seconds
+layout (location=2) in vec4 aMisc;     //x = wind phase
+
+out vec4 PosAlive;
+out vec4 VelAge;
+out vec4 Misc;
+
+uniform float dt;
+uniform vec3  boatPos;
+uniform float maxAge;
+uniform float maxHeight;
+uniform float maxDistance;
+
+void main() {
+    vec3 pos = aPosAlive.xyz;
+    vec3 vel = aVelAge.xyz;
+    float t  = aVelAge.w;
+    float alive = aPosAlive.w;
+
+    //same integrator as the CPU lanterns in main.cpp
+    if (alive > 0.0) {
+        t += dt;
+        vel.y += 0.01 * dt;
+        float w = aMisc.x + t;
+        vec3 wind = vec3(0.15 * sin(0.6 * w) + 0.08 * cos(1.1 * w),
+                         0.0,
+                         0.15 * cos(0.5 * w) + 0.06 * sin(1.3 * w));
+        vel += wind * 0.15 * dt;
+        vel *= 0.9985;
+        pos += vel * dt;
+
+        if (t > maxAge || pos.y > maxHeight || length(pos - boatPos) > maxDistance) alive = 0.0;
+    }
+
+    PosAlive = vec4(pos, alive);
+    VelAge   = vec4(vel, t);
+    Misc     = aMisc;
+}
@@ -0,0 +1,13 @@
+#version 330 core
+in float Intensity;
+out vec4 FragColor;
+
+uniform vec3 glow;
+
+void main() {
+    vec2 d = gl_PointCoord * 2.0 - 1.0;
+    float r2 = dot(d, d);
+    if (r2 > 1.0) discard;
+    float f = 1.0 - r2;
+    FragColor = vec4(glow * Intensity * f * f, 1.0); //additive
+}
@@ -0,0 +1,17 @@
+#version 330 core
+layout (location=0) in vec4 aInstance; //xyz = lantern position, w = scale
+
+out float Intensity;
+
+uniform mat4 view, projection;
+uniform float pixelScale;  //viewport height / 2 * projection[1][1]
+uniform float modelHeight; //lantern height before scaling
+
+void main() {
+    vec4 v = view * vec4(aInstance.xyz, 1.0);
+    float px = modelHeight * aInstance.w / max(-v.z, 1e-3) * pixelScale;
+    //a bit of halo around the lantern, sub-pixel lanterns fade instead of shrinking
+    gl_PointSize = max(2.0 * px, 2.0);
+    Intensity = clamp(px, 0.35, 1.0);
+    gl_Position = projection * v;
+}
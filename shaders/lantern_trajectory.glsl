@@ -0,0 +1,42 @@
+//Closed form of the lantern integrator in main.cpp, for lanterns stored only as
+//spawn records (AnalyticLanterns). The per-frame 0.9985 damping becomes a continuous
+//rate k, so velocity follows dv/dt = a(t) - k v with a(t) = constant lift plus the
+//four wind sinusoids, and both v and x integrate exactly.
+uniform float lanternTime;        //seconds, same clock as the spawn times
+uniform float lanternDamping;     //k
+uniform float lanternMaxAge;
+uniform float lanternMaxHeight;
+uniform float lanternMaxDistance;
+uniform vec3  lanternBoatPos;
+
+//displacement from forcing A * sin(w * s + th), starting at rest
+float windTerm(float A, float w, float th, float k, float t, float decay) {
+    float c = A / (k * k + w * w);
+    float v0 = c * (k * sin(th) - w * cos(th));              //particular velocity at s = 0
+    float xt = c * (-(k / w) * cos(w * t + th) - sin(w * t + th));
+    float x0 = c * (-(k / w) * cos(th) - sin(th));
+    return xt - x0 - v0 * (1.0 - decay) / k;
+}
+
+//spawn = (position, spawn time), velPhase = (initial velocity, wind phase)
+//returns (position, 1) while the lantern is alive, 0 once it has expired or been culled
+vec4 lanternPosition(vec4 spawn, vec4 velPhase) {
+    float t = lanternTime - spawn.w;
+    if (t < 0.0 || t > lanternMaxAge) return vec4(0.0);
+
+    const float HALF_PI = 1.5707963;
+    float k = lanternDamping;
+    float decay = exp(-k * t);
+    float g = (1.0 - decay) / k;
+    float ph = velPhase.w;
+
+    vec3 p = spawn.xyz + velPhase.xyz * g;
+    p.y += 0.01 / k * (t - g);
+    p.x += windTerm(0.15 * 0.15, 0.6, 0.6 * ph, k, t, decay)
+         + windTerm(0.15 * 0.08, 1.1, 1.1 * ph + HALF_PI, k, t, decay);
+    p.z += windTerm(0.15 * 0.15, 0.5, 0.5 * ph + HALF_PI, k, t, decay)
+         + windTerm(0.15 * 0.06, 1.3, 1.3 * ph, k, t, decay);
+
+    bool culled = p.y > lanternMaxHeight || length(p - lanternBoatPos) > lanternMaxDistance;
+    return vec4(p, culled ? 0.0 : 1.0);
+}
@@ -1,9 +1,14 @@
 #version 330 core
-out vec4 FragColor;
+layout (location=0) out vec4 FragColor;
+layout (location=1) out vec4 LanternLight; //stochastic mode: lantern light with albedo divided out
+layout (location=2) out vec4 Albedo;
 
 in vec3 FragPos;
 in vec3 Normal;
 in vec2 TexCoords;
+in float ViewDepth;
+in float VertexAO;
+in vec2 LightmapUV;
 
 uniform vec3 viewPos;
 
@@ -14,34 +19,198 @@ uniform vec3  baseColor;
 uniform vec3 dirLightDir;
 uniform vec3 dirLightColor;
 
+#define NUM_CASCADES 4
+uniform bool  useDirShadow;
+uniform sampler2DArrayShadow dirShadowMap;
+uniform mat4  cascadeViewProj[NUM_CASCADES];
+uniform float cascadeSplits[NUM_CASCADES];   //view distance where each cascade ends
+uniform float cascadeTexel[NUM_CASCADES];    //world size of a shadow texel
+
 struct PointLight {
     vec3 position;
     vec3 color;
     float constant;
     float linear;
     float quadratic;
+    int   shadowSlot; //-1 = no shadow cube
 };
 uniform int numLanterns;
 uniform PointLight lanterns[64];
 
+//stochastic many-light mode (StochasticLights)
+uniform bool  stochasticLights;
+uniform samplerBuffer lightData;  //xyz = position, w = power
+uniform samplerBuffer lightAlias; //x = keep probability, y = alias index, z = pdf of this light
+uniform int   lightCount;
+uniform int   lightStride;        //texels per light in lightData (the GPU lantern ring uses 3)
+uniform bool  lightUniform;       //no alias table, every light equally likely
+uniform bool  lightAnalytic;      //lightData holds AnalyticLanterns spawn records (2 texels)
+uniform int   frameIndex;
+uniform vec3  lanternColor;
+uniform vec3  lanternAtten;       //constant, linear, quadratic
+#define RESERVOIRS 2
+
+//lantern glow from every lantern in the sky, splatted on the CPU (IrradianceVolume)
+uniform bool      useIrradianceVolume;
+uniform sampler3D irradianceVolume; //rgb = L1 direction, a = L0
+uniform vec3      volumeOrigin;
+uniform vec3      volumeInvSize;
+#define CANDIDATES 4
+
+uniform bool useVertexAO; //VertexAO holds a baked value, otherwise the attribute is unset
+uniform bool useLightmap; //static models: moonlight baked by Lightmap, no shadow-map lookups
+uniform sampler2D lightmap; //rgb = irradiance / 2 (direct + bounce), a = moon visibility
+
 uniform bool isLantern;
 uniform vec3 lanternTint;
 uniform float lanternEmissive;
 
-uniform samplerCube pointShadowMap;
+#define MAX_POINT_SHADOWS 5
+uniform samplerCube pointShadowMaps[MAX_POINT_SHADOWS];
+uniform sampler2DArray pointShadowDP[MAX_POINT_SHADOWS]; //dual-paraboloid: layer 0 = +Y, 1 = -Y
+uniform bool  shadowDualParaboloid;
+uniform vec3  pointLightPos[MAX_POINT_SHADOWS];
 uniform float shadowFarPlane;
-uniform vec3  pointLightPos;
-uniform int   shadowedIndex;
 
-float pointShadow(vec3 fragPos) {
-    vec3  L = fragPos - pointLightPos;
+//sampler arrays only take constant indices in GLSL 3.30
+float sampleShadowCube(int slot, vec3 L) {
+    if (slot == 0) return texture(pointShadowMaps[0], L).r;
+    if (slot == 1) return texture(pointShadowMaps[1], L).r;
+    if (slot == 2) return texture(pointShadowMaps[2], L).r;
+    if (slot == 3) return texture(pointShadowMaps[3], L).r;
+    return texture(pointShadowMaps[4], L).r;
+}
+
+float sampleShadowDP(int slot, vec3 L) {
+    vec3 v = normalize(L);
+    float layer = (v.y >= 0.0) ? 0.0 : 1.0;
+    vec3 uvl = vec3(v.xz / (1.0 + abs(v.y)) * 0.5 + 0.5, layer);
+    if (slot == 0) return texture(pointShadowDP[0], uvl).r;
+    if (slot == 1) return texture(pointShadowDP[1], uvl).r;
+    if (slot == 2) return texture(pointShadowDP[2], uvl).r;
+    if (slot == 3) return texture(pointShadowDP[3], uvl).r;
+    return texture(pointShadowDP[4], uvl).r;
+}
+
+float pointShadow(int slot, vec3 fragPos) {
+    vec3  L = fragPos - pointLightPos[slot];
     float current = length(L);
-    float closest = texture(pointShadowMap, L).r * shadowFarPlane;
+    float closest = (shadowDualParaboloid ? sampleShadowDP(slot, L) : sampleShadowCube(slot, L)) * shadowFarPlane;
 
     float bias = 0.02;
     return (current - bias > closest) ? 1.0 : 0.0;
 }
 
+//0 = lit, 1 = in the moon's shadow
+float dirShadow(vec3 N) {
+    if (!useDirShadow) return 0.0;
+    for (int c = 0; c < NUM_CASCADES; ++c) {
+        if (ViewDepth > cascadeSplits[c]) continue;
+        //normal offset keeps the surface from shadowing itself
+        vec3 p = FragPos + N * cascadeTexel[c] * 1.5;
+        vec4 ls = cascadeViewProj[c] * vec4(p, 1.0);
+        vec3 uvz = ls.xyz / ls.w * 0.5 + 0.5;
+        //cached far cascades are padded, but fall through if we're outside anyway
+        if (any(lessThan(uvz.xy, vec2(0.0))) || any(greaterThan(uvz.xy, vec2(1.0)))) continue;
+
+        vec2 texel = 1.0 / vec2(textureSize(dirShadowMap, 0).xy);
+        float lit = 0.0;
+        for (int y = -1; y <= 1; y += 2)
+            for (int x = -1; x <= 1; x += 2)
+                lit += texture(dirShadowMap, vec4(uvz.xy + vec2(x, y) * 0.5 * texel, float(c), uvz.z - 0.0005));
+        return 1.0 - lit * 0.25;
+    }
+    return 0.0;
+}
+
+uint hashU(uint x) {
+    x ^= x >> 16; x *= 0x7feb352du;
+    x ^= x >> 15; x *= 0x846ca68bu;
+    x ^= x >> 16;
+    return x;
+}
+
+float rand01(inout uint state) {
+    state = hashU(state);
+    return float(state >> 8) * (1.0 / 16777216.0);
+}
+
+#include "lantern_trajectory.glsl"
+
+//xyz = position, w = power
+vec4 fetchLight(int i) {
+    if (lightAnalytic)
+        return lanternPosition(texelFetch(lightData, i * 2), texelFetch(lightData, i * 2 + 1));
+    return texelFetch(lightData, i * lightStride);
+}
+
+//alias table draw, probability ~ power / distance^2 to the camera
+int sampleLight(inout uint rng, out float pdf) {
+    int i = min(int(rand01(rng) * float(lightCount)), lightCount - 1);
+    if (lightUniform) {
+        pdf = 1.0 / float(lightCount);
+        return i;
+    }
+    vec4 a = texelFetch(lightAlias, i);
+    if (rand01(rng) >= a.x) {
+        i = int(a.y);
+        a = texelFetch(lightAlias, i);
+    }
+    pdf = a.z;
+    return i;
+}
+
+float lanternFalloff(float power, float dist) {
+    return power / (lanternAtten.x + lanternAtten.y * dist + lanternAtten.z * dist * dist);
+}
+
+//one lantern's diffuse + specular, albedo divided out so the blur doesn't smear texture detail
+vec3 lanternIllum(vec4 ld, vec3 N, vec3 V, vec3 albedo) {
+    vec3 L = ld.xyz - FragPos;
+    float dist = length(L);
+    L = L / max(dist, 1e-4);
+    float atten = lanternFalloff(ld.w, dist);
+    float d = max(dot(N, L), 0.0);
+    float s2 = pow(max(dot(N, normalize(L + V)), 0.0), 32.0);
+    return atten * lanternColor * (d + 0.25 * s2 / max(albedo, vec3(0.05)));
+}
+
+//resampled importance sampling: CANDIDATES draws per reservoir, the survivor is picked
+//by this pixel's own power / distance^2, then shaded once; cost doesn't depend on lightCount
+vec3 stochasticLanterns(vec3 N, vec3 V, vec3 albedo) {
+    if (lightCount <= 0) return vec3(0.0);
+    uint rng = hashU(uint(gl_FragCoord.x) * 1973u ^ uint(gl_FragCoord.y) * 9277u ^ uint(frameIndex) * 26699u);
+    vec3 sum = vec3(0.0);
+    for (int r = 0; r < RESERVOIRS; ++r) {
+        int chosen = -1;
+        float wSum = 0.0, chosenTarget = 0.0;
+        for (int m = 0; m < CANDIDATES; ++m) {
+            float pdf;
+            int i = sampleLight(rng, pdf);
+            vec4 ld = fetchLight(i);
+            vec3 L = ld.xyz - FragPos;
+            float dist = length(L);
+            float target = lanternFalloff(ld.w, dist) * (max(dot(N, L / max(dist, 1e-4)), 0.0) + 0.05);
+            float w = target / max(pdf, 1e-20);
+            wSum += w;
+            if (rand01(rng) * wSum < w) { chosen = i; chosenTarget = target; }
+        }
+        if (chosen < 0 || chosenTarget <= 0.0) continue;
+        float W = wSum / (float(CANDIDATES) * chosenTarget);
+        sum += lanternIllum(fetchLight(chosen), N, V, albedo) * W;
+    }
+    return sum / float(RESERVOIRS);
+}
+
+//L0 + L1 irradiance for the normal: clamped cosine lobe is 1/4 + n.l/2
+float volumeGlow(vec3 N) {
+    if (!useIrradianceVolume) return 0.0;
+    vec3 uvw = (FragPos - volumeOrigin) * volumeInvSize;
+    if (any(lessThan(uvw, vec3(0.0))) || any(greaterThan(uvw, vec3(1.0)))) return 0.0;
+    vec4 e = texture(irradianceVolume, uvw);
+    return max(0.25 * e.a + 0.5 * dot(e.rgb, N), 0.0);
+}
+
 void main() {
     vec3 N = normalize(Normal);
     vec3 V = normalize(viewPos - FragPos);
@@ -56,6 +225,16 @@ void main() {
     float spec = pow(max(dot(N, H), 0.0), 32.0);
     vec3 dirSpec = spec * dirLightColor * 0.25;
 
+    if (useLightmap) {
+        vec4 baked = texture(lightmap, LightmapUV);
+        dirDiffuse = baked.rgb * 2.0 * albedo;
+        dirSpec   *= baked.a;
+    } else {
+        float moonShadow = (ndotl > 0.0) ? dirShadow(N) : 0.0;
+        dirDiffuse *= 1.0 - moonShadow;
+        dirSpec    *= 1.0 - moonShadow;
+    }
+
     vec3 pts = vec3(0.0);
     for (int i = 0; i < numLanterns; ++i) {
         vec3 L = lanterns[i].position - FragPos;
@@ -70,14 +249,17 @@ void main() {
         vec3  H2 = normalize(L + V);
         float s2 = pow(max(dot(N, H2), 0.0), 32.0);
 
-        float sh = (i == shadowedIndex) ? pointShadow(FragPos) : 0.0;
+        float sh = (lanterns[i].shadowSlot >= 0) ? pointShadow(lanterns[i].shadowSlot, FragPos) : 0.0;
 
         vec3 contrib = atten * (d * lanterns[i].color * albedo + 0.25 * s2 * lanterns[i].color);
         pts += (1.0 - sh) * contrib;
     }
 
-    vec3 ambient = 0.12 * albedo;
+    float ao = useVertexAO ? VertexAO : 1.0;
+    vec3 ambient = ao * (0.12 * albedo + volumeGlow(N) * lanternColor * albedo);
     vec3 emissive = (isLantern ? lanternTint * lanternEmissive : vec3(0.0));
     vec3 color = ambient + dirDiffuse + dirSpec + pts + emissive;
     FragColor = vec4(color, 1.0);
+    LanternLight = vec4(stochasticLights ? stochasticLanterns(N, V, albedo) : vec3(0.0), 1.0);
+    Albedo = vec4(albedo, 1.0);
 }
\ No newline at end of file
@@ -2,17 +2,39 @@
 layout (location=0) in vec3 aPos;
 layout (location=1) in vec3 aNormal;
 layout (location=2) in vec2 aTexCoords;
+layout (location=3) in float aAO;       //baked per-vertex ambient occlusion (castle, island)
+layout (location=4) in vec2 aLightmapUV; //lightmap atlas coordinates (castle, island)
+layout (location=5) in vec4 aInstance;  //instanced lanterns: xyz = position, w * instanceScale = scale
+layout (location=6) in vec4 aInstance2; //analytic lanterns: aInstance = spawn record, this = velocity + phase
 
 out vec3 FragPos;
 out vec3 Normal;
 out vec2 TexCoords;
+out float ViewDepth;
+out float VertexAO;
+out vec2 LightmapUV;
 
 uniform mat4 model, view, projection;
+uniform bool instanced;
+uniform bool instanceAnalytic;
+uniform float instanceScale;
+
+#include "lantern_trajectory.glsl"
 
 void main() {
-    vec4 w = model * vec4(aPos, 1.0);
+    mat4 M = model;
+    if (instanced) {
+        vec4 inst = instanceAnalytic ? lanternPosition(aInstance, aInstance2) : aInstance;
+        float s = inst.w * instanceScale;
+        M = mat4(vec4(s, 0.0, 0.0, 0.0), vec4(0.0, s, 0.0, 0.0),
+                 vec4(0.0, 0.0, s, 0.0), vec4(inst.xyz, 1.0));
+    }
+    vec4 w = M * vec4(aPos, 1.0);
     FragPos  = w.xyz;
-    Normal   = normalize(mat3(model) * aNormal);
+    Normal   = normalize(mat3(M) * aNormal);
     TexCoords = aTexCoords;
+    VertexAO = aAO;
+    LightmapUV = aLightmapUV;
+    ViewDepth = -(view * w).z;
     gl_Position = projection * view * w;
 }
\ No newline at end of file
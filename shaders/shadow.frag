@@ -1,4 +1,12 @@
 #version 330 core
+in vec4 FragPos;
+in float Hemi;
+
+uniform vec3 lightPos;
+uniform float farPlane;
+
 void main() {
-    //depth-only, no color output
-}
\ No newline at end of file
+    if (Hemi < 0.0) discard; //paraboloid fragment from the other hemisphere
+    //linear distance to the light, so lookups compare in world units
+    gl_FragDepth = length(FragPos.xyz - lightPos) / farPlane;
+}
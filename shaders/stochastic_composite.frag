@@ -0,0 +1,16 @@
+#version 330 core
+in vec2 UV;
+out vec4 FragColor;
+
+uniform sampler2D baseColor;    //ambient + moon + emissive
+uniform sampler2D lanternLight; //denoised, albedo divided out
+uniform sampler2D albedo;
+uniform sampler2D depthTex;
+
+void main() {
+    float depth = texture(depthTex, UV).r;
+    if (depth >= 1.0) discard; //leave the background to the skybox
+    vec3 color = texture(baseColor, UV).rgb + texture(albedo, UV).rgb * texture(lanternLight, UV).rgb;
+    FragColor = vec4(color, 1.0);
+    gl_FragDepth = depth;
+}
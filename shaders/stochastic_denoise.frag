@@ -0,0 +1,26 @@
+#version 330 core
+in vec2 UV;
+out vec4 FragColor;
+
+uniform sampler2D accumulated; //rgb = light, a = clip w (0 = sky)
+
+void main() {
+    vec4 c = texture(accumulated, UV);
+    if (c.a <= 0.0) { FragColor = c; return; }
+
+    //5x5 gaussian, taps on other surfaces (depth jump) are dropped
+    vec2 texel = 1.0 / vec2(textureSize(accumulated, 0));
+    const float k[3] = float[](0.375, 0.25, 0.0625);
+    vec3 sum = vec3(0.0);
+    float wsum = 0.0;
+    for (int y = -2; y <= 2; ++y) {
+        for (int x = -2; x <= 2; ++x) {
+            vec4 s = texture(accumulated, UV + vec2(x, y) * texel);
+            float wd = exp(-abs(s.a - c.a) / (0.02 * c.a));
+            float w = k[abs(x)] * k[abs(y)] * wd * step(1e-6, s.a);
+            sum += s.rgb * w;
+            wsum += w;
+        }
+    }
+    FragColor = vec4(sum / max(wsum, 1e-6), c.a);
+}
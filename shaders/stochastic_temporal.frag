@@ -0,0 +1,36 @@
+#version 330 core
+in vec2 UV;
+out vec4 FragColor;
+
+uniform sampler2D currentLight;
+uniform sampler2D depthTex;
+uniform sampler2D history;      //rgb = accumulated light, a = clip w of that surface
+uniform mat4 viewProj, invViewProj, prevViewProj;
+uniform bool historyValid;
+uniform float blend;
+
+void main() {
+    float depth = texture(depthTex, UV).r;
+    if (depth >= 1.0) { FragColor = vec4(0.0); return; }
+
+    vec4 ndc = vec4(UV * 2.0 - 1.0, depth * 2.0 - 1.0, 1.0);
+    vec4 world = invViewProj * ndc;
+    world /= world.w;
+    float w = (viewProj * world).w;
+
+    vec3 cur = texture(currentLight, UV).rgb;
+    float a = 1.0;
+    if (historyValid) {
+        //where was this surface last frame, and is the history there the same surface?
+        vec4 prevClip = prevViewProj * world;
+        vec2 prevUV = prevClip.xy / prevClip.w * 0.5 + 0.5;
+        if (all(greaterThanEqual(prevUV, vec2(0.0))) && all(lessThanEqual(prevUV, vec2(1.0)))) {
+            vec4 h = texture(history, prevUV);
+            if (abs(h.a - prevClip.w) < 0.05 * prevClip.w) {
+                a = blend;
+                cur = mix(h.rgb, cur, a);
+            }
+        }
+    }
+    FragColor = vec4(cur, w);
+}
@@ -4,9 +4,13 @@ in vec3 vViewDir;
 out vec4 FragColor;
 
 uniform samplerCube skybox;
-uniform samplerCube pointShadowMap;
+#define MAX_POINT_SHADOWS 5
+uniform samplerCube pointShadowMaps[MAX_POINT_SHADOWS];
+uniform sampler2DArray pointShadowDP[MAX_POINT_SHADOWS]; //dual-paraboloid: layer 0 = +Y, 1 = -Y
+uniform bool  shadowDualParaboloid;
+uniform vec3  pointLightPos[MAX_POINT_SHADOWS];
+uniform int   numPointShadows;
 uniform float shadowFarPlane;
-uniform vec3 pointLightPos;
 
 uniform vec3 waterColor;
 uniform float alphaBase;
@@ -23,10 +27,29 @@ vec3 fakeNormal(vec3 p) {
     return normalize(vec3(-n, 1.0, -n));
 }
 
-float pointShadow(vec3 fragPos) {
-    vec3  L = fragPos - pointLightPos;
+float sampleShadowCube(int slot, vec3 L) {
+    if (slot == 0) return texture(pointShadowMaps[0], L).r;
+    if (slot == 1) return texture(pointShadowMaps[1], L).r;
+    if (slot == 2) return texture(pointShadowMaps[2], L).r;
+    if (slot == 3) return texture(pointShadowMaps[3], L).r;
+    return texture(pointShadowMaps[4], L).r;
+}
+
+float sampleShadowDP(int slot, vec3 L) {
+    vec3 v = normalize(L);
+    float layer = (v.y >= 0.0) ? 0.0 : 1.0;
+    vec3 uvl = vec3(v.xz / (1.0 + abs(v.y)) * 0.5 + 0.5, layer);
+    if (slot == 0) return texture(pointShadowDP[0], uvl).r;
+    if (slot == 1) return texture(pointShadowDP[1], uvl).r;
+    if (slot == 2) return texture(pointShadowDP[2], uvl).r;
+    if (slot == 3) return texture(pointShadowDP[3], uvl).r;
+    return texture(pointShadowDP[4], uvl).r;
+}
+
+float pointShadow(int slot, vec3 fragPos) {
+    vec3  L = fragPos - pointLightPos[slot];
     float current = length(L);
-    float closest = texture(pointShadowMap, L).r * shadowFarPlane;
+    float closest = (shadowDualParaboloid ? sampleShadowDP(slot, L) : sampleShadowCube(slot, L)) * shadowFarPlane;
     float bias = 0.02; // tune 0.005–0.03
     return (current - bias > closest) ? 1.0 : 0.0; // 1=in shadow
 }
@@ -48,7 +71,9 @@ void main() {
 
     refr *= exp(-absorb * 0.5);
 
-    float sh = pointShadow(vWorldPos);     // 0 lit, 1 shadow
+    float sh = 0.0;                        // 0 lit, 1 shadow
+    for (int k = 0; k < numPointShadows; ++k)
+        sh = max(sh, pointShadow(k, vWorldPos));
     refr *= (1.0 - 0.8 * sh);              // dim refracted (direct-lit-ish) path in shadow
 
     vec3 color = mix(refr, refl, fres);
@@ -0,0 +1,116 @@
+#include "AOBake.hpp"
+#include "TriangleBVH.hpp"
+#include "ThreadPool.hpp"
+#include "Philox.hpp"
+#include "Hemisphere.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <unordered_map>
+
+namespace {
+
+const uint32_t VERSION = 1;
+const RandomKey AO_KEY{0x414f4241u, 0u, 0u}; //fixed: a rebake gives the same result
+
+struct BlobHeader {
+    uint32_t version;
+    int32_t samples;
+    float distance;
+    uint32_t count;
+};
+
+//exact (position, normal) bits: only true duplicates share a result
+struct VertexKey {
+    float v[6];
+    bool operator==(const VertexKey& o) const { return std::memcmp(v, o.v, sizeof(v)) == 0; }
+};
+struct VertexKeyHash {
+    size_t operator()(const VertexKey& k) const {
+        uint32_t bits[6];
+        std::memcpy(bits, k.v, sizeof(bits));
+        uint64_t h = 1469598103934665603ull;
+        for (uint32_t b : bits) h = (h ^ b) * 1099511628211ull;
+        return size_t(h);
+    }
+};
+
+} //namespace
+
+void AOBake::Bake(const std::vector<MeshData>& meshes, const TriangleBVH& bvh, const Settings& settings,
+                  ThreadPool* pool, std::vector<float>& ao) {
+    auto t0 = std::chrono::steady_clock::now();
+    size_t total = 0;
+    for (const auto& m : meshes) total += m.vertices.size();
+    ao.assign(total, 1.0f);
+    if (bvh.Empty() || total == 0) return;
+
+    //unique (position, normal) pairs, remap[i] = which one vertex i uses
+    std::vector<uint32_t> remap(total);
+    std::vector<const Vertex*> unique;
+    {
+        std::unordered_map<VertexKey, uint32_t, VertexKeyHash> seen;
+        seen.reserve(total);
+        size_t i = 0;
+        for (const auto& m : meshes)
+            for (const auto& v : m.vertices) {
+                VertexKey k{{v.Position.x, v.Position.y, v.Position.z, v.Normal.x, v.Normal.y, v.Normal.z}};
+                auto it = seen.emplace(k, uint32_t(unique.size()));
+                if (it.second) unique.push_back(&v);
+                remap[i++] = it.first->second;
+            }
+    }
+
+    const int S = std::max(settings.samples, 1);
+    const std::vector<glm::vec3> dirs = CosineHemisphere(S);
+
+    const float diag = glm::length(bvh.BoundsMax() - bvh.BoundsMin());
+    const float reach = settings.distance * diag;
+    const float offset = 1e-4f * diag; //keeps the ray from starting inside its own triangle
+    std::vector<float> open(unique.size());
+    auto bakeRange = [&](size_t b, size_t e) {
+        for (size_t i = b; i < e; ++i) {
+            const Vertex& v = *unique[i];
+            float len = glm::length(v.Normal);
+            if (len < 1e-8f) { open[i] = 1.0f; continue; }
+            glm::vec3 n = v.Normal / len, t, bt;
+            TangentBasis(n, t, bt);
+            float r[4];
+            RandomFloats4(AO_KEY, uint32_t(i), 0u, r);
+            const float c = std::cos(6.2831853f * r[0]), sn = std::sin(6.2831853f * r[0]);
+            const glm::vec3 origin = v.Position + n * offset;
+            int escaped = 0;
+            for (int s = 0; s < S; ++s) //t in [0, 1] covers the reach
+                escaped += !bvh.Occluded(origin, ToHemisphere(dirs[s], c, sn, n, t, bt) * reach, 1.0f);
+            open[i] = float(escaped) / S;
+        }
+    };
+    if (pool) pool->ParallelFor(unique.size(), 256, bakeRange);
+    else bakeRange(0, unique.size());
+
+    for (size_t i = 0; i < total; ++i) ao[i] = open[remap[i]];
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+    std::printf("[AO] baked %zu vertices (%zu unique) x %d rays in %.0f ms\n", total, unique.size(), S, ms);
+}
+
+void AOBake::Serialize(const Settings& settings, const std::vector<float>& ao, std::vector<uint8_t>& out) {
+    const BlobHeader h{VERSION, settings.samples, settings.distance, uint32_t(ao.size())};
+    out.resize(sizeof(h) + ao.size() * sizeof(float));
+    std::memcpy(out.data(), &h, sizeof(h));
+    if (!ao.empty()) std::memcpy(out.data() + sizeof(h), ao.data(), ao.size() * sizeof(float));
+}
+
+bool AOBake::Deserialize(const std::vector<uint8_t>& in, const Settings& settings, size_t vertexCount,
+                         std::vector<float>& ao) {
+    BlobHeader h;
+    if (in.size() < sizeof(h)) return false;
+    std::memcpy(&h, in.data(), sizeof(h));
+    if (h.version != VERSION || h.samples != settings.samples || h.distance != settings.distance
+        || h.count != vertexCount || in.size() != sizeof(h) + size_t(h.count) * sizeof(float))
+        return false;
+    ao.resize(h.count);
+    if (h.count) std::memcpy(ao.data(), in.data() + sizeof(h), h.count * sizeof(float));
+    return true;
+}
@@ -0,0 +1,167 @@
+#include "AnalyticLanterns.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <random>
+
+void AnalyticLanterns::init() {
+    //free slots get a spawn time far in the past, so their age is always past maxAge
+    std::vector<glm::vec4> records(size_t(CAPACITY) * RECORD_TEXELS, glm::vec4(0.0f));
+    for (int i = 0; i < CAPACITY; ++i) records[size_t(i) * RECORD_TEXELS].w = -1e6f;
+
+    glGenBuffers(1, &vbo);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glBufferData(GL_ARRAY_BUFFER, records.size() * sizeof(glm::vec4), records.data(), GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    glGenTextures(1, &recordTex);
+    glBindTexture(GL_TEXTURE_BUFFER, recordTex);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, vbo);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+}
+
+void AnalyticLanterns::Spawn(const Lantern& L, float now) {
+    //a lantern handed over mid-flight keeps its age
+    pending.push_back(glm::vec4(L.pos, now - L.t));
+    pending.push_back(glm::vec4(L.vel, L.phase));
+}
+
+void AnalyticLanterns::Update() {
+    if (pending.empty()) return;
+    int n = (int)pending.size() / RECORD_TEXELS;
+    if (n > CAPACITY) {
+        pending.erase(pending.begin(), pending.end() - size_t(CAPACITY) * RECORD_TEXELS);
+        n = CAPACITY;
+    }
+
+    const size_t recordBytes = RECORD_TEXELS * sizeof(glm::vec4);
+    const int first = std::min(n, CAPACITY - head);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glBufferSubData(GL_ARRAY_BUFFER, head * recordBytes, first * recordBytes, pending.data());
+    if (first < n)
+        glBufferSubData(GL_ARRAY_BUFFER, 0, (n - first) * recordBytes, pending.data() + first * RECORD_TEXELS);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    used = std::min(CAPACITY, std::max(used, head + n));
+    head = (head + n) % CAPACITY;
+    pending.clear();
+}
+
+void AnalyticLanterns::SetUniforms(Shader& s, float now, const glm::vec3& boatPos) const {
+    s.use();
+    s.setFloat("lanternTime", now);
+    s.setFloat("lanternDamping", Damping());
+    s.setFloat("lanternMaxAge", maxAge);
+    s.setFloat("lanternMaxHeight", maxHeight);
+    s.setFloat("lanternMaxDistance", maxDistance);
+    s.setVec3("lanternBoatPos", boatPos);
+}
+
+void AnalyticLanterns::bindInstances(Shader& s, const Model& lanternModel) const {
+    s.setBool("instanceAnalytic", true);
+    s.setFloat("instanceScale", scale);
+    lanternModel.SetInstanceBuffer(vbo, RECORD_TEXELS * sizeof(glm::vec4), RECORD_TEXELS);
+    lanternModel.DrawInstanced(used);
+    s.setBool("instanceAnalytic", false);
+}
+
+void AnalyticLanterns::DrawMeshes(Shader& lit, const Model& lanternModel) const {
+    if (used == 0) return;
+    lit.use();
+    lit.setBool("instanced", true);
+    bindInstances(lit, lanternModel);
+    lit.setBool("instanced", false);
+}
+
+void AnalyticLanterns::DrawCasters(Shader& cascadeShader, const Model& lanternModel) const {
+    if (used == 0) return;
+    cascadeShader.use();
+    bindInstances(cascadeShader, lanternModel);
+}
+
+float AnalyticLanterns::Damping() {
+    //v *= 0.9985 once per frame is exp(-k dt) at the reference frame rate
+    return -std::log(0.9985f) * REFERENCE_FPS;
+}
+
+namespace {
+//displacement from forcing A * sin(w * s + th) starting at rest, see lantern_trajectory.glsl
+float WindTerm(float A, float w, float th, float k, float t, float decay) {
+    float c = A / (k * k + w * w);
+    float v0 = c * (k * std::sin(th) - w * std::cos(th));
+    float xt = c * (-(k / w) * std::cos(w * t + th) - std::sin(w * t + th));
+    float x0 = c * (-(k / w) * std::cos(th) - std::sin(th));
+    return xt - x0 - v0 * (1.0f - decay) / k;
+}
+}
+
+glm::vec3 AnalyticLanterns::Evaluate(const glm::vec3& pos0, const glm::vec3& vel0, float ph, float t) {
+    const float HALF_PI = 1.5707963f;
+    const float k = Damping();
+    const float decay = std::exp(-k * t);
+    const float g = (1.0f - decay) / k;
+
+    glm::vec3 p = pos0 + vel0 * g;
+    p.y += 0.01f / k * (t - g);
+    p.x += WindTerm(0.15f * 0.15f, 0.6f, 0.6f * ph, k, t, decay)
+         + WindTerm(0.15f * 0.08f, 1.1f, 1.1f * ph + HALF_PI, k, t, decay);
+    p.z += WindTerm(0.15f * 0.15f, 0.5f, 0.5f * ph + HALF_PI, k, t, decay)
+         + WindTerm(0.15f * 0.06f, 1.3f, 1.3f * ph, k, t, decay);
+    return p;
+}
+
+void RunTrajectoryBenchmark() {
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<float> r01(0.0f, 1.0f);
+
+    //both spawn kinds from main.cpp: off the boat (upward) and castle bursts (radial kick)
+    struct Spawn { glm::vec3 pos, vel; float phase; };
+    std::vector<Spawn> spawns;
+    for (int i = 0; i < 1000; ++i) {
+        glm::vec3 side(r01(rng) - 0.5f, 0.0f, r01(rng) - 0.5f);
+        spawns.push_back({glm::vec3(0.0f, 1.25f, 0.0f),
+                          glm::vec3(0.0f, 0.7f, 0.0f) + glm::vec3(0, 0, -0.1f) + side * 0.05f,
+                          r01(rng) * 100.0f});
+        glm::vec3 jitter(r01(rng) - 0.5f, 0.4f * r01(rng), r01(rng) - 0.5f);
+        glm::vec3 radial = glm::vec3(jitter.x, 0.0f, jitter.z) * 0.7f;
+        spawns.push_back({jitter, glm::vec3(0.0f, 0.01f, 0.0f) + radial
+                          + glm::vec3(0.2f * r01(rng) - 0.1f, 0.0f, 0.2f * r01(rng) - 0.1f),
+                          r01(rng) * 100.0f});
+    }
+
+    std::printf("\n== Analytic lantern trajectories vs the frame stepper (%zu lanterns, 40 s) ==\n",
+                spawns.size());
+    std::printf("%-8s %12s %12s %12s %14s\n", "fps", "mean err", "p99 err", "max err", "max err @ 10s");
+    for (float fps : {30.0f, 60.0f, 144.0f}) {
+        const float dt = 1.0f / fps;
+        std::vector<float> errs;
+        float maxErr = 0.0f, maxErr10 = 0.0f;
+        for (const auto& s : spawns) {
+            glm::vec3 pos = s.pos, vel = s.vel;
+            float t = 0.0f;
+            while (t < 40.0f) {
+                //the loop from main.cpp
+                t += dt;
+                vel.y += 0.01f * dt;
+                float w = s.phase + t;
+                glm::vec3 wind(0.15f * std::sin(0.6f * w) + 0.08f * std::cos(1.1f * w), 0.0f,
+                               0.15f * std::cos(0.5f * w) + 0.06f * std::sin(1.3f * w));
+                vel += wind * 0.15f * dt;
+                vel *= 0.9985f;
+                pos += vel * dt;
+
+                float e = glm::length(pos - AnalyticLanterns::Evaluate(s.pos, s.vel, s.phase, t));
+                errs.push_back(e);
+                maxErr = std::max(maxErr, e);
+                if (t <= 10.0f) maxErr10 = std::max(maxErr10, e);
+            }
+        }
+        double sum = 0.0;
+        for (float e : errs) sum += e;
+        std::nth_element(errs.begin(), errs.begin() + errs.size() * 99 / 100, errs.end());
+        std::printf("%-8.0f %12.4f %12.4f %12.4f %14.4f\n", fps, sum / errs.size(),
+                    errs[errs.size() * 99 / 100], maxErr, maxErr10);
+    }
+    std::printf("(the stepper damps per frame, so away from %.0f fps it drifts from itself too)\n",
+                AnalyticLanterns::REFERENCE_FPS);
+}
@@ -0,0 +1,160 @@
+#include "AssetPack.hpp"
+#include "MeshCache.hpp"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <unordered_map>
+
+namespace {
+
+const uint32_t MAGIC = FourCC('A', 'P', 'A', 'K');
+const uint32_t VERSION = 1;
+const uint64_t ALIGN = 4096; //entries start on a page: madvise ranges and GL pointers line up
+
+struct PackHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t entryCount;
+    uint32_t namesBytes; //name blob right after the entry table
+};
+
+struct PackEntry {
+    uint64_t offset; //from the start of the pack
+    uint64_t size;
+    uint32_t nameOffset; //into the name blob
+    uint32_t nameSize;
+};
+
+struct Mapping {
+    const uint8_t* base = nullptr;
+    size_t size = 0;
+    std::unordered_map<std::string, AssetPack::View> entries;
+};
+
+Mapping& Pack() {
+    static Mapping mapping;
+    return mapping;
+}
+
+uint64_t AlignUp(uint64_t v) { return (v + ALIGN - 1) / ALIGN * ALIGN; }
+
+} //namespace
+
+namespace AssetPack {
+
+bool Open(const std::string& path) {
+    Close();
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    void* base = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && size_t(st.st_size) >= sizeof(PackHeader))
+        base = mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd); //the mapping keeps the file
+    if (base == MAP_FAILED) return false;
+
+    Mapping& pack = Pack();
+    pack.base = static_cast<const uint8_t*>(base);
+    pack.size = size_t(st.st_size);
+    PackHeader header;
+    std::memcpy(&header, pack.base, sizeof(header));
+    const size_t tableEnd = sizeof(header) + size_t(header.entryCount) * sizeof(PackEntry);
+    bool ok = header.magic == MAGIC && header.version == VERSION && tableEnd + header.namesBytes <= pack.size;
+    const uint8_t* names = pack.base + tableEnd;
+    for (uint32_t i = 0; ok && i < header.entryCount; ++i) {
+        PackEntry e;
+        std::memcpy(&e, pack.base + sizeof(header) + i * sizeof(PackEntry), sizeof(e));
+        ok = e.offset <= pack.size && e.size <= pack.size - e.offset
+          && uint64_t(e.nameOffset) + e.nameSize <= header.namesBytes;
+        if (ok)
+            pack.entries[std::string(reinterpret_cast<const char*>(names) + e.nameOffset, e.nameSize)] =
+                View{pack.base + e.offset, size_t(e.size)};
+    }
+    if (!ok) {
+        std::fprintf(stderr, "Asset pack: '%s' is not a valid pack\n", path.c_str());
+        Close();
+        return false;
+    }
+    //reads are scattered (one entry here, one there), the default readahead would only waste I/O
+    madvise(const_cast<uint8_t*>(pack.base), pack.size, MADV_RANDOM);
+    return true;
+}
+
+void Close() {
+    Mapping& pack = Pack();
+    if (pack.base) munmap(const_cast<uint8_t*>(pack.base), pack.size);
+    pack = Mapping();
+}
+
+View Find(const std::string& name) {
+    const Mapping& pack = Pack();
+    auto it = pack.entries.find(name);
+    return it == pack.entries.end() ? View() : it->second;
+}
+
+void Prefetch(const std::string& name) {
+    const View v = Find(name);
+    if (!v || v.size == 0) return;
+    //entries start on a page, only the length needs rounding
+    madvise(const_cast<uint8_t*>(v.data), size_t(AlignUp(v.size)), MADV_WILLNEED);
+}
+
+size_t EntryCount() { return Pack().entries.size(); }
+size_t MappedBytes() { return Pack().size; }
+
+bool Write(const std::string& path, const std::vector<std::pair<std::string, std::string>>& files) {
+    std::vector<PackEntry> entries(files.size());
+    std::string names;
+    for (size_t i = 0; i < files.size(); ++i) {
+        struct stat st;
+        if (stat(files[i].second.c_str(), &st) != 0) {
+            std::fprintf(stderr, "Asset pack: can't read '%s'\n", files[i].second.c_str());
+            return false;
+        }
+        entries[i].size = uint64_t(st.st_size);
+        entries[i].nameOffset = uint32_t(names.size());
+        entries[i].nameSize = uint32_t(files[i].first.size());
+        names += files[i].first;
+    }
+    const PackHeader header{MAGIC, VERSION, uint32_t(entries.size()), uint32_t(names.size())};
+    uint64_t at = AlignUp(sizeof(header) + entries.size() * sizeof(PackEntry) + names.size());
+    for (auto& e : entries) {
+        e.offset = at;
+        at = AlignUp(at + e.size);
+    }
+
+    //next to the final name and renamed, like the caches: a running game never maps half a pack
+    const std::string tmp = path + ".tmp";
+    FILE* f = std::fopen(tmp.c_str(), "wb");
+    if (!f) return false;
+    bool ok = std::fwrite(&header, sizeof(header), 1, f) == 1
+           && (entries.empty() || std::fwrite(entries.data(), sizeof(PackEntry), entries.size(), f) == entries.size())
+           && std::fwrite(names.data(), 1, names.size(), f) == names.size();
+    std::vector<uint8_t> buffer(size_t(1) << 20);
+    for (size_t i = 0; ok && i < files.size(); ++i) {
+        ok = std::fseek(f, long(entries[i].offset), SEEK_SET) == 0;
+        FILE* in = ok ? std::fopen(files[i].second.c_str(), "rb") : nullptr;
+        ok = in != nullptr;
+        for (uint64_t left = entries[i].size; ok && left; ) {
+            const size_t n = std::fread(buffer.data(), 1, size_t(std::min<uint64_t>(left, buffer.size())), in);
+            ok = n > 0 && std::fwrite(buffer.data(), 1, n, f) == n;
+            left -= n;
+        }
+        if (in) std::fclose(in);
+    }
+    //the last entry's padding, so every entry's rounded-up length lies inside the file; the
+    //file is extended rather than written, the last data byte may sit right at `at - 1`
+    if (ok) ok = std::fflush(f) == 0 && ftruncate(fileno(f), off_t(at)) == 0;
+    ok = (std::fclose(f) == 0) && ok;
+    if (!ok || std::rename(tmp.c_str(), path.c_str()) != 0) {
+        std::remove(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+} //namespace AssetPack
@@ -0,0 +1,299 @@
+#include "AssetStreamer.hpp"
+#include <GLFW/glfw3.h>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+AssetStreamer::~AssetStreamer() { Stop(); }
+
+bool AssetStreamer::Start(GLFWwindow* mainWindow, size_t stagingBytes) {
+    if (thread.joinable()) return true;
+    //an invisible 1x1 window is the only portable way GLFW hands out a second context;
+    //the version / profile hints are still the main window's
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    context = glfwCreateWindow(1, 1, "loader", nullptr, mainWindow);
+    glfwWindowHint(GLFW_VISIBLE, GLFW_TRUE);
+    if (!context) {
+        std::cerr << "Asset streamer: no shared context, loading on the main thread\n";
+        return false;
+    }
+    segmentBytes = std::max<size_t>(stagingBytes / SEGMENTS, 64 * 1024);
+    stopping = false;
+    unlimited = false;
+    thread = std::thread(&AssetStreamer::threadLoop, this);
+    return true;
+}
+
+void AssetStreamer::Stop() {
+    if (!thread.joinable()) return;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+        unlimited = true;
+    }
+    wake.notify_all();
+    thread.join();
+    glfwDestroyWindow(context);
+    context = nullptr;
+}
+
+void AssetStreamer::Post(std::function<void()> job) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        jobs.push_back(std::move(job));
+    }
+    wake.notify_one();
+}
+
+void AssetStreamer::SetBudget(const Budget& b) {
+    std::lock_guard<std::mutex> lock(mutex);
+    budget = b;
+}
+
+void AssetStreamer::BeginFrame(const glm::mat4& viewProj, const glm::vec3& eyePos) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (frameBytes) {
+            ++stats.frames;
+            stats.maxFrameBytes = std::max(stats.maxFrameBytes, frameBytes);
+            stats.maxFrameMs = std::max(stats.maxFrameMs, frameMs);
+        }
+        frameBytes = 0;
+        frameMs = 0.0;
+        creditBytes = budget.bytesPerFrame;
+        creditMs = budget.msPerFrame;
+        frustum = Frustum::FromMatrix(viewProj);
+        eye = eyePos;
+        haveView = true;
+    }
+    wake.notify_one();
+}
+
+AssetStreamer::Backlog AssetStreamer::Pending() {
+    std::lock_guard<std::mutex> lock(mutex);
+    Backlog b = stats;
+    b.bytes = 0;
+    b.batches = 0;
+    for (const Batch& batch : batches)
+        if (batch.pendingBytes) {
+            b.bytes += batch.pendingBytes;
+            ++b.batches;
+        }
+    return b;
+}
+
+void AssetStreamer::threadLoop() {
+    glfwMakeContextCurrent(context);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1); //rows are packed in the sources and in staging
+    glGenBuffers(1, &staging);
+    glBindBuffer(GL_COPY_READ_BUFFER, staging);
+    persistent = GLEW_ARB_buffer_storage;
+    if (persistent) {
+        const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_COPY_READ_BUFFER, segmentBytes * SEGMENTS, nullptr, flags);
+        mapped = static_cast<unsigned char*>(glMapBufferRange(GL_COPY_READ_BUFFER, 0, segmentBytes * SEGMENTS, flags));
+        persistent = mapped != nullptr;
+    }
+    if (!persistent) glBufferData(GL_COPY_READ_BUFFER, segmentBytes, nullptr, GL_STREAM_DRAW);
+
+    std::unique_lock<std::mutex> lock(mutex);
+    for (;;) {
+        wake.wait(lock, [this]{ return stopping || !jobs.empty() || canTransfer(); });
+        if (!jobs.empty()) {
+            std::function<void()> job = std::move(jobs.front());
+            jobs.pop_front();
+            lock.unlock();
+            job();
+            lock.lock();
+            continue;
+        }
+        if (!canTransfer()) break; //stopping, and everything posted has run and gone up
+
+        //one chunk of the best batch's next transfer, no bigger than a segment or the budget left
+        const int b = pickBatch();
+        const Transfer t = batches[b].transfers.front();
+        size_t n = std::min(t.bytes - t.done, segmentBytes);
+        if (!unlimited) n = std::min(n, creditBytes);
+        if (t.format) //whole rows
+            n = std::min(std::max<size_t>(n / t.rowBytes, 1) * t.rowBytes, t.bytes - t.done);
+        lock.unlock();
+
+        const auto start = std::chrono::steady_clock::now();
+        const size_t offset = stage(t.src + t.done, n);
+        if (!t.format) {
+            glBindBuffer(GL_COPY_WRITE_BUFFER, t.object);
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, offset, t.done, n);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        } else {
+            glBindTexture(GL_TEXTURE_2D, t.object);
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, staging);
+            glTexSubImage2D(GL_TEXTURE_2D, t.level, 0, int(t.done / t.rowBytes), t.width, int(n / t.rowBytes),
+                            t.format, t.type, reinterpret_cast<const void*>(offset));
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        }
+        retire();
+        const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        lock.lock();
+        Batch& batch = batches[b];
+        if ((batch.transfers.front().done += n) == t.bytes) batch.transfers.pop_front();
+        batch.pendingBytes -= n;
+        creditBytes -= std::min(creditBytes, n);
+        creditMs -= ms;
+        frameBytes += n;
+        frameMs += ms;
+        fenceIfDone(batch);
+    }
+    lock.unlock();
+
+    glFinish(); //nothing of ours is still reading staging
+    for (GLsync& f : segmentFence)
+        if (f) { glDeleteSync(f); f = 0; }
+    if (mapped) {
+        glBindBuffer(GL_COPY_READ_BUFFER, staging);
+        glUnmapBuffer(GL_COPY_READ_BUFFER);
+        mapped = nullptr;
+    }
+    glDeleteBuffers(1, &staging);
+    staging = 0;
+    glfwMakeContextCurrent(nullptr);
+}
+
+bool AssetStreamer::canTransfer() const {
+    if (!unlimited && (creditBytes == 0 || creditMs <= 0.0)) return false;
+    for (const Batch& b : batches)
+        if (b.pendingBytes) return true;
+    return false;
+}
+
+int AssetStreamer::pickBatch() const {
+    //in view before out of view, then nearest; in posting order until there is a view
+    int best = -1;
+    float bestScore = 0.0f;
+    for (int i = 0; i < (int)batches.size(); ++i) {
+        const Batch& b = batches[i];
+        if (!b.pendingBytes) continue;
+        if (!haveView) return i;
+        const glm::vec3 outside = glm::max(glm::max(b.bmin - eye, eye - b.bmax), glm::vec3(0.0f));
+        const float score = glm::length(outside) + (frustum.BoxVisible(b.bmin, b.bmax) ? 0.0f : 1e6f);
+        if (best < 0 || score < bestScore) {
+            best = i;
+            bestScore = score;
+        }
+    }
+    return best;
+}
+
+void AssetStreamer::BeginBatch(const glm::vec3& worldMin, const glm::vec3& worldMax) {
+    std::lock_guard<std::mutex> lock(mutex);
+    Batch b;
+    b.bmin = worldMin;
+    b.bmax = worldMax;
+    batches.push_back(std::move(b));
+    openBatch = (int)batches.size() - 1;
+}
+
+int AssetStreamer::EndBatch() {
+    std::lock_guard<std::mutex> lock(mutex);
+    const int id = openBatch;
+    if (id < 0) return -1;
+    batches[id].closed = true;
+    fenceIfDone(batches[id]);
+    openBatch = -1;
+    return id;
+}
+
+void AssetStreamer::queue(const Transfer& t) {
+    bool own;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        own = openBatch < 0;
+    }
+    if (own) BeginBatch(glm::vec3(0.0f), glm::vec3(0.0f)); //a stray upload still gets its fence
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        batches[openBatch].transfers.push_back(t);
+        batches[openBatch].pendingBytes += t.bytes;
+    }
+    if (own) EndBatch();
+}
+
+void AssetStreamer::fenceIfDone(Batch& b) {
+    if (!b.closed || b.pendingBytes || b.fence || b.ready) return;
+    b.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    glFlush(); //a fence the loader context never submits never signals for the main one
+}
+
+bool AssetStreamer::BatchReady(int batch) {
+    if (batch < 0) return true;
+    std::lock_guard<std::mutex> lock(mutex);
+    Batch& b = batches[batch];
+    if (b.ready) return true;
+    if (!b.fence) return false;
+    const GLenum r = glClientWaitSync(b.fence, 0, 0);
+    if (r != GL_ALREADY_SIGNALED && r != GL_CONDITION_SATISFIED) return false;
+    glDeleteSync(b.fence);
+    b.fence = 0;
+    b.ready = true;
+    return true;
+}
+
+size_t AssetStreamer::stage(const void* data, size_t bytes) {
+    glBindBuffer(GL_COPY_READ_BUFFER, staging);
+    bytesStreamed += bytes;
+    if (persistent) {
+        //the segment's last copy has to be done with it before it's overwritten
+        GLsync& fence = segmentFence[nextSegment];
+        if (fence) {
+            glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+            glDeleteSync(fence);
+            fence = 0;
+        }
+        const size_t offset = size_t(nextSegment) * segmentBytes;
+        std::memcpy(mapped + offset, data, bytes);
+        return offset;
+    }
+    //orphan: the driver hands out fresh storage while the previous chunk is still being copied
+    glBufferData(GL_COPY_READ_BUFFER, segmentBytes, nullptr, GL_STREAM_DRAW);
+    void* dst = glMapBufferRange(GL_COPY_READ_BUFFER, 0, bytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    if (dst) std::memcpy(dst, data, bytes);
+    glUnmapBuffer(GL_COPY_READ_BUFFER);
+    return 0;
+}
+
+void AssetStreamer::retire() {
+    if (!persistent) return;
+    segmentFence[nextSegment] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    nextSegment = (nextSegment + 1) % SEGMENTS;
+}
+
+GLuint AssetStreamer::CreateBuffer(const void* data, size_t bytes) {
+    GLuint buffer;
+    glGenBuffers(1, &buffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+    glBufferData(GL_COPY_WRITE_BUFFER, bytes, nullptr, GL_STATIC_DRAW);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    Transfer t;
+    t.object = buffer;
+    t.src = static_cast<const unsigned char*>(data);
+    t.bytes = bytes;
+    if (bytes) queue(t);
+    return buffer;
+}
+
+void AssetStreamer::TexImage2D(GLuint tex, GLint level, GLint internalFormat, int width, int height,
+                               GLenum format, GLenum type, const void* pixels, int bytesPerTexel) {
+    glBindTexture(GL_TEXTURE_2D, tex);
+    glTexImage2D(GL_TEXTURE_2D, level, internalFormat, width, height, 0, format, type, nullptr);
+    Transfer t;
+    t.object = tex;
+    t.format = format;
+    t.type = type;
+    t.level = level;
+    t.width = width;
+    t.rowBytes = size_t(width) * bytesPerTexel;
+    t.src = static_cast<const unsigned char*>(pixels);
+    t.bytes = t.rowBytes * height;
+    if (t.bytes) queue(t);
+}
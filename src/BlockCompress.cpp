@@ -0,0 +1,437 @@
+#include "BlockCompress.hpp"
+#include "ThreadPool.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define BLOCK_SSE 1
+#endif
+
+namespace {
+
+//the 16 texels of a block as four channel rows, so four texels load as one register
+struct Block {
+    alignas(16) float c[4][16];
+};
+
+struct Endpoints {
+    float e[2][4]; //e[0] at weight 0, e[1] at weight 1
+};
+
+const int BC7_WEIGHTS[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+void LoadBlock(const uint8_t* rgba, int width, int height, int bx, int by, Block& block) {
+    for (int y = 0; y < 4; ++y) {
+        const int sy = std::min(by * 4 + y, height - 1);
+        for (int x = 0; x < 4; ++x) {
+            const uint8_t* p = rgba + (size_t(sy) * width + std::min(bx * 4 + x, width - 1)) * 4;
+            for (int k = 0; k < 4; ++k) block.c[k][y * 4 + x] = p[k];
+        }
+    }
+}
+
+//closest palette entry per texel under a per-channel weight; returns the summed error
+float NearestIndices(const Block& block, const float (*palette)[4], int count, const float weight[4],
+                     uint8_t indices[16]) {
+    float total = 0.0f;
+#ifdef BLOCK_SSE
+    for (int g = 0; g < 16; g += 4) {
+        __m128 ch[4];
+        for (int k = 0; k < 4; ++k) ch[k] = _mm_load_ps(&block.c[k][g]);
+        __m128 best = _mm_set1_ps(3.4e38f), bestIndex = _mm_setzero_ps();
+        for (int p = 0; p < count; ++p) {
+            __m128 d = _mm_setzero_ps();
+            for (int k = 0; k < 4; ++k) {
+                if (weight[k] == 0.0f) continue;
+                const __m128 diff = _mm_sub_ps(ch[k], _mm_set1_ps(palette[p][k]));
+                d = _mm_add_ps(d, _mm_mul_ps(_mm_mul_ps(diff, diff), _mm_set1_ps(weight[k])));
+            }
+            const __m128 closer = _mm_cmplt_ps(d, best);
+            best = _mm_min_ps(d, best);
+            bestIndex = _mm_or_ps(_mm_and_ps(closer, _mm_set1_ps(float(p))), _mm_andnot_ps(closer, bestIndex));
+        }
+        alignas(16) float idx[4], err[4];
+        _mm_store_ps(idx, bestIndex);
+        _mm_store_ps(err, best);
+        for (int i = 0; i < 4; ++i) {
+            indices[g + i] = uint8_t(idx[i]);
+            total += err[i];
+        }
+    }
+#else
+    for (int i = 0; i < 16; ++i) {
+        float best = 3.4e38f;
+        for (int p = 0; p < count; ++p) {
+            float d = 0.0f;
+            for (int k = 0; k < 4; ++k) {
+                const float diff = block.c[k][i] - palette[p][k];
+                d += diff * diff * weight[k];
+            }
+            if (d < best) { best = d; indices[i] = uint8_t(p); }
+        }
+        total += best;
+    }
+#endif
+    return total;
+}
+
+//extremes of the texels along their principal axis (power iteration on the covariance)
+void FitLine(const Block& block, const float weight[4], Endpoints& line) {
+    float mean[4] = {}, lo[4], hi[4];
+    for (int k = 0; k < 4; ++k) {
+        lo[k] = hi[k] = block.c[k][0];
+        for (int i = 0; i < 16; ++i) {
+            mean[k] += block.c[k][i];
+            lo[k] = std::min(lo[k], block.c[k][i]);
+            hi[k] = std::max(hi[k], block.c[k][i]);
+        }
+        mean[k] /= 16.0f;
+    }
+    float cov[4][4] = {};
+    for (int i = 0; i < 16; ++i)
+        for (int a = 0; a < 4; ++a)
+            for (int b = a; b < 4; ++b)
+                cov[a][b] += (block.c[a][i] - mean[a]) * (block.c[b][i] - mean[b]) * weight[a] * weight[b];
+    for (int a = 0; a < 4; ++a)
+        for (int b = 0; b < a; ++b) cov[a][b] = cov[b][a];
+
+    float axis[4];
+    for (int k = 0; k < 4; ++k) axis[k] = (hi[k] - lo[k]) * weight[k];
+    for (int it = 0; it < 8; ++it) {
+        float next[4] = {}, len = 0.0f;
+        for (int a = 0; a < 4; ++a) {
+            for (int b = 0; b < 4; ++b) next[a] += cov[a][b] * axis[b];
+            len = std::max(len, std::fabs(next[a]));
+        }
+        if (len < 1e-6f) break;
+        for (int k = 0; k < 4; ++k) axis[k] = next[k] / len;
+    }
+    float len2 = 0.0f;
+    for (int k = 0; k < 4; ++k) len2 += axis[k] * axis[k];
+    if (len2 < 1e-12f) {
+        for (int k = 0; k < 4; ++k) line.e[0][k] = line.e[1][k] = mean[k];
+        return;
+    }
+    float tMin = 3.4e38f, tMax = -3.4e38f;
+    for (int i = 0; i < 16; ++i) {
+        float t = 0.0f;
+        for (int k = 0; k < 4; ++k) t += (block.c[k][i] - mean[k]) * axis[k];
+        tMin = std::min(tMin, t);
+        tMax = std::max(tMax, t);
+    }
+    for (int k = 0; k < 4; ++k) {
+        line.e[0][k] = std::min(255.0f, std::max(0.0f, mean[k] + axis[k] * tMin / len2));
+        line.e[1][k] = std::min(255.0f, std::max(0.0f, mean[k] + axis[k] * tMax / len2));
+    }
+}
+
+//endpoints minimising the squared error for fixed per-texel weights; false when degenerate
+bool Refit(const Block& block, const float w[16], Endpoints& line) {
+    float a = 0.0f, b = 0.0f, c = 0.0f, x0[4] = {}, x1[4] = {};
+    for (int i = 0; i < 16; ++i) {
+        const float u = 1.0f - w[i];
+        a += u * u;
+        b += u * w[i];
+        c += w[i] * w[i];
+        for (int k = 0; k < 4; ++k) {
+            x0[k] += u * block.c[k][i];
+            x1[k] += w[i] * block.c[k][i];
+        }
+    }
+    const float det = a * c - b * b;
+    if (std::fabs(det) < 1e-6f) return false;
+    for (int k = 0; k < 4; ++k) {
+        line.e[0][k] = std::min(255.0f, std::max(0.0f, (c * x0[k] - b * x1[k]) / det));
+        line.e[1][k] = std::min(255.0f, std::max(0.0f, (a * x1[k] - b * x0[k]) / det));
+    }
+    return true;
+}
+
+uint16_t To565(const float* c) {
+    const int r = int(c[0] * 31.0f / 255.0f + 0.5f), g = int(c[1] * 63.0f / 255.0f + 0.5f), b = int(c[2] * 31.0f / 255.0f + 0.5f);
+    return uint16_t((r << 11) | (g << 5) | b);
+}
+
+void From565(uint16_t v, float* c) {
+    const int r = (v >> 11) & 31, g = (v >> 5) & 63, b = v & 31;
+    c[0] = float((r << 3) | (r >> 2));
+    c[1] = float((g << 2) | (g >> 4));
+    c[2] = float((b << 3) | (b >> 2));
+    c[3] = 255.0f;
+}
+
+struct ColorBlock {
+    uint16_t c0, c1;
+    uint8_t indices[16];
+    float error;
+};
+
+//4-colour BC1 block for a line: c0 > c1, palette c0, c1, 2/3 c0 + 1/3 c1, 1/3 c0 + 2/3 c1
+ColorBlock QuantizeColor(const Block& block, const Endpoints& line) {
+    static const float RGB[4] = { 1.0f, 1.0f, 1.0f, 0.0f };
+    ColorBlock out;
+    out.c0 = To565(line.e[1]);
+    out.c1 = To565(line.e[0]);
+    if (out.c0 < out.c1) std::swap(out.c0, out.c1);
+    float palette[4][4];
+    From565(out.c0, palette[0]);
+    From565(out.c1, palette[1]);
+    if (out.c0 == out.c1) {
+        std::memset(out.indices, 0, sizeof(out.indices));
+        out.error = NearestIndices(block, palette, 1, RGB, out.indices);
+        return out;
+    }
+    for (int k = 0; k < 4; ++k) {
+        palette[2][k] = (2.0f * palette[0][k] + palette[1][k]) / 3.0f;
+        palette[3][k] = (palette[0][k] + 2.0f * palette[1][k]) / 3.0f;
+    }
+    out.error = NearestIndices(block, palette, 4, RGB, out.indices);
+    return out;
+}
+
+void EncodeColor(const Block& block, uint8_t* dst) {
+    static const float RGB[4] = { 1.0f, 1.0f, 1.0f, 0.0f };
+    static const float WEIGHT_OF_INDEX[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f }; //toward c0
+    Endpoints line;
+    FitLine(block, RGB, line);
+    ColorBlock best = QuantizeColor(block, line);
+    if (best.c0 != best.c1) {
+        float w[16];
+        for (int i = 0; i < 16; ++i) w[i] = WEIGHT_OF_INDEX[best.indices[i]];
+        if (Refit(block, w, line)) {
+            const ColorBlock refit = QuantizeColor(block, line);
+            if (refit.error < best.error) best = refit;
+        }
+    }
+    uint32_t bits = 0;
+    for (int i = 0; i < 16; ++i) bits |= uint32_t(best.indices[i]) << (2 * i);
+    std::memcpy(dst, &best.c0, 2);
+    std::memcpy(dst + 2, &best.c1, 2);
+    std::memcpy(dst + 4, &bits, 4);
+}
+
+//8-level BC3 alpha: a0 > a1, palette a0, a1 and six steps between
+void EncodeAlpha(const Block& block, uint8_t* dst) {
+    static const float ALPHA[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+    float lo = block.c[3][0], hi = block.c[3][0];
+    for (int i = 1; i < 16; ++i) {
+        lo = std::min(lo, block.c[3][i]);
+        hi = std::max(hi, block.c[3][i]);
+    }
+    int a0 = int(hi + 0.5f), a1 = int(lo + 0.5f);
+    uint8_t indices[16] = {};
+    if (a0 != a1) {
+        float palette[8][4] = {};
+        palette[0][3] = float(a0);
+        palette[1][3] = float(a1);
+        for (int s = 1; s < 7; ++s) palette[s + 1][3] = float(((7 - s) * a0 + s * a1) / 7);
+        NearestIndices(block, palette, 8, ALPHA, indices);
+    }
+    uint64_t bits = 0;
+    for (int i = 0; i < 16; ++i) bits |= uint64_t(indices[i]) << (3 * i);
+    dst[0] = uint8_t(a0);
+    dst[1] = uint8_t(a1);
+    for (int b = 0; b < 6; ++b) dst[2 + b] = uint8_t(bits >> (8 * b));
+}
+
+//BC7 mode 6 endpoint: 7 bits per channel plus one parity bit shared by the four channels
+struct Bc7Endpoint {
+    int q[4];
+    int p;
+};
+
+Bc7Endpoint QuantizeBc7(const float* e) {
+    Bc7Endpoint best{};
+    float bestError = 3.4e38f;
+    for (int p = 0; p < 2; ++p) {
+        Bc7Endpoint cand{};
+        cand.p = p;
+        float error = 0.0f;
+        for (int k = 0; k < 4; ++k) {
+            cand.q[k] = std::min(127, std::max(0, int((e[k] - p) * 0.5f + 0.5f)));
+            const float d = float((cand.q[k] << 1) | p) - e[k];
+            error += d * d;
+        }
+        if (error < bestError) { bestError = error; best = cand; }
+    }
+    return best;
+}
+
+struct Bc7Block {
+    Bc7Endpoint ep[2];
+    uint8_t indices[16];
+    float error;
+};
+
+Bc7Block QuantizeBc7Line(const Block& block, const Endpoints& line) {
+    static const float RGBA[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+    Bc7Block out;
+    out.ep[0] = QuantizeBc7(line.e[0]);
+    out.ep[1] = QuantizeBc7(line.e[1]);
+    float palette[16][4];
+    for (int s = 0; s < 16; ++s)
+        for (int k = 0; k < 4; ++k) {
+            const int e0 = (out.ep[0].q[k] << 1) | out.ep[0].p, e1 = (out.ep[1].q[k] << 1) | out.ep[1].p;
+            palette[s][k] = float(((64 - BC7_WEIGHTS[s]) * e0 + BC7_WEIGHTS[s] * e1 + 32) >> 6);
+        }
+    out.error = NearestIndices(block, palette, 16, RGBA, out.indices);
+    return out;
+}
+
+void PutBits(uint8_t* dst, int& at, uint32_t value, int count) {
+    for (int i = 0; i < count; ++i, ++at)
+        if (value >> i & 1) dst[at >> 3] |= uint8_t(1 << (at & 7));
+}
+
+void EncodeBc7(const Block& block, uint8_t* dst) {
+    static const float RGBA[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+    Endpoints line;
+    FitLine(block, RGBA, line);
+    Bc7Block best = QuantizeBc7Line(block, line);
+    float w[16];
+    for (int i = 0; i < 16; ++i) w[i] = BC7_WEIGHTS[best.indices[i]] / 64.0f;
+    if (Refit(block, w, line)) {
+        const Bc7Block refit = QuantizeBc7Line(block, line);
+        if (refit.error < best.error) best = refit;
+    }
+    //texel 0's index is stored without its top bit, so it has to be < 8
+    if (best.indices[0] >= 8) {
+        std::swap(best.ep[0], best.ep[1]);
+        for (uint8_t& i : best.indices) i = uint8_t(15 - i);
+    }
+    std::memset(dst, 0, 16);
+    int at = 0;
+    PutBits(dst, at, 1u << 6, 7); //mode 6
+    for (int k = 0; k < 4; ++k) {
+        PutBits(dst, at, uint32_t(best.ep[0].q[k]), 7);
+        PutBits(dst, at, uint32_t(best.ep[1].q[k]), 7);
+    }
+    PutBits(dst, at, uint32_t(best.ep[0].p), 1);
+    PutBits(dst, at, uint32_t(best.ep[1].p), 1);
+    for (int i = 0; i < 16; ++i) PutBits(dst, at, best.indices[i], i == 0 ? 3 : 4);
+}
+
+size_t BlockBytes(BlockCompress::Format format) { return format == BlockCompress::BC1 ? 8 : 16; }
+
+void DecodeColor(const uint8_t* src, bool threeColor, uint8_t out[16][4]) {
+    uint16_t c0, c1;
+    uint32_t bits;
+    std::memcpy(&c0, src, 2);
+    std::memcpy(&c1, src + 2, 2);
+    std::memcpy(&bits, src + 4, 4);
+    float p[4][4];
+    From565(c0, p[0]);
+    From565(c1, p[1]);
+    for (int k = 0; k < 4; ++k) {
+        if (c0 > c1 || !threeColor) {
+            p[2][k] = (2.0f * p[0][k] + p[1][k]) / 3.0f;
+            p[3][k] = (p[0][k] + 2.0f * p[1][k]) / 3.0f;
+        } else {
+            p[2][k] = (p[0][k] + p[1][k]) * 0.5f;
+            p[3][k] = 0.0f; //transparent black
+        }
+    }
+    for (int i = 0; i < 16; ++i)
+        for (int k = 0; k < 4; ++k) out[i][k] = uint8_t(p[bits >> (2 * i) & 3][k] + 0.5f);
+}
+
+void DecodeAlpha(const uint8_t* src, uint8_t out[16][4]) {
+    const int a0 = src[0], a1 = src[1];
+    int palette[8] = { a0, a1 };
+    for (int s = 1; s < 7; ++s)
+        palette[s + 1] = a0 > a1 ? ((7 - s) * a0 + s * a1) / 7 : s < 5 ? ((5 - s) * a0 + s * a1) / 5 : (s == 5 ? 0 : 255);
+    uint64_t bits = 0;
+    for (int b = 0; b < 6; ++b) bits |= uint64_t(src[2 + b]) << (8 * b);
+    for (int i = 0; i < 16; ++i) out[i][3] = uint8_t(palette[bits >> (3 * i) & 7]);
+}
+
+uint32_t GetBits(const uint8_t* src, int& at, int count) {
+    uint32_t v = 0;
+    for (int i = 0; i < count; ++i, ++at) v |= uint32_t(src[at >> 3] >> (at & 7) & 1) << i;
+    return v;
+}
+
+void DecodeBc7(const uint8_t* src, uint8_t out[16][4]) {
+    if ((src[0] & 0x7f) != 0x40) { //only mode 6 is ever written
+        for (int i = 0; i < 16; ++i) { out[i][0] = 255; out[i][1] = 0; out[i][2] = 255; out[i][3] = 255; }
+        return;
+    }
+    int at = 7, e[2][4];
+    for (int k = 0; k < 4; ++k) {
+        e[0][k] = int(GetBits(src, at, 7)) << 1;
+        e[1][k] = int(GetBits(src, at, 7)) << 1;
+    }
+    const int p0 = int(GetBits(src, at, 1)), p1 = int(GetBits(src, at, 1));
+    for (int k = 0; k < 4; ++k) { e[0][k] |= p0; e[1][k] |= p1; }
+    for (int i = 0; i < 16; ++i) {
+        const int w = BC7_WEIGHTS[GetBits(src, at, i == 0 ? 3 : 4)];
+        for (int k = 0; k < 4; ++k) out[i][k] = uint8_t(((64 - w) * e[0][k] + w * e[1][k] + 32) >> 6);
+    }
+}
+
+} //namespace
+
+namespace BlockCompress {
+
+size_t LevelBytes(Format format, int width, int height) {
+    if (format == RGBA8) return size_t(width) * height * 4;
+    return size_t((width + 3) / 4) * ((height + 3) / 4) * BlockBytes(format);
+}
+
+void Encode(Format format, const uint8_t* rgba, int width, int height, ThreadPool* pool, std::vector<uint8_t>& out) {
+    out.resize(LevelBytes(format, width, height));
+    if (format == RGBA8) {
+        std::memcpy(out.data(), rgba, out.size());
+        return;
+    }
+    const int blocksX = (width + 3) / 4, blocksY = (height + 3) / 4;
+    const size_t blockBytes = BlockBytes(format);
+    auto rows = [&](size_t begin, size_t end) {
+        Block block;
+        for (size_t by = begin; by < end; ++by)
+            for (int bx = 0; bx < blocksX; ++bx) {
+                LoadBlock(rgba, width, height, bx, int(by), block);
+                uint8_t* dst = &out[(by * blocksX + bx) * blockBytes];
+                if (format == BC1) EncodeColor(block, dst);
+                else if (format == BC3) { EncodeAlpha(block, dst); EncodeColor(block, dst + 8); }
+                else EncodeBc7(block, dst);
+            }
+    };
+    const size_t grain = std::max<size_t>(1, 256 / size_t(blocksX)); //about 256 blocks a chunk
+    if (pool && size_t(blocksY) > grain) pool->ParallelFor(size_t(blocksY), grain, rows);
+    else rows(0, size_t(blocksY));
+}
+
+void Decode(Format format, const uint8_t* blocks, int width, int height, std::vector<uint8_t>& rgba) {
+    rgba.resize(size_t(width) * height * 4);
+    if (format == RGBA8) {
+        std::memcpy(rgba.data(), blocks, rgba.size());
+        return;
+    }
+    const int blocksX = (width + 3) / 4, blocksY = (height + 3) / 4;
+    const size_t blockBytes = BlockBytes(format);
+    uint8_t texels[16][4];
+    for (int by = 0; by < blocksY; ++by)
+        for (int bx = 0; bx < blocksX; ++bx) {
+            const uint8_t* src = blocks + (size_t(by) * blocksX + bx) * blockBytes;
+            if (format == BC1) DecodeColor(src, true, texels);
+            else if (format == BC3) { DecodeColor(src + 8, false, texels); DecodeAlpha(src, texels); }
+            else DecodeBc7(src, texels);
+            for (int y = 0; y < 4 && by * 4 + y < height; ++y)
+                for (int x = 0; x < 4 && bx * 4 + x < width; ++x)
+                    std::memcpy(&rgba[(size_t(by * 4 + y) * width + bx * 4 + x) * 4], texels[y * 4 + x], 4);
+        }
+}
+
+const char* Name(Format format) {
+    switch (format) {
+    case BC1: return "BC1";
+    case BC3: return "BC3";
+    case BC7: return "BC7";
+    default: return "RGBA8";
+    }
+}
+
+} //namespace BlockCompress
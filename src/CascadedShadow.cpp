@@ -0,0 +1,115 @@
+#include "CascadedShadow.hpp"
+#include <glm/gtc/matrix_transform.hpp>
+#include <cmath>
+
+void CascadedShadow::init(int newSize) {
+    size = newSize;
+    if (!fbo) glGenFramebuffers(1, &fbo);
+    if (!tex) glGenTextures(1, &tex);
+
+    glBindTexture(GL_TEXTURE_2D_ARRAY, tex);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT24, size, size, NUM_CASCADES, 0,
+                 GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
+    //hardware 2x2 PCF through sampler2DArrayShadow
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, tex, 0, 0);
+    glDrawBuffer(GL_NONE);
+    glReadBuffer(GL_NONE);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    Invalidate();
+}
+
+void CascadedShadow::release() {
+    if (tex) glDeleteTextures(1, &tex);
+    if (fbo) glDeleteFramebuffers(1, &fbo);
+    tex = 0;
+    fbo = 0;
+    Invalidate();
+}
+
+void CascadedShadow::Invalidate() {
+    for (auto& c : cascades) c.valid = false;
+}
+
+size_t CascadedShadow::memoryBytes() const {
+    return tex ? size_t(size) * size * NUM_CASCADES * 4 : 0;
+}
+
+unsigned int CascadedShadow::Update(const glm::mat4& view, float fovY, float aspect, float nearP,
+                                    float shadowDistance, const glm::vec3& lightDir) {
+    const glm::mat4 invView = glm::inverse(view);
+    const glm::vec3 up = std::fabs(lightDir.y) > 0.9f ? glm::vec3(0, 0, 1) : glm::vec3(0, 1, 0);
+    const glm::mat4 lightRot = glm::lookAt(glm::vec3(0.0f), lightDir, up);
+    const float tanY = std::tan(fovY * 0.5f);
+
+    unsigned int renderMask = 0;
+    float splitNear = nearP;
+    for (int i = 0; i < NUM_CASCADES; ++i) {
+        //practical split scheme: blend of uniform and logarithmic
+        float k = float(i + 1) / NUM_CASCADES;
+        float logSplit = nearP * std::pow(shadowDistance / nearP, k);
+        float uniSplit = nearP + (shadowDistance - nearP) * k;
+        float splitFar = splitLambda * logSplit + (1.0f - splitLambda) * uniSplit;
+
+        //bounding sphere of the slice: its radius doesn't change when the camera turns
+        glm::vec3 corners[8];
+        int n = 0;
+        for (float d : { splitNear, splitFar }) {
+            float hh = d * tanY, hw = hh * aspect;
+            for (float sx : { -1.0f, 1.0f })
+                for (float sy : { -1.0f, 1.0f })
+                    corners[n++] = glm::vec3(invView * glm::vec4(sx * hw, sy * hh, -d, 1.0f));
+        }
+        glm::vec3 center(0.0f);
+        for (const auto& c : corners) center += c;
+        center /= 8.0f;
+        float radius = 0.0f;
+        for (const auto& c : corners) radius = std::max(radius, glm::length(c - center));
+        radius = std::ceil(radius * 16.0f) / 16.0f;
+
+        Cascade& cas = cascades[i];
+        cas.splitFar = splitFar;
+        glm::vec3 centerLS = glm::vec3(lightRot * glm::vec4(center, 1.0f));
+
+        //a far cascade stays as long as the slice still fits in the box it was rendered with
+        if (i > 0 && cas.valid) {
+            glm::vec3 d = glm::abs(centerLS - cas.centerLS);
+            if (d.x + radius <= cas.radius && d.y + radius <= cas.radius
+                    && d.z + radius <= cas.radius + depthExtra * 0.5f) {
+                splitNear = splitFar;
+                continue;
+            }
+        }
+
+        float r = (i == 0) ? radius : radius * padding;
+        float texel = 2.0f * r / size;
+        centerLS.x = std::floor(centerLS.x / texel) * texel;
+        centerLS.y = std::floor(centerLS.y / texel) * texel;
+
+        //light looks down -z in its own space
+        glm::mat4 P = glm::ortho(centerLS.x - r, centerLS.x + r, centerLS.y - r, centerLS.y + r,
+                                 -(centerLS.z + r + depthExtra), -(centerLS.z - r - depthExtra));
+        cas.viewProj = P * lightRot;
+        cas.centerLS = centerLS;
+        cas.radius = r;
+        cas.texelWorld = texel;
+        cas.valid = true;
+        renderMask |= 1u << i;
+        splitNear = splitFar;
+    }
+    return renderMask;
+}
+
+void CascadedShadow::BeginCascade(int i) const {
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, tex, 0, i);
+    glViewport(0, 0, size, size);
+    glClear(GL_DEPTH_BUFFER_BIT);
+}
@@ -0,0 +1,39 @@
+#include "Frustum.hpp"
+
+Frustum Frustum::FromMatrix(const glm::mat4& m) {
+    //Gribb/Hartmann: rows of the matrix combined
+    glm::vec4 row0(m[0][0], m[1][0], m[2][0], m[3][0]);
+    glm::vec4 row1(m[0][1], m[1][1], m[2][1], m[3][1]);
+    glm::vec4 row2(m[0][2], m[1][2], m[2][2], m[3][2]);
+    glm::vec4 row3(m[0][3], m[1][3], m[2][3], m[3][3]);
+
+    Frustum f;
+    f.planes[0] = row3 + row0; //left
+    f.planes[1] = row3 - row0; //right
+    f.planes[2] = row3 + row1; //bottom
+    f.planes[3] = row3 - row1; //top
+    f.planes[4] = row3 + row2; //near
+    f.planes[5] = row3 - row2; //far
+    for (auto& p : f.planes) {
+        float len = glm::length(glm::vec3(p));
+        p = p / len;
+    }
+    return f;
+}
+
+bool Frustum::SphereVisible(const glm::vec3& c, float r) const {
+    for (const auto& p : planes)
+        if (glm::dot(glm::vec3(p), c) + p.w < -r) return false;
+    return true;
+}
+
+bool Frustum::BoxVisible(const glm::vec3& bmin, const glm::vec3& bmax) const {
+    for (const auto& p : planes) {
+        //corner furthest along the plane normal
+        glm::vec3 v(p.x >= 0.0f ? bmax.x : bmin.x,
+                    p.y >= 0.0f ? bmax.y : bmin.y,
+                    p.z >= 0.0f ? bmax.z : bmin.z);
+        if (glm::dot(glm::vec3(p), v) + p.w < 0.0f) return false;
+    }
+    return true;
+}
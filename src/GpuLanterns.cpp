@@ -0,0 +1,92 @@
+#include "GpuLanterns.hpp"
+#include <algorithm>
+
+void GpuLanterns::init() {
+    const GLsizeiptr bytes = GLsizeiptr(CAPACITY) * RECORD_TEXELS * sizeof(glm::vec4);
+    const GLsizei stride = RECORD_TEXELS * sizeof(glm::vec4);
+    std::vector<glm::vec4> zeros(size_t(CAPACITY) * RECORD_TEXELS, glm::vec4(0.0f)); //all slots free
+
+    glGenBuffers(2, vbo);
+    glGenVertexArrays(2, vao);
+    glGenTextures(2, stateTex);
+    for (int i = 0; i < 2; ++i) {
+        glBindVertexArray(vao[i]);
+        glBindBuffer(GL_ARRAY_BUFFER, vbo[i]);
+        glBufferData(GL_ARRAY_BUFFER, bytes, zeros.data(), GL_DYNAMIC_COPY);
+        for (int a = 0; a < RECORD_TEXELS; ++a) {
+            glEnableVertexAttribArray(a);
+            glVertexAttribPointer(a, 4, GL_FLOAT, GL_FALSE, stride, (void*)(a * sizeof(glm::vec4)));
+        }
+        glBindTexture(GL_TEXTURE_BUFFER, stateTex[i]);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, vbo[i]);
+    }
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+
+    sim.reset(new Shader("shaders/lantern_sim.vert", {"PosAlive", "VelAge", "Misc"}));
+}
+
+void GpuLanterns::flushSpawns() {
+    if (pending.empty()) return;
+    //more than a ring's worth in one go: only the newest survive anyway
+    if ((int)pending.size() > CAPACITY)
+        pending.erase(pending.begin(), pending.end() - CAPACITY);
+
+    staging.clear();
+    for (const auto& L : pending) {
+        staging.push_back(glm::vec4(L.pos, 1.0f));
+        staging.push_back(glm::vec4(L.vel, L.t));
+        staging.push_back(glm::vec4(L.phase, 0.0f, 0.0f, 0.0f));
+    }
+
+    //one write, or two when the batch wraps around the end of the ring
+    const size_t recordBytes = RECORD_TEXELS * sizeof(glm::vec4);
+    const int n = (int)pending.size();
+    const int first = std::min(n, CAPACITY - head);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo[current]);
+    glBufferSubData(GL_ARRAY_BUFFER, head * recordBytes, first * recordBytes, staging.data());
+    if (first < n)
+        glBufferSubData(GL_ARRAY_BUFFER, 0, (n - first) * recordBytes, staging.data() + first * RECORD_TEXELS);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    used = std::min(CAPACITY, std::max(used, head + n));
+    head = (head + n) % CAPACITY;
+    pending.clear();
+}
+
+void GpuLanterns::Step(float dt, const glm::vec3& boatPos) {
+    flushSpawns();
+    if (used == 0) return;
+
+    sim->use();
+    sim->setFloat("dt", dt);
+    sim->setVec3("boatPos", boatPos);
+    sim->setFloat("maxAge", maxAge);
+    sim->setFloat("maxHeight", maxHeight);
+    sim->setFloat("maxDistance", maxDistance);
+
+    const int next = 1 - current;
+    glEnable(GL_RASTERIZER_DISCARD);
+    glBindVertexArray(vao[current]);
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, vbo[next]);
+    glBeginTransformFeedback(GL_POINTS);
+    glDrawArrays(GL_POINTS, 0, used);
+    glEndTransformFeedback();
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+    glBindVertexArray(0);
+    glDisable(GL_RASTERIZER_DISCARD);
+
+    //slots past `used` were never written and are still zero (free) in both buffers
+    current = next;
+}
+
+void GpuLanterns::DrawMeshes(Shader& lit, const Model& lanternModel) const {
+    if (used == 0) return;
+    lit.use();
+    lit.setBool("instanced", true);
+    lit.setFloat("instanceScale", scale); //w is 1 for live lanterns, 0 collapses free slots
+    lanternModel.SetInstanceBuffer(vbo[current], RECORD_TEXELS * sizeof(glm::vec4));
+    lanternModel.DrawInstanced(used);
+    lit.setBool("instanced", false);
+}
@@ -0,0 +1,134 @@
+#include "ImageFilter.hpp"
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define FILTER_SSE 1
+#endif
+
+namespace {
+
+struct Tables {
+    float toLinear[256];
+    uint8_t toSrgb[4096]; //linear [0, 1] in 4096 steps
+    Tables() {
+        for (int i = 0; i < 256; ++i) {
+            const float c = i / 255.0f;
+            toLinear[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+        }
+        for (int i = 0; i < 4096; ++i) {
+            const float l = i / 4095.0f;
+            const float c = l <= 0.0031308f ? l * 12.92f : 1.055f * std::pow(l, 1.0f / 2.4f) - 0.055f;
+            toSrgb[i] = uint8_t(std::min(255.0f, c * 255.0f + 0.5f));
+        }
+    }
+};
+
+const Tables& Lut() {
+    static const Tables tables;
+    return tables;
+}
+
+float Mitchell(float x) {
+    const float B = 1.0f / 3.0f, C = 1.0f / 3.0f;
+    x = std::fabs(x);
+    if (x < 1.0f)
+        return ((12 - 9 * B - 6 * C) * x * x * x + (-18 + 12 * B + 6 * C) * x * x + (6 - 2 * B)) / 6.0f;
+    if (x < 2.0f)
+        return ((-B - 6 * C) * x * x * x + (6 * B + 30 * C) * x * x + (-12 * B - 48 * C) * x + (8 * B + 24 * C)) / 6.0f;
+    return 0.0f;
+}
+
+//source texels and normalised weights for every destination texel along one axis
+struct Taps {
+    std::vector<int> first, count;
+    std::vector<size_t> offset;
+    std::vector<float> weights;
+};
+
+Taps BuildTaps(int src, int dst) {
+    Taps taps;
+    taps.first.resize(dst);
+    taps.count.resize(dst);
+    taps.offset.resize(dst);
+    const float scale = float(src) / float(dst);
+    for (int d = 0; d < dst; ++d) {
+        taps.offset[d] = taps.weights.size();
+        if (src == dst) { //untouched axis, no blur
+            taps.first[d] = d;
+            taps.count[d] = 1;
+            taps.weights.push_back(1.0f);
+            continue;
+        }
+        const float center = (d + 0.5f) * scale;
+        const int lo = std::max(0, int(std::floor(center - 2.0f * scale))), hi = std::min(src - 1, int(std::ceil(center + 2.0f * scale)));
+        float sum = 0.0f;
+        for (int s = lo; s <= hi; ++s) {
+            const float w = Mitchell((s + 0.5f - center) / scale);
+            taps.weights.push_back(w);
+            sum += w;
+        }
+        for (size_t i = taps.offset[d]; i < taps.weights.size(); ++i) taps.weights[i] /= sum;
+        taps.first[d] = lo;
+        taps.count[d] = hi - lo + 1;
+    }
+    return taps;
+}
+
+//out (4 floats) = sum of weights[i] * texels[4 * i]
+inline void Filter(const float* texels, size_t stride, const float* weights, int count, float* out) {
+#ifdef FILTER_SSE
+    __m128 acc = _mm_setzero_ps();
+    for (int i = 0; i < count; ++i)
+        acc = _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(weights[i]), _mm_loadu_ps(texels + i * stride)));
+    _mm_storeu_ps(out, acc);
+#else
+    out[0] = out[1] = out[2] = out[3] = 0.0f;
+    for (int i = 0; i < count; ++i)
+        for (int k = 0; k < 4; ++k) out[k] += weights[i] * texels[i * stride + k];
+#endif
+}
+
+} //namespace
+
+namespace ImageFilter {
+
+void Downsample(const uint8_t* rgba, int width, int height, int dstWidth, int dstHeight, std::vector<uint8_t>& out) {
+    const Tables& lut = Lut();
+    const Taps across = BuildTaps(width, dstWidth), down = BuildTaps(height, dstHeight);
+
+    //horizontal pass, one source row at a time, into premultiplied linear floats
+    std::vector<float> row(size_t(width) * 4), mid(size_t(dstWidth) * height * 4);
+    for (int y = 0; y < height; ++y) {
+        const uint8_t* src = rgba + size_t(y) * width * 4;
+        for (int x = 0; x < width; ++x) {
+            const float a = src[4 * x + 3] / 255.0f;
+            for (int k = 0; k < 3; ++k) row[4 * x + k] = lut.toLinear[src[4 * x + k]] * a;
+            row[4 * x + 3] = a;
+        }
+        float* dst = &mid[size_t(y) * dstWidth * 4];
+        for (int x = 0; x < dstWidth; ++x)
+            Filter(&row[size_t(across.first[x]) * 4], 4, &across.weights[across.offset[x]], across.count[x], dst + 4 * x);
+    }
+
+    //vertical pass, then un-premultiply and back to sRGB bytes
+    out.resize(size_t(dstWidth) * dstHeight * 4);
+    const size_t stride = size_t(dstWidth) * 4;
+    for (int y = 0; y < dstHeight; ++y) {
+        const float* column = &mid[size_t(down.first[y]) * stride];
+        uint8_t* dst = &out[size_t(y) * stride];
+        for (int x = 0; x < dstWidth; ++x) {
+            float texel[4];
+            Filter(column + 4 * x, stride, &down.weights[down.offset[y]], down.count[y], texel);
+            const float a = std::min(1.0f, std::max(0.0f, texel[3]));
+            for (int k = 0; k < 3; ++k) {
+                const float l = a > 0.0f ? std::min(1.0f, std::max(0.0f, texel[k] / a)) : 0.0f;
+                dst[4 * x + k] = lut.toSrgb[int(l * 4095.0f + 0.5f)];
+            }
+            dst[4 * x + 3] = uint8_t(a * 255.0f + 0.5f);
+        }
+    }
+}
+
+} //namespace ImageFilter
@@ -0,0 +1,205 @@
+#include "IrradianceVolume.hpp"
+#include "ThreadPool.hpp"
+#include <algorithm>
+#include <cmath>
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define IRRADIANCE_SSE 1
+#endif
+
+namespace {
+
+const int CELLS = IrradianceVolume::NX * IrradianceVolume::NY * IrradianceVolume::NZ;
+
+int Index(int x, int y, int z) {
+    return (z * IrradianceVolume::NY + y) * IrradianceVolume::NX + x;
+}
+
+} //namespace
+
+void IrradianceVolume::init() {
+    l0.assign(CELLS, 0.0f);
+    l1x.assign(CELLS, 0.0f);
+    l1y.assign(CELLS, 0.0f);
+    l1z.assign(CELLS, 0.0f);
+    upload.assign(CELLS, glm::vec4(0.0f));
+
+    glGenTextures(1, &tex);
+    glBindTexture(GL_TEXTURE_3D, tex);
+    glTexImage3D(GL_TEXTURE_3D, 0, GL_RGBA16F, NX, NY, NZ, 0, GL_RGBA, GL_FLOAT, upload.data());
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_3D, 0);
+}
+
+void IrradianceVolume::clear() {
+    std::fill(l0.begin(), l0.end(), 0.0f);
+    std::fill(l1x.begin(), l1x.end(), 0.0f);
+    std::fill(l1y.begin(), l1y.end(), 0.0f);
+    std::fill(l1z.begin(), l1z.end(), 0.0f);
+    splatted.clear();
+    updatesSinceRebuild = 0;
+}
+
+void IrradianceVolume::Update(const std::vector<Lantern>& lanterns, const glm::vec3& focus,
+                              ThreadPool& pool) {
+    if (!enabled || !tex) return;
+
+    //the volume moves in steps of 8 cells; a move means splatting everything again
+    const glm::vec3 size = glm::vec3(NX, NY, NZ) * cellSize;
+    const float snap = cellSize * 8.0f;
+    glm::vec3 want = glm::floor((focus - 0.5f * size) / snap) * snap;
+    want.y = -2.0f * cellSize; //a little below the water up to where lanterns despawn
+    bool full = !originValid || want != origin || updatesSinceRebuild >= rebuildAfterUpdates;
+    if (full) {
+        origin = want;
+        originValid = true;
+        clear();
+    }
+
+    ops.clear();
+    ++stamp;
+    const float move2 = (moveThreshold * cellSize) * (moveThreshold * cellSize);
+    for (const auto& L : lanterns) {
+        auto it = splatted.find(L.id);
+        if (it == splatted.end()) {
+            splatted[L.id] = {L.pos, stamp};
+            ops.push_back({L.pos, 1.0f});
+            continue;
+        }
+        it->second.stamp = stamp;
+        glm::vec3 d = L.pos - it->second.pos;
+        if (glm::dot(d, d) < move2) continue;
+        ops.push_back({it->second.pos, -1.0f});
+        ops.push_back({L.pos, 1.0f});
+        it->second.pos = L.pos;
+    }
+    for (auto it = splatted.begin(); it != splatted.end();) {
+        if (it->second.stamp != stamp) { //despawned
+            ops.push_back({it->second.pos, -1.0f});
+            it = splatted.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    if (ops.empty() && !full) return;
+
+    int zMin = NZ, zMax = -1;
+    splat(pool, zMin, zMax);
+    if (full) { zMin = 0; zMax = NZ - 1; }
+    uploadSlices(zMin, zMax);
+    ++updatesSinceRebuild;
+}
+
+void IrradianceVolume::splat(ThreadPool& pool, int& zMin, int& zMax) {
+    const float R = splatRadius, R2 = R * R;
+    const float cs = cellSize;
+
+    //dirty z range of all ops, clipped to the grid
+    for (const auto& op : ops) {
+        int z0 = (int)std::floor((op.pos.z - R - origin.z) / cs);
+        int z1 = (int)std::floor((op.pos.z + R - origin.z) / cs);
+        zMin = std::min(zMin, std::max(z0, 0));
+        zMax = std::max(zMax, std::min(z1, NZ - 1));
+    }
+    if (zMin > zMax) return;
+
+    //every task owns whole z slices, so no two threads ever write the same cell
+    pool.ParallelFor(NZ, 2, [&](size_t zb, size_t ze) {
+        for (const auto& op : ops) {
+            const glm::vec3 p = op.pos - origin; //grid space, cell i is centred at (i + 0.5) * cs
+            const float k = op.sign * strength;
+            int z0 = std::max((int)std::floor((p.z - R) / cs), (int)zb);
+            int z1 = std::min((int)std::floor((p.z + R) / cs), (int)ze - 1);
+            int y0 = std::max((int)std::floor((p.y - R) / cs), 0);
+            int y1 = std::min((int)std::floor((p.y + R) / cs), NY - 1);
+            for (int z = z0; z <= z1; ++z) {
+                const float dz = (z + 0.5f) * cs - p.z;
+                for (int y = y0; y <= y1; ++y) {
+                    const float dy = (y + 0.5f) * cs - p.y;
+                    const float dyz2 = dy * dy + dz * dz;
+                    if (dyz2 >= R2) continue;
+                    const float half = std::sqrt(R2 - dyz2);
+                    int x0 = std::max((int)std::floor((p.x - half) / cs), 0);
+                    int x1 = std::min((int)std::floor((p.x + half) / cs), NX - 1);
+                    if (x0 > x1) continue;
+                    const int row = Index(0, y, z);
+#ifdef IRRADIANCE_SSE
+                    x0 &= ~3; //NX is a multiple of 4, so whole groups stay in the row
+                    const __m128 vDyz2 = _mm_set1_ps(dyz2), vDy = _mm_set1_ps(dy), vDz = _mm_set1_ps(dz);
+                    const __m128 vC = _mm_set1_ps(LANTERN_ATTEN_CONSTANT);
+                    const __m128 vL = _mm_set1_ps(LANTERN_ATTEN_LINEAR);
+                    const __m128 vQ = _mm_set1_ps(LANTERN_ATTEN_QUADRATIC);
+                    const __m128 vInvR2 = _mm_set1_ps(1.0f / R2), vOne = _mm_set1_ps(1.0f);
+                    const __m128 vK = _mm_set1_ps(k), vZero = _mm_setzero_ps(), vEps = _mm_set1_ps(1e-4f);
+                    const __m128 vStep = _mm_set1_ps(4.0f * cs);
+                    __m128 vDx = _mm_sub_ps(_mm_mul_ps(_mm_add_ps(_mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f),
+                                                                  _mm_set1_ps((float)x0)),
+                                                       _mm_set1_ps(cs)),
+                                            _mm_set1_ps(p.x));
+                    for (int x = x0; x <= x1; x += 4, vDx = _mm_add_ps(vDx, vStep)) {
+                        __m128 d2 = _mm_add_ps(_mm_mul_ps(vDx, vDx), vDyz2);
+                        __m128 d = _mm_sqrt_ps(d2);
+                        //attenuation, faded to zero at the splat radius so moves don't pop
+                        __m128 att = _mm_div_ps(vK, _mm_add_ps(vC, _mm_add_ps(_mm_mul_ps(vL, d),
+                                                                              _mm_mul_ps(vQ, d2))));
+                        __m128 fade = _mm_max_ps(_mm_sub_ps(vOne, _mm_mul_ps(d2, vInvR2)), vZero);
+                        att = _mm_mul_ps(att, _mm_mul_ps(fade, fade));
+                        //unit vector from the cell towards the lantern is -(dx, dy, dz) / d
+                        __m128 s = _mm_div_ps(att, _mm_max_ps(d, vEps));
+                        float* c0 = &l0[row + x];
+                        float* cx = &l1x[row + x];
+                        float* cy = &l1y[row + x];
+                        float* cz = &l1z[row + x];
+                        _mm_storeu_ps(c0, _mm_add_ps(_mm_loadu_ps(c0), att));
+                        _mm_storeu_ps(cx, _mm_sub_ps(_mm_loadu_ps(cx), _mm_mul_ps(s, vDx)));
+                        _mm_storeu_ps(cy, _mm_sub_ps(_mm_loadu_ps(cy), _mm_mul_ps(s, vDy)));
+                        _mm_storeu_ps(cz, _mm_sub_ps(_mm_loadu_ps(cz), _mm_mul_ps(s, vDz)));
+                    }
+#else
+                    for (int x = x0; x <= x1; ++x) {
+                        const float dx = (x + 0.5f) * cs - p.x;
+                        const float d2 = dx * dx + dyz2;
+                        const float d = std::sqrt(d2);
+                        float fade = std::max(1.0f - d2 / R2, 0.0f);
+                        float att = k * fade * fade / (LANTERN_ATTEN_CONSTANT + LANTERN_ATTEN_LINEAR * d
+                                                       + LANTERN_ATTEN_QUADRATIC * d2);
+                        float s = att / std::max(d, 1e-4f);
+                        l0[row + x] += att;
+                        l1x[row + x] -= s * dx;
+                        l1y[row + x] -= s * dy;
+                        l1z[row + x] -= s * dz;
+                    }
+#endif
+                }
+            }
+        }
+    });
+}
+
+void IrradianceVolume::uploadSlices(int zMin, int zMax) {
+    if (zMin > zMax) return;
+    const int first = Index(0, 0, zMin), last = Index(0, 0, zMax + 1);
+    for (int i = first; i < last; ++i) upload[i] = glm::vec4(l1x[i], l1y[i], l1z[i], l0[i]);
+    glBindTexture(GL_TEXTURE_3D, tex);
+    glTexSubImage3D(GL_TEXTURE_3D, 0, 0, 0, zMin, NX, NY, zMax - zMin + 1,
+                    GL_RGBA, GL_FLOAT, upload.data() + first);
+    glBindTexture(GL_TEXTURE_3D, 0);
+}
+
+void IrradianceVolume::Bind(Shader& lit, int unit) const {
+    glActiveTexture(GL_TEXTURE0 + unit);
+    glBindTexture(GL_TEXTURE_3D, tex);
+    lit.setInt("irradianceVolume", unit);
+    lit.setBool("useIrradianceVolume", enabled && originValid);
+    lit.setVec3("volumeOrigin", origin);
+    lit.setVec3("volumeInvSize", 1.0f / (glm::vec3(NX, NY, NZ) * cellSize));
+}
+
+size_t IrradianceVolume::memoryBytes() const {
+    //RGBA16F on the GPU, four float channels plus the upload staging on the CPU
+    return size_t(CELLS) * (8 + 4 * sizeof(float) + sizeof(glm::vec4));
+}
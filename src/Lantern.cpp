@@ -0,0 +1,10 @@
+#include "Lantern.hpp"
+#include <cmath>
+
+float LanternInfluenceRadius(float threshold) {
+    //solve q*d^2 + l*d + (c - 1/threshold) = 0 for the positive root
+    float a = LANTERN_ATTEN_QUADRATIC;
+    float b = LANTERN_ATTEN_LINEAR;
+    float c = LANTERN_ATTEN_CONSTANT - 1.0f / threshold;
+    return (-b + std::sqrt(b * b - 4.0f * a * c)) / (2.0f * a);
+}
@@ -0,0 +1,188 @@
+#include "LanternLOD.hpp"
+#include "Frustum.hpp"
+#include "ThreadPool.hpp"
+#include <glm/gtc/matrix_transform.hpp>
+#include <algorithm>
+#include <mutex>
+
+namespace {
+const int IMPOSTOR_W = 64, IMPOSTOR_H = 128;
+}
+
+void LanternLOD::init(Model& lanternModel, GLuint lanternTex) {
+    glGenBuffers(LOD_COUNT, instanceBuf);
+    for (GLuint buf : instanceBuf) {
+        glBindBuffer(GL_ARRAY_BUFFER, buf);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec4), nullptr, GL_STREAM_DRAW);
+    }
+
+    //mesh LOD: the model's own VAOs with the instance stream on attribute 5
+    lanternModel.SetInstanceBuffer(instanceBuf[LOD_MESH]);
+
+    //impostor: one quad, instanced
+    const float corners[8] = { -0.5f, 0.0f,  0.5f, 0.0f,  -0.5f, 1.0f,  0.5f, 1.0f };
+    glGenVertexArrays(1, &quadVAO);
+    glGenBuffers(1, &quadVBO);
+    glBindVertexArray(quadVAO);
+    glBindBuffer(GL_ARRAY_BUFFER, quadVBO);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void*)0);
+    glBindBuffer(GL_ARRAY_BUFFER, instanceBuf[LOD_IMPOSTOR]);
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(glm::vec4), (void*)0);
+    glVertexAttribDivisor(1, 1);
+
+    //sprite: one point per instance record
+    glGenVertexArrays(1, &spriteVAO);
+    glBindVertexArray(spriteVAO);
+    glBindBuffer(GL_ARRAY_BUFFER, instanceBuf[LOD_SPRITE]);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(glm::vec4), (void*)0);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    impostorShader.reset(new Shader("shaders/lantern_impostor.vert", "shaders/lantern_impostor.frag"));
+    spriteShader.reset(new Shader("shaders/lantern_sprite.vert", "shaders/lantern_sprite.frag"));
+
+    lanternModel.Bounds(boundsMin, boundsMax);
+    bakeImpostor(lanternModel, lanternTex);
+}
+
+void LanternLOD::bakeImpostor(Model& lanternModel, GLuint lanternTex) {
+    //orthographic side view (from +Z) of the whole model, square pixels not needed
+    glm::vec3 c = 0.5f * (boundsMin + boundsMax);
+    glm::vec3 e = boundsMax - boundsMin;
+    float halfW = 0.5f * std::max(e.x, e.z);
+    impostorSize = glm::vec2(2.0f * halfW, e.y);
+    impostorOffset = glm::vec3(c.x, boundsMin.y, c.z);
+    glm::mat4 viewProj = glm::ortho(-halfW, halfW, 0.0f, e.y, 0.0f, 2.0f * halfW + e.z)
+        * glm::lookAt(glm::vec3(c.x, boundsMin.y, boundsMax.z + halfW),
+                      glm::vec3(c.x, boundsMin.y, c.z), glm::vec3(0, 1, 0));
+
+    glGenTextures(1, &impostorTex);
+    glBindTexture(GL_TEXTURE_2D, impostorTex);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_SRGB8_ALPHA8, IMPOSTOR_W, IMPOSTOR_H, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    GLuint fbo = 0, depth = 0;
+    glGenFramebuffers(1, &fbo);
+    glGenRenderbuffers(1, &depth);
+    glBindRenderbuffer(GL_RENDERBUFFER, depth);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, IMPOSTOR_W, IMPOSTOR_H);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, impostorTex, 0);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth);
+
+    glViewport(0, 0, IMPOSTOR_W, IMPOSTOR_H);
+    glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    Shader bake("shaders/impostor_bake.vert", "shaders/impostor_bake.frag");
+    bake.use();
+    bake.setMat4("viewProj", viewProj);
+    bake.setInt("diffuseTex", 0);
+    bake.setVec3("glow", glow);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, lanternTex);
+    lanternModel.Draw(bake);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glDeleteFramebuffers(1, &fbo);
+    glDeleteRenderbuffers(1, &depth);
+    glDeleteProgram(bake.ID);
+
+    glBindTexture(GL_TEXTURE_2D, impostorTex);
+    glGenerateMipmap(GL_TEXTURE_2D);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void LanternLOD::Classify(const std::vector<Lantern>& lanterns, const glm::mat4& view,
+                          const glm::mat4& proj, int viewportHeight, ThreadPool& pool) {
+    for (auto& b : batch) b.clear();
+
+    const Frustum frustum = Frustum::FromMatrix(proj * view);
+    const glm::vec3 e = (boundsMax - boundsMin) * scale;
+    const float height = e.y;
+    const float radius = 0.5f * glm::length(e);
+    const glm::vec3 centerOffset = 0.5f * (boundsMin + boundsMax) * scale;
+    //pixels = height / view depth * pixelScale
+    const float pixelScale = 0.5f * viewportHeight * proj[1][1];
+    const float meshDepth = height * pixelScale / meshPixels;
+    const float impostorDepth = height * pixelScale / impostorPixels;
+
+    std::mutex m;
+    pool.ParallelFor(lanterns.size(), 4096, [&](size_t b, size_t end) {
+        std::vector<glm::vec4> local[LOD_COUNT];
+        for (size_t i = b; i < end; ++i) {
+            const glm::vec3& p = lanterns[i].pos;
+            if (!frustum.SphereVisible(p + centerOffset, radius)) continue;
+            float depth = -(view * glm::vec4(p, 1.0f)).z;
+            int level = depth < meshDepth ? LOD_MESH : depth < impostorDepth ? LOD_IMPOSTOR : LOD_SPRITE;
+            local[level].push_back(glm::vec4(p, scale));
+        }
+        std::lock_guard<std::mutex> lock(m);
+        for (int l = 0; l < LOD_COUNT; ++l)
+            batch[l].insert(batch[l].end(), local[l].begin(), local[l].end());
+    });
+
+    for (int l = 0; l < LOD_COUNT; ++l) {
+        glBindBuffer(GL_ARRAY_BUFFER, instanceBuf[l]);
+        //orphan, last frame's batch may still be in flight
+        glBufferData(GL_ARRAY_BUFFER, std::max<size_t>(batch[l].size(), 1) * sizeof(glm::vec4), nullptr, GL_STREAM_DRAW);
+        if (!batch[l].empty())
+            glBufferSubData(GL_ARRAY_BUFFER, 0, batch[l].size() * sizeof(glm::vec4), batch[l].data());
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void LanternLOD::DrawMeshes(Shader& lit, const Model& lanternModel) const {
+    if (batch[LOD_MESH].empty()) return;
+    lit.use();
+    lit.setBool("instanced", true);
+    lit.setFloat("instanceScale", 1.0f);
+    lanternModel.SetInstanceBuffer(instanceBuf[LOD_MESH]); //the GPU lantern path rebinds it
+    lanternModel.DrawInstanced(Count(LOD_MESH));
+    lit.setBool("instanced", false);
+}
+
+void LanternLOD::DrawImpostors(const glm::mat4& view, const glm::mat4& proj, const glm::vec3& eye) const {
+    if (batch[LOD_IMPOSTOR].empty()) return;
+    impostorShader->use();
+    impostorShader->setMat4("view", view);
+    impostorShader->setMat4("projection", proj);
+    impostorShader->setVec3("viewPos", eye);
+    impostorShader->setVec3("impostorOffset", impostorOffset);
+    impostorShader->setFloat("impostorWidth", impostorSize.x);
+    impostorShader->setFloat("impostorHeight", impostorSize.y);
+    impostorShader->setInt("impostorTex", 0);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, impostorTex);
+    glBindVertexArray(quadVAO);
+    glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, Count(LOD_IMPOSTOR));
+    glBindVertexArray(0);
+}
+
+void LanternLOD::DrawSprites(const glm::mat4& view, const glm::mat4& proj, int viewportHeight) const {
+    if (batch[LOD_SPRITE].empty()) return;
+    spriteShader->use();
+    spriteShader->setMat4("view", view);
+    spriteShader->setMat4("projection", proj);
+    spriteShader->setFloat("pixelScale", 0.5f * viewportHeight * proj[1][1]);
+    spriteShader->setFloat("modelHeight", boundsMax.y - boundsMin.y);
+    spriteShader->setVec3("glow", glow);
+
+    glEnable(GL_PROGRAM_POINT_SIZE);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_ONE, GL_ONE);
+    glDepthMask(GL_FALSE);
+    glBindVertexArray(spriteVAO);
+    glDrawArrays(GL_POINTS, 0, Count(LOD_SPRITE));
+    glBindVertexArray(0);
+    glDepthMask(GL_TRUE);
+    glDisable(GL_BLEND);
+    glDisable(GL_PROGRAM_POINT_SIZE);
+}
@@ -0,0 +1,135 @@
+#include "LanternPool.hpp"
+#include "Philox.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+
+namespace {
+
+uint32_t SlotIndex(LanternPool::Handle h) { return h & 0xFFFFu; }
+uint16_t Generation(LanternPool::Handle h) { return uint16_t(h >> 16); }
+
+} //namespace
+
+LanternPool::LanternPool(int capacity) {
+    capacity = std::max(1, std::min(capacity, MAX_CAPACITY));
+    live.reserve(capacity);
+    slots.resize(capacity);
+    Clear();
+}
+
+void LanternPool::Clear() {
+    live.clear();
+    //chain every slot into the free list, lowest index first
+    for (size_t i = 0; i < slots.size(); ++i) {
+        slots[i].dense = i + 1 < slots.size() ? uint32_t(i + 1) : NO_SLOT;
+        if (slots[i].generation == 0) slots[i].generation = 1;
+    }
+    freeHead = 0;
+}
+
+LanternPool::Handle LanternPool::allocate(uint32_t denseIndex) {
+    const uint32_t s = freeHead;
+    freeHead = slots[s].dense;
+    slots[s].dense = denseIndex;
+    return (Handle(slots[s].generation) << 16) | s;
+}
+
+LanternPool::Handle LanternPool::Spawn(const Lantern& L) {
+    if (freeHead == NO_SLOT) return INVALID;
+    live.push_back(L);
+    live.back().id = allocate(uint32_t(live.size() - 1));
+    return live.back().id;
+}
+
+int LanternPool::SpawnBatch(int n, Lantern*& first) {
+    n = std::max(0, std::min(n, Capacity() - (int)live.size()));
+    const size_t base = live.size();
+    live.resize(base + n); //within the reserved capacity
+    for (int i = 0; i < n; ++i)
+        live[base + i].id = allocate(uint32_t(base + i));
+    first = live.data() + base;
+    return n;
+}
+
+const Lantern* LanternPool::Get(Handle h) const {
+    const uint32_t s = SlotIndex(h);
+    if (h == INVALID || s >= slots.size() || slots[s].generation != Generation(h)) return nullptr;
+    return &live[slots[s].dense];
+}
+
+Lantern* LanternPool::Get(Handle h) {
+    return const_cast<Lantern*>(static_cast<const LanternPool*>(this)->Get(h));
+}
+
+bool LanternPool::Despawn(Handle h) {
+    const Lantern* L = Get(h);
+    if (!L) return false;
+    removeAt(size_t(L - live.data()));
+    return true;
+}
+
+void LanternPool::removeAt(size_t i) {
+    const uint32_t s = SlotIndex(live[i].id);
+    if (i + 1 != live.size()) {
+        live[i] = live.back();
+        slots[SlotIndex(live[i].id)].dense = uint32_t(i);
+    }
+    live.pop_back();
+
+    //stale handles stop matching; skip 0 so no handle is ever INVALID
+    if (++slots[s].generation == 0) slots[s].generation = 1;
+    slots[s].dense = freeHead;
+    freeHead = s;
+}
+
+void RunPoolBenchmark() {
+    using Clock = std::chrono::steady_clock;
+    const int CAP = LanternPool::MAX_CAPACITY;
+    const int FRAMES = 2000, BURST = 1000;
+    LanternPool pool(CAP);
+    const Lantern* storage = pool.Live().data();
+    std::vector<float> ages(BURST);
+    std::vector<LanternPool::Handle> probes;
+    probes.reserve(FRAMES);
+
+    std::printf("\n== Lantern pool: %d frames, %d-lantern bursts, capacity %d ==\n", FRAMES, BURST, CAP);
+    size_t spawned = 0, expired = 0, staleHits = 0;
+    double spawnMs = 0.0, expireMs = 0.0;
+    for (int f = 0; f < FRAMES; ++f) {
+        auto t0 = Clock::now();
+        Lantern* batch = nullptr;
+        int n = pool.SpawnBatch(BURST, batch);
+        FillUniform(ages.data(), n, 0.0f, 40.0f, RandomKey{1u, 0u, uint32_t(f)});
+        for (int i = 0; i < n; ++i) {
+            batch[i].pos = glm::vec3(0.0f);
+            batch[i].vel = glm::vec3(0.0f);
+            batch[i].t = ages[i];
+            batch[i].phase = 0.0f;
+        }
+        spawned += n;
+        if (n) probes.push_back(batch[0].id);
+        auto t1 = Clock::now();
+
+        //age everything a frame's worth and drop the expired ones
+        size_t before = pool.Size();
+        for (auto& L : pool.Live()) L.t += 1.0f;
+        pool.RemoveIf([](const Lantern& L) { return L.t > 40.0f; });
+        expired += before - pool.Size();
+        auto t2 = Clock::now();
+
+        spawnMs += std::chrono::duration<double, std::milli>(t1 - t0).count();
+        expireMs += std::chrono::duration<double, std::milli>(t2 - t1).count();
+    }
+    //handles to lanterns that have since expired must not resolve to their slot's new owner
+    for (auto h : probes) {
+        const Lantern* L = pool.Get(h);
+        if (L && L->id != h) ++staleHits;
+    }
+
+    std::printf("spawned %zu, expired %zu, live %zu\n", spawned, expired, pool.Size());
+    std::printf("spawn   %.3f ms/frame (%.1f ns/lantern)\n", spawnMs / FRAMES, spawnMs * 1e6 / std::max<size_t>(spawned, 1));
+    std::printf("expire  %.3f ms/frame (%.1f ns/lantern)\n", expireMs / FRAMES, expireMs * 1e6 / std::max<size_t>(expired, 1));
+    std::printf("storage moved: %s, stale handles resolved: %zu\n",
+                pool.Live().data() == storage ? "no" : "YES", staleHits);
+}
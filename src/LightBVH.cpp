@@ -0,0 +1,367 @@
+#include "LightBVH.hpp"
+#include "BVHBuild.hpp"
+#include "ThreadPool.hpp"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <mutex>
+
+namespace {
+
+const int SAH_BINS = 12;
+const size_t PARALLEL_MIN = 8192; //below this one thread beats the hand-off
+
+struct Bounds {
+    glm::vec3 mn{FLT_MAX}, mx{-FLT_MAX};
+    void grow(const glm::vec3& p) { mn = glm::min(mn, p); mx = glm::max(mx, p); }
+    void grow(const Bounds& b) { mn = glm::min(mn, b.mn); mx = glm::max(mx, b.mx); }
+    float halfArea() const {
+        if (mn.x > mx.x) return 0.0f;
+        glm::vec3 e = mx - mn;
+        return e.x * e.y + e.y * e.z + e.z * e.x;
+    }
+};
+
+struct Bin {
+    Bounds b;
+    int count = 0;
+};
+
+Bounds RangeBounds(const std::vector<glm::vec3>& points, const std::vector<int>& prims,
+                   int begin, int end, ThreadPool* pool) {
+    Bounds total;
+    std::mutex m;
+    BVHBuild::Range(pool, end - begin, PARALLEL_MIN, [&](size_t b, size_t e) {
+        Bounds local;
+        for (size_t i = b; i < e; ++i) local.grow(points[prims[begin + i]]);
+        std::lock_guard<std::mutex> lock(m);
+        total.grow(local);
+    });
+    return total;
+}
+
+int BinOf(float v, float lo, float scale) {
+    int b = (int)((v - lo) * scale);
+    return std::min(std::max(b, 0), SAH_BINS - 1);
+}
+
+//binned SAH over [begin, end). Partitions prims in place and returns the middle,
+//or -1 when the range should stay a leaf.
+int SplitRange(const std::vector<glm::vec3>& points, std::vector<int>& prims,
+               int begin, int end, const Bounds& bounds, int leafSize, ThreadPool* pool) {
+    const int count = end - begin;
+    if (count <= leafSize) return -1;
+
+    const glm::vec3 extent = bounds.mx - bounds.mn;
+    Bin bins[3][SAH_BINS];
+    std::mutex m;
+    BVHBuild::Range(pool, count, PARALLEL_MIN, [&](size_t b, size_t e) {
+        Bin local[3][SAH_BINS];
+        for (size_t i = b; i < e; ++i) {
+            const glm::vec3& p = points[prims[begin + i]];
+            for (int a = 0; a < 3; ++a) {
+                if (extent[a] <= 0.0f) continue;
+                Bin& bin = local[a][BinOf(p[a], bounds.mn[a], SAH_BINS / extent[a])];
+                bin.b.grow(p);
+                bin.count++;
+            }
+        }
+        std::lock_guard<std::mutex> lock(m);
+        for (int a = 0; a < 3; ++a)
+            for (int k = 0; k < SAH_BINS; ++k) {
+                bins[a][k].b.grow(local[a][k].b);
+                bins[a][k].count += local[a][k].count;
+            }
+    });
+
+    //sweep: cost of splitting after bin k is nL*areaL + nR*areaR
+    int bestAxis = -1, bestBin = 0;
+    float bestCost = FLT_MAX;
+    for (int a = 0; a < 3; ++a) {
+        if (extent[a] <= 0.0f) continue;
+        float rightArea[SAH_BINS];
+        int rightCount[SAH_BINS];
+        Bounds acc;
+        int n = 0;
+        for (int k = SAH_BINS - 1; k > 0; --k) {
+            acc.grow(bins[a][k].b);
+            n += bins[a][k].count;
+            rightArea[k] = acc.halfArea();
+            rightCount[k] = n;
+        }
+        acc = Bounds();
+        n = 0;
+        for (int k = 0; k < SAH_BINS - 1; ++k) {
+            acc.grow(bins[a][k].b);
+            n += bins[a][k].count;
+            if (n == 0 || rightCount[k + 1] == 0) continue;
+            float cost = n * acc.halfArea() + rightCount[k + 1] * rightArea[k + 1];
+            if (cost < bestCost) { bestCost = cost; bestAxis = a; bestBin = k; }
+        }
+    }
+
+    int mid = -1;
+    if (bestAxis >= 0) {
+        const float lo = bounds.mn[bestAxis], scale = SAH_BINS / extent[bestAxis];
+        mid = (int)(std::partition(prims.begin() + begin, prims.begin() + end, [&](int i) {
+            return BinOf(points[i][bestAxis], lo, scale) <= bestBin;
+        }) - prims.begin());
+    }
+    if (mid <= begin || mid >= end) mid = begin + count / 2; //every lantern in one spot
+    return mid;
+}
+
+//serial top-down build of one subtree rooted at out[root]
+void BuildSubtree(std::vector<LightNode>& out, int root, int begin, int end,
+                  const std::vector<glm::vec3>& points, std::vector<int>& prims, int leafSize) {
+    struct Item { int node, begin, end; };
+    std::vector<Item> stack{{root, begin, end}};
+    while (!stack.empty()) {
+        Item it = stack.back();
+        stack.pop_back();
+        Bounds b = RangeBounds(points, prims, it.begin, it.end, nullptr);
+        int mid = SplitRange(points, prims, it.begin, it.end, b, leafSize, nullptr);
+        if (mid < 0) {
+            out[it.node].first = it.begin;
+            out[it.node].count = it.end - it.begin;
+            continue;
+        }
+        int left = (int)out.size();
+        out.resize(out.size() + 2);
+        out[left].parent = out[left + 1].parent = it.node;
+        out[it.node].first = left;
+        out[it.node].count = 0;
+        stack.push_back({left, it.begin, mid});
+        stack.push_back({left + 1, mid, it.end});
+    }
+}
+
+float MinDist2(const glm::vec3& p, const LightNode& n) {
+    glm::vec3 d = glm::max(glm::max(n.bmin - p, p - n.bmax), glm::vec3(0.0f));
+    return glm::dot(d, d);
+}
+
+float LanternAttenuation(float d2) {
+    float d = std::sqrt(d2);
+    return 1.0f / (LANTERN_ATTEN_CONSTANT + LANTERN_ATTEN_LINEAR * d + LANTERN_ATTEN_QUADRATIC * d2);
+}
+
+} //namespace
+
+void LightBVH::Update(const std::vector<Lantern>& lanterns, ThreadPool& pool) {
+    if (lanterns.size() != points.size() || nodes.empty()) {
+        Build(lanterns, pool); //spawn / despawn shifted the indices
+        return;
+    }
+    Refit(lanterns, pool);
+    if (sahCost() > builtCost * rebuildRatio) Build(lanterns, pool);
+}
+
+void LightBVH::Build(const std::vector<Lantern>& lanterns, ThreadPool& pool) {
+    const int n = (int)lanterns.size();
+    nodes.clear();
+    points.resize(n);
+    prims.resize(n);
+    leafOf.assign(n, -1);
+    ++rebuilds;
+    if (n == 0) { builtCost = 0.0f; return; }
+
+    BVHBuild::Range(&pool, n, PARALLEL_MIN, [&](size_t b, size_t e) {
+        for (size_t i = b; i < e; ++i) { points[i] = lanterns[i].pos; prims[i] = (int)i; }
+    });
+
+    //top levels split here, the rest as subtrees on the pool (see BVHBuild)
+    const int subtreeMax = std::max(1024, n / (int)(pool.Size() * 4 + 1));
+    BVHBuild::Build(nodes, n, subtreeMax, &pool,
+        [&](int node, int begin, int end, int left) {
+            Bounds b = RangeBounds(points, prims, begin, end, &pool);
+            int mid = SplitRange(points, prims, begin, end, b, leafSize, &pool);
+            nodes[left].parent = nodes[left + 1].parent = node;
+            nodes[node].first = left;
+            return mid;
+        },
+        [&](std::vector<LightNode>& local, int begin, int end) {
+            BuildSubtree(local, 0, begin, end, points, prims, leafSize);
+        },
+        [&](LightNode& node, const BVHBuild::Placement& to) {
+            node.parent = node.parent < 0 ? nodes[to.at].parent : to(node.parent);
+            if (node.count == 0) node.first = to(node.first);
+        });
+
+    for (int i = 0; i < (int)nodes.size(); ++i)
+        for (int j = 0; j < nodes[i].count; ++j) leafOf[prims[nodes[i].first + j]] = i;
+
+    Refit(lanterns, pool);
+    builtCost = sahCost();
+}
+
+void LightBVH::refitLeaf(LightNode& n) const {
+    Bounds b;
+    glm::vec3 sum(0.0f);
+    for (int j = 0; j < n.count; ++j) {
+        const glm::vec3& p = points[prims[n.first + j]];
+        b.grow(p);
+        sum += p;
+    }
+    n.bmin = b.mn;
+    n.bmax = b.mx;
+    n.power = (float)n.count; //every lantern burns equally bright
+    n.center = sum / n.power;
+}
+
+void LightBVH::Refit(const std::vector<Lantern>& lanterns, ThreadPool& pool) {
+    if (nodes.empty()) return;
+    BVHBuild::Range(&pool, nodes.size(), PARALLEL_MIN, [&](size_t b, size_t e) {
+        for (size_t i = b; i < e; ++i) {
+            LightNode& n = nodes[i];
+            if (n.count == 0) continue;
+            for (int j = 0; j < n.count; ++j) {
+                int li = prims[n.first + j];
+                points[li] = lanterns[li].pos;
+            }
+            refitLeaf(n);
+        }
+    });
+
+    //children come after their parent, so one backwards pass sees them first
+    for (int i = (int)nodes.size() - 1; i >= 0; --i) {
+        LightNode& n = nodes[i];
+        if (n.count != 0) continue;
+        const LightNode& l = nodes[n.first];
+        const LightNode& r = nodes[n.first + 1];
+        n.bmin = glm::min(l.bmin, r.bmin);
+        n.bmax = glm::max(l.bmax, r.bmax);
+        n.power = l.power + r.power;
+        n.center = (l.center * l.power + r.center * r.power) / n.power;
+    }
+}
+
+float LightBVH::sahCost() const {
+    if (nodes.empty()) return 0.0f;
+    float cost = 0.0f;
+    for (const auto& n : nodes) {
+        Bounds b;
+        b.mn = n.bmin;
+        b.mx = n.bmax;
+        cost += b.halfArea() * (n.count ? (float)n.count : 1.0f);
+    }
+    Bounds root;
+    root.mn = nodes[0].bmin;
+    root.mx = nodes[0].bmax;
+    return cost / std::max(root.halfArea(), 1e-6f);
+}
+
+void LightBVH::Nearest(const glm::vec3& p, int k, std::vector<int>& out) const {
+    out.clear();
+    if (nodes.empty() || k <= 0) return;
+
+    typedef std::pair<float, int> Entry; //(distance^2, node or lantern)
+    std::vector<Entry> best;  //max-heap of the k closest so far
+    std::vector<Entry> queue; //min-heap of nodes by box distance
+    auto nearer = [](const Entry& a, const Entry& b) { return a.first > b.first; };
+    queue.push_back({MinDist2(p, nodes[0]), 0});
+    while (!queue.empty()) {
+        std::pop_heap(queue.begin(), queue.end(), nearer);
+        Entry e = queue.back();
+        queue.pop_back();
+        if ((int)best.size() == k && e.first >= best.front().first) break;
+
+        const LightNode& n = nodes[e.second];
+        if (n.count == 0) {
+            for (int c = 0; c < 2; ++c) {
+                queue.push_back({MinDist2(p, nodes[n.first + c]), n.first + c});
+                std::push_heap(queue.begin(), queue.end(), nearer);
+            }
+            continue;
+        }
+        for (int j = 0; j < n.count; ++j) {
+            int li = prims[n.first + j];
+            glm::vec3 d = points[li] - p;
+            float d2 = glm::dot(d, d);
+            if ((int)best.size() < k) {
+                best.push_back({d2, li});
+                std::push_heap(best.begin(), best.end());
+            } else if (d2 < best.front().first) {
+                std::pop_heap(best.begin(), best.end());
+                best.back() = {d2, li};
+                std::push_heap(best.begin(), best.end());
+            }
+        }
+    }
+    std::sort_heap(best.begin(), best.end());
+    for (const auto& b : best) out.push_back(b.second);
+}
+
+void LightBVH::QuerySpheres(const Frustum& frustum, float radius, std::vector<int>& out) const {
+    out.clear();
+    if (nodes.empty()) return;
+    const glm::vec3 r(radius);
+    std::vector<int> stack{0};
+    while (!stack.empty()) {
+        const LightNode& n = nodes[stack.back()];
+        stack.pop_back();
+        if (!frustum.BoxVisible(n.bmin - r, n.bmax + r)) continue;
+        if (n.count == 0) {
+            stack.push_back(n.first);
+            stack.push_back(n.first + 1);
+            continue;
+        }
+        for (int j = 0; j < n.count; ++j) {
+            int li = prims[n.first + j];
+            if (frustum.SphereVisible(points[li], radius)) out.push_back(li);
+        }
+    }
+}
+
+void LightBVH::Cut(const glm::vec3& p, int maxLights, const std::vector<int>& forced,
+                   std::vector<CutLight>& out) const {
+    out.clear();
+    if (nodes.empty() || maxLights <= 0) return;
+
+    //every node above a forced lantern has to be opened
+    std::vector<char> mustSplit(nodes.size(), 0);
+    for (int f : forced) {
+        if (f < 0 || f >= (int)leafOf.size()) continue;
+        for (int i = leafOf[f]; i >= 0 && !mustSplit[i]; i = nodes[i].parent) mustSplit[i] = 1;
+    }
+
+    //a cluster's error is bounded by all its power arriving from the nearest box corner;
+    //a single lantern is exact and never needs splitting
+    auto priority = [&](int i) {
+        const LightNode& n = nodes[i];
+        if (mustSplit[i]) return FLT_MAX;
+        if (n.count == 1) return -1.0f;
+        return n.power * LanternAttenuation(MinDist2(p, n));
+    };
+    typedef std::pair<float, int> Entry;
+    std::vector<Entry> heap{{priority(0), 0}};
+
+    auto emit = [&](int i) {
+        const LightNode& n = nodes[i];
+        if (n.count == 1) out.push_back({points[prims[n.first]], 1.0f, prims[n.first]});
+        else out.push_back({n.center, n.power, -1});
+    };
+
+    while (!heap.empty()) {
+        const Entry top = heap.front();
+        if (top.first < 0.0f) break; //only exact lanterns left
+        const LightNode& n = nodes[top.second];
+        const int grows = (n.count == 0 ? 2 : n.count) - 1;
+        if (top.first != FLT_MAX && (int)(out.size() + heap.size()) + grows > maxLights) break;
+
+        std::pop_heap(heap.begin(), heap.end());
+        heap.pop_back();
+        if (n.count == 0) {
+            for (int c = 0; c < 2; ++c) {
+                heap.push_back({priority(n.first + c), n.first + c});
+                std::push_heap(heap.begin(), heap.end());
+            }
+        } else {
+            for (int j = 0; j < n.count; ++j) {
+                int li = prims[n.first + j];
+                out.push_back({points[li], 1.0f, li});
+            }
+        }
+    }
+    for (const auto& e : heap) emit(e.second);
+}
@@ -0,0 +1,435 @@
+#include "Lightmap.hpp"
+#include "AssetPack.hpp"
+#include "AssetStreamer.hpp"
+#include "Model.hpp"
+#include "TriangleBVH.hpp"
+#include "ThreadPool.hpp"
+#include "Philox.hpp"
+#include "Hemisphere.hpp"
+#include <GL/glew.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <unordered_map>
+
+namespace {
+
+const uint32_t ATLAS_VERSION = 1;
+const uint32_t TEXEL_MAGIC = FourCC('L', 'M', 'A', 'P');
+const uint32_t TEXEL_VERSION = 1;
+const int GUTTER = 2;            //texels around each chart, covers bilinear taps and dilation
+const float TARGET_FILL = 0.7f;  //first guess at how much of the atlas the charts cover
+const int MAX_PACK_TRIES = 40;
+const RandomKey BOUNCE_KEY{0x4c4d4150u, 0u, 0u};
+
+struct AtlasHeader {
+    uint32_t version;
+    int32_t size; //0: unwrap failed, no lightmap
+    uint32_t vertexCount;
+};
+
+struct TexelHeader {
+    uint32_t magic, version;
+    uint64_t key;
+    int32_t size;
+};
+
+struct Chart {
+    int mesh, axis; //axis: 0..5 = +x, -x, +y, -y, +z, -z
+    std::vector<uint32_t> tris;
+    glm::vec2 mn{1e30f}, mx{-1e30f};
+    int w = 0, h = 0, x = 0, y = 0;
+};
+
+uint64_t Fnv(uint64_t h, const void* data, size_t bytes) {
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < bytes; ++i) h = (h ^ p[i]) * 1099511628211ull;
+    return h;
+}
+
+uint64_t PositionKey(const glm::vec3& p) { return Fnv(1469598103934665603ull, &p, sizeof(p)); }
+
+glm::vec2 Project(const glm::vec3& p, int axis) {
+    switch (axis / 2) {
+    case 0: return glm::vec2(p.z, p.y);
+    case 1: return glm::vec2(p.x, p.z);
+    default: return glm::vec2(p.x, p.y);
+    }
+}
+
+int Find(std::vector<uint32_t>& parent, uint32_t i) {
+    while (parent[i] != i) i = parent[i] = parent[parent[i]];
+    return (int)i;
+}
+
+//shelf packing, tallest first; false when the charts overflow the atlas
+bool Pack(std::vector<Chart>& charts, const std::vector<uint32_t>& order, float scale, int size) {
+    int x = 0, y = 0, shelf = 0;
+    for (uint32_t c : order) {
+        Chart& ch = charts[c];
+        glm::vec2 ext = (ch.mx - ch.mn) * scale;
+        ch.w = int(std::ceil(ext.x)) + 1 + 2 * GUTTER;
+        ch.h = int(std::ceil(ext.y)) + 1 + 2 * GUTTER;
+        if (ch.w > size) return false;
+        if (x + ch.w > size) { x = 0; y += shelf; shelf = 0; }
+        if (y + ch.h > size) return false;
+        ch.x = x;
+        ch.y = y;
+        x += ch.w;
+        shelf = std::max(shelf, ch.h);
+    }
+    return true;
+}
+
+//world position and normal of one atlas texel
+struct Sample {
+    uint32_t texel;
+    glm::vec3 pos, normal;
+};
+
+} //namespace
+
+bool Lightmap::Unwrap(std::vector<MeshData>& meshes, int size, Atlas& atlas) {
+    atlas.size = 0;
+    atlas.uv.clear();
+
+    //1. charts: union triangles across shared edges when their dominant axis agrees
+    std::vector<Chart> charts;
+    for (int m = 0; m < (int)meshes.size(); ++m) {
+        const MeshData& mesh = meshes[m];
+        const uint32_t nt = uint32_t(mesh.indices.size() / 3);
+        std::vector<int> axis(nt);
+        std::vector<uint32_t> parent(nt);
+        std::unordered_map<uint64_t, uint32_t> edgeOwner;
+        edgeOwner.reserve(nt * 2);
+        for (uint32_t t = 0; t < nt; ++t) {
+            parent[t] = t;
+            const glm::vec3& a = mesh.vertices[mesh.indices[3 * t]].Position;
+            glm::vec3 n = glm::cross(mesh.vertices[mesh.indices[3 * t + 1]].Position - a,
+                                     mesh.vertices[mesh.indices[3 * t + 2]].Position - a);
+            glm::vec3 an = glm::abs(n);
+            int ax = an.x > an.y ? (an.x > an.z ? 0 : 2) : (an.y > an.z ? 1 : 2);
+            axis[t] = ax * 2 + (n[ax] < 0.0f ? 1 : 0);
+            for (int e = 0; e < 3; ++e) {
+                uint64_t k0 = PositionKey(mesh.vertices[mesh.indices[3 * t + e]].Position);
+                uint64_t k1 = PositionKey(mesh.vertices[mesh.indices[3 * t + (e + 1) % 3]].Position);
+                uint64_t edge = std::min(k0, k1) * 31ull ^ std::max(k0, k1);
+                auto it = edgeOwner.emplace(edge, t);
+                if (!it.second && axis[it.first->second] == axis[t])
+                    parent[Find(parent, t)] = uint32_t(Find(parent, it.first->second));
+            }
+        }
+        std::unordered_map<uint32_t, uint32_t> chartOf;
+        for (uint32_t t = 0; t < nt; ++t) {
+            auto it = chartOf.emplace(uint32_t(Find(parent, t)), uint32_t(charts.size()));
+            if (it.second) { charts.emplace_back(); charts.back().mesh = m; charts.back().axis = axis[t]; }
+            Chart& ch = charts[it.first->second];
+            ch.tris.push_back(t);
+            for (int k = 0; k < 3; ++k) {
+                glm::vec2 p = Project(mesh.vertices[mesh.indices[3 * t + k]].Position, ch.axis);
+                ch.mn = glm::min(ch.mn, p);
+                ch.mx = glm::max(ch.mx, p);
+            }
+        }
+    }
+    if (charts.empty()) return false;
+
+    //2. pack: start from the density that would fill TARGET_FILL, shrink until it fits
+    double area = 0.0;
+    for (const auto& ch : charts) area += double(ch.mx.x - ch.mn.x) * double(ch.mx.y - ch.mn.y);
+    std::vector<uint32_t> order(charts.size());
+    for (uint32_t i = 0; i < order.size(); ++i) order[i] = i;
+    std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+        return charts[a].mx.y - charts[a].mn.y > charts[b].mx.y - charts[b].mn.y;
+    });
+    float scale = float(std::sqrt(TARGET_FILL * double(size) * size / std::max(area, 1e-12)));
+    bool fits = false;
+    for (int attempt = 0; attempt < MAX_PACK_TRIES && !fits; ++attempt) {
+        fits = Pack(charts, order, scale, size);
+        if (!fits) scale *= 0.85f;
+    }
+    if (!fits) {
+        std::printf("[Lightmap] %zu charts don't fit a %dx%d atlas, keeping runtime lighting\n",
+                    charts.size(), size, size);
+        return false;
+    }
+
+    //3. UVs; a vertex already placed by another chart gets a copy
+    std::vector<std::vector<glm::vec2>> uv(meshes.size());
+    std::vector<std::vector<int>> owner(meshes.size());
+    for (size_t m = 0; m < meshes.size(); ++m) {
+        uv[m].assign(meshes[m].vertices.size(), glm::vec2(0.0f));
+        owner[m].assign(meshes[m].vertices.size(), -1);
+    }
+    std::unordered_map<uint64_t, uint32_t> copies;
+    size_t split = 0;
+    for (int c = 0; c < (int)charts.size(); ++c) {
+        const Chart& ch = charts[c];
+        MeshData& mesh = meshes[ch.mesh];
+        const glm::vec2 base(ch.x + GUTTER + 0.5f, ch.y + GUTTER + 0.5f);
+        for (uint32_t t : ch.tris)
+            for (int k = 0; k < 3; ++k) {
+                unsigned int& index = mesh.indices[3 * t + k];
+                if (owner[ch.mesh][index] != c && owner[ch.mesh][index] != -1) {
+                    auto it = copies.emplace(uint64_t(index) << 32 | uint32_t(c), uint32_t(mesh.vertices.size()));
+                    if (it.second) {
+                        mesh.vertices.push_back(mesh.vertices[index]);
+                        uv[ch.mesh].push_back(glm::vec2(0.0f));
+                        owner[ch.mesh].push_back(c);
+                        ++split;
+                    }
+                    index = it.first->second;
+                }
+                owner[ch.mesh][index] = c;
+                glm::vec2 p = Project(mesh.vertices[index].Position, ch.axis);
+                uv[ch.mesh][index] = (base + (p - ch.mn) * scale) / float(size);
+            }
+    }
+    atlas.size = size;
+    for (const auto& u : uv) atlas.uv.insert(atlas.uv.end(), u.begin(), u.end());
+    std::printf("[Lightmap] %zu charts in a %dx%d atlas, %.1f texels/unit, %zu vertices split\n",
+                charts.size(), size, size, scale, split);
+    return true;
+}
+
+void Lightmap::SerializeAtlas(const Atlas& atlas, std::vector<uint8_t>& out) {
+    const AtlasHeader h{ATLAS_VERSION, atlas.size, uint32_t(atlas.uv.size())};
+    out.resize(sizeof(h) + atlas.uv.size() * sizeof(glm::vec2));
+    std::memcpy(out.data(), &h, sizeof(h));
+    if (!atlas.uv.empty()) std::memcpy(out.data() + sizeof(h), atlas.uv.data(), atlas.uv.size() * sizeof(glm::vec2));
+}
+
+bool Lightmap::DeserializeAtlas(const std::vector<uint8_t>& in, int size, size_t vertexCount, Atlas& atlas) {
+    AtlasHeader h;
+    if (in.size() < sizeof(h)) return false;
+    std::memcpy(&h, in.data(), sizeof(h));
+    if (h.version != ATLAS_VERSION || (h.size != size && h.size != 0)) return false;
+    if (h.size == 0) { //a failed unwrap is cached too, so it isn't retried every start
+        atlas.size = 0;
+        atlas.uv.clear();
+        return in.size() == sizeof(h);
+    }
+    if (h.vertexCount != vertexCount || in.size() != sizeof(h) + vertexCount * sizeof(glm::vec2)) return false;
+    atlas.size = h.size;
+    atlas.uv.resize(vertexCount);
+    std::memcpy(atlas.uv.data(), in.data() + sizeof(h), vertexCount * sizeof(glm::vec2));
+    return true;
+}
+
+void Lightmap::Bake(const std::vector<Target>& targets, const CollisionScene& scene, const glm::vec3& lightDir,
+                    const glm::vec3& lightColor, const Settings& settings, ThreadPool& pool,
+                    std::vector<std::vector<uint8_t>>& texels) {
+    texels.assign(targets.size(), {});
+
+    //everything the texels depend on; one key for all targets since they shadow each other
+    uint64_t key = Fnv(1469598103934665603ull, &TEXEL_VERSION, sizeof(TEXEL_VERSION));
+    key = Fnv(key, &lightDir, sizeof(lightDir));
+    key = Fnv(key, &lightColor, sizeof(lightColor));
+    key = Fnv(key, &settings, sizeof(settings));
+    for (const auto& t : targets) {
+        const Atlas& a = t.model->LightmapAtlas();
+        key = Fnv(key, &t.toWorld, sizeof(t.toWorld));
+        key = Fnv(key, &t.sceneInstance, sizeof(t.sceneInstance));
+        key = Fnv(key, t.albedo.data(), t.albedo.size() * sizeof(glm::vec3));
+        key = Fnv(key, &a.size, sizeof(a.size));
+        key = Fnv(key, a.uv.data(), a.uv.size() * sizeof(glm::vec2));
+    }
+
+    const glm::vec3 L = -glm::normalize(lightDir);
+    const std::vector<glm::vec3> dirs = CosineHemisphere(std::max(settings.bounceSamples, 1));
+    //first triangle of each mesh, to find the albedo behind a bounce hit
+    std::vector<std::vector<uint32_t>> firstTri(targets.size());
+    for (size_t i = 0; i < targets.size(); ++i) {
+        uint32_t n = 0;
+        for (const auto& m : targets[i].model->getMeshes()) {
+            firstTri[i].push_back(n);
+            n += uint32_t(m.indices.size() / 3);
+        }
+    }
+    auto albedoAt = [&](int instance, uint32_t triangle) {
+        for (size_t i = 0; i < targets.size(); ++i) {
+            if (targets[i].sceneInstance != instance) continue;
+            size_t m = std::upper_bound(firstTri[i].begin(), firstTri[i].end(), triangle) - firstTri[i].begin() - 1;
+            return m < targets[i].albedo.size() ? targets[i].albedo[m] : glm::vec3(0.5f);
+        }
+        return glm::vec3(0.5f);
+    };
+    auto sunlight = [&](const glm::vec3& p, const glm::vec3& n) { //irradiance and visibility
+        float ndotl = glm::dot(n, L);
+        if (ndotl <= 0.0f || scene.Occluded(p + n * settings.bias, L, 1e4f)) return 0.0f;
+        return ndotl;
+    };
+
+    for (size_t ti = 0; ti < targets.size(); ++ti) {
+        const Target& target = targets[ti];
+        const Atlas& atlas = target.model->LightmapAtlas();
+        if (atlas.size == 0) continue;
+        const int size = atlas.size;
+        const std::string path = MeshCache::PathFor(target.model->Source(), ".lmap");
+
+        //a packed bake still has to match the scene and settings
+        if (const AssetPack::View packed = AssetPack::Find(path)) {
+            TexelHeader h;
+            const size_t bytes = size_t(size) * size * 4;
+            if (packed.size >= sizeof(h) + bytes) {
+                std::memcpy(&h, packed.data, sizeof(h));
+                if (h.magic == TEXEL_MAGIC && h.version == TEXEL_VERSION && h.key == key && h.size == size) {
+                    texels[ti].assign(packed.data + sizeof(h), packed.data + sizeof(h) + bytes);
+                    continue;
+                }
+            }
+        }
+        if (FILE* f = std::fopen(path.c_str(), "rb")) {
+            TexelHeader h;
+            std::vector<uint8_t> data(size_t(size) * size * 4);
+            bool ok = std::fread(&h, sizeof(h), 1, f) == 1 && h.magic == TEXEL_MAGIC && h.version == TEXEL_VERSION
+                   && h.key == key && h.size == size && std::fread(data.data(), 1, data.size(), f) == data.size();
+            std::fclose(f);
+            if (ok) { texels[ti] = std::move(data); continue; }
+        }
+
+        auto t0 = std::chrono::steady_clock::now();
+        //texel centres back onto triangles; a triangle too small to cover one still claims
+        //the texel under its centroid
+        std::vector<Sample> samples;
+        std::vector<int> sampleOf(size_t(size) * size, -1);
+        const glm::mat3 normalToWorld = glm::transpose(glm::inverse(glm::mat3(target.toWorld)));
+        size_t first = 0;
+        for (const auto& mesh : target.model->getMeshes()) {
+            for (size_t t = 0; t + 2 < mesh.indices.size(); t += 3) {
+                const Vertex* v[3];
+                glm::vec2 uv[3];
+                for (int k = 0; k < 3; ++k) {
+                    v[k] = &mesh.vertices[mesh.indices[t + k]];
+                    uv[k] = atlas.uv[first + mesh.indices[t + k]] * float(size) - 0.5f; //texel centres on integers
+                }
+                glm::vec3 geo = glm::cross(v[1]->Position - v[0]->Position, v[2]->Position - v[0]->Position);
+                auto place = [&](int x, int y, float b0, float b1, float b2) {
+                    if (x < 0 || y < 0 || x >= size || y >= size) return;
+                    uint32_t texel = uint32_t(y * size + x);
+                    if (sampleOf[texel] >= 0) return;
+                    glm::vec3 p = v[0]->Position * b0 + v[1]->Position * b1 + v[2]->Position * b2;
+                    glm::vec3 n = v[0]->Normal * b0 + v[1]->Normal * b1 + v[2]->Normal * b2;
+                    if (glm::dot(n, n) < 1e-12f) n = geo;
+                    sampleOf[texel] = int(samples.size());
+                    samples.push_back({texel, glm::vec3(target.toWorld * glm::vec4(p, 1.0f)),
+                                       glm::normalize(normalToWorld * n)});
+                };
+                glm::vec2 e1 = uv[1] - uv[0], e2 = uv[2] - uv[0];
+                float det = e1.x * e2.y - e1.y * e2.x;
+                bool covered = false;
+                if (std::fabs(det) > 1e-12f) {
+                    glm::vec2 lo = glm::floor(glm::min(uv[0], glm::min(uv[1], uv[2])));
+                    glm::vec2 hi = glm::ceil(glm::max(uv[0], glm::max(uv[1], uv[2])));
+                    for (int y = int(lo.y); y <= int(hi.y); ++y)
+                        for (int x = int(lo.x); x <= int(hi.x); ++x) {
+                            glm::vec2 d = glm::vec2(float(x), float(y)) - uv[0];
+                            float b1 = (d.x * e2.y - d.y * e2.x) / det, b2 = (e1.x * d.y - e1.y * d.x) / det;
+                            if (b1 < -1e-4f || b2 < -1e-4f || b1 + b2 > 1.0f + 1e-4f) continue;
+                            place(x, y, 1.0f - b1 - b2, b1, b2);
+                            covered = true;
+                        }
+                }
+                if (!covered) {
+                    glm::vec2 c = (uv[0] + uv[1] + uv[2]) / 3.0f;
+                    place(int(std::lround(c.x)), int(std::lround(c.y)), 1.0f / 3.0f, 1.0f / 3.0f, 1.0f / 3.0f);
+                }
+            }
+            first += mesh.vertices.size();
+        }
+
+        //direct + shadow + one bounce per texel, across the pool
+        std::vector<glm::vec4> value(samples.size());
+        const float S = float(dirs.size());
+        pool.ParallelFor(samples.size(), 64, [&](size_t b, size_t e) {
+            for (size_t i = b; i < e; ++i) {
+                const Sample& s = samples[i];
+                const float direct = sunlight(s.pos, s.normal);
+                glm::vec3 t, bt;
+                TangentBasis(s.normal, t, bt);
+                float r[4];
+                RandomFloats4(BOUNCE_KEY, uint32_t(i), uint32_t(ti), r);
+                const float c = std::cos(6.2831853f * r[0]), sn = std::sin(6.2831853f * r[0]);
+                const glm::vec3 origin = s.pos + s.normal * settings.bias;
+                glm::vec3 bounce(0.0f);
+                for (const auto& d : dirs) {
+                    glm::vec3 dir = ToHemisphere(d, c, sn, s.normal, t, bt);
+                    RayHit hit;
+                    int instance = -1;
+                    if (!scene.Raycast(origin, dir, settings.bounceDistance, hit, &instance)) continue;
+                    //cosine-weighted: irradiance = mean of the radiance seen, albedo * E / pi * pi
+                    bounce += albedoAt(instance, hit.triangle) * sunlight(origin + dir * hit.t, hit.normal);
+                }
+                value[i] = glm::vec4(lightColor * direct + lightColor * bounce / S, direct > 0.0f ? 1.0f : 0.0f);
+            }
+        });
+
+        //encode, then grow the charts into their gutters so bilinear taps never see black
+        std::vector<uint8_t>& out = texels[ti];
+        out.assign(size_t(size) * size * 4, 0);
+        std::vector<uint8_t> filled(size_t(size) * size, 0);
+        auto encode = [](float x) { return uint8_t(std::min(std::max(x, 0.0f), 1.0f) * 255.0f + 0.5f); };
+        for (size_t i = 0; i < samples.size(); ++i) {
+            uint8_t* px = &out[4 * size_t(samples[i].texel)];
+            px[0] = encode(value[i].r / RANGE);
+            px[1] = encode(value[i].g / RANGE);
+            px[2] = encode(value[i].b / RANGE);
+            px[3] = encode(value[i].a);
+            filled[samples[i].texel] = 1;
+        }
+        for (int pass = 0; pass < GUTTER; ++pass) {
+            std::vector<uint8_t> next = filled;
+            for (int y = 0; y < size; ++y)
+                for (int x = 0; x < size; ++x) {
+                    if (filled[size_t(y) * size + x]) continue;
+                    int sum[4] = {0, 0, 0, 0}, n = 0;
+                    for (int dy = -1; dy <= 1; ++dy)
+                        for (int dx = -1; dx <= 1; ++dx) {
+                            int nx = x + dx, ny = y + dy;
+                            if (nx < 0 || ny < 0 || nx >= size || ny >= size || !filled[size_t(ny) * size + nx]) continue;
+                            for (int k = 0; k < 4; ++k) sum[k] += out[4 * (size_t(ny) * size + nx) + k];
+                            ++n;
+                        }
+                    if (!n) continue;
+                    for (int k = 0; k < 4; ++k) out[4 * (size_t(y) * size + x) + k] = uint8_t(sum[k] / n);
+                    next[size_t(y) * size + x] = 1;
+                }
+            filled.swap(next);
+        }
+
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+        std::printf("[Lightmap] %s: %zu texels x %zu bounce rays in %.0f ms\n",
+                    target.model->Source().c_str(), samples.size(), dirs.size(), ms);
+
+        mkdir("cache", 0755);
+        const std::string tmp = path + ".tmp";
+        if (FILE* f = std::fopen(tmp.c_str(), "wb")) {
+            const TexelHeader h{TEXEL_MAGIC, TEXEL_VERSION, key, size};
+            bool ok = std::fwrite(&h, sizeof(h), 1, f) == 1 && std::fwrite(out.data(), 1, out.size(), f) == out.size();
+            ok = (std::fclose(f) == 0) && ok;
+            if (!ok || std::rename(tmp.c_str(), path.c_str()) != 0) std::remove(tmp.c_str());
+        }
+    }
+}
+
+unsigned int Lightmap::CreateTexture(const std::vector<uint8_t>& texels, int size, AssetStreamer* streamer) {
+    if (size == 0 || texels.size() != size_t(size) * size * 4) return 0;
+    GLuint tex;
+    glGenTextures(1, &tex);
+    if (streamer) {
+        streamer->TexImage2D(tex, 0, GL_RGBA8, size, size, GL_RGBA, GL_UNSIGNED_BYTE, texels.data(), 4);
+    } else {
+        glBindTexture(GL_TEXTURE_2D, tex);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, size, size, 0, GL_RGBA, GL_UNSIGNED_BYTE, texels.data());
+    }
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    return tex;
+}
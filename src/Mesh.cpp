@@ -1,19 +1,40 @@
 #include "Mesh.hpp"
+#include "AssetStreamer.hpp"
+#include <utility>
 
-Mesh::Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices)
-    : vertices(vertices), indices(indices) {
-    setupMesh();
+Mesh::Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices, bool createGL)
+    : vertices(std::move(vertices)), indices(std::move(indices)) {
+    if (createGL) setupMesh();
 }
 
 void Mesh::setupMesh() {
-    glGenVertexArrays(1, &VAO);
     glGenBuffers(1, &VBO);
     glGenBuffers(1, &EBO);
-    glBindVertexArray(VAO);
     glBindBuffer(GL_ARRAY_BUFFER, VBO);
     glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, EBO); //no vertex array bound yet to hold an element binding
+    glBufferData(GL_COPY_WRITE_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    CreateVertexArray();
+}
+
+void Mesh::Upload(AssetStreamer& streamer, const glm::vec3& worldMin, const glm::vec3& worldMax) {
+    streamer.BeginBatch(worldMin, worldMax);
+    VBO = streamer.CreateBuffer(vertices.data(), vertices.size() * sizeof(Vertex));
+    EBO = streamer.CreateBuffer(indices.data(), indices.size() * sizeof(unsigned int));
+    if (!pendingAO.empty()) aoVBO = streamer.CreateBuffer(pendingAO.data(), pendingAO.size() * sizeof(float));
+    if (!pendingUV.empty()) uv2VBO = streamer.CreateBuffer(pendingUV.data(), pendingUV.size() * sizeof(glm::vec2));
+    streamBatch = streamer.EndBatch();
+}
+
+void Mesh::CreateVertexArray() {
+    if (VAO) return;
+    std::vector<float>().swap(pendingAO); //uploaded by now
+    std::vector<glm::vec2>().swap(pendingUV);
+    glGenVertexArrays(1, &VAO);
+    glBindVertexArray(VAO);
+    glBindBuffer(GL_ARRAY_BUFFER, VBO);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
 
     glEnableVertexAttribArray(0); // position
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
@@ -21,10 +42,68 @@ void Mesh::setupMesh() {
     glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
     glEnableVertexAttribArray(2); // texcoords
     glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
+    if (aoVBO) {
+        glBindBuffer(GL_ARRAY_BUFFER, aoVBO);
+        glEnableVertexAttribArray(3);
+        glVertexAttribPointer(3, 1, GL_FLOAT, GL_FALSE, sizeof(float), (void*)0);
+    }
+    if (uv2VBO) {
+        glBindBuffer(GL_ARRAY_BUFFER, uv2VBO);
+        glEnableVertexAttribArray(4);
+        glVertexAttribPointer(4, 2, GL_FLOAT, GL_FALSE, sizeof(glm::vec2), (void*)0);
+    }
+    glBindVertexArray(0);
+}
+
+void Mesh::SetInstanceBuffer(GLuint buffer, GLsizei stride, int vec4s) const {
+    glBindVertexArray(VAO);
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    for (int i = 0; i < vec4s; ++i) {
+        glEnableVertexAttribArray(5 + i);
+        glVertexAttribPointer(5 + i, 4, GL_FLOAT, GL_FALSE, stride, (void*)(i * sizeof(glm::vec4)));
+        glVertexAttribDivisor(5 + i, 1);
+    }
+    for (int i = vec4s; i < 3; ++i) glDisableVertexAttribArray(5 + i); //left over from a wider record
+    glBindVertexArray(0);
+}
+
+void Mesh::SetVertexAO(const float* ao) {
+    if (!VAO) {
+        pendingAO.assign(ao, ao + vertices.size());
+        return;
+    }
+    if (!aoVBO) glGenBuffers(1, &aoVBO);
+    glBindVertexArray(VAO);
+    glBindBuffer(GL_ARRAY_BUFFER, aoVBO);
+    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), ao, GL_STATIC_DRAW);
+    glEnableVertexAttribArray(3);
+    glVertexAttribPointer(3, 1, GL_FLOAT, GL_FALSE, sizeof(float), (void*)0);
+    glBindVertexArray(0);
+}
+
+void Mesh::SetLightmapUV(const glm::vec2* uv) {
+    if (!VAO) {
+        pendingUV.assign(uv, uv + vertices.size());
+        return;
+    }
+    if (!uv2VBO) glGenBuffers(1, &uv2VBO);
+    glBindVertexArray(VAO);
+    glBindBuffer(GL_ARRAY_BUFFER, uv2VBO);
+    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(glm::vec2), uv, GL_STATIC_DRAW);
+    glEnableVertexAttribArray(4);
+    glVertexAttribPointer(4, 2, GL_FLOAT, GL_FALSE, sizeof(glm::vec2), (void*)0);
+    glBindVertexArray(0);
+}
+
+void Mesh::DrawInstanced(int count) const {
+    if (!VAO) return;
+    glBindVertexArray(VAO);
+    glDrawElementsInstanced(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0, count);
     glBindVertexArray(0);
 }
 
 void Mesh::Draw(Shader& shader) const {
+    if (!VAO) return;
     glBindVertexArray(VAO);
     glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
     glBindVertexArray(0);
@@ -0,0 +1,507 @@
+#include "MeshCache.hpp"
+#include "AssetPack.hpp"
+#include "MeshOptimize.hpp"
+#include "ThreadPool.hpp"
+#include <assimp/Importer.hpp>
+#include <assimp/postprocess.h>
+#include <assimp/scene.h>
+#include <draco/compression/decode.h>
+#include <draco/compression/encode.h>
+#include <draco/mesh/mesh.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <memory>
+
+namespace {
+
+const uint32_t MAGIC = FourCC('M', 'C', 'H', 'E');
+const uint32_t VERSION = 3; //3: meshes welded and reordered at import (MeshOptimize)
+const uint32_t TAG_MESHES = FourCC('M', 'E', 'S', 'H');
+const uint32_t TAG_DRACO = FourCC('D', 'R', 'C', 'O'); //the meshes, Draco-encoded, instead of MESH
+
+MeshCache::Encoding gEncoding;
+
+struct FileHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t sourceSize;
+    int64_t sourceMtime;
+    uint32_t sectionCount;
+    uint32_t vertexSize; //sizeof(Vertex) when written, guards against layout changes
+    float boundsMin[3], boundsMax[3]; //all meshes, model space
+};
+
+struct SectionHeader {
+    uint32_t tag;
+    uint32_t pad;
+    uint64_t size;
+};
+
+bool SourceStamp(const std::string& source, uint64_t& size, int64_t& mtime) {
+    struct stat st;
+    if (stat(source.c_str(), &st) != 0) return false;
+    size = uint64_t(st.st_size);
+    mtime = int64_t(st.st_mtime);
+    return true;
+}
+
+template <class T>
+void Append(std::vector<uint8_t>& out, const T* data, size_t count) {
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(data);
+    out.insert(out.end(), p, p + count * sizeof(T));
+}
+
+//reads count T's at `at` and advances it; false when the blob is too short
+template <class T>
+bool Take(const std::vector<uint8_t>& in, size_t& at, T* data, size_t count) {
+    const size_t bytes = count * sizeof(T);
+    if (at + bytes > in.size()) return false;
+    if (bytes) std::copy(in.begin() + at, in.begin() + at + bytes, reinterpret_cast<uint8_t*>(data));
+    at += bytes;
+    return true;
+}
+
+void ProcessNode(aiNode* node, const aiScene* scene, std::vector<MeshData>& meshes) {
+    for (unsigned int i = 0; i < node->mNumMeshes; i++) {
+        const aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
+        MeshData data;
+        bool hasUV = mesh->HasTextureCoords(0);
+        if (!hasUV) {
+            std::cerr << "[Assimp] Mesh has NO UVs: using (0,0) for all texcoords\n";
+        }
+
+        data.vertices.reserve(mesh->mNumVertices);
+        for (unsigned int v = 0; v < mesh->mNumVertices; v++) {
+            Vertex vertex;
+            vertex.Position = glm::vec3(mesh->mVertices[v].x, mesh->mVertices[v].y, mesh->mVertices[v].z);
+            vertex.Normal   = glm::vec3(mesh->mNormals[v].x, mesh->mNormals[v].y, mesh->mNormals[v].z);
+            vertex.TexCoords = hasUV ?
+                glm::vec2(mesh->mTextureCoords[0][v].x, mesh->mTextureCoords[0][v].y) : glm::vec2(0.0f);
+            data.vertices.push_back(vertex);
+        }
+
+        data.indices.reserve(size_t(mesh->mNumFaces) * 3);
+        for (unsigned int f = 0; f < mesh->mNumFaces; f++)
+            for (unsigned int j = 0; j < mesh->mFaces[f].mNumIndices; j++)
+                data.indices.push_back(mesh->mFaces[f].mIndices[j]);
+        meshes.push_back(std::move(data));
+    }
+    for (unsigned int i = 0; i < node->mNumChildren; i++)
+        ProcessNode(node->mChildren[i], scene, meshes);
+}
+
+//a cache file, either on disk or a pack entry mapped in memory
+struct CacheReader {
+    FILE* f = nullptr;
+    AssetPack::View packed;
+    size_t at = 0;
+
+    ~CacheReader() { if (f) std::fclose(f); }
+    bool Read(void* dst, size_t bytes) {
+        if (f) return bytes == 0 || std::fread(dst, 1, bytes, f) == bytes;
+        if (bytes > packed.size - at) return false;
+        if (bytes) std::memcpy(dst, packed.data + at, bytes);
+        at += bytes;
+        return true;
+    }
+    uint64_t Size() const {
+        struct stat st;
+        if (!f) return packed.size;
+        return fstat(fileno(f), &st) == 0 ? uint64_t(st.st_size) : 0;
+    }
+};
+
+//opens the cache (the pack's entry first) and reads its header; false when it is missing or
+//stale. A packed cache skips the source stamp, the shipped game may not have the OBJ at all
+bool OpenCurrent(const std::string& source, FileHeader& header, CacheReader& in) {
+    const std::string path = MeshCache::PathFor(source);
+    in.packed = AssetPack::Find(path);
+    if (in.packed)
+        return in.Read(&header, sizeof(header)) && header.magic == MAGIC && header.version == VERSION
+            && header.vertexSize == sizeof(Vertex);
+    uint64_t size;
+    int64_t mtime;
+    if (!SourceStamp(source, size, mtime)) return false;
+    in.f = std::fopen(path.c_str(), "rb");
+    return in.f && in.Read(&header, sizeof(header)) && header.magic == MAGIC && header.version == VERSION
+        && header.sourceSize == size && header.sourceMtime == mtime && header.vertexSize == sizeof(Vertex);
+}
+
+//every section of an opened cache, in file order
+bool ReadSections(CacheReader& in, const FileHeader& header, CachedModel& model) {
+    const uint64_t fileSize = in.Size();
+    for (uint32_t s = 0; s < header.sectionCount; ++s) {
+        SectionHeader sh;
+        if (!in.Read(&sh, sizeof(sh)) || sh.size > fileSize) return false; //a torn size never allocates
+        CachedModel::Section section{sh.tag, std::vector<uint8_t>(sh.size)};
+        if (!in.Read(section.bytes.data(), sh.size)) return false;
+        model.sections.push_back(std::move(section));
+    }
+    return true;
+}
+
+bool DecodeRaw(const std::vector<uint8_t>& blob, std::vector<MeshData>& meshes) {
+    size_t at = 0;
+    uint32_t count = 0;
+    bool ok = Take(blob, at, &count, 1);
+    for (uint32_t m = 0; ok && m < count; ++m) {
+        uint32_t counts[2];
+        MeshData data;
+        ok = Take(blob, at, counts, 2);
+        if (!ok) break;
+        data.vertices.resize(counts[0]);
+        data.indices.resize(counts[1]);
+        ok = Take(blob, at, data.vertices.data(), counts[0]) && Take(blob, at, data.indices.data(), counts[1]);
+        meshes.push_back(std::move(data));
+    }
+    return ok;
+}
+
+void EncodeRaw(const std::vector<MeshData>& meshes, std::vector<uint8_t>& blob) {
+    const uint32_t count = uint32_t(meshes.size());
+    Append(blob, &count, 1);
+    for (const auto& m : meshes) {
+        const uint32_t counts[2] = { uint32_t(m.vertices.size()), uint32_t(m.indices.size()) };
+        Append(blob, counts, 2);
+        Append(blob, m.vertices.data(), m.vertices.size());
+        Append(blob, m.indices.data(), m.indices.size());
+    }
+}
+
+bool EncodeDraco(const MeshData& data, const MeshCache::Encoding& encoding, std::vector<uint8_t>& out) {
+    if (data.vertices.empty() || data.indices.empty() || data.indices.size() % 3) return false; //triangles only
+    draco::Mesh mesh;
+    const uint32_t n = uint32_t(data.vertices.size());
+    mesh.set_num_points(n);
+    auto addAttribute = [&](draco::GeometryAttribute::Type type, int components, size_t offset) {
+        draco::GeometryAttribute ga;
+        ga.Init(type, nullptr, uint8_t(components), draco::DT_FLOAT32, false, sizeof(float) * components, 0);
+        draco::PointAttribute* att = mesh.attribute(mesh.AddAttribute(ga, true, n));
+        for (uint32_t v = 0; v < n; ++v)
+            att->SetAttributeValue(draco::AttributeValueIndex(v),
+                                   reinterpret_cast<const uint8_t*>(&data.vertices[v]) + offset);
+    };
+    addAttribute(draco::GeometryAttribute::POSITION, 3, offsetof(Vertex, Position));
+    addAttribute(draco::GeometryAttribute::NORMAL, 3, offsetof(Vertex, Normal));
+    addAttribute(draco::GeometryAttribute::TEX_COORD, 2, offsetof(Vertex, TexCoords));
+    mesh.SetNumFaces(data.indices.size() / 3);
+    for (size_t t = 0; t < data.indices.size() / 3; ++t) {
+        draco::Mesh::Face face;
+        for (int k = 0; k < 3; ++k) face[k] = draco::PointIndex(data.indices[t * 3 + k]);
+        mesh.SetFace(draco::FaceIndex(uint32_t(t)), face);
+    }
+
+    draco::Encoder encoder;
+    encoder.SetEncodingMethod(draco::MESH_SEQUENTIAL_ENCODING);
+    encoder.SetAttributeQuantization(draco::GeometryAttribute::POSITION, encoding.positionBits);
+    encoder.SetAttributeQuantization(draco::GeometryAttribute::NORMAL, encoding.normalBits);
+    encoder.SetAttributeQuantization(draco::GeometryAttribute::TEX_COORD, encoding.texCoordBits);
+    encoder.SetSpeedOptions(encoding.speed, encoding.speed);
+    draco::EncoderBuffer buffer;
+    if (!encoder.EncodeMeshToBuffer(mesh, &buffer).ok()) return false;
+    out.assign(reinterpret_cast<const uint8_t*>(buffer.data()), reinterpret_cast<const uint8_t*>(buffer.data()) + buffer.size());
+    return true;
+}
+
+bool DecodeDraco(const uint8_t* bytes, size_t size, MeshData& data) {
+    draco::DecoderBuffer buffer;
+    buffer.Init(reinterpret_cast<const char*>(bytes), size);
+    draco::Decoder decoder;
+    auto result = decoder.DecodeMeshFromBuffer(&buffer);
+    if (!result.ok()) return false;
+    const std::unique_ptr<draco::Mesh> mesh = std::move(result).value();
+    const draco::PointAttribute* position = mesh->GetNamedAttribute(draco::GeometryAttribute::POSITION);
+    const draco::PointAttribute* normal = mesh->GetNamedAttribute(draco::GeometryAttribute::NORMAL);
+    const draco::PointAttribute* uv = mesh->GetNamedAttribute(draco::GeometryAttribute::TEX_COORD);
+    if (!position || !normal || !uv) return false;
+    data.vertices.resize(mesh->num_points());
+    for (uint32_t v = 0; v < mesh->num_points(); ++v) {
+        const draco::PointIndex p(v);
+        position->GetMappedValue(p, &data.vertices[v].Position[0]);
+        normal->GetMappedValue(p, &data.vertices[v].Normal[0]);
+        uv->GetMappedValue(p, &data.vertices[v].TexCoords[0]);
+    }
+    data.indices.resize(size_t(mesh->num_faces()) * 3);
+    for (uint32_t t = 0; t < mesh->num_faces(); ++t) {
+        const draco::Mesh::Face& face = mesh->face(draco::FaceIndex(t));
+        for (int k = 0; k < 3; ++k) data.indices[size_t(t) * 3 + k] = face[k].value();
+    }
+    return true;
+}
+
+//count, then each mesh's size and Draco bytes; false when any mesh can't be encoded
+bool EncodeDracoBlob(const std::vector<MeshData>& meshes, const MeshCache::Encoding& encoding, ThreadPool* pool,
+                     std::vector<uint8_t>& blob) {
+    std::vector<std::vector<uint8_t>> encoded(meshes.size());
+    std::atomic<bool> ok{true};
+    auto run = [&](size_t b, size_t e) {
+        for (size_t i = b; i < e; ++i)
+            if (!EncodeDraco(meshes[i], encoding, encoded[i])) ok = false;
+    };
+    if (pool) pool->ParallelFor(meshes.size(), 1, run);
+    else run(0, meshes.size());
+    if (!ok) return false;
+    const uint32_t count = uint32_t(meshes.size());
+    Append(blob, &count, 1);
+    for (const auto& e : encoded) {
+        const uint64_t size = e.size();
+        Append(blob, &size, 1);
+        Append(blob, e.data(), e.size());
+    }
+    return true;
+}
+
+//each mesh decodes on its own worker: Draco's decoder is serial within a mesh
+bool DecodeDracoBlob(const std::vector<uint8_t>& blob, ThreadPool* pool, std::vector<MeshData>& meshes) {
+    size_t at = 0;
+    uint32_t count = 0;
+    if (!Take(blob, at, &count, 1) || count > blob.size()) return false;
+    std::vector<std::pair<size_t, size_t>> spans(count); //offset, size
+    for (auto& span : spans) {
+        uint64_t size = 0;
+        if (!Take(blob, at, &size, 1) || size > blob.size() - at) return false;
+        span = {at, size_t(size)};
+        at += size_t(size);
+    }
+    meshes.assign(count, MeshData());
+    std::atomic<bool> ok{true};
+    auto run = [&](size_t b, size_t e) {
+        for (size_t i = b; i < e; ++i)
+            if (!DecodeDraco(blob.data() + spans[i].first, spans[i].second, meshes[i])) ok = false;
+    };
+    if (pool) pool->ParallelFor(count, 1, run);
+    else run(0, count);
+    return ok;
+}
+
+//moves the MESH or DRCO section into model.meshes
+bool UnpackMeshes(CachedModel& model, ThreadPool* pool) {
+    const CachedModel::Section* section = model.Find(TAG_MESHES);
+    model.draco = section == nullptr;
+    if (!section) section = model.Find(TAG_DRACO);
+    if (!section) return false;
+    const bool ok = model.draco ? DecodeDracoBlob(section->bytes, pool, model.meshes)
+                                : DecodeRaw(section->bytes, model.meshes);
+    model.sections.erase(model.sections.begin() + (section - model.sections.data()));
+    return ok;
+}
+
+//the whole cache file for `model`, its meshes stored as `encoding` says (raw when Draco fails)
+bool WriteFile(const std::string& path, FileHeader header, const CachedModel& model,
+               const MeshCache::Encoding& encoding, ThreadPool* pool) {
+    glm::vec3 bmin(1e30f), bmax(-1e30f);
+    for (const auto& m : model.meshes)
+        for (const auto& v : m.vertices) {
+            bmin = glm::min(bmin, v.Position);
+            bmax = glm::max(bmax, v.Position);
+        }
+    for (int k = 0; k < 3; ++k) {
+        header.boundsMin[k] = bmin[k];
+        header.boundsMax[k] = bmax[k];
+    }
+    header.sectionCount = uint32_t(model.sections.size() + 1);
+
+    std::vector<uint8_t> meshBlob;
+    uint32_t meshTag = TAG_DRACO;
+    if (!encoding.draco || !EncodeDracoBlob(model.meshes, encoding, pool, meshBlob)) {
+        if (encoding.draco) std::cerr << "Mesh cache: Draco can't encode " << path << ", storing it raw\n";
+        meshBlob.clear();
+        EncodeRaw(model.meshes, meshBlob);
+        meshTag = TAG_MESHES;
+    }
+
+    mkdir("cache", 0755);
+    //write next to the final name and rename, so a crash never leaves half a cache file
+    const std::string tmp = path + ".tmp";
+    FILE* f = std::fopen(tmp.c_str(), "wb");
+    if (!f) return false;
+    bool ok = std::fwrite(&header, sizeof(header), 1, f) == 1;
+    auto writeSection = [&](uint32_t tag, const std::vector<uint8_t>& bytes) {
+        SectionHeader sh{tag, 0, bytes.size()};
+        ok = ok && std::fwrite(&sh, sizeof(sh), 1, f) == 1
+                && (bytes.empty() || std::fwrite(bytes.data(), 1, bytes.size(), f) == bytes.size());
+    };
+    writeSection(meshTag, meshBlob);
+    for (const auto& s : model.sections) writeSection(s.tag, s.bytes);
+    ok = (std::fclose(f) == 0) && ok;
+    if (!ok || std::rename(tmp.c_str(), path.c_str()) != 0) {
+        std::remove(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+} //namespace
+
+const CachedModel::Section* CachedModel::Find(uint32_t tag) const {
+    for (const auto& s : sections)
+        if (s.tag == tag) return &s;
+    return nullptr;
+}
+
+std::vector<uint8_t>& CachedModel::Put(uint32_t tag) {
+    for (auto& s : sections)
+        if (s.tag == tag) { s.bytes.clear(); return s.bytes; }
+    sections.push_back({tag, {}});
+    return sections.back().bytes;
+}
+
+std::string MeshCache::PathFor(const std::string& source, const char* extension) {
+    std::string name = source;
+    for (char& c : name)
+        if (c == '/' || c == '\\' || c == ':') c = '_';
+    return "cache/" + name + extension;
+}
+
+bool MeshCache::Import(const std::string& source, std::vector<MeshData>& meshes) {
+    Assimp::Importer importer;
+    const aiScene* scene = importer.ReadFile(source, aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
+    if (!scene || !scene->mRootNode) {
+        std::cerr << "Model load error: " << importer.GetErrorString() << std::endl;
+        return false;
+    }
+    meshes.clear();
+    ProcessNode(scene->mRootNode, scene, meshes);
+    return true;
+}
+
+bool MeshCache::Peek(const std::string& source, glm::vec3& bmin, glm::vec3& bmax) {
+    FileHeader header;
+    CacheReader in;
+    if (!OpenCurrent(source, header, in)) return false;
+    bmin = glm::vec3(header.boundsMin[0], header.boundsMin[1], header.boundsMin[2]);
+    bmax = glm::vec3(header.boundsMax[0], header.boundsMax[1], header.boundsMax[2]);
+    return true;
+}
+
+bool MeshCache::Read(const std::string& source, CachedModel& out, ThreadPool* pool) {
+    FileHeader header;
+    CacheReader in;
+    CachedModel model;
+    if (!OpenCurrent(source, header, in) || !ReadSections(in, header, model)) return false;
+    //the meshes are kept unpacked, every other section stays a blob for its owner
+    if (!UnpackMeshes(model, pool)) return false;
+    out = std::move(model);
+    return true;
+}
+
+void MeshCache::SetEncoding(const Encoding& encoding) { gEncoding = encoding; }
+const MeshCache::Encoding& MeshCache::GetEncoding() { return gEncoding; }
+
+bool MeshCache::Write(const std::string& source, const CachedModel& model, ThreadPool* pool) {
+    return WriteAs(PathFor(source), source, model, gEncoding, pool);
+}
+
+bool MeshCache::WriteAs(const std::string& path, const std::string& source, const CachedModel& model,
+                        const Encoding& encoding, ThreadPool* pool) {
+    FileHeader header{MAGIC, VERSION, 0, 0, 0, uint32_t(sizeof(Vertex)), {}, {}};
+    if (!SourceStamp(source, header.sourceSize, header.sourceMtime)) return false;
+    return WriteFile(path, header, model, encoding, pool);
+}
+
+namespace {
+
+double MsSince(std::chrono::steady_clock::time_point t0) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+}
+
+//written out and evicted from the page cache, so the next read comes from the disk
+void DropFromPageCache(const std::string& path) {
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) return;
+    fdatasync(fd);
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    close(fd);
+}
+
+} //namespace
+
+void RunMeshCacheBenchmark(const char* path) {
+    ThreadPool pool;
+    auto t0 = std::chrono::steady_clock::now();
+    CachedModel model;
+    if (!MeshCache::Import(path, model.meshes)) return;
+    MeshOptimize::Optimize(model.meshes, &pool); //what a cache holds
+    const double importMs = MsSince(t0);
+    size_t vertices = 0, triangles = 0;
+    glm::vec3 bmin(1e30f), bmax(-1e30f);
+    for (const auto& m : model.meshes) {
+        vertices += m.vertices.size();
+        triangles += m.indices.size() / 3;
+        for (const auto& v : m.vertices) {
+            bmin = glm::min(bmin, v.Position);
+            bmax = glm::max(bmax, v.Position);
+        }
+    }
+    const float diagonal = std::max(glm::length(bmax - bmin), 1e-6f);
+    std::printf("mesh cache, %s: %zu meshes, %zu vertices, %zu triangles, import + optimize %.1f ms\n", path,
+                model.meshes.size(), vertices, triangles, importMs);
+    std::printf("  %-26s %9s %9s %10s %10s %10s %11s\n", "storage", "MB", "encode ms", "cold ms", "cold pool",
+                "warm pool", "max error");
+
+    struct Variant {
+        const char* name;
+        MeshCache::Encoding encoding;
+    };
+    const Variant variants[] = {
+        {"raw", {false, 0, 0, 0, 0}},
+        {"draco 16/12/14 bits", {true, 16, 12, 14, 5}},
+        {"draco 14/10/12 bits", {true, 14, 10, 12, 5}},
+        {"draco 11/8/10 bits", {true, 11, 8, 10, 5}},
+        {"draco 14/10/12, speed 0", {true, 14, 10, 12, 0}},
+        {"draco 14/10/12, speed 10", {true, 14, 10, 12, 10}},
+    };
+    const FileHeader header{MAGIC, VERSION, 0, 0, 0, uint32_t(sizeof(Vertex)), {}, {}};
+    const std::string file = "cache/mesh_benchmark.mcache";
+    for (const Variant& variant : variants) {
+        t0 = std::chrono::steady_clock::now();
+        if (!WriteFile(file, header, model, variant.encoding, &pool)) {
+            std::printf("  %-26s couldn't write %s\n", variant.name, file.c_str());
+            continue;
+        }
+        const double encodeMs = MsSince(t0);
+        struct stat st;
+        const double mb = stat(file.c_str(), &st) == 0 ? st.st_size / (1024.0 * 1024.0) : 0.0;
+
+        //read + unpack exactly as a cache hit does: cold serially, cold over the pool, warm over the pool
+        double ms[3];
+        CachedModel read;
+        for (int pass = 0; pass < 3; ++pass) {
+            if (pass < 2) DropFromPageCache(file);
+            read = CachedModel();
+            t0 = std::chrono::steady_clock::now();
+            CacheReader in;
+            in.f = std::fopen(file.c_str(), "rb");
+            FileHeader h;
+            const bool ok = in.f && in.Read(&h, sizeof(h)) && ReadSections(in, h, read)
+                         && UnpackMeshes(read, pass ? &pool : nullptr);
+            ms[pass] = MsSince(t0);
+            if (!ok) read = CachedModel();
+        }
+
+        float error = 0.0f;
+        bool sameShape = read.meshes.size() == model.meshes.size();
+        for (size_t m = 0; sameShape && m < model.meshes.size(); ++m) {
+            const MeshData &a = model.meshes[m], &b = read.meshes[m];
+            sameShape = a.vertices.size() == b.vertices.size() && a.indices == b.indices;
+            for (size_t v = 0; sameShape && v < a.vertices.size(); ++v)
+                error = std::max(error, glm::length(a.vertices[v].Position - b.vertices[v].Position));
+        }
+        if (!sameShape) {
+            std::printf("  %-26s read back a different mesh\n", variant.name);
+            continue;
+        }
+        std::printf("  %-26s %9.2f %9.1f %10.1f %10.1f %10.1f %9.5f%%\n", variant.name, mb, encodeMs, ms[0], ms[1],
+                    ms[2], 100.0f * error / diagonal);
+    }
+    std::remove(file.c_str());
+    std::printf("  (%u workers + main thread; max error: position, of the bounding box diagonal)\n", pool.Size());
+}
@@ -0,0 +1,396 @@
+#include "MeshOptimize.hpp"
+#include "ThreadPool.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+
+namespace {
+
+const int ANALYZE_CACHE = 16;     //FIFO entries the stats and the overdraw clusters assume
+const int FORSYTH_CACHE = 32;     //LRU entries Forsyth's scores model
+const int VALENCE_TABLE = 32;     //precomputed valence boosts
+const int OVERDRAW_GRID = 256;    //pixels per side of each overdraw view
+const uint32_t NONE = std::numeric_limits<uint32_t>::max();
+
+double MsSince(std::chrono::steady_clock::time_point t0) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+}
+
+//FIFO post-transform cache kept as insertion times: a vertex is cached while fewer than
+//`size` others went in after it
+struct FifoCache {
+    std::vector<uint32_t> stamp;
+    uint32_t time;
+    uint32_t size;
+
+    FifoCache(size_t vertexCount, int entries) : stamp(vertexCount, 0), time(uint32_t(entries) + 1), size(uint32_t(entries)) {}
+    bool Miss(uint32_t v) {
+        if (time - stamp[v] <= size) return false;
+        stamp[v] = time++;
+        return true;
+    }
+    void Flush() { time += size + 1; }
+};
+
+size_t CacheMisses(const std::vector<unsigned int>& indices, size_t vertexCount) {
+    FifoCache cache(vertexCount, ANALYZE_CACHE);
+    size_t misses = 0;
+    for (unsigned int i : indices) misses += cache.Miss(i);
+    return misses;
+}
+
+uint64_t HashVertex(const Vertex& v) {
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(&v);
+    uint64_t h = 1469598103934665603ull;
+    for (size_t i = 0; i < sizeof(Vertex); ++i) h = (h ^ p[i]) * 1099511628211ull;
+    return h;
+}
+
+//Forsyth's vertex score: the last triangle's three vertices a flat 0.75, older cache entries
+//decaying with their position, plus a boost for vertices with few triangles left
+struct ForsythScores {
+    float cache[FORSYTH_CACHE];
+    float valence[VALENCE_TABLE];
+
+    ForsythScores() {
+        for (int i = 0; i < FORSYTH_CACHE; ++i)
+            cache[i] = i < 3 ? 0.75f : std::pow(1.0f - float(i - 3) / float(FORSYTH_CACHE - 3), 1.5f);
+        valence[0] = 0.0f;
+        for (int i = 1; i < VALENCE_TABLE; ++i) valence[i] = 2.0f / std::sqrt(float(i));
+    }
+    float operator()(int cachePos, uint32_t remaining) const {
+        if (remaining == 0) return -1.0f; //no triangle left to draw
+        const float boost = remaining < uint32_t(VALENCE_TABLE) ? valence[remaining] : 2.0f / std::sqrt(float(remaining));
+        return (cachePos >= 0 ? cache[cachePos] : 0.0f) + boost;
+    }
+};
+
+//area-weighted centroid and (unnormalised) normal of triangles [begin, end)
+void ClusterShape(const std::vector<unsigned int>& indices, const std::vector<Vertex>& vertices, size_t begin,
+                  size_t end, glm::vec3& centroid, glm::vec3& normal, float& area) {
+    centroid = glm::vec3(0.0f);
+    normal = glm::vec3(0.0f);
+    area = 0.0f;
+    for (size_t t = begin; t < end; ++t) {
+        const glm::vec3& a = vertices[indices[t * 3]].Position;
+        const glm::vec3& b = vertices[indices[t * 3 + 1]].Position;
+        const glm::vec3& c = vertices[indices[t * 3 + 2]].Position;
+        const glm::vec3 n = glm::cross(b - a, c - a);
+        const float w = glm::length(n);
+        centroid += (a + b + c) * (w / 3.0f);
+        normal += n;
+        area += w;
+    }
+    if (area > 0.0f) centroid /= area;
+}
+
+//fragments shaded and pixels covered drawing every triangle in order, depth test LESS and no
+//face culling (as the main pass draws), looking down `axis` from the + or - side
+void RasterizeView(const std::vector<MeshData>& meshes, const glm::vec3& bmin, const glm::vec3& bmax, int axis,
+                   bool positive, size_t& shaded, size_t& covered) {
+    const int ua = (axis + 1) % 3, va = (axis + 2) % 3;
+    const float extent = std::max(bmax[ua] - bmin[ua], bmax[va] - bmin[va]);
+    const float scale = extent > 0.0f ? (OVERDRAW_GRID - 1) / extent : 0.0f;
+    std::vector<float> depth(size_t(OVERDRAW_GRID) * OVERDRAW_GRID, std::numeric_limits<float>::max());
+    shaded = 0;
+    for (const MeshData& mesh : meshes)
+        for (size_t t = 0; t + 2 < mesh.indices.size(); t += 3) {
+            glm::vec3 p[3]; //x, y in pixels, z = depth
+            for (int k = 0; k < 3; ++k) {
+                const glm::vec3& v = mesh.vertices[mesh.indices[t + k]].Position;
+                p[k] = glm::vec3((v[ua] - bmin[ua]) * scale, (v[va] - bmin[va]) * scale,
+                                 positive ? bmax[axis] - v[axis] : v[axis] - bmin[axis]);
+            }
+            const float area = (p[1].x - p[0].x) * (p[2].y - p[0].y) - (p[2].x - p[0].x) * (p[1].y - p[0].y);
+            if (area == 0.0f) continue;
+            const int x0 = std::max(0, int(std::floor(std::min({p[0].x, p[1].x, p[2].x}))));
+            const int x1 = std::min(OVERDRAW_GRID - 1, int(std::ceil(std::max({p[0].x, p[1].x, p[2].x}))));
+            const int y0 = std::max(0, int(std::floor(std::min({p[0].y, p[1].y, p[2].y}))));
+            const int y1 = std::min(OVERDRAW_GRID - 1, int(std::ceil(std::max({p[0].y, p[1].y, p[2].y}))));
+            const float inv = 1.0f / area;
+            for (int y = y0; y <= y1; ++y)
+                for (int x = x0; x <= x1; ++x) {
+                    const float px = x + 0.5f, py = y + 0.5f;
+                    //barycentrics, positive inside for either winding
+                    const float w0 = ((p[2].x - p[1].x) * (py - p[1].y) - (p[2].y - p[1].y) * (px - p[1].x)) * inv;
+                    const float w1 = ((p[0].x - p[2].x) * (py - p[2].y) - (p[0].y - p[2].y) * (px - p[2].x)) * inv;
+                    const float w2 = 1.0f - w0 - w1;
+                    if (w0 < 0.0f || w1 < 0.0f || w2 < 0.0f) continue;
+                    const float z = w0 * p[0].z + w1 * p[1].z + w2 * p[2].z;
+                    float& stored = depth[size_t(y) * OVERDRAW_GRID + x];
+                    if (z < stored) {
+                        stored = z;
+                        ++shaded;
+                    }
+                }
+        }
+    covered = 0;
+    for (float z : depth) covered += z != std::numeric_limits<float>::max();
+}
+
+} //namespace
+
+size_t MeshOptimize::Weld(MeshData& mesh) {
+    const size_t n = mesh.vertices.size();
+    size_t buckets = 1;
+    while (buckets < n * 2) buckets <<= 1;
+    //open addressing over the vertices kept so far, linear probing
+    std::vector<uint32_t> table(buckets, NONE), remap(n);
+    std::vector<Vertex> unique;
+    unique.reserve(n);
+    for (size_t i = 0; i < n; ++i) {
+        const Vertex& v = mesh.vertices[i];
+        size_t b = size_t(HashVertex(v)) & (buckets - 1);
+        while (table[b] != NONE && std::memcmp(&unique[table[b]], &v, sizeof(Vertex)) != 0)
+            b = (b + 1) & (buckets - 1);
+        if (table[b] == NONE) {
+            table[b] = uint32_t(unique.size());
+            unique.push_back(v);
+        }
+        remap[i] = table[b];
+    }
+    for (unsigned int& i : mesh.indices) i = remap[i];
+    const size_t removed = n - unique.size();
+    mesh.vertices.swap(unique);
+    return removed;
+}
+
+void MeshOptimize::OptimizeVertexCache(std::vector<unsigned int>& indices, size_t vertexCount) {
+    static const ForsythScores score;
+    const size_t triCount = indices.size() / 3;
+    if (triCount < 2) return;
+
+    //each vertex's triangles not yet drawn live in adjacency[offset[v], offset[v] + remaining[v])
+    std::vector<uint32_t> remaining(vertexCount, 0), offset(vertexCount + 1, 0);
+    for (unsigned int i : indices) ++remaining[i];
+    for (size_t v = 0; v < vertexCount; ++v) offset[v + 1] = offset[v] + remaining[v];
+    std::vector<uint32_t> adjacency(indices.size()), fill(offset.begin(), offset.end() - 1);
+    for (size_t k = 0; k < triCount * 3; ++k) adjacency[fill[indices[k]]++] = uint32_t(k / 3);
+
+    std::vector<int> cachePos(vertexCount, -1);
+    std::vector<float> vertexScore(vertexCount), triScore(triCount, 0.0f);
+    for (size_t v = 0; v < vertexCount; ++v) vertexScore[v] = score(-1, remaining[v]);
+    for (size_t t = 0; t < triCount; ++t)
+        for (int k = 0; k < 3; ++k) triScore[t] += vertexScore[indices[t * 3 + k]];
+
+    std::vector<bool> emitted(triCount, false);
+    std::vector<uint32_t> cache, next;
+    cache.reserve(FORSYTH_CACHE + 3);
+    next.reserve(FORSYTH_CACHE + 3);
+    std::vector<unsigned int> out;
+    out.reserve(indices.size());
+    size_t cursor = 0; //dead ends restart at the first triangle not yet drawn
+    uint32_t best = NONE;
+    for (size_t drawn = 0; drawn < triCount; ++drawn) {
+        if (best == NONE) {
+            while (emitted[cursor]) ++cursor;
+            best = uint32_t(cursor);
+        }
+        emitted[best] = true;
+        const unsigned int* tri = &indices[size_t(best) * 3];
+        out.insert(out.end(), tri, tri + 3);
+
+        //the triangle's vertices to the front of the LRU cache, out of their adjacency
+        next.clear();
+        for (int k = 0; k < 3; ++k) {
+            const uint32_t v = tri[k];
+            uint32_t* list = &adjacency[offset[v]];
+            for (uint32_t j = 0; j < remaining[v]; ++j)
+                if (list[j] == best) {
+                    list[j] = list[--remaining[v]];
+                    break;
+                }
+            if (std::find(next.begin(), next.end(), v) == next.end()) next.push_back(v);
+        }
+        for (uint32_t v : cache)
+            if (std::find(next.begin(), next.end(), v) == next.end()) next.push_back(v);
+        for (size_t i = 0; i < next.size(); ++i) {
+            const uint32_t v = next[i];
+            cachePos[v] = i < size_t(FORSYTH_CACHE) ? int(i) : -1;
+            vertexScore[v] = score(cachePos[v], remaining[v]);
+        }
+
+        //rescore what the cache touches, the best of it goes next
+        best = NONE;
+        float bestScore = -1.0f;
+        for (uint32_t v : next)
+            for (uint32_t j = 0; j < remaining[v]; ++j) {
+                const uint32_t t = adjacency[offset[v] + j];
+                const unsigned int* u = &indices[size_t(t) * 3];
+                triScore[t] = vertexScore[u[0]] + vertexScore[u[1]] + vertexScore[u[2]];
+                if (triScore[t] > bestScore) {
+                    bestScore = triScore[t];
+                    best = t;
+                }
+            }
+        if (next.size() > size_t(FORSYTH_CACHE)) next.resize(FORSYTH_CACHE);
+        cache.swap(next);
+    }
+    indices.swap(out);
+}
+
+void MeshOptimize::OptimizeOverdraw(std::vector<unsigned int>& indices, const std::vector<Vertex>& vertices,
+                                    float threshold) {
+    const size_t triCount = indices.size() / 3;
+    if (triCount < 2) return;
+    const size_t before = CacheMisses(indices, vertices.size());
+
+    //hard boundaries: a triangle missing all three vertices starts over, so cutting the order
+    //there costs nothing
+    std::vector<size_t> hard{0};
+    {
+        FifoCache cache(vertices.size(), ANALYZE_CACHE);
+        for (size_t t = 0; t < triCount; ++t) {
+            int misses = 0;
+            for (int k = 0; k < 3; ++k) misses += cache.Miss(indices[t * 3 + k]);
+            if (misses == 3 && t > 0) hard.push_back(t);
+        }
+        hard.push_back(triCount);
+    }
+    //soft boundaries: a cluster is cut again wherever its own misses so far stay within
+    //`threshold` of the whole cluster's rate
+    std::vector<size_t> starts;
+    FifoCache cache(vertices.size(), ANALYZE_CACHE);
+    for (size_t c = 0; c + 1 < hard.size(); ++c) {
+        const size_t begin = hard[c], end = hard[c + 1];
+        cache.Flush();
+        size_t clusterMisses = 0;
+        for (size_t k = begin * 3; k < end * 3; ++k) clusterMisses += cache.Miss(indices[k]);
+        const float limit = threshold * float(clusterMisses) / float(end - begin);
+        cache.Flush();
+        starts.push_back(begin);
+        size_t misses = 0, tris = 0;
+        for (size_t t = begin; t < end; ++t) {
+            for (int k = 0; k < 3; ++k) misses += cache.Miss(indices[t * 3 + k]);
+            ++tris;
+            if (t + 1 < end && tris >= size_t(ANALYZE_CACHE) && float(misses) / float(tris) <= limit) {
+                starts.push_back(t + 1);
+                cache.Flush();
+                misses = tris = 0;
+            }
+        }
+    }
+    starts.push_back(triCount);
+
+    //outward facing clusters first: they are the likely occluders from any side
+    glm::vec3 meshCentroid, meshNormal;
+    float meshArea;
+    ClusterShape(indices, vertices, 0, triCount, meshCentroid, meshNormal, meshArea);
+    struct Cluster {
+        size_t begin, end;
+        float key;
+    };
+    std::vector<Cluster> clusters;
+    clusters.reserve(starts.size() - 1);
+    for (size_t c = 0; c + 1 < starts.size(); ++c) {
+        glm::vec3 centroid, normal;
+        float area;
+        ClusterShape(indices, vertices, starts[c], starts[c + 1], centroid, normal, area);
+        const float length = glm::length(normal);
+        const float key = length > 0.0f ? glm::dot(centroid - meshCentroid, normal / length) : 0.0f;
+        clusters.push_back({starts[c], starts[c + 1], key});
+    }
+    std::stable_sort(clusters.begin(), clusters.end(), [](const Cluster& a, const Cluster& b) { return a.key > b.key; });
+
+    std::vector<unsigned int> sorted;
+    sorted.reserve(indices.size());
+    for (const Cluster& c : clusters)
+        sorted.insert(sorted.end(), indices.begin() + c.begin * 3, indices.begin() + c.end * 3);
+    if (float(CacheMisses(sorted, vertices.size())) <= threshold * float(before)) indices.swap(sorted);
+}
+
+void MeshOptimize::OptimizeVertexFetch(MeshData& mesh) {
+    std::vector<uint32_t> remap(mesh.vertices.size(), NONE);
+    std::vector<Vertex> ordered;
+    ordered.reserve(mesh.vertices.size());
+    for (unsigned int& i : mesh.indices) {
+        if (remap[i] == NONE) {
+            remap[i] = uint32_t(ordered.size());
+            ordered.push_back(mesh.vertices[i]);
+        }
+        i = remap[i];
+    }
+    mesh.vertices.swap(ordered); //vertices no triangle uses are dropped
+}
+
+void MeshOptimize::Optimize(std::vector<MeshData>& meshes, ThreadPool* pool) {
+    auto run = [&](size_t b, size_t e) {
+        for (size_t m = b; m < e; ++m) {
+            MeshData& mesh = meshes[m];
+            Weld(mesh);
+            OptimizeVertexCache(mesh.indices, mesh.vertices.size());
+            OptimizeOverdraw(mesh.indices, mesh.vertices);
+            OptimizeVertexFetch(mesh);
+        }
+    };
+    if (pool) pool->ParallelFor(meshes.size(), 1, run);
+    else run(0, meshes.size());
+}
+
+MeshOptimize::Stats MeshOptimize::Analyze(const std::vector<MeshData>& meshes, ThreadPool* pool) {
+    Stats stats;
+    size_t misses = 0;
+    glm::vec3 bmin(1e30f), bmax(-1e30f);
+    for (const MeshData& mesh : meshes) {
+        misses += CacheMisses(mesh.indices, mesh.vertices.size()); //every draw starts with an empty cache
+        stats.triangles += mesh.indices.size() / 3;
+        stats.vertices += mesh.vertices.size();
+        for (const Vertex& v : mesh.vertices) {
+            bmin = glm::min(bmin, v.Position);
+            bmax = glm::max(bmax, v.Position);
+        }
+    }
+    if (stats.triangles == 0) return stats;
+    stats.acmr = float(misses) / float(stats.triangles);
+    stats.atvr = stats.vertices ? float(misses) / float(stats.vertices) : 0.0f;
+
+    size_t shaded[6], covered[6];
+    auto run = [&](size_t b, size_t e) {
+        for (size_t view = b; view < e; ++view)
+            RasterizeView(meshes, bmin, bmax, int(view / 2), view % 2 == 0, shaded[view], covered[view]);
+    };
+    if (pool) pool->ParallelFor(6, 1, run);
+    else run(0, 6);
+    size_t totalShaded = 0, totalCovered = 0;
+    for (int view = 0; view < 6; ++view) {
+        totalShaded += shaded[view];
+        totalCovered += covered[view];
+    }
+    stats.overdraw = totalCovered ? float(totalShaded) / float(totalCovered) : 0.0f;
+    return stats;
+}
+
+void RunMeshOptimizeBenchmark(const std::vector<std::string>& models) {
+    ThreadPool pool;
+    std::printf("mesh optimization, %u workers + main thread; ACMR and ATVR at a %d-entry FIFO cache,\n"
+                "overdraw over six axis views at %dx%d\n", pool.Size(), ANALYZE_CACHE, OVERDRAW_GRID, OVERDRAW_GRID);
+    for (const std::string& path : models) {
+        std::vector<MeshData> meshes;
+        if (!MeshCache::Import(path, meshes)) continue;
+        std::printf("%s, %zu meshes\n", path.c_str(), meshes.size());
+        std::printf("  %-14s %9s %10s %10s %7s %7s %9s\n", "stage", "ms", "triangles", "vertices", "ACMR", "ATVR",
+                    "overdraw");
+        auto report = [&](const char* stage, double ms) {
+            const MeshOptimize::Stats s = MeshOptimize::Analyze(meshes, &pool);
+            std::printf("  %-14s %9.1f %10zu %10zu %7.3f %7.3f %9.3f\n", stage, ms, s.triangles, s.vertices, s.acmr,
+                        s.atvr, s.overdraw);
+        };
+        //one stage at a time over every mesh, each mesh on its own worker
+        auto stage = [&](const char* name, void (*fn)(MeshData&)) {
+            const auto t0 = std::chrono::steady_clock::now();
+            pool.ParallelFor(meshes.size(), 1, [&](size_t b, size_t e) {
+                for (size_t m = b; m < e; ++m) fn(meshes[m]);
+            });
+            report(name, MsSince(t0));
+        };
+        report("imported", 0.0);
+        stage("welded", [](MeshData& m) { MeshOptimize::Weld(m); });
+        stage("vertex cache", [](MeshData& m) { MeshOptimize::OptimizeVertexCache(m.indices, m.vertices.size()); });
+        stage("overdraw", [](MeshData& m) { MeshOptimize::OptimizeOverdraw(m.indices, m.vertices); });
+        stage("vertex fetch", [](MeshData& m) { MeshOptimize::OptimizeVertexFetch(m); });
+    }
+}
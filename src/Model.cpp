@@ -1,52 +1,142 @@
 #include "Model.hpp"
-#include <assimp/Importer.hpp>
-#include <assimp/postprocess.h>
+#include "AssetPack.hpp"
+#include "MeshCache.hpp"
+#include "MeshOptimize.hpp"
+#include "AOBake.hpp"
+#include "AssetStreamer.hpp"
+#include <cstdio>
 #include <iostream>
 
-Model::Model(const std::string& path) { loadModel(path); }
+namespace {
+const int LIGHTMAP_SIZE = 1024;
+}
+
+Model::Model(const std::string& path, unsigned bake, ThreadPool* pool, AssetStreamer* streamer, const glm::mat4& toWorld) {
+    loadModel(path, bake, pool, streamer, toWorld);
+}
+
+size_t Model::CreateVertexArrays(AssetStreamer* streamer) {
+    size_t waiting = 0;
+    for (auto& mesh : meshes) {
+        if (mesh.VAO) continue;
+        if (streamer && !streamer->BatchReady(mesh.StreamBatch())) { ++waiting; continue; }
+        mesh.CreateVertexArray();
+    }
+    return waiting;
+}
 
 void Model::Draw(Shader& shader) {
     for (auto& mesh : meshes) mesh.Draw(shader);
 }
 
-void Model::loadModel(std::string path) {
-    Assimp::Importer importer;
-    const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
-    if (!scene || !scene->mRootNode) {
-        std::cerr << "Model load error: " << importer.GetErrorString() << std::endl;
-        return;
-    }
-    directory = path.substr(0, path.find_last_of('/'));
-    processNode(scene->mRootNode, scene);
+void Model::SetInstanceBuffer(GLuint buffer, GLsizei stride, int vec4s) const {
+    for (const auto& mesh : meshes) mesh.SetInstanceBuffer(buffer, stride, vec4s);
+}
+
+void Model::DrawInstanced(int count) const {
+    for (const auto& mesh : meshes) mesh.DrawInstanced(count);
 }
 
-void Model::processNode(aiNode* node, const aiScene* scene) {
-    for (unsigned int i = 0; i < node->mNumMeshes; i++)
-        meshes.push_back(processMesh(scene->mMeshes[node->mMeshes[i]], scene));
-    for (unsigned int i = 0; i < node->mNumChildren; i++)
-        processNode(node->mChildren[i], scene);
+void Model::Bounds(glm::vec3& bmin, glm::vec3& bmax) const {
+    bmin = glm::vec3(1e30f);
+    bmax = glm::vec3(-1e30f);
+    for (const auto& mesh : meshes)
+        for (const auto& v : mesh.vertices) {
+            bmin = glm::min(bmin, v.Position);
+            bmax = glm::max(bmax, v.Position);
+        }
 }
 
-Mesh Model::processMesh(aiMesh* mesh, const aiScene* scene) {
-    std::vector<Vertex> vertices;
-    std::vector<unsigned int> indices;
-    bool hasUV = mesh->HasTextureCoords(0);
-    if (!hasUV) {
-        std::cerr << "[Assimp] Mesh has NO UVs: using (0,0) for all texcoords\n";
+bool Model::Prepare(const std::string& path, unsigned bake, ThreadPool* pool) {
+    CachedModel cached;
+    TriangleBVH collision;
+    Lightmap::Atlas atlas;
+    std::vector<float> ao;
+    return importStages(path, bake, pool, cached, collision, atlas, ao);
+}
+
+bool Model::importStages(const std::string& path, unsigned bake, ThreadPool* pool, CachedModel& cached,
+                         TriangleBVH& collision, Lightmap::Atlas& lightmapAtlas, std::vector<float>& ao) {
+    //warm start from cache/, assimp only when the cache is missing or older than the OBJ
+    bool dirty = false;
+    if (!MeshCache::Read(path, cached, pool)) {
+        if (!MeshCache::Import(path, cached.meshes)) return false;
+        cached.sections.clear();
+        dirty = true;
+        //welded and reordered once, before anything indexes the vertices or triangles
+        const MeshOptimize::Stats before = MeshOptimize::Analyze(cached.meshes, pool);
+        MeshOptimize::Optimize(cached.meshes, pool);
+        const MeshOptimize::Stats after = MeshOptimize::Analyze(cached.meshes, pool);
+        std::printf("[MESH] %s: %zu -> %zu vertices, ACMR %.3f -> %.3f, ATVR %.3f -> %.3f, overdraw %.3f -> %.3f\n",
+                    path.c_str(), before.vertices, after.vertices, before.acmr, after.acmr, before.atvr, after.atvr,
+                    before.overdraw, after.overdraw);
+    } else if (cached.draco != MeshCache::GetEncoding().draco && !AssetPack::Find(MeshCache::PathFor(path))) {
+        dirty = true; //stored the other way on disk, rewritten as asked (a packed cache stays as packed)
     }
+    auto vertexCount = [&]() {
+        size_t n = 0;
+        for (const auto& m : cached.meshes) n += m.vertices.size();
+        return n;
+    };
 
-    for (unsigned int i = 0; i < mesh->mNumVertices; i++) {
-        Vertex vertex;
-        vertex.Position = glm::vec3(mesh->mVertices[i].x, mesh->mVertices[i].y, mesh->mVertices[i].z);
-        vertex.Normal   = glm::vec3(mesh->mNormals[i].x, mesh->mNormals[i].y, mesh->mNormals[i].z);
-        vertex.TexCoords = mesh->HasTextureCoords(0) ?
-            glm::vec2(mesh->mTextureCoords[0][i].x, mesh->mTextureCoords[0][i].y) : glm::vec2(0.0f);
-        vertices.push_back(vertex);
+    //first: unwrapping may split vertices, which the per-vertex stages below depend on
+    if (bake & MODEL_LIGHTMAP) {
+        const CachedModel::Section* s = cached.Find(Lightmap::UV_TAG);
+        if (!s || !Lightmap::DeserializeAtlas(s->bytes, LIGHTMAP_SIZE, vertexCount(), lightmapAtlas)) {
+            Lightmap::Unwrap(cached.meshes, LIGHTMAP_SIZE, lightmapAtlas);
+            Lightmap::SerializeAtlas(lightmapAtlas, cached.Put(Lightmap::UV_TAG));
+            dirty = true;
+        }
+    }
+
+    if (bake & (MODEL_COLLISION | MODEL_AO)) {
+        const CachedModel::Section* s = cached.Find(TriangleBVH::CACHE_TAG);
+        if (!s || !collision.Deserialize(s->bytes)) {
+            collision.Build(cached.meshes, pool);
+            collision.Serialize(cached.Put(TriangleBVH::CACHE_TAG));
+            dirty = true;
+        }
+    }
+    if (bake & MODEL_AO) {
+        const AOBake::Settings settings;
+        const CachedModel::Section* s = cached.Find(AOBake::CACHE_TAG);
+        if (!s || !AOBake::Deserialize(s->bytes, settings, vertexCount(), ao)) {
+            AOBake::Bake(cached.meshes, collision, settings, pool, ao);
+            AOBake::Serialize(settings, ao, cached.Put(AOBake::CACHE_TAG));
+            dirty = true;
+        }
     }
+    if (dirty && !MeshCache::Write(path, cached, pool)) {
+        std::cerr << "Mesh cache: could not write " << MeshCache::PathFor(path) << std::endl;
+        return false;
+    }
+    return true;
+}
 
-    for (unsigned int i = 0; i < mesh->mNumFaces; i++)
-        for (unsigned int j = 0; j < mesh->mFaces[i].mNumIndices; j++)
-            indices.push_back(mesh->mFaces[i].mIndices[j]);
+void Model::loadModel(const std::string& path, unsigned bake, ThreadPool* pool, AssetStreamer* streamer, const glm::mat4& toWorld) {
+    CachedModel cached;
+    std::vector<float> ao;
+    //a cache that can't be written still leaves usable meshes
+    importStages(path, bake, pool, cached, collision, lightmapAtlas, ao);
+    if (cached.meshes.empty()) return;
+    source = path;
+    directory = path.substr(0, path.find_last_of('/'));
 
-    return Mesh(vertices, indices);
-}
\ No newline at end of file
+    meshes.reserve(cached.meshes.size());
+    size_t first = 0;
+    for (auto& m : cached.meshes) {
+        meshes.emplace_back(std::move(m.vertices), std::move(m.indices), streamer == nullptr);
+        if (!ao.empty()) meshes.back().SetVertexAO(ao.data() + first);
+        if (lightmapAtlas.size) meshes.back().SetLightmapUV(lightmapAtlas.uv.data() + first);
+        if (streamer) {
+            glm::vec3 wmin(1e30f), wmax(-1e30f);
+            for (const auto& v : meshes.back().vertices) {
+                const glm::vec3 w = glm::vec3(toWorld * glm::vec4(v.Position, 1.0f));
+                wmin = glm::min(wmin, w);
+                wmax = glm::max(wmax, w);
+            }
+            meshes.back().Upload(*streamer, wmin, wmax);
+        }
+        first += meshes.back().vertices.size();
+    }
+}
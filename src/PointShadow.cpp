@@ -0,0 +1,92 @@
+#include "PointShadow.hpp"
+#include <glm/gtc/matrix_transform.hpp>
+#include <string>
+
+void PointShadow::init(int newSize, const ShadowFormat& newFormat) {
+    if (tex && size == newSize && format.depthFormat == newFormat.depthFormat
+            && format.projection == newFormat.projection) return;
+    if (tex && format.projection != newFormat.projection) release(); //target can't change
+    if (!fbo) glGenFramebuffers(1, &fbo);
+    if (!tex) glGenTextures(1, &tex);
+    size = newSize;
+    format = newFormat;
+
+    GLenum tgt = target();
+    glBindTexture(tgt, tex);
+    if (format.projection == SHADOW_CUBE) {
+        for (int i=0;i<6;++i) {
+            glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X+i, 0, format.depthFormat,
+                        size, size, 0, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
+        }
+        glTexParameteri(tgt, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    } else {
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, format.depthFormat,
+                     size, size, 2, 0, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
+    }
+    glTexParameteri(tgt, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(tgt, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(tgt, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(tgt, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, tex, 0);
+    glDrawBuffer(GL_NONE);
+    glReadBuffer(GL_NONE);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void PointShadow::release() {
+    if (tex) glDeleteTextures(1, &tex);
+    if (fbo) glDeleteFramebuffers(1, &fbo);
+    tex = 0;
+    fbo = 0;
+    size = 0;
+}
+
+size_t DepthBytesPerTexel(GLenum depthFormat) {
+    //24-bit depth is stored padded to 32 bits by every driver we've seen
+    return depthFormat == GL_DEPTH_COMPONENT16 ? 2 : 4;
+}
+
+size_t PointShadow::memoryBytes() const {
+    return tex ? size_t(size) * size * views() * DepthBytesPerTexel(format.depthFormat) : 0;
+}
+
+const char* ShadowFormatName(const ShadowFormat& f) {
+    bool cube = f.projection == SHADOW_CUBE;
+    switch (f.depthFormat) {
+        case GL_DEPTH_COMPONENT16: return cube ? "cube/16"  : "dual-paraboloid/16";
+        case GL_DEPTH_COMPONENT24: return cube ? "cube/24"  : "dual-paraboloid/24";
+        default:                   return cube ? "cube/32F" : "dual-paraboloid/32F";
+    }
+}
+
+std::array<glm::mat4,6> ShadowMatrices(const PointShadow& s) {
+    float aspect = 1.0f;
+    glm::mat4 P = glm::perspective(glm::radians(90.0f), aspect, s.nearP, s.farP);
+    glm::vec3 L = s.lightPos;
+    return {
+        P * glm::lookAt(L, L + glm::vec3( 1, 0, 0), glm::vec3(0,-1, 0)),
+        P * glm::lookAt(L, L + glm::vec3(-1, 0, 0), glm::vec3(0,-1, 0)),
+        P * glm::lookAt(L, L + glm::vec3( 0, 1, 0), glm::vec3(0, 0, 1)),
+        P * glm::lookAt(L, L + glm::vec3( 0,-1, 0), glm::vec3(0, 0,-1)),
+        P * glm::lookAt(L, L + glm::vec3( 0, 0, 1), glm::vec3(0,-1, 0)),
+        P * glm::lookAt(L, L + glm::vec3( 0, 0,-1), glm::vec3(0,-1, 0))
+    };
+}
+
+void BeginShadowPass(Shader& shadowShader, const PointShadow& s, unsigned int viewMask) {
+    shadowShader.use();
+    bool dp = s.format.projection == SHADOW_DUAL_PARABOLOID;
+    shadowShader.setBool("dualParaboloid", dp);
+    if (!dp) {
+        auto mats = ShadowMatrices(s);
+        for (int i = 0; i < 6; ++i)
+            shadowShader.setMat4("shadowMatrices[" + std::to_string(i) + "]", mats[i]);
+    }
+    shadowShader.setVec3("lightPos", s.lightPos);
+    shadowShader.setFloat("farPlane", s.farP);
+    shadowShader.setInt("faceMask", (int)viewMask);
+    glBindFramebuffer(GL_FRAMEBUFFER, s.fbo);
+    glViewport(0, 0, s.size, s.size);
+}
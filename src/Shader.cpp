@@ -1,18 +1,41 @@
 #include "Shader.hpp"
+#include "AssetPack.hpp"
 #include <GL/glew.h>
 #include <fstream>
 #include <sstream>
 #include <iostream>
 
-Shader::Shader(const char* vertexPath, const char* fragmentPath) {
-    std::string vertexCode, fragmentCode;
-    std::ifstream vFile(vertexPath), fFile(fragmentPath);
-    std::stringstream vStream, fStream;
+//reads a shader file (from the asset pack when it has it), pasting in any `#include "file"`
+//line (path relative to the shader)
+static std::string LoadSource(const std::string& path) {
+    std::stringstream packed;
+    std::ifstream file;
+    std::istream* in = &file;
+    if (AssetPack::View v = AssetPack::Find(path)) {
+        packed.str(std::string(reinterpret_cast<const char*>(v.data), v.size));
+        in = &packed;
+    } else {
+        file.open(path);
+    }
+    std::string dir = path.substr(0, path.find_last_of('/') + 1);
+    std::stringstream out;
+    std::string line;
+    while (std::getline(*in, line)) {
+        size_t at = line.find_first_not_of(" \t");
+        size_t open = line.find('"');
+        size_t close = line.rfind('"');
+        if (at != std::string::npos && line.compare(at, 8, "#include") == 0
+                && open != std::string::npos && close > open)
+            out << LoadSource(dir + line.substr(open + 1, close - open - 1)) << "\n";
+        else
+            out << line << "\n";
+    }
+    return out.str();
+}
 
-    vStream << vFile.rdbuf();
-    fStream << fFile.rdbuf();
-    vertexCode = vStream.str();
-    fragmentCode = fStream.str();
+Shader::Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath) {
+    std::string vertexCode = LoadSource(vertexPath);
+    std::string fragmentCode = LoadSource(fragmentPath);
 
     const char* vShaderCode = vertexCode.c_str();
     const char* fShaderCode = fragmentCode.c_str();
@@ -24,13 +47,24 @@ Shader::Shader(const char* vertexPath, const char* fragmentPath) {
     glShaderSource(fragment, 1, &fShaderCode, NULL);
     glCompileShader(fragment);
 
+    unsigned int geometry = 0;
+    if (geometryPath) {
+        std::string geometryCode = LoadSource(geometryPath);
+        const char* gShaderCode = geometryCode.c_str();
+        geometry = glCreateShader(GL_GEOMETRY_SHADER);
+        glShaderSource(geometry, 1, &gShaderCode, NULL);
+        glCompileShader(geometry);
+    }
+
     ID = glCreateProgram();
     glAttachShader(ID, vertex);
     glAttachShader(ID, fragment);
+    if (geometry) glAttachShader(ID, geometry);
     glLinkProgram(ID);
 
     glDeleteShader(vertex);
     glDeleteShader(fragment);
+    if (geometry) glDeleteShader(geometry);
 
     int success;
     char infoLog[512];
@@ -41,6 +75,37 @@ Shader::Shader(const char* vertexPath, const char* fragmentPath) {
         std::cout << "Vertex Shader Compilation Failed:\n" << infoLog << std::endl;
 }
 }
+Shader::Shader(const char* vertexPath, const std::vector<std::string>& feedbackVaryings) {
+    std::string vertexCode = LoadSource(vertexPath);
+    const char* vShaderCode = vertexCode.c_str();
+
+    unsigned int vertex = glCreateShader(GL_VERTEX_SHADER);
+    glShaderSource(vertex, 1, &vShaderCode, NULL);
+    glCompileShader(vertex);
+
+    ID = glCreateProgram();
+    glAttachShader(ID, vertex);
+    //has to happen before linking
+    std::vector<const char*> names;
+    for (const auto& v : feedbackVaryings) names.push_back(v.c_str());
+    glTransformFeedbackVaryings(ID, (GLsizei)names.size(), names.data(), GL_INTERLEAVED_ATTRIBS);
+    glLinkProgram(ID);
+
+    int success;
+    char infoLog[512];
+    glGetShaderiv(vertex, GL_COMPILE_STATUS, &success);
+    if (!success) {
+        glGetShaderInfoLog(vertex, 512, NULL, infoLog);
+        std::cout << "Vertex Shader Compilation Failed:\n" << infoLog << std::endl;
+    }
+    glGetProgramiv(ID, GL_LINK_STATUS, &success);
+    if (!success) {
+        glGetProgramInfoLog(ID, 512, NULL, infoLog);
+        std::cout << "Transform Feedback Program Link Failed:\n" << infoLog << std::endl;
+    }
+    glDeleteShader(vertex);
+}
+
 auto checkCompile = [](GLuint s, const char* name){
     GLint ok=0; glGetShaderiv(s, GL_COMPILE_STATUS, &ok);
     if(!ok){
@@ -0,0 +1,131 @@
+#include "ShadowBench.hpp"
+#include "PointShadow.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+namespace {
+
+std::vector<float> ReadDepth(const PointShadow& s) {
+    const size_t face = size_t(s.size) * s.size;
+    std::vector<float> out(face * s.views());
+    glBindTexture(s.target(), s.tex);
+    if (s.format.projection == SHADOW_CUBE) {
+        for (int f = 0; f < 6; ++f)
+            glGetTexImage(GL_TEXTURE_CUBE_MAP_POSITIVE_X + f, 0, GL_DEPTH_COMPONENT, GL_FLOAT, out.data() + f * face);
+    } else {
+        glGetTexImage(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT, GL_FLOAT, out.data());
+    }
+    return out;
+}
+
+float Texel(const std::vector<float>& d, int size, int layer, float s, float t) {
+    int x = std::min(std::max(int(s * size), 0), size - 1);
+    int y = std::min(std::max(int(t * size), 0), size - 1);
+    return d[size_t(layer) * size * size + size_t(y) * size + x];
+}
+
+//same face selection as the GL spec cube lookup
+float LookupCube(const std::vector<float>& d, int size, const glm::vec3& v) {
+    float ax = std::fabs(v.x), ay = std::fabs(v.y), az = std::fabs(v.z);
+    int face; float ma, sc, tc;
+    if (ax >= ay && ax >= az) { face = v.x > 0 ? 0 : 1; ma = ax; sc = v.x > 0 ? -v.z : v.z; tc = -v.y; }
+    else if (ay >= az)        { face = v.y > 0 ? 2 : 3; ma = ay; sc = v.x; tc = v.y > 0 ? v.z : -v.z; }
+    else                      { face = v.z > 0 ? 4 : 5; ma = az; sc = v.z > 0 ? v.x : -v.x; tc = -v.y; }
+    return Texel(d, size, face, (sc / ma + 1.0f) * 0.5f, (tc / ma + 1.0f) * 0.5f);
+}
+
+//matches sampleShadowDP in lighting.frag
+float LookupDP(const std::vector<float>& d, int size, const glm::vec3& v) {
+    int layer = v.y >= 0.0f ? 0 : 1;
+    float k = 1.0f / (1.0f + std::fabs(v.y));
+    return Texel(d, size, layer, v.x * k * 0.5f + 0.5f, v.z * k * 0.5f + 0.5f);
+}
+
+//GPU time of one full shadow pass, averaged over `reps` after a warm-up pass
+double TimedPass(Shader& shadowShader, const PointShadow& s, const std::function<void()>& drawCasters, int reps) {
+    GLuint q = 0;
+    glGenQueries(1, &q);
+    double totalMs = 0.0;
+    for (int r = 0; r <= reps; ++r) {
+        glBeginQuery(GL_TIME_ELAPSED, q);
+        BeginShadowPass(shadowShader, s, (1u << s.views()) - 1u);
+        glClear(GL_DEPTH_BUFFER_BIT);
+        drawCasters();
+        glEndQuery(GL_TIME_ELAPSED);
+        GLuint64 ns = 0;
+        glGetQueryObjectui64v(q, GL_QUERY_RESULT, &ns);
+        if (r > 0) totalMs += ns / 1.0e6;
+    }
+    glDeleteQueries(1, &q);
+    return totalMs / reps;
+}
+
+} // namespace
+
+void RunShadowBenchmark(Shader& shadowShader, const glm::vec3& lightPos, int size,
+                        const std::function<void()>& drawCasters) {
+    glEnable(GL_DEPTH_TEST);
+    glEnable(GL_CULL_FACE);
+    glCullFace(GL_FRONT);
+
+    PointShadow ref;
+    ref.init(2048, ShadowFormat{ GL_DEPTH_COMPONENT32F, SHADOW_CUBE });
+    ref.lightPos = lightPos;
+    TimedPass(shadowShader, ref, drawCasters, 1);
+    const std::vector<float> refDepth = ReadDepth(ref);
+
+    //fibonacci sphere, every direction weighs the same
+    const int N = 16384;
+    std::vector<glm::vec3> dirs(N);
+    for (int i = 0; i < N; ++i) {
+        float y = 1.0f - 2.0f * (i + 0.5f) / N;
+        float r = std::sqrt(std::max(0.0f, 1.0f - y * y));
+        float phi = i * 2.39996323f;
+        dirs[i] = glm::vec3(r * std::cos(phi), y, r * std::sin(phi));
+    }
+
+    const GLenum depths[3] = { GL_DEPTH_COMPONENT16, GL_DEPTH_COMPONENT24, GL_DEPTH_COMPONENT32F };
+    const ShadowProjection projs[2] = { SHADOW_CUBE, SHADOW_DUAL_PARABOLOID };
+    const float bias = 0.02f; //same as pointShadow() in the shaders
+
+    std::printf("[SHADOW BENCH] light (%.1f, %.1f, %.1f), %d^2 per view, reference 2048^2 cube/32F\n",
+                lightPos.x, lightPos.y, lightPos.z, size);
+    std::printf("%-22s %10s %10s %12s %12s %12s\n", "mode", "memory", "pass ms", "mean err cm", "p99 err cm", "> bias %");
+
+    for (ShadowProjection proj : projs) {
+        for (GLenum depth : depths) {
+            PointShadow s;
+            s.init(size, ShadowFormat{ depth, proj });
+            s.lightPos = lightPos;
+            double ms = TimedPass(shadowShader, s, drawCasters, 10);
+            std::vector<float> d = ReadDepth(s);
+
+            std::vector<float> errs;
+            errs.reserve(N);
+            for (const auto& v : dirs) {
+                float r = LookupCube(refDepth, ref.size, v);
+                if (r >= 1.0f) continue; //nothing in that direction
+                float m = proj == SHADOW_CUBE ? LookupCube(d, s.size, v) : LookupDP(d, s.size, v);
+                errs.push_back(std::fabs(m - r) * s.farP);
+            }
+            double mean = 0.0, p99 = 0.0, over = 0.0;
+            if (!errs.empty()) {
+                for (float e : errs) { mean += e; if (e > bias) over += 1.0; }
+                mean /= errs.size();
+                over = 100.0 * over / errs.size();
+                std::nth_element(errs.begin(), errs.begin() + errs.size() * 99 / 100, errs.end());
+                p99 = errs[errs.size() * 99 / 100];
+            }
+            std::printf("%-22s %8.1fMB %10.3f %12.2f %12.2f %12.2f\n", ShadowFormatName(s.format),
+                        s.memoryBytes() / (1024.0 * 1024.0), ms, mean * 100.0, p99 * 100.0, over);
+            s.release();
+        }
+    }
+
+    ref.release();
+    glCullFace(GL_BACK);
+    glDisable(GL_CULL_FACE);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
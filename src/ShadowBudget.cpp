@@ -0,0 +1,139 @@
+#include "ShadowBudget.hpp"
+#include "Frustum.hpp"
+#include <algorithm>
+#include <unordered_map>
+
+int ShadowBudget::SizeForRank(int rank) {
+    if (rank == 0) return 1024;
+    if (rank <= 2) return 512;
+    return 256;
+}
+
+void ShadowBudget::Update(const std::vector<Lantern>& lanterns, const glm::mat4& viewProj,
+                          const glm::vec3& eye, const LightBVH* tree) {
+    const float R = LanternInfluenceRadius();
+    const Frustum frustum = Frustum::FromMatrix(viewProj);
+
+    std::unordered_map<unsigned int, int> holder; //lantern id -> slot
+    for (int s = 0; s < MAX_SLOTS; ++s)
+        if (slots[s].active) holder[slots[s].lanternId] = s;
+
+    //score: projected area of the light's reach, (R/d)^2, zero when it can't touch the view
+    std::vector<float> score(lanterns.size(), 0.0f);
+    std::vector<int> visible;
+    if (tree) {
+        tree->QuerySpheres(frustum, R, visible);
+    } else {
+        for (int i = 0; i < (int)lanterns.size(); ++i)
+            if (frustum.SphereVisible(lanterns[i].pos, R)) visible.push_back(i);
+    }
+
+    std::vector<int> candidates;
+    candidates.reserve(visible.size());
+    for (int i : visible) {
+        const Lantern& L = lanterns[i];
+        float d2 = std::max(glm::dot(L.pos - eye, L.pos - eye), 0.25f);
+        float s = R * R / d2;
+
+        auto it = holder.find(L.id);
+        if (it != holder.end()) {
+            s *= hysteresis;
+            if (slots[it->second].heldFrames < minHoldFrames) s += 1e6f; //locked in
+        }
+        score[i] = s;
+        candidates.push_back(i);
+    }
+
+    const int take = std::min((int)candidates.size(), MAX_SLOTS);
+    std::partial_sort(candidates.begin(), candidates.begin() + take, candidates.end(),
+        [&](int a, int b){ return score[a] > score[b]; });
+    candidates.resize(take);
+
+    //drop holders that fell out of the top N
+    bool keep[MAX_SLOTS] = {};
+    for (int rank = 0; rank < take; ++rank) {
+        auto it = holder.find(lanterns[candidates[rank]].id);
+        if (it != holder.end()) keep[it->second] = true;
+    }
+    for (int s = 0; s < MAX_SLOTS; ++s) {
+        if (slots[s].active && !keep[s]) {
+            slots[s].active = false;
+            slots[s].lanternIndex = -1;
+            slots[s].idleFrames = 0;
+        }
+    }
+
+    slotOfLantern.assign(lanterns.size(), -1);
+    for (int rank = 0; rank < take; ++rank) {
+        int li = candidates[rank];
+        int s;
+        auto it = holder.find(lanterns[li].id);
+        if (it != holder.end()) {
+            s = it->second;
+            slots[s].heldFrames++;
+        } else {
+            //prefer an empty slot that still has a cube of the right size
+            const int want = SizeForRank(rank);
+            s = -1;
+            for (int k = 0; k < MAX_SLOTS; ++k) {
+                if (slots[k].active) continue;
+                if (s < 0 || (slots[k].shadow.size == want && slots[s].shadow.size != want)) s = k;
+            }
+            slots[s].active = true;
+            slots[s].lanternId = lanterns[li].id;
+            slots[s].heldFrames = 0;
+            slots[s].smallerFrames = 0;
+        }
+
+        ShadowSlot& slot = slots[s];
+        slot.lanternIndex = li;
+        slot.score = score[li];
+        slotOfLantern[li] = s;
+
+        //grow right away, shrink only once the lower rank has stuck
+        const int want = SizeForRank(rank);
+        if (slot.shadow.tex && (slot.shadow.format.depthFormat != format.depthFormat
+                || slot.shadow.format.projection != format.projection)) {
+            slot.shadow.init(want, format); //format switched at runtime
+            slot.smallerFrames = 0;
+        } else if (slot.shadow.size < want) {
+            slot.shadow.init(want, format);
+            slot.smallerFrames = 0;
+        } else if (slot.shadow.size > want) {
+            if (++slot.smallerFrames > shrinkAfterFrames) {
+                slot.shadow.init(want, format);
+                slot.smallerFrames = 0;
+            }
+        } else {
+            slot.smallerFrames = 0;
+        }
+    }
+
+    for (auto& slot : slots) {
+        if (slot.active || !slot.shadow.tex) continue;
+        if (++slot.idleFrames > releaseAfterFrames) {
+            slot.shadow.release();
+            slot.cache.release();
+        }
+    }
+}
+
+int ShadowBudget::SlotOf(int lanternIndex) const {
+    if (lanternIndex < 0 || lanternIndex >= (int)slotOfLantern.size()) return -1;
+    return slotOfLantern[lanternIndex];
+}
+
+size_t ShadowBudget::MemoryBytes() const {
+    size_t total = 0;
+    for (const auto& slot : slots) total += slot.shadow.memoryBytes() + slot.cache.memoryBytes();
+    return total;
+}
+
+void ShadowBudget::ReleaseAll() {
+    for (auto& slot : slots) {
+        slot.shadow.release();
+        slot.cache.release();
+        slot.active = false;
+        slot.lanternIndex = -1;
+    }
+}
@@ -0,0 +1,91 @@
+#include "ShadowCache.hpp"
+#include <cmath>
+
+int CubeFace(const glm::vec3& d) {
+    glm::vec3 a(std::fabs(d.x), std::fabs(d.y), std::fabs(d.z));
+    if (a.x >= a.y && a.x >= a.z) return d.x >= 0.0f ? 0 : 1;
+    if (a.y >= a.z)               return d.y >= 0.0f ? 2 : 3;
+    return d.z >= 0.0f ? 4 : 5;
+}
+
+int ShadowViewOf(const glm::vec3& d, ShadowProjection projection) {
+    if (projection == SHADOW_CUBE) return CubeFace(d);
+    return d.y >= 0.0f ? 0 : 1;
+}
+
+ShadowCacheUpdate ShadowCache::Begin(PointShadow& live, unsigned int id, const glm::vec3& lightPos,
+                                     const glm::vec3& moverPos, float moverRadius) {
+    bool full = !valid
+        || id != lanternId
+        || live.tex != liveTex
+        || live.size != staticLayer.size
+        || live.format.depthFormat != staticLayer.format.depthFormat
+        || live.format.projection != staticLayer.format.projection
+        || glm::length(lightPos - origin) > moveTolerance;
+
+    if (full) {
+        staticLayer.init(live.size, live.format);
+        origin = lightPos;
+        lanternId = id;
+        liveTex = live.tex;
+        valid = true;
+        staticLayer.lightPos = origin;
+        live.lightPos = origin;
+        return { true, (1u << live.views()) - 1u };
+    }
+
+    live.lightPos = origin;
+    const int views = live.views();
+    unsigned int mask = 0;
+    for (int k = 0; k < facesPerFrame && k < views; ++k) {
+        mask |= 1u << (nextFace % views);
+        nextFace = (nextFace + 1) % views;
+    }
+
+    //every view the mover's bounding sphere can touch
+    const ShadowProjection proj = live.format.projection;
+    glm::vec3 c = moverPos - origin;
+    mask |= 1u << ShadowViewOf(c, proj);
+    for (int axis = 0; axis < 3; ++axis) {
+        glm::vec3 off(0.0f);
+        off[axis] = moverRadius;
+        mask |= 1u << ShadowViewOf(c + off, proj);
+        mask |= 1u << ShadowViewOf(c - off, proj);
+    }
+    return { false, mask };
+}
+
+void ShadowCache::release() {
+    staticLayer.release();
+    valid = false;
+    liveTex = 0;
+}
+
+void CopyShadowViews(const PointShadow& src, const PointShadow& dst, unsigned int viewMask) {
+    static GLuint readFbo = 0, drawFbo = 0;
+    if (!readFbo) {
+        glGenFramebuffers(1, &readFbo);
+        glGenFramebuffers(1, &drawFbo);
+    }
+
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, readFbo);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, drawFbo);
+    glReadBuffer(GL_NONE);
+    glDrawBuffer(GL_NONE);
+    const bool cube = src.format.projection == SHADOW_CUBE;
+    for (int f = 0; f < src.views(); ++f) {
+        if (!(viewMask & (1u << f))) continue;
+        if (cube) {
+            glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+                                   GL_TEXTURE_CUBE_MAP_POSITIVE_X + f, src.tex, 0);
+            glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+                                   GL_TEXTURE_CUBE_MAP_POSITIVE_X + f, dst.tex, 0);
+        } else {
+            glFramebufferTextureLayer(GL_READ_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, src.tex, 0, f);
+            glFramebufferTextureLayer(GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, dst.tex, 0, f);
+        }
+        glBlitFramebuffer(0, 0, src.size, src.size, 0, 0, dst.size, dst.size,
+                          GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
@@ -0,0 +1,164 @@
+#include "SpatialHash.hpp"
+#include "ThreadPool.hpp"
+#include "Philox.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+
+namespace {
+const size_t GRAIN = 2048; //points per task, small enough for a few tasks at 10k lanterns
+const size_t SCAN_BLOCKS = 64;
+}
+
+void SpatialHash::Build(const std::vector<Lantern>& lanterns, ThreadPool& pool) {
+    gathered.resize(lanterns.size());
+    for (size_t i = 0; i < lanterns.size(); ++i) gathered[i] = lanterns[i].pos;
+    Build(gathered.data(), gathered.size(), pool);
+}
+
+void SpatialHash::Build(const glm::vec3* points, size_t n, ThreadPool& pool) {
+    size_t buckets = 1024;
+    while (buckets < 2 * n) buckets *= 2;
+    mask = uint32_t(buckets - 1);
+    if (countsCapacity < buckets) {
+        counts.reset(new std::atomic<uint32_t>[buckets]);
+        countsCapacity = buckets;
+    }
+    start.resize(buckets + 1);
+    keys.resize(n);
+    sortedIndex.resize(n);
+    sortedPos.resize(n);
+    sortedCell.resize(n);
+
+    //1. count
+    pool.ParallelFor(buckets, buckets / SCAN_BLOCKS, [&](size_t b, size_t e) {
+        for (size_t i = b; i < e; ++i) counts[i].store(0, std::memory_order_relaxed);
+    });
+    pool.ParallelFor(n, GRAIN, [&](size_t b, size_t e) {
+        for (size_t i = b; i < e; ++i) {
+            keys[i] = bucketOf(cellOf(points[i]));
+            counts[keys[i]].fetch_add(1, std::memory_order_relaxed);
+        }
+    });
+
+    //2. exclusive prefix sum: block totals in parallel, scan the totals, then each block
+    const size_t blockSize = buckets / SCAN_BLOCKS;
+    uint32_t blockBase[SCAN_BLOCKS + 1];
+    pool.ParallelFor(SCAN_BLOCKS, 1, [&](size_t b, size_t e) {
+        for (size_t blk = b; blk < e; ++blk) {
+            uint32_t sum = 0;
+            for (size_t i = blk * blockSize; i < (blk + 1) * blockSize; ++i)
+                sum += counts[i].load(std::memory_order_relaxed);
+            blockBase[blk + 1] = sum;
+        }
+    });
+    blockBase[0] = 0;
+    for (size_t blk = 0; blk < SCAN_BLOCKS; ++blk) blockBase[blk + 1] += blockBase[blk];
+    pool.ParallelFor(SCAN_BLOCKS, 1, [&](size_t b, size_t e) {
+        for (size_t blk = b; blk < e; ++blk) {
+            uint32_t run = blockBase[blk];
+            for (size_t i = blk * blockSize; i < (blk + 1) * blockSize; ++i) {
+                uint32_t c = counts[i].load(std::memory_order_relaxed);
+                start[i] = run;
+                counts[i].store(run, std::memory_order_relaxed); //becomes the scatter cursor
+                run += c;
+            }
+        }
+    });
+    start[buckets] = uint32_t(n);
+
+    //3. scatter, then put each bucket back in index order (they hold ~0.5 points on average)
+    pool.ParallelFor(n, GRAIN, [&](size_t b, size_t e) {
+        for (size_t i = b; i < e; ++i)
+            sortedIndex[counts[keys[i]].fetch_add(1, std::memory_order_relaxed)] = uint32_t(i);
+    });
+    pool.ParallelFor(buckets, buckets / SCAN_BLOCKS, [&](size_t b, size_t e) {
+        for (size_t k = b; k < e; ++k) {
+            if (start[k + 1] - start[k] > 1)
+                std::sort(sortedIndex.begin() + start[k], sortedIndex.begin() + start[k + 1]);
+            for (uint32_t s = start[k]; s < start[k + 1]; ++s) {
+                sortedPos[s] = points[sortedIndex[s]];
+                sortedCell[s] = cellKey(cellOf(sortedPos[s]));
+            }
+        }
+    });
+}
+
+void SpatialHash::Separation(float radius, float strength, std::vector<glm::vec3>& out, ThreadPool& pool) const {
+    out.resize(sortedIndex.size());
+    const float invRadius = 1.0f / radius;
+    //walk in bucket order so neighbouring queries hit the same cache lines
+    pool.ParallelFor(sortedIndex.size(), GRAIN, [&](size_t b, size_t e) {
+        for (size_t s = b; s < e; ++s) {
+            const uint32_t self = sortedIndex[s];
+            glm::vec3 push(0.0f);
+            Query(sortedPos[s], radius, [&](uint32_t j, const glm::vec3& d, float d2) {
+                if (j == self || d2 <= 1e-12f) return; //coincident points have no direction
+                float dist = std::sqrt(d2);
+                push -= d * ((1.0f - dist * invRadius) / dist);
+            });
+            out[self] = push * strength;
+        }
+    });
+}
+
+void RunSpatialHashBenchmark() {
+    using Clock = std::chrono::steady_clock;
+    auto ms = [](Clock::time_point a, Clock::time_point b) {
+        return std::chrono::duration<double, std::milli>(b - a).count();
+    };
+    const float RADIUS = 0.5f, DENSITY = 4.0f; //lanterns per unit^3, ~2 neighbours each
+    const int REPEAT = 10;
+    ThreadPool pool;
+    SpatialHash grid;
+    grid.cellSize = 2.0f * RADIUS;
+
+    std::printf("\n== Spatial hash: radius %.2f, %.0f lanterns/unit^3, %u workers + caller ==\n",
+                RADIUS, DENSITY, pool.Size());
+    std::printf("%-8s %10s %10s %12s %14s %12s\n", "count", "build ms", "sep ms", "ns/lantern", "brute ms", "max diff");
+    for (size_t n : {10000u, 20000u, 50000u, 100000u, 200000u}) {
+        const float side = std::cbrt(n / DENSITY);
+        std::vector<float> r(3 * n);
+        FillUniform(r.data(), r.size(), 0.0f, side, RandomKey{7u, 0u, uint32_t(n)});
+        std::vector<glm::vec3> pts(n);
+        for (size_t i = 0; i < n; ++i) pts[i] = glm::vec3(r[3 * i], r[3 * i + 1], r[3 * i + 2]);
+
+        std::vector<glm::vec3> sep;
+        double buildMs = 0.0, sepMs = 0.0;
+        for (int k = 0; k < REPEAT; ++k) {
+            auto t0 = Clock::now();
+            grid.Build(pts.data(), n, pool);
+            auto t1 = Clock::now();
+            grid.Separation(RADIUS, 1.0f, sep, pool);
+            auto t2 = Clock::now();
+            buildMs += ms(t0, t1);
+            sepMs += ms(t1, t2);
+        }
+        buildMs /= REPEAT;
+        sepMs /= REPEAT;
+
+        //O(n^2) reference, only where it finishes in reasonable time
+        if (n <= 20000) {
+            std::vector<glm::vec3> brute(n, glm::vec3(0.0f));
+            auto t0 = Clock::now();
+            pool.ParallelFor(n, 256, [&](size_t b, size_t e) {
+                for (size_t i = b; i < e; ++i)
+                    for (size_t j = 0; j < n; ++j) {
+                        glm::vec3 d = pts[j] - pts[i];
+                        float d2 = glm::dot(d, d);
+                        if (j == i || d2 > RADIUS * RADIUS || d2 <= 1e-12f) continue;
+                        float dist = std::sqrt(d2);
+                        brute[i] -= d * ((1.0f - dist / RADIUS) / dist);
+                    }
+            });
+            double bruteMs = ms(t0, Clock::now());
+            float maxDiff = 0.0f;
+            for (size_t i = 0; i < n; ++i) maxDiff = std::max(maxDiff, glm::length(brute[i] - sep[i]));
+            std::printf("%-8zu %10.3f %10.3f %12.1f %14.2f %12.2e\n", n, buildMs, sepMs,
+                        (buildMs + sepMs) * 1e6 / n, bruteMs, maxDiff);
+        } else {
+            std::printf("%-8zu %10.3f %10.3f %12.1f %14s %12s\n", n, buildMs, sepMs,
+                        (buildMs + sepMs) * 1e6 / n, "-", "-");
+        }
+    }
+}
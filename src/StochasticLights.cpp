@@ -0,0 +1,221 @@
+#include "StochasticLights.hpp"
+#include <algorithm>
+
+namespace {
+GLuint MakeTarget(GLenum internalFormat, GLenum format, GLenum type, int w, int h) {
+    GLuint t = 0;
+    glGenTextures(1, &t);
+    glBindTexture(GL_TEXTURE_2D, t);
+    glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, w, h, 0, format, type, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    return t;
+}
+
+void UploadTexels(GLuint buf, GLuint tex, const std::vector<glm::vec4>& texels) {
+    glBindBuffer(GL_TEXTURE_BUFFER, buf);
+    //orphan, last frame's copy may still be in flight
+    glBufferData(GL_TEXTURE_BUFFER, std::max<size_t>(texels.size(), 1) * sizeof(glm::vec4), nullptr, GL_STREAM_DRAW);
+    if (!texels.empty())
+        glBufferSubData(GL_TEXTURE_BUFFER, 0, texels.size() * sizeof(glm::vec4), texels.data());
+    glBindTexture(GL_TEXTURE_BUFFER, tex);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, buf);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+}
+
+void StochasticLights::init() {
+    glGenBuffers(1, &lightBuf);
+    glGenBuffers(1, &aliasBuf);
+    glGenTextures(1, &lightTex);
+    glGenTextures(1, &aliasTex);
+    UploadTexels(lightBuf, lightTex, lightTexels);
+    UploadTexels(aliasBuf, aliasTex, aliasTexels);
+    glGenVertexArrays(1, &emptyVAO);
+
+    temporal.reset(new Shader("shaders/fullscreen.vert", "shaders/stochastic_temporal.frag"));
+    denoise.reset(new Shader("shaders/fullscreen.vert", "shaders/stochastic_denoise.frag"));
+    composite.reset(new Shader("shaders/fullscreen.vert", "shaders/stochastic_composite.frag"));
+}
+
+void StochasticLights::BuildLightTables(const std::vector<Lantern>& lanterns, const glm::vec3& eye) {
+    const size_t n = lanterns.size();
+    lightCount = n;
+    externalTex = 0;
+    lightTexels.resize(n);
+    aliasTexels.resize(n);
+
+    //proposal weight: power over squared distance to the camera
+    std::vector<float> w(n);
+    double total = 0.0;
+    for (size_t i = 0; i < n; ++i) {
+        const float power = 1.0f;
+        glm::vec3 d = lanterns[i].pos - eye;
+        w[i] = power / std::max(glm::dot(d, d), 1.0f);
+        total += w[i];
+        lightTexels[i] = glm::vec4(lanterns[i].pos, power);
+    }
+
+    //Vose's alias method: every bucket keeps i with prob[i] or falls to alias[i]
+    std::vector<float> prob(n);
+    std::vector<int> alias(n, 0), small, large;
+    small.reserve(n);
+    large.reserve(n);
+    for (size_t i = 0; i < n; ++i) {
+        prob[i] = float(w[i] * n / total);
+        (prob[i] < 1.0f ? small : large).push_back((int)i);
+    }
+    while (!small.empty() && !large.empty()) {
+        int s = small.back(); small.pop_back();
+        int l = large.back();
+        alias[s] = l;
+        prob[l] = (prob[l] + prob[s]) - 1.0f;
+        if (prob[l] < 1.0f) { large.pop_back(); small.push_back(l); }
+    }
+    for (int i : large) prob[i] = 1.0f;
+    for (int i : small) prob[i] = 1.0f; //float round-off leftovers
+
+    for (size_t i = 0; i < n; ++i)
+        aliasTexels[i] = glm::vec4(prob[i], float(alias[i]), float(w[i] / total), 0.0f);
+
+    UploadTexels(lightBuf, lightTex, lightTexels);
+    UploadTexels(aliasBuf, aliasTex, aliasTexels);
+}
+
+void StochasticLights::UseExternalLights(GLuint bufferTexture, size_t count, int stride, bool analytic) {
+    externalTex = bufferTexture;
+    externalStride = stride;
+    externalAnalytic = analytic;
+    lightCount = count;
+}
+
+void StochasticLights::BindForShading(Shader& lit, int lightUnit, int aliasUnit) const {
+    glActiveTexture(GL_TEXTURE0 + lightUnit);
+    glBindTexture(GL_TEXTURE_BUFFER, externalTex ? externalTex : lightTex);
+    glActiveTexture(GL_TEXTURE0 + aliasUnit);
+    glBindTexture(GL_TEXTURE_BUFFER, aliasTex);
+    glActiveTexture(GL_TEXTURE0);
+
+    lit.setInt("lightData", lightUnit);
+    lit.setInt("lightAlias", aliasUnit);
+    lit.setBool("stochasticLights", enabled);
+    lit.setInt("lightCount", enabled ? (int)lightCount : 0);
+    lit.setInt("frameIndex", frameIndex);
+    lit.setInt("lightStride", externalTex ? externalStride : 1);
+    lit.setBool("lightUniform", externalTex != 0);
+    lit.setBool("lightAnalytic", externalTex != 0 && externalAnalytic);
+}
+
+void StochasticLights::allocTargets(int w, int h) {
+    releaseTargets();
+    width = w;
+    height = h;
+
+    colorTex    = MakeTarget(GL_RGBA16F, GL_RGBA, GL_FLOAT, w, h);
+    lightingTex = MakeTarget(GL_RGBA16F, GL_RGBA, GL_FLOAT, w, h);
+    albedoTex   = MakeTarget(GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, w, h);
+    depthTex    = MakeTarget(GL_DEPTH_COMPONENT24, GL_DEPTH_COMPONENT, GL_FLOAT, w, h);
+    glGenFramebuffers(1, &sceneFbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, sceneFbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, colorTex, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, lightingTex, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, GL_TEXTURE_2D, albedoTex, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthTex, 0);
+    const GLenum bufs[3] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2 };
+    glDrawBuffers(3, bufs);
+
+    //history: rgb = accumulated lantern light, a = clip w of the surface it belongs to
+    for (int i = 0; i < 2; ++i) {
+        historyTex[i] = MakeTarget(GL_RGBA16F, GL_RGBA, GL_FLOAT, w, h);
+        glGenFramebuffers(1, &historyFbo[i]);
+        glBindFramebuffer(GL_FRAMEBUFFER, historyFbo[i]);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, historyTex[i], 0);
+    }
+    filterTex = MakeTarget(GL_RGBA16F, GL_RGBA, GL_FLOAT, w, h);
+    glGenFramebuffers(1, &filterFbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, filterFbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, filterTex, 0);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    historyValid = false;
+}
+
+void StochasticLights::releaseTargets() {
+    GLuint texs[] = { colorTex, lightingTex, albedoTex, depthTex, historyTex[0], historyTex[1], filterTex };
+    GLuint fbos[] = { sceneFbo, historyFbo[0], historyFbo[1], filterFbo };
+    for (GLuint t : texs) if (t) glDeleteTextures(1, &t);
+    for (GLuint f : fbos) if (f) glDeleteFramebuffers(1, &f);
+    colorTex = lightingTex = albedoTex = depthTex = filterTex = 0;
+    historyTex[0] = historyTex[1] = 0;
+    sceneFbo = filterFbo = 0;
+    historyFbo[0] = historyFbo[1] = 0;
+}
+
+void StochasticLights::BeginScene(int w, int h) {
+    if (w != width || h != height || !sceneFbo) allocTargets(w, h);
+    glBindFramebuffer(GL_FRAMEBUFFER, sceneFbo);
+    glViewport(0, 0, w, h);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+}
+
+void StochasticLights::Resolve(const glm::mat4& viewProj) {
+    glDisable(GL_DEPTH_TEST);
+    glDepthMask(GL_FALSE);
+    glBindVertexArray(emptyVAO);
+
+    auto bind = [](int unit, GLuint tex) {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        glBindTexture(GL_TEXTURE_2D, tex);
+    };
+
+    //1. temporal accumulation into the next history
+    const int prev = historyIndex, next = 1 - historyIndex;
+    glBindFramebuffer(GL_FRAMEBUFFER, historyFbo[next]);
+    temporal->use();
+    bind(0, lightingTex);
+    bind(1, depthTex);
+    bind(2, historyTex[prev]);
+    temporal->setInt("currentLight", 0);
+    temporal->setInt("depthTex", 1);
+    temporal->setInt("history", 2);
+    temporal->setMat4("viewProj", viewProj);
+    temporal->setMat4("invViewProj", glm::inverse(viewProj));
+    temporal->setMat4("prevViewProj", prevViewProj);
+    temporal->setBool("historyValid", historyValid);
+    temporal->setFloat("blend", historyBlend);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+
+    //2. depth-aware spatial filter, not fed back so history stays sharp
+    glBindFramebuffer(GL_FRAMEBUFFER, filterFbo);
+    denoise->use();
+    bind(0, historyTex[next]);
+    denoise->setInt("accumulated", 0);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+
+    //3. base + albedo * lantern light, depth restored for skybox and water
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glEnable(GL_DEPTH_TEST);
+    glDepthFunc(GL_ALWAYS);
+    glDepthMask(GL_TRUE);
+    composite->use();
+    bind(0, colorTex);
+    bind(1, filterTex);
+    bind(2, albedoTex);
+    bind(3, depthTex);
+    composite->setInt("baseColor", 0);
+    composite->setInt("lanternLight", 1);
+    composite->setInt("albedo", 2);
+    composite->setInt("depthTex", 3);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    glDepthFunc(GL_LESS);
+
+    glBindVertexArray(0);
+    glActiveTexture(GL_TEXTURE0);
+
+    historyIndex = next;
+    historyValid = true;
+    prevViewProj = viewProj;
+    frameIndex++;
+}
@@ -0,0 +1,53 @@
+#include "TextureDensity.hpp"
+#include "Model.hpp"
+#include <algorithm>
+#include <cmath>
+#include <utility>
+#include <vector>
+
+namespace TextureDensity {
+
+Estimate Analyze(const Model& model, float scale, float closestCenter, float fovY, int viewportHeight) {
+    Estimate estimate;
+    std::vector<std::pair<float, float>> ratios; //world per UV, world area
+    float totalArea = 0.0f;
+    for (const Mesh& mesh : model.getMeshes()) {
+        for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3) {
+            const Vertex& a = mesh.vertices[mesh.indices[i]];
+            const Vertex& b = mesh.vertices[mesh.indices[i + 1]];
+            const Vertex& c = mesh.vertices[mesh.indices[i + 2]];
+            const float world = 0.5f * scale * scale * glm::length(glm::cross(b.Position - a.Position, c.Position - a.Position));
+            const glm::vec2 du = b.TexCoords - a.TexCoords, dv = c.TexCoords - a.TexCoords;
+            const float uv = 0.5f * std::fabs(du.x * dv.y - du.y * dv.x);
+            if (world <= 0.0f || uv < 1e-10f) continue; //no UVs or degenerate
+            ratios.push_back({std::sqrt(world / uv), world});
+            totalArea += world;
+        }
+    }
+    if (ratios.empty()) return estimate;
+
+    std::sort(ratios.begin(), ratios.end());
+    float covered = 0.0f;
+    estimate.worldPerUV = ratios.back().first;
+    for (const auto& r : ratios) {
+        covered += r.second;
+        if (covered >= 0.95f * totalArea) { estimate.worldPerUV = r.first; break; }
+    }
+
+    glm::vec3 bmin, bmax;
+    model.Bounds(bmin, bmax);
+    estimate.radius = 0.5f * scale * glm::length(bmax - bmin);
+    const float tanHalf = std::tan(0.5f * fovY);
+    const float fills = estimate.radius / tanHalf - estimate.radius; //sphere spans the viewport height
+    estimate.closest = std::max(closestCenter - estimate.radius, fills);
+    if (estimate.closest <= 0.0f) return estimate;
+
+    //world size of one pixel at that distance, then texels so that one texel is no bigger
+    const float pixel = 2.0f * estimate.closest * tanHalf / float(viewportHeight);
+    const float texels = estimate.worldPerUV / pixel;
+    estimate.size = 1;
+    while (float(estimate.size) < texels && estimate.size < 16384) estimate.size *= 2;
+    return estimate;
+}
+
+} //namespace TextureDensity
@@ -0,0 +1,445 @@
+#include "TextureLoader.hpp"
+#include "AssetPack.hpp"
+#include "ImageFilter.hpp"
+#include "MeshCache.hpp"
+#include "ThreadPool.hpp"
+#include "stb_image.h"
+#include <GL/glew.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+namespace {
+
+const uint32_t MAGIC = FourCC('T', 'E', 'X', 'C');
+const uint32_t VERSION = 3;
+
+struct CacheHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t contentHash; //of the source file's bytes
+    uint32_t kind;
+    uint32_t compression;
+    uint32_t format;
+    int32_t maxSize;
+    int32_t sourceWidth, sourceHeight;
+    int32_t width, height;
+    uint32_t levels;
+    uint32_t pad;
+};
+
+double MsSince(std::chrono::steady_clock::time_point t0) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+}
+
+bool ReadFile(const std::string& path, std::vector<uint8_t>& bytes) {
+    FILE* f = std::fopen(path.c_str(), "rb");
+    if (!f) return false;
+    struct stat st;
+    bool ok = fstat(fileno(f), &st) == 0;
+    if (ok) {
+        bytes.resize(size_t(st.st_size));
+        ok = bytes.empty() || std::fread(bytes.data(), 1, bytes.size(), f) == bytes.size();
+    }
+    std::fclose(f);
+    return ok;
+}
+
+uint64_t ContentHash(const uint8_t* bytes, size_t size) {
+    uint64_t h = 1469598103934665603ull;
+    for (size_t i = 0; i < size; ++i) h = (h ^ bytes[i]) * 1099511628211ull;
+    return h;
+}
+
+int LevelSize(int size, size_t level) { return std::max(1, size >> level); }
+
+//every level down to 1x1 from the one above
+void BuildMips(TextureLoader::Image& image) {
+    int w = image.width, h = image.height;
+    while (w > 1 || h > 1) {
+        const int nw = std::max(1, w / 2), nh = std::max(1, h / 2);
+        std::vector<uint8_t> next;
+        ImageFilter::Downsample(image.levels.back().data(), w, h, nw, nh, next);
+        image.levels.push_back(std::move(next));
+        w = nw;
+        h = nh;
+    }
+}
+
+//header fields shared by a cache file and a packed one; false when the header doesn't match the request
+bool ApplyHeader(const CacheHeader& header, TextureLoader::Kind kind, TextureLoader::Compression compression,
+                 int maxSize, TextureLoader::Image& image) {
+    const bool ok = header.magic == MAGIC && header.version == VERSION && header.kind == uint32_t(kind)
+           && header.compression == uint32_t(compression) && header.maxSize == maxSize
+           && header.format <= BlockCompress::BC7
+           && header.width > 0 && header.height > 0 && header.width <= 16384 && header.height <= 16384
+           && header.levels > 0 && header.levels <= 15;
+    if (!ok) return false;
+    image.width = header.width;
+    image.height = header.height;
+    image.sourceWidth = header.sourceWidth;
+    image.sourceHeight = header.sourceHeight;
+    image.format = BlockCompress::Format(header.format);
+    image.levels.resize(header.levels);
+    return true;
+}
+
+size_t CachedLevelBytes(const TextureLoader::Image& image, size_t level) {
+    return BlockCompress::LevelBytes(image.format, LevelSize(image.width, level), LevelSize(image.height, level));
+}
+
+bool ReadCache(const std::string& path, uint64_t hash, TextureLoader::Kind kind,
+               TextureLoader::Compression compression, int maxSize, TextureLoader::Image& image) {
+    FILE* f = std::fopen(path.c_str(), "rb");
+    if (!f) return false;
+    CacheHeader header;
+    bool ok = std::fread(&header, sizeof(header), 1, f) == 1 && header.contentHash == hash
+           && ApplyHeader(header, kind, compression, maxSize, image);
+    for (size_t l = 0; ok && l < image.levels.size(); ++l) {
+        std::vector<uint8_t>& bytes = image.levels[l].bytes;
+        bytes.resize(CachedLevelBytes(image, l));
+        ok = std::fread(bytes.data(), 1, bytes.size(), f) == bytes.size();
+    }
+    std::fclose(f);
+    if (!ok) image = TextureLoader::Image();
+    return ok;
+}
+
+//a packed .tex, trusted without the source hash (the packer built it from the file it ships);
+//the levels point into the mapping
+bool MapPackedCache(const AssetPack::View& packed, TextureLoader::Kind kind, TextureLoader::Compression compression,
+                    int maxSize, TextureLoader::Image& image) {
+    CacheHeader header;
+    if (packed.size < sizeof(header)) return false;
+    std::memcpy(&header, packed.data, sizeof(header));
+    bool ok = ApplyHeader(header, kind, compression, maxSize, image);
+    size_t at = sizeof(header);
+    for (size_t l = 0; ok && l < image.levels.size(); ++l) {
+        const size_t bytes = CachedLevelBytes(image, l);
+        ok = bytes <= packed.size - at;
+        image.levels[l].mapped = packed.data + at;
+        image.levels[l].mappedSize = bytes;
+        at += bytes;
+    }
+    if (!ok) image = TextureLoader::Image();
+    return ok;
+}
+
+bool WriteCache(const std::string& path, uint64_t hash, TextureLoader::Kind kind,
+                TextureLoader::Compression compression, int maxSize, const TextureLoader::Image& image) {
+    const CacheHeader header{MAGIC, VERSION, hash, uint32_t(kind), uint32_t(compression), uint32_t(image.format),
+                             maxSize, image.sourceWidth, image.sourceHeight, image.width, image.height,
+                             uint32_t(image.levels.size()), 0};
+    mkdir("cache", 0755);
+    const std::string tmp = path + ".tmp";
+    FILE* f = std::fopen(tmp.c_str(), "wb");
+    if (!f) return false;
+    bool ok = std::fwrite(&header, sizeof(header), 1, f) == 1;
+    for (const auto& level : image.levels)
+        ok = ok && std::fwrite(level.data(), 1, level.size(), f) == level.size();
+    ok = (std::fclose(f) == 0) && ok;
+    if (!ok || std::rename(tmp.c_str(), path.c_str()) != 0) {
+        std::remove(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool Opaque(const std::vector<uint8_t>& rgba) {
+    for (size_t i = 3; i < rgba.size(); i += 4)
+        if (rgba[i] != 255) return false;
+    return true;
+}
+
+GLenum InternalFormat(BlockCompress::Format format) {
+    switch (format) {
+    case BlockCompress::BC1: return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+    case BlockCompress::BC3: return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+    case BlockCompress::BC7: return GL_COMPRESSED_RGBA_BPTC_UNORM;
+    default: return GL_RGBA8;
+    }
+}
+
+bool DriverSamples(BlockCompress::Format format) {
+    switch (format) {
+    case BlockCompress::BC1:
+    case BlockCompress::BC3: return GLEW_EXT_texture_compression_s3tc;
+    case BlockCompress::BC7: return GLEW_ARB_texture_compression_bptc;
+    default: return true;
+    }
+}
+
+//one level of `image` into target; blocks the driver can't sample are expanded to RGBA8 first
+void UploadLevel(GLenum target, const TextureLoader::Image& image, size_t level) {
+    const int w = LevelSize(image.width, level), h = LevelSize(image.height, level);
+    const TextureLoader::Level& data = image.levels[level];
+    if (image.format == BlockCompress::RGBA8 || !DriverSamples(image.format)) {
+        std::vector<uint8_t> rgba;
+        const uint8_t* pixels = data.data();
+        if (image.format != BlockCompress::RGBA8) {
+            BlockCompress::Decode(image.format, data.data(), w, h, rgba);
+            pixels = rgba.data();
+        }
+        glTexImage2D(target, GLint(level), GL_RGBA, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+    } else {
+        glCompressedTexImage2D(target, GLint(level), InternalFormat(image.format), w, h, 0, GLsizei(data.size()),
+                               data.data());
+    }
+}
+
+//what a texture of this size takes on the GPU, whole mip chain or level 0 only
+size_t ChainBytes(BlockCompress::Format format, int width, int height, bool mips) {
+    if (!DriverSamples(format)) format = BlockCompress::RGBA8;
+    size_t bytes = 0;
+    for (size_t l = 0; ; ++l) {
+        const int w = LevelSize(width, l), h = LevelSize(height, l);
+        bytes += BlockCompress::LevelBytes(format, w, h);
+        if (!mips || (w == 1 && h == 1)) return bytes;
+    }
+}
+
+size_t ImageBytes(const TextureLoader::Image& image) {
+    size_t bytes = 0;
+    for (const auto& level : image.levels) bytes += level.size();
+    return bytes;
+}
+
+} //namespace
+
+void TextureLoader::Decode(const std::string& path, Kind kind, Compression compression, int maxSize,
+                           bool readCache, ThreadPool* pool, Image& image) {
+    const auto t0 = std::chrono::steady_clock::now();
+    image = Image();
+    const std::string cachePath = MeshCache::PathFor(path, ".tex");
+    const AssetPack::View packedCache = AssetPack::Find(cachePath);
+    if (readCache && packedCache && MapPackedCache(packedCache, kind, compression, maxSize, image)) {
+        image.fromCache = true;
+        image.ms = MsSince(t0);
+        return;
+    }
+
+    std::vector<uint8_t> file;
+    AssetPack::View source = AssetPack::Find(path); //the packed file, or the one read here
+    if (!source) {
+        if (!ReadFile(path, file)) {
+            std::printf("[TEX] can't read '%s'\n", path.c_str());
+            return;
+        }
+        source = AssetPack::View{file.data(), file.size()};
+    }
+    const uint64_t hash = ContentHash(source.data, source.size);
+    if (readCache && ReadCache(cachePath, hash, kind, compression, maxSize, image)) {
+        image.fromCache = true;
+        image.ms = MsSince(t0);
+        return;
+    }
+
+    int w = 0, h = 0, n = 0;
+    unsigned char* data = stbi_load_from_memory(source.data, int(source.size), &w, &h, &n, STBI_rgb_alpha);
+    if (!data) {
+        std::printf("[TEX] stbi_load FAILED for '%s': %s\n", path.c_str(), stbi_failure_reason());
+        return;
+    }
+    image.sourceWidth = w;
+    image.sourceHeight = h;
+    if (maxSize > 0 && (w > maxSize || h > maxSize)) {
+        image.levels.emplace_back();
+        ImageFilter::Downsample(data, w, h, std::min(w, maxSize), std::min(h, maxSize), image.levels.back().bytes);
+        w = std::min(w, maxSize);
+        h = std::min(h, maxSize);
+    } else {
+        image.levels.emplace_back(std::vector<uint8_t>(data, data + size_t(w) * h * 4));
+    }
+    stbi_image_free(data);
+    image.width = w;
+    image.height = h;
+    if (kind == TEXTURE_2D) BuildMips(image);
+
+    if (compression != COMPRESS_NONE) {
+        image.format = compression == COMPRESS_BC7 ? BlockCompress::BC7
+                     : Opaque(image.levels[0].bytes) ? BlockCompress::BC1 : BlockCompress::BC3;
+        std::vector<uint8_t> blocks;
+        for (size_t l = 0; l < image.levels.size(); ++l) {
+            BlockCompress::Encode(image.format, image.levels[l].data(), LevelSize(w, l), LevelSize(h, l), pool, blocks);
+            image.levels[l].bytes.swap(blocks);
+        }
+    }
+    if (!WriteCache(cachePath, hash, kind, compression, maxSize, image))
+        std::printf("[TEX] couldn't write '%s'\n", cachePath.c_str());
+    image.ms = MsSince(t0);
+}
+
+bool TextureLoader::CachedRequest(const std::string& path, Compression& compression, int& maxSize) {
+    std::vector<uint8_t> file;
+    if (!ReadFile(path, file)) return false;
+    FILE* f = std::fopen(MeshCache::PathFor(path, ".tex").c_str(), "rb");
+    if (!f) return false;
+    CacheHeader header;
+    const bool ok = std::fread(&header, sizeof(header), 1, f) == 1 && header.magic == MAGIC
+                 && header.version == VERSION && header.contentHash == ContentHash(file.data(), file.size());
+    std::fclose(f);
+    if (!ok) return false;
+    compression = Compression(header.compression);
+    maxSize = header.maxSize;
+    return true;
+}
+
+TextureLoader::~TextureLoader() {
+    for (size_t i = 0; i < jobs.size(); ++i) wait(int(i));
+}
+
+int TextureLoader::Request(const std::string& path, Kind kind, int maxSize) {
+    jobs.emplace_back(new Job());
+    Job* job = jobs.back().get();
+    job->path = path;
+    job->kind = kind;
+    job->maxSize = maxSize;
+    pool.Submit([this, job] {
+        Decode(job->path, job->kind, compression, job->maxSize, true, &pool, job->image);
+        std::lock_guard<std::mutex> lock(mutex);
+        job->done = true;
+        finished.notify_all();
+    });
+    return int(jobs.size()) - 1;
+}
+
+TextureLoader::Job& TextureLoader::wait(int ticket) {
+    Job& job = *jobs[size_t(ticket)];
+    std::unique_lock<std::mutex> lock(mutex);
+    finished.wait(lock, [&] { return job.done; });
+    return job;
+}
+
+unsigned int TextureLoader::Texture2D(int ticket) {
+    const auto t0 = std::chrono::steady_clock::now();
+    Job& job = wait(ticket);
+    const double waited = MsSince(t0);
+    Image& image = job.image;
+    if (image.levels.empty()) return 0;
+
+    unsigned int tex = 0;
+    glGenTextures(1, &tex);
+    if (!tex) { std::puts("[TEX] glGenTextures returned 0"); return 0; }
+    glBindTexture(GL_TEXTURE_2D, tex);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (size_t l = 0; l < image.levels.size(); ++l) UploadLevel(GL_TEXTURE_2D, image, l);
+    GLenum err = glGetError();
+    if (err != GL_NO_ERROR) {
+        std::printf("[TEX] upload error=0x%X for '%s'\n", err, job.path.c_str());
+        glDeleteTextures(1, &tex);
+        return 0;
+    }
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, GLint(image.levels.size()) - 1);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    std::printf("[TEX] OK '%s' %dx%d %s%s, %zu mips, %.1f KB, %s in %.1f ms (waited %.1f ms) -> id=%u\n",
+                job.path.c_str(), image.width, image.height, BlockCompress::Name(image.format),
+                DriverSamples(image.format) ? "" : " (expanded)", image.levels.size(), ImageBytes(image) / 1024.0,
+                image.fromCache ? "from cache" : "decoded", image.ms, waited, tex);
+    job.vram = ChainBytes(image.format, image.width, image.height, true);
+    job.vramAtSource = ChainBytes(image.format, image.sourceWidth, image.sourceHeight, true);
+    image.levels.clear(); //the pixels live on the GPU now
+    return tex;
+}
+
+unsigned int TextureLoader::Cubemap(int firstFace) {
+    unsigned int textureID;
+    glGenTextures(1, &textureID);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+    for (int i = 0; i < 6; ++i) {
+        Job& job = wait(firstFace + i);
+        Image& image = job.image;
+        if (image.levels.empty()) {
+            std::printf("[TEX] cubemap face failed to load at path: %s\n", job.path.c_str());
+            continue;
+        }
+        UploadLevel(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, image, 0);
+        std::printf("[TEX] face '%s' %dx%d %s%s, %.1f KB, %s in %.1f ms\n", job.path.c_str(), image.width,
+                    image.height, BlockCompress::Name(image.format), DriverSamples(image.format) ? "" : " (expanded)",
+                    ImageBytes(image) / 1024.0, image.fromCache ? "from cache" : "decoded", image.ms);
+        job.vram = ChainBytes(image.format, image.width, image.height, false);
+        job.vramAtSource = ChainBytes(image.format, image.sourceWidth, image.sourceHeight, false);
+        image.levels.clear();
+    }
+
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    return textureID;
+}
+
+void TextureLoader::PrintVramReport() const {
+    size_t total = 0, atSource = 0;
+    std::printf("[TEX] %-34s %-6s %11s %11s %9s %9s\n", "texture", "format", "file", "uploaded", "KB", "saved KB");
+    for (const auto& job : jobs) {
+        if (!job->done || !job->vram) continue;
+        const Image& image = job->image;
+        char file[24], uploaded[24];
+        std::snprintf(file, sizeof(file), "%dx%d", image.sourceWidth, image.sourceHeight);
+        std::snprintf(uploaded, sizeof(uploaded), "%dx%d", image.width, image.height);
+        std::printf("[TEX] %-34s %-6s %11s %11s %9.1f %9.1f\n", job->path.c_str(), BlockCompress::Name(image.format),
+                    file, uploaded, job->vram / 1024.0, (job->vramAtSource - job->vram) / 1024.0);
+        total += job->vram;
+        atSource += job->vramAtSource;
+    }
+    std::printf("[TEX] %.2f MB of textures, %.2f MB reclaimed by the texel budgets\n", total / (1024.0 * 1024.0),
+                (atSource - total) / (1024.0 * 1024.0));
+}
+
+void RunTextureBenchmark(const std::vector<std::pair<std::string, TextureLoader::Kind>>& files) {
+    ThreadPool pool;
+    std::vector<TextureLoader::Image> reference(files.size()), images(files.size());
+    //PSNR of every level 0 against the uncompressed decode, over all files
+    auto psnr = [&]() {
+        double squared = 0.0;
+        size_t count = 0;
+        std::vector<uint8_t> rgba;
+        for (size_t i = 0; i < files.size(); ++i) {
+            if (images[i].levels.empty() || reference[i].levels.empty()) continue;
+            BlockCompress::Decode(images[i].format, images[i].levels[0].data(), images[i].width, images[i].height, rgba);
+            const std::vector<uint8_t>& ref = reference[i].levels[0].bytes;
+            for (size_t j = 0; j < rgba.size(); ++j) {
+                const double d = double(rgba[j]) - double(ref[j]);
+                squared += d * d;
+            }
+            count += rgba.size();
+        }
+        return squared > 0.0 ? 10.0 * std::log10(255.0 * 255.0 * count / squared) : 99.0;
+    };
+    auto pass = [&](const char* name, TextureLoader::Compression compression, bool parallel, bool readCache) {
+        const auto t0 = std::chrono::steady_clock::now();
+        auto run = [&](size_t b, size_t e) {
+            for (size_t i = b; i < e; ++i)
+                TextureLoader::Decode(files[i].first, files[i].second, compression, 0, readCache,
+                                      parallel ? &pool : nullptr, images[i]);
+        };
+        if (parallel) pool.ParallelFor(files.size(), 1, run);
+        else run(0, files.size());
+        const double ms = MsSince(t0);
+        size_t bytes = 0, cached = 0, failed = 0;
+        for (const auto& image : images) {
+            bytes += ImageBytes(image);
+            cached += image.fromCache;
+            failed += image.levels.empty();
+        }
+        if (compression == TextureLoader::COMPRESS_NONE) reference = images;
+        std::printf("  %-30s %8.1f ms  %6.1f MB, %5.1f dB, %zu/%zu from cache, %zu failed\n", name, ms,
+                    bytes / (1024.0 * 1024.0), psnr(), cached, files.size(), failed);
+    };
+    std::printf("texture decode, %zu files, %u workers + main thread\n", files.size(), pool.Size());
+    pass("serial stb_image, RGBA8", TextureLoader::COMPRESS_NONE, false, false);
+    pass("pool stb_image, RGBA8", TextureLoader::COMPRESS_NONE, true, false);
+    pass("pool stb_image + BC7", TextureLoader::COMPRESS_BC7, true, false);
+    pass("pool stb_image + BC1/BC3", TextureLoader::COMPRESS_S3TC, true, false);
+    pass("pool, warm cache (BC1/BC3)", TextureLoader::COMPRESS_S3TC, true, true);
+}
@@ -0,0 +1,96 @@
+#include "ThreadPool.hpp"
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+ThreadPool::ThreadPool(unsigned int threads) {
+    if (threads == 0) {
+        unsigned int hw = std::thread::hardware_concurrency();
+        threads = hw > 1 ? hw - 1 : 1; //the main thread does GL and joins in on ParallelFor
+    }
+    workers.reserve(threads);
+    for (unsigned int i = 0; i < threads; ++i)
+        workers.emplace_back([this]{ workerLoop(); });
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto& t : workers) t.join();
+}
+
+void ThreadPool::Submit(std::function<void()> task) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        tasks.push(std::move(task));
+    }
+    wake.notify_one();
+}
+
+bool ThreadPool::runOne(std::unique_lock<std::mutex>& lock) {
+    if (tasks.empty()) return false;
+    std::function<void()> task = std::move(tasks.front());
+    tasks.pop();
+    ++busy;
+    lock.unlock();
+    task();
+    lock.lock();
+    --busy;
+    if (tasks.empty() && busy == 0) idle.notify_all();
+    return true;
+}
+
+void ThreadPool::workerLoop() {
+    std::unique_lock<std::mutex> lock(mutex);
+    for (;;) {
+        wake.wait(lock, [this]{ return stopping || !tasks.empty(); });
+        if (stopping && tasks.empty()) return;
+        runOne(lock);
+    }
+}
+
+void ThreadPool::WaitIdle() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (runOne(lock)) {} //help instead of sleeping
+    idle.wait(lock, [this]{ return tasks.empty() && busy == 0; });
+}
+
+void ThreadPool::ParallelFor(size_t count, size_t grain,
+                             const std::function<void(size_t, size_t)>& fn) {
+    if (count == 0) return;
+    grain = std::max<size_t>(grain, 1);
+    const size_t maxChunks = (size_t)Size() * 4 + 1;
+    const size_t chunks = std::min(maxChunks, (count + grain - 1) / grain);
+    if (chunks <= 1) { fn(0, count); return; }
+
+    const size_t step = (count + chunks - 1) / chunks;
+    //helpers that start after the last chunk still touch the counters, so they are shared
+    struct State {
+        std::atomic<size_t> next{0}, done{0};
+        std::mutex mutex;
+        std::condition_variable cv;
+    };
+    auto state = std::make_shared<State>();
+
+    //every runner pulls chunks until none are left, the caller is one of them
+    auto runner = [state, chunks, step, count, &fn]{
+        size_t c;
+        while ((c = state->next.fetch_add(1)) < chunks) {
+            size_t b = c * step, e = std::min(count, b + step);
+            if (b < e) fn(b, e);
+            if (state->done.fetch_add(1) + 1 == chunks) {
+                std::lock_guard<std::mutex> lock(state->mutex);
+                state->cv.notify_all();
+            }
+        }
+    };
+    const size_t helpers = std::min<size_t>(Size(), chunks - 1);
+    for (size_t i = 0; i < helpers; ++i) Submit(runner);
+    runner();
+
+    std::unique_lock<std::mutex> lock(state->mutex);
+    state->cv.wait(lock, [&]{ return state->done.load() == chunks; });
+}
@@ -0,0 +1,702 @@
+#include "TriangleBVH.hpp"
+#include "BVHBuild.hpp"
+#include "ThreadPool.hpp"
+#include "Philox.hpp"
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define BVH_SSE 1
+#endif
+
+namespace {
+
+const int SAH_BINS = 12;
+const size_t PARALLEL_MIN = 16384; //below this one thread beats the hand-off
+const int STACK_SIZE = 256;
+const uint32_t SERIAL_MAGIC = FourCC('B', 'V', 'H', '4');
+const uint32_t SERIAL_VERSION = 1;
+
+struct Bounds {
+    glm::vec3 mn{FLT_MAX}, mx{-FLT_MAX};
+    void grow(const glm::vec3& p) { mn = glm::min(mn, p); mx = glm::max(mx, p); }
+    void grow(const Bounds& b) { mn = glm::min(mn, b.mn); mx = glm::max(mx, b.mx); }
+    float halfArea() const {
+        if (mn.x > mx.x) return 0.0f;
+        glm::vec3 e = mx - mn;
+        return e.x * e.y + e.y * e.z + e.z * e.x;
+    }
+};
+
+struct BinaryNode {
+    Bounds b;
+    int left = -1;            //inner: children at left, left + 1
+    int first = 0, count = 0; //leaf: prims [first, first + count)
+};
+
+struct Bin {
+    Bounds b;
+    int count = 0;
+};
+
+//what every build step reads
+struct BuildInput {
+    std::vector<Bounds> triBounds;
+    std::vector<glm::vec3> centroids;
+    std::vector<uint32_t> prims;
+};
+
+//triangle bounds and centroid bounds of prims [begin, end)
+void RangeBounds(const BuildInput& in, int begin, int end, ThreadPool* pool, Bounds& b, Bounds& cb) {
+    std::mutex m;
+    BVHBuild::Range(pool, end - begin, PARALLEL_MIN, [&](size_t lo, size_t hi) {
+        Bounds lb, lcb;
+        for (size_t i = lo; i < hi; ++i) {
+            uint32_t p = in.prims[begin + i];
+            lb.grow(in.triBounds[p]);
+            lcb.grow(in.centroids[p]);
+        }
+        std::lock_guard<std::mutex> lock(m);
+        b.grow(lb);
+        cb.grow(lcb);
+    });
+}
+
+//binned SAH along the widest centroid axis. Partitions prims in place and returns the
+//middle, or -1 when the range should stay a leaf.
+int SplitRange(BuildInput& in, int begin, int end, const Bounds& b, const Bounds& cb, ThreadPool* pool) {
+    const int count = end - begin;
+    if (count <= 1) return -1;
+    glm::vec3 ext = cb.mx - cb.mn;
+    int axis = ext.x > ext.y ? (ext.x > ext.z ? 0 : 2) : (ext.y > ext.z ? 1 : 2);
+    if (ext[axis] <= 0.0f) //every centroid in one spot: split only to respect MAX_LEAF
+        return count > TriangleBVH::MAX_LEAF ? begin + count / 2 : -1;
+
+    const float lo = cb.mn[axis], scale = SAH_BINS / ext[axis];
+    auto binOf = [&](uint32_t p) {
+        return std::min(std::max(int((in.centroids[p][axis] - lo) * scale), 0), SAH_BINS - 1);
+    };
+    Bin bins[SAH_BINS];
+    std::mutex m;
+    BVHBuild::Range(pool, count, PARALLEL_MIN, [&](size_t s, size_t e) {
+        Bin local[SAH_BINS];
+        for (size_t i = s; i < e; ++i) {
+            uint32_t p = in.prims[begin + i];
+            Bin& bin = local[binOf(p)];
+            bin.b.grow(in.triBounds[p]);
+            ++bin.count;
+        }
+        std::lock_guard<std::mutex> lock(m);
+        for (int k = 0; k < SAH_BINS; ++k) { bins[k].b.grow(local[k].b); bins[k].count += local[k].count; }
+    });
+
+    float rightArea[SAH_BINS];
+    int rightCount[SAH_BINS];
+    Bounds acc;
+    int n = 0;
+    for (int k = SAH_BINS - 1; k > 0; --k) {
+        acc.grow(bins[k].b);
+        n += bins[k].count;
+        rightArea[k] = acc.halfArea();
+        rightCount[k] = n;
+    }
+    //cost in triangle tests: a 4-wide box test costs about half of one
+    float bestCost = FLT_MAX;
+    int bestSplit = -1;
+    acc = Bounds();
+    n = 0;
+    for (int k = 1; k < SAH_BINS; ++k) {
+        acc.grow(bins[k - 1].b);
+        n += bins[k - 1].count;
+        if (n == 0 || rightCount[k] == 0) continue;
+        float cost = 0.5f * b.halfArea() + acc.halfArea() * n + rightArea[k] * rightCount[k];
+        if (cost < bestCost) { bestCost = cost; bestSplit = k; }
+    }
+    if (count <= TriangleBVH::MAX_LEAF && (bestSplit < 0 || bestCost >= b.halfArea() * count)) return -1;
+    if (bestSplit < 0) return begin + count / 2;
+
+    auto mid = std::partition(in.prims.begin() + begin, in.prims.begin() + end,
+                              [&](uint32_t p) { return binOf(p) < bestSplit; });
+    return int(mid - in.prims.begin());
+}
+
+void BuildSubtree(std::vector<BinaryNode>& nodes, int index, int begin, int end, BuildInput& in) {
+    Bounds b, cb;
+    RangeBounds(in, begin, end, nullptr, b, cb);
+    nodes[index].b = b;
+    int mid = SplitRange(in, begin, end, b, cb, nullptr);
+    if (mid < 0) {
+        nodes[index].first = begin;
+        nodes[index].count = end - begin;
+        return;
+    }
+    int left = (int)nodes.size();
+    nodes.resize(nodes.size() + 2);
+    nodes[index].left = left;
+    BuildSubtree(nodes, left, begin, mid, in);
+    BuildSubtree(nodes, left + 1, mid, end, in);
+}
+
+//pulls grandchildren up until the node has 4 children: the biggest inner child opens first
+int Collapse(const std::vector<BinaryNode>& bin, int bi, std::vector<TriangleBVH::Node>& out) {
+    int slots[4] = { bin[bi].left, bin[bi].left + 1, -1, -1 };
+    int used = 2;
+    while (used < 4) {
+        int open = -1;
+        float area = -1.0f;
+        for (int k = 0; k < used; ++k)
+            if (bin[slots[k]].count == 0 && bin[slots[k]].b.halfArea() > area) { area = bin[slots[k]].b.halfArea(); open = k; }
+        if (open < 0) break;
+        int l = bin[slots[open]].left;
+        slots[open] = l;
+        slots[used++] = l + 1;
+    }
+
+    const int me = (int)out.size();
+    out.emplace_back();
+    int child[4];
+    for (int k = 0; k < 4; ++k) {
+        if (k >= used) { child[k] = -1; continue; }
+        const BinaryNode& c = bin[slots[k]];
+        child[k] = c.count > 0 ? ~c.first : Collapse(bin, slots[k], out);
+    }
+    TriangleBVH::Node& n = out[me]; //out may have grown, look it up again
+    for (int k = 0; k < 4; ++k) {
+        const bool valid = k < used;
+        const Bounds& b = valid ? bin[slots[k]].b : Bounds();
+        n.bminX[k] = valid ? b.mn.x : 0.0f; n.bminY[k] = valid ? b.mn.y : 0.0f; n.bminZ[k] = valid ? b.mn.z : 0.0f;
+        n.bmaxX[k] = valid ? b.mx.x : 0.0f; n.bmaxY[k] = valid ? b.mx.y : 0.0f; n.bmaxZ[k] = valid ? b.mx.z : 0.0f;
+        n.child[k] = child[k];
+        n.count[k] = valid && bin[slots[k]].count > 0 ? bin[slots[k]].count : 0;
+    }
+    return me;
+}
+
+float SafeInverse(float d) {
+    if (std::fabs(d) < 1e-20f) return d < 0.0f ? -1e30f : 1e30f;
+    return 1.0f / d;
+}
+
+//two-sided Moller-Trumbore on precomputed edges
+bool IntersectTriangle(const TriangleBVH::Triangle& tri, const glm::vec3& o, const glm::vec3& d, float tMax, float& t) {
+    glm::vec3 pvec = glm::cross(d, tri.e2);
+    float det = glm::dot(tri.e1, pvec);
+    if (std::fabs(det) < 1e-12f) return false;
+    float invDet = 1.0f / det;
+    glm::vec3 tvec = o - tri.v0;
+    float u = glm::dot(tvec, pvec) * invDet;
+    if (u < 0.0f || u > 1.0f) return false;
+    glm::vec3 qvec = glm::cross(tvec, tri.e1);
+    float v = glm::dot(d, qvec) * invDet;
+    if (v < 0.0f || u + v > 1.0f) return false;
+    t = glm::dot(tri.e2, qvec) * invDet;
+    return t > 0.0f && t < tMax;
+}
+
+//closest point on triangle abc to p (Ericson, Real-Time Collision Detection 5.1.5)
+glm::vec3 ClosestPoint(const glm::vec3& p, const glm::vec3& a, const glm::vec3& b, const glm::vec3& c) {
+    glm::vec3 ab = b - a, ac = c - a, ap = p - a;
+    float d1 = glm::dot(ab, ap), d2 = glm::dot(ac, ap);
+    if (d1 <= 0.0f && d2 <= 0.0f) return a;
+    glm::vec3 bp = p - b;
+    float d3 = glm::dot(ab, bp), d4 = glm::dot(ac, bp);
+    if (d3 >= 0.0f && d4 <= d3) return b;
+    float vc = d1 * d4 - d3 * d2;
+    if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f) return a + ab * (d1 / (d1 - d3));
+    glm::vec3 cp = p - c;
+    float d5 = glm::dot(ab, cp), d6 = glm::dot(ac, cp);
+    if (d6 >= 0.0f && d5 <= d6) return c;
+    float vb = d5 * d2 - d1 * d6;
+    if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f) return a + ac * (d2 / (d2 - d6));
+    float va = d3 * d6 - d5 * d4;
+    if (va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f)
+        return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+    float denom = 1.0f / (va + vb + vc);
+    return a + ab * (vb * denom) + ac * (vc * denom);
+}
+
+//entry distance of the ray into each child box; bit k set when child k is hit before tMax
+int RayBoxes(const TriangleBVH::Node& n, const glm::vec3& o, const glm::vec3& inv, float tMax, float tNear[4]) {
+#ifdef BVH_SSE
+    const __m128 ox = _mm_set1_ps(o.x), oy = _mm_set1_ps(o.y), oz = _mm_set1_ps(o.z);
+    const __m128 ix = _mm_set1_ps(inv.x), iy = _mm_set1_ps(inv.y), iz = _mm_set1_ps(inv.z);
+    __m128 tx0 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(n.bminX), ox), ix);
+    __m128 tx1 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(n.bmaxX), ox), ix);
+    __m128 ty0 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(n.bminY), oy), iy);
+    __m128 ty1 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(n.bmaxY), oy), iy);
+    __m128 tz0 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(n.bminZ), oz), iz);
+    __m128 tz1 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(n.bmaxZ), oz), iz);
+    __m128 tn = _mm_max_ps(_mm_max_ps(_mm_min_ps(tx0, tx1), _mm_min_ps(ty0, ty1)),
+                           _mm_max_ps(_mm_min_ps(tz0, tz1), _mm_setzero_ps()));
+    __m128 tf = _mm_min_ps(_mm_min_ps(_mm_max_ps(tx0, tx1), _mm_max_ps(ty0, ty1)),
+                           _mm_min_ps(_mm_max_ps(tz0, tz1), _mm_set1_ps(tMax)));
+    _mm_storeu_ps(tNear, tn);
+    return _mm_movemask_ps(_mm_cmple_ps(tn, tf));
+#else
+    int mask = 0;
+    for (int k = 0; k < 4; ++k) {
+        float tx0 = (n.bminX[k] - o.x) * inv.x, tx1 = (n.bmaxX[k] - o.x) * inv.x;
+        float ty0 = (n.bminY[k] - o.y) * inv.y, ty1 = (n.bmaxY[k] - o.y) * inv.y;
+        float tz0 = (n.bminZ[k] - o.z) * inv.z, tz1 = (n.bmaxZ[k] - o.z) * inv.z;
+        float tn = std::max(std::max(std::min(tx0, tx1), std::min(ty0, ty1)), std::max(std::min(tz0, tz1), 0.0f));
+        float tf = std::min(std::min(std::max(tx0, tx1), std::max(ty0, ty1)), std::min(std::max(tz0, tz1), tMax));
+        tNear[k] = tn;
+        if (tn <= tf) mask |= 1 << k;
+    }
+    return mask;
+#endif
+}
+
+//squared distance from c to each child box; bit k set when it is within r2
+int SphereBoxes(const TriangleBVH::Node& n, const glm::vec3& c, float r2, float dist2[4]) {
+#ifdef BVH_SSE
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 cx = _mm_set1_ps(c.x), cy = _mm_set1_ps(c.y), cz = _mm_set1_ps(c.z);
+    __m128 dx = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_load_ps(n.bminX), cx), _mm_sub_ps(cx, _mm_load_ps(n.bmaxX))), zero);
+    __m128 dy = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_load_ps(n.bminY), cy), _mm_sub_ps(cy, _mm_load_ps(n.bmaxY))), zero);
+    __m128 dz = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_load_ps(n.bminZ), cz), _mm_sub_ps(cz, _mm_load_ps(n.bmaxZ))), zero);
+    __m128 d2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+    _mm_storeu_ps(dist2, d2);
+    return _mm_movemask_ps(_mm_cmple_ps(d2, _mm_set1_ps(r2)));
+#else
+    int mask = 0;
+    for (int k = 0; k < 4; ++k) {
+        float dx = std::max(std::max(n.bminX[k] - c.x, c.x - n.bmaxX[k]), 0.0f);
+        float dy = std::max(std::max(n.bminY[k] - c.y, c.y - n.bmaxY[k]), 0.0f);
+        float dz = std::max(std::max(n.bminZ[k] - c.z, c.z - n.bmaxZ[k]), 0.0f);
+        dist2[k] = dx * dx + dy * dy + dz * dz;
+        if (dist2[k] <= r2) mask |= 1 << k;
+    }
+    return mask;
+#endif
+}
+
+//pushes the hit inner children so the nearest is popped first
+void PushOrdered(const TriangleBVH::Node& n, int mask, const float key[4], int* stack, int& sp) {
+    int inner[4];
+    float keys[4];
+    int count = 0;
+    for (int k = 0; k < 4; ++k) {
+        if (!(mask & (1 << k)) || n.child[k] < 0) continue;
+        int j = count++;
+        while (j > 0 && keys[j - 1] < key[k]) { keys[j] = keys[j - 1]; inner[j] = inner[j - 1]; --j; }
+        keys[j] = key[k];
+        inner[j] = n.child[k];
+    }
+    for (int j = 0; j < count && sp < STACK_SIZE; ++j) stack[sp++] = inner[j];
+}
+
+} //namespace
+
+void TriangleBVH::Build(const std::vector<MeshData>& meshes, ThreadPool* pool) {
+    std::vector<glm::vec3> positions;
+    std::vector<uint32_t> indices;
+    for (const auto& m : meshes) {
+        const uint32_t base = (uint32_t)positions.size();
+        for (const auto& v : m.vertices) positions.push_back(v.Position);
+        for (unsigned int i : m.indices) indices.push_back(base + i);
+    }
+    Build(positions, indices, pool);
+}
+
+void TriangleBVH::Build(const std::vector<glm::vec3>& positions, const std::vector<uint32_t>& indices, ThreadPool* pool) {
+    const int n = (int)(indices.size() / 3);
+    nodes.clear();
+    tris.clear();
+    bmin = bmax = glm::vec3(0.0f);
+    if (n == 0) return;
+
+    BuildInput in;
+    in.triBounds.resize(n);
+    in.centroids.resize(n);
+    in.prims.resize(n);
+    BVHBuild::Range(pool, n, PARALLEL_MIN, [&](size_t b, size_t e) {
+        for (size_t i = b; i < e; ++i) {
+            Bounds tb;
+            for (int k = 0; k < 3; ++k) tb.grow(positions[indices[3 * i + k]]);
+            in.triBounds[i] = tb;
+            in.centroids[i] = 0.5f * (tb.mn + tb.mx);
+            in.prims[i] = (uint32_t)i;
+        }
+    });
+
+    //top levels split here, the rest as subtrees on the pool (see BVHBuild)
+    const int subtreeMax = pool ? std::max(4096, n / (int)(pool->Size() * 4 + 1)) : n;
+    std::vector<BinaryNode> bin;
+    BVHBuild::Build(bin, n, subtreeMax, pool,
+        [&](int node, int begin, int end, int left) {
+            Bounds b, cb;
+            RangeBounds(in, begin, end, pool, b, cb);
+            int mid = SplitRange(in, begin, end, b, cb, pool);
+            bin[node].b = b;
+            bin[node].left = left;
+            return mid;
+        },
+        [&](std::vector<BinaryNode>& local, int begin, int end) {
+            BuildSubtree(local, 0, begin, end, in);
+        },
+        [](BinaryNode& node, const BVHBuild::Placement& to) {
+            if (node.count == 0) node.left = to.base + node.left - 1; //a child is never the local root
+        });
+    bmin = bin[0].b.mn;
+    bmax = bin[0].b.mx;
+
+    if (bin[0].count > 0) { //a handful of triangles: one node, one leaf
+        Node root;
+        std::memset(&root, 0, sizeof(root));
+        for (int k = 0; k < 4; ++k) root.child[k] = -1;
+        root.bminX[0] = bmin.x; root.bminY[0] = bmin.y; root.bminZ[0] = bmin.z;
+        root.bmaxX[0] = bmax.x; root.bmaxY[0] = bmax.y; root.bmaxZ[0] = bmax.z;
+        root.child[0] = ~0;
+        root.count[0] = (uint32_t)n;
+        nodes.push_back(root);
+    } else {
+        nodes.reserve(bin.size() / 3 + 1);
+        Collapse(bin, 0, nodes);
+    }
+
+    tris.resize(n);
+    BVHBuild::Range(pool, n, PARALLEL_MIN, [&](size_t b, size_t e) {
+        for (size_t i = b; i < e; ++i) {
+            uint32_t p = in.prims[i];
+            glm::vec3 v0 = positions[indices[3 * p]];
+            tris[i] = { v0, positions[indices[3 * p + 1]] - v0, positions[indices[3 * p + 2]] - v0, p };
+        }
+    });
+}
+
+template <bool ANY>
+bool TriangleBVH::traceRay(const glm::vec3& o, const glm::vec3& d, float tMax, RayHit* hit) const {
+    if (nodes.empty()) return false;
+    const glm::vec3 inv(SafeInverse(d.x), SafeInverse(d.y), SafeInverse(d.z));
+    float best = tMax;
+    int bestTri = -1;
+    int stack[STACK_SIZE];
+    int sp = 0;
+    stack[sp++] = 0;
+    while (sp > 0) {
+        const Node& n = nodes[stack[--sp]];
+        float tNear[4];
+        int mask = RayBoxes(n, o, inv, best, tNear);
+        for (int k = 0; k < 4; ++k) {
+            if (!(mask & (1 << k)) || n.child[k] >= 0) continue;
+            const uint32_t first = ~n.child[k];
+            for (uint32_t i = first; i < first + n.count[k]; ++i) {
+                float t;
+                if (!IntersectTriangle(tris[i], o, d, best, t)) continue;
+                if (ANY) return true;
+                best = t;
+                bestTri = (int)i;
+            }
+        }
+        PushOrdered(n, mask, tNear, stack, sp);
+    }
+    if (bestTri < 0) return false;
+    if (hit) {
+        const Triangle& tri = tris[bestTri];
+        glm::vec3 nrm = glm::normalize(glm::cross(tri.e1, tri.e2));
+        hit->t = best;
+        hit->triangle = tri.id;
+        hit->normal = glm::dot(nrm, d) > 0.0f ? -nrm : nrm;
+    }
+    return true;
+}
+
+bool TriangleBVH::Raycast(const glm::vec3& origin, const glm::vec3& dir, float tMax, RayHit& hit) const {
+    return traceRay<false>(origin, dir, tMax, &hit);
+}
+
+bool TriangleBVH::Occluded(const glm::vec3& origin, const glm::vec3& dir, float tMax) const {
+    return traceRay<true>(origin, dir, tMax, nullptr);
+}
+
+bool TriangleBVH::SphereQuery(const glm::vec3& c, float radius, SphereContact& contact) const {
+    if (nodes.empty()) return false;
+    float best2 = radius * radius;
+    int bestTri = -1;
+    glm::vec3 bestPoint(0.0f);
+    int stack[STACK_SIZE];
+    int sp = 0;
+    stack[sp++] = 0;
+    while (sp > 0) {
+        const Node& n = nodes[stack[--sp]];
+        float dist2[4];
+        int mask = SphereBoxes(n, c, best2, dist2);
+        for (int k = 0; k < 4; ++k) {
+            if (!(mask & (1 << k)) || n.child[k] >= 0) continue;
+            const uint32_t first = ~n.child[k];
+            for (uint32_t i = first; i < first + n.count[k]; ++i) {
+                const Triangle& t = tris[i];
+                glm::vec3 p = ClosestPoint(c, t.v0, t.v0 + t.e1, t.v0 + t.e2);
+                glm::vec3 d = c - p;
+                float d2 = glm::dot(d, d);
+                if (d2 > best2 || (d2 == best2 && bestTri >= 0)) continue;
+                best2 = d2;
+                bestTri = (int)i;
+                bestPoint = p;
+            }
+        }
+        PushOrdered(n, mask, dist2, stack, sp);
+    }
+    if (bestTri < 0) return false;
+
+    const Triangle& t = tris[bestTri];
+    const float dist = std::sqrt(best2);
+    glm::vec3 nrm = glm::normalize(glm::cross(t.e1, t.e2));
+    contact.point = bestPoint;
+    contact.normal = dist > 1e-6f ? (c - bestPoint) / dist : (glm::dot(nrm, c - t.v0) < 0.0f ? -nrm : nrm);
+    contact.depth = radius - dist;
+    contact.triangle = t.id;
+    return true;
+}
+
+void TriangleBVH::Serialize(std::vector<uint8_t>& out) const {
+    const uint32_t header[4] = { SERIAL_MAGIC, SERIAL_VERSION, (uint32_t)nodes.size(), (uint32_t)tris.size() };
+    const float box[6] = { bmin.x, bmin.y, bmin.z, bmax.x, bmax.y, bmax.z };
+    out.clear();
+    auto put = [&](const void* p, size_t bytes) {
+        const uint8_t* b = static_cast<const uint8_t*>(p);
+        out.insert(out.end(), b, b + bytes);
+    };
+    put(header, sizeof(header));
+    put(box, sizeof(box));
+    put(nodes.data(), nodes.size() * sizeof(Node));
+    put(tris.data(), tris.size() * sizeof(Triangle));
+}
+
+bool TriangleBVH::Deserialize(const std::vector<uint8_t>& in) {
+    uint32_t header[4];
+    float box[6];
+    if (in.size() < sizeof(header) + sizeof(box)) return false;
+    std::memcpy(header, in.data(), sizeof(header));
+    std::memcpy(box, in.data() + sizeof(header), sizeof(box));
+    const size_t at = sizeof(header) + sizeof(box);
+    if (header[0] != SERIAL_MAGIC || header[1] != SERIAL_VERSION
+        || in.size() != at + header[2] * sizeof(Node) + header[3] * sizeof(Triangle))
+        return false;
+    nodes.resize(header[2]);
+    tris.resize(header[3]);
+    std::memcpy(nodes.data(), in.data() + at, nodes.size() * sizeof(Node));
+    std::memcpy(tris.data(), in.data() + at + nodes.size() * sizeof(Node), tris.size() * sizeof(Triangle));
+    bmin = glm::vec3(box[0], box[1], box[2]);
+    bmax = glm::vec3(box[3], box[4], box[5]);
+    return true;
+}
+
+void CollisionScene::Add(const TriangleBVH& bvh, const glm::mat4& modelToWorld) {
+    Instance inst;
+    inst.bvh = &bvh;
+    inst.toWorld = modelToWorld;
+    inst.toLocal = glm::inverse(modelToWorld);
+    const glm::mat3 l(inst.toLocal);
+    inst.normalToWorld = glm::transpose(l);
+    inst.localRadiusScale = 0.0f;
+    for (int r = 0; r < 3; ++r) //largest row of a (rotation, scale) inverse = largest stretch
+        inst.localRadiusScale = std::max(inst.localRadiusScale, glm::length(glm::vec3(l[0][r], l[1][r], l[2][r])));
+    inst.worldMin = glm::vec3(FLT_MAX);
+    inst.worldMax = glm::vec3(-FLT_MAX);
+    const glm::vec3 mn = bvh.BoundsMin(), mx = bvh.BoundsMax();
+    for (int k = 0; k < 8; ++k) {
+        glm::vec3 corner(k & 1 ? mx.x : mn.x, k & 2 ? mx.y : mn.y, k & 4 ? mx.z : mn.z);
+        glm::vec3 w = glm::vec3(modelToWorld * glm::vec4(corner, 1.0f));
+        inst.worldMin = glm::min(inst.worldMin, w);
+        inst.worldMax = glm::max(inst.worldMax, w);
+    }
+    instances.push_back(inst);
+}
+
+bool CollisionScene::Raycast(const glm::vec3& origin, const glm::vec3& dir, float tMax, RayHit& hit, int* instance) const {
+    bool found = false;
+    for (size_t i = 0; i < instances.size(); ++i) {
+        const Instance& inst = instances[i];
+        //an unnormalised local direction keeps t the same in both spaces
+        glm::vec3 lo = glm::vec3(inst.toLocal * glm::vec4(origin, 1.0f));
+        glm::vec3 ld = glm::mat3(inst.toLocal) * dir;
+        RayHit h;
+        if (!inst.bvh->Raycast(lo, ld, tMax, h)) continue;
+        tMax = h.t;
+        hit = h;
+        hit.normal = glm::normalize(inst.normalToWorld * h.normal);
+        if (instance) *instance = (int)i;
+        found = true;
+    }
+    return found;
+}
+
+bool CollisionScene::Occluded(const glm::vec3& origin, const glm::vec3& dir, float tMax) const {
+    for (const auto& inst : instances) {
+        glm::vec3 lo = glm::vec3(inst.toLocal * glm::vec4(origin, 1.0f));
+        if (inst.bvh->Occluded(lo, glm::mat3(inst.toLocal) * dir, tMax)) return true;
+    }
+    return false;
+}
+
+bool CollisionScene::SphereQuery(const glm::vec3& center, float radius, SphereContact& contact) const {
+    bool found = false;
+    for (const auto& inst : instances) {
+        glm::vec3 outside = glm::max(glm::max(inst.worldMin - center, center - inst.worldMax), glm::vec3(0.0f));
+        if (glm::dot(outside, outside) > radius * radius) continue;
+        glm::vec3 lc = glm::vec3(inst.toLocal * glm::vec4(center, 1.0f));
+        SphereContact local;
+        if (!inst.bvh->SphereQuery(lc, radius * inst.localRadiusScale, local)) continue;
+        glm::vec3 p = glm::vec3(inst.toWorld * glm::vec4(local.point, 1.0f));
+        glm::vec3 d = center - p;
+        float dist = glm::length(d);
+        if (dist >= radius || (found && radius - dist <= contact.depth)) continue;
+        contact.point = p;
+        contact.normal = dist > 1e-6f ? d / dist : glm::normalize(inst.normalToWorld * local.normal);
+        contact.depth = radius - dist;
+        contact.triangle = local.triangle;
+        found = true;
+    }
+    return found;
+}
+
+void RunTriangleBVHBenchmark(const char* path) {
+    using Clock = std::chrono::steady_clock;
+    auto ms = [](Clock::time_point a, Clock::time_point b) {
+        return std::chrono::duration<double, std::milli>(b - a).count();
+    };
+
+    std::vector<glm::vec3> positions;
+    std::vector<uint32_t> indices;
+    std::vector<MeshData> meshes;
+    std::string source = path;
+    if (MeshCache::Import(path, meshes)) {
+        for (const auto& m : meshes) {
+            const uint32_t base = (uint32_t)positions.size();
+            for (const auto& v : m.vertices) positions.push_back(v.Position);
+            for (unsigned int i : m.indices) indices.push_back(base + i);
+        }
+    } else {
+        //stand-in: 1M-triangle terrain with a field of towers on it
+        source = "generated terrain";
+        const int G = 708;
+        for (int z = 0; z <= G; ++z)
+            for (int x = 0; x <= G; ++x) {
+                float fx = x * 0.1f, fz = z * 0.1f;
+                float h = 2.0f * std::sin(fx * 0.3f) * std::cos(fz * 0.27f) + 0.3f * std::sin(fx * 3.1f + fz * 2.3f);
+                if ((x / 40) % 3 == 0 && (z / 40) % 3 == 0 && x % 40 > 8 && z % 40 > 8) h += 12.0f; //towers
+                positions.push_back(glm::vec3(fx, h, fz));
+            }
+        for (int z = 0; z < G; ++z)
+            for (int x = 0; x < G; ++x) {
+                uint32_t a = z * (G + 1) + x, b = a + 1, c = a + G + 1, d = c + 1;
+                uint32_t quad[6] = { a, c, b, b, c, d };
+                indices.insert(indices.end(), quad, quad + 6);
+            }
+    }
+    const size_t triCount = indices.size() / 3;
+
+    ThreadPool pool;
+    TriangleBVH bvh;
+    auto t0 = Clock::now();
+    bvh.Build(positions, indices, nullptr);
+    auto t1 = Clock::now();
+    bvh.Build(positions, indices, &pool);
+    auto t2 = Clock::now();
+
+    std::printf("\n== Triangle BVH4: %s, %zu triangles, %zu nodes, %u workers + caller ==\n",
+                source.c_str(), triCount, bvh.NodeCount(), pool.Size());
+    std::printf("build   %.1f ms on one thread, %.1f ms on the pool\n", ms(t0, t1), ms(t1, t2));
+
+    //rays from a shell around the model towards random points inside it
+    const glm::vec3 mn = bvh.BoundsMin(), mx = bvh.BoundsMax(), ext = mx - mn;
+    const size_t RAYS = 1 << 20;
+    std::vector<float> r(RAYS * 6);
+    FillUniform(r.data(), r.size(), 0.0f, 1.0f, RandomKey{3u, 0u, 0u});
+    std::vector<glm::vec3> origins(RAYS), dirs(RAYS);
+    for (size_t i = 0; i < RAYS; ++i) {
+        glm::vec3 a(r[6 * i], r[6 * i + 1], r[6 * i + 2]), b(r[6 * i + 3], r[6 * i + 4], r[6 * i + 5]);
+        origins[i] = mn - 0.25f * ext + a * 1.5f * ext;
+        origins[i].y = mx.y + 0.1f * ext.y + a.y * ext.y; //above, looking down and across
+        dirs[i] = mn + b * ext - origins[i];
+    }
+    std::vector<float> hitT(RAYS);
+    auto castRange = [&](size_t b, size_t e) {
+        for (size_t i = b; i < e; ++i) {
+            RayHit h;
+            hitT[i] = bvh.Raycast(origins[i], dirs[i], 2.0f, h) ? h.t : -1.0f;
+        }
+    };
+    auto t3 = Clock::now();
+    castRange(0, RAYS);
+    auto t4 = Clock::now();
+    pool.ParallelFor(RAYS, 4096, castRange);
+    auto t5 = Clock::now();
+    size_t hits = 0;
+    for (float t : hitT) hits += t >= 0.0f;
+
+    //click picking casts one ray on the main thread: its worst case is what a user feels
+    const size_t PICKS = 1000;
+    std::vector<double> pickUs(PICKS);
+    for (size_t i = 0; i < PICKS; ++i) {
+        RayHit h;
+        auto p0 = Clock::now();
+        bvh.Raycast(origins[i], dirs[i], 2.0f, h);
+        pickUs[i] = 1e3 * ms(p0, Clock::now());
+    }
+    std::sort(pickUs.begin(), pickUs.end());
+
+    size_t occluded = 0;
+    std::mutex m;
+    pool.ParallelFor(RAYS, 4096, [&](size_t b, size_t e) {
+        size_t local = 0;
+        for (size_t i = b; i < e; ++i) local += bvh.Occluded(origins[i], dirs[i], 2.0f);
+        std::lock_guard<std::mutex> lock(m);
+        occluded += local;
+    });
+    auto t6 = Clock::now();
+
+    //spheres near the surface: the lantern-collision query
+    const float radius = 0.01f * glm::length(ext);
+    size_t contacts = 0;
+    pool.ParallelFor(RAYS, 4096, [&](size_t b, size_t e) {
+        size_t local = 0;
+        for (size_t i = b; i < e; ++i) {
+            SphereContact c;
+            glm::vec3 p = mn + glm::vec3(r[6 * i + 3], r[6 * i + 4], r[6 * i + 5]) * ext;
+            local += bvh.SphereQuery(p, radius, c);
+        }
+        std::lock_guard<std::mutex> lock(m);
+        contacts += local;
+    });
+    auto t7 = Clock::now();
+
+    //brute force over every triangle for a sample of the rays
+    const size_t CHECK = 64;
+    size_t mismatches = 0;
+    for (size_t i = 0; i < CHECK; ++i) {
+        float best = 2.0f;
+        bool any = false;
+        for (size_t k = 0; k < triCount; ++k) {
+            glm::vec3 v0 = positions[indices[3 * k]];
+            TriangleBVH::Triangle tri{ v0, positions[indices[3 * k + 1]] - v0, positions[indices[3 * k + 2]] - v0, 0 };
+            glm::vec3 pvec = glm::cross(dirs[i], tri.e2);
+            float det = glm::dot(tri.e1, pvec);
+            if (std::fabs(det) < 1e-12f) continue;
+            glm::vec3 tvec = origins[i] - v0;
+            float u = glm::dot(tvec, pvec) / det;
+            glm::vec3 qvec = glm::cross(tvec, tri.e1);
+            float v = glm::dot(dirs[i], qvec) / det;
+            float t = glm::dot(tri.e2, qvec) / det;
+            if (u >= 0.0f && v >= 0.0f && u + v <= 1.0f && t > 0.0f && t < best) { best = t; any = true; }
+        }
+        float expect = any ? best : -1.0f;
+        if (std::fabs(expect - hitT[i]) > 1e-4f) ++mismatches;
+    }
+
+    auto perSec = [&](double msTaken) { return RAYS / msTaken * 1e-3; }; //millions per second
+    std::printf("rays    %.2f M/s one thread, %.2f M/s pool (%zu of %zu hit)\n",
+                perSec(ms(t3, t4)), perSec(ms(t4, t5)), hits, RAYS);
+    std::printf("picks   %.1f us median, %.1f us worst of %zu single rays\n",
+                pickUs[PICKS / 2], pickUs[PICKS - 1], PICKS);
+    std::printf("any-hit %.2f M/s pool (%zu occluded)\n", perSec(ms(t5, t6)), occluded);
+    std::printf("spheres %.2f M/s pool, radius %.3f (%zu touching)\n", perSec(ms(t6, t7)), radius, contacts);
+    std::printf("brute-force check: %zu of %zu rays disagree\n", mismatches, CHECK);
+}
@@ -3,65 +3,52 @@
 #include "Shader.hpp"
 #include "Camera.hpp"
 #include "Model.hpp"
-#include "stb_image.h"
+#include "Lantern.hpp"
+#include "PointShadow.hpp"
+#include "ShadowBudget.hpp"
+#include "ShadowBench.hpp"
+#include "CascadedShadow.hpp"
+#include "StochasticLights.hpp"
+#include "LightBVH.hpp"
+#include "ThreadPool.hpp"
+#include "IrradianceVolume.hpp"
+#include "LanternLOD.hpp"
+#include "GpuLanterns.hpp"
+#include "AnalyticLanterns.hpp"
+#include "LanternPool.hpp"
+#include "Philox.hpp"
+#include "SpatialHash.hpp"
+#include "TriangleBVH.hpp"
+#include "Lightmap.hpp"
+#include "TextureLoader.hpp"
+#include "TextureDensity.hpp"
+#include "AssetStreamer.hpp"
+#include "MeshCache.hpp"
+#include "MeshOptimize.hpp"
+#include "AssetPack.hpp"
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <iostream>
 #include <vector>
 #include <unistd.h>
 #include <limits.h>
-#include <random>
 #include <fstream>
 #include <string>
 #include <array>
 #include <algorithm>
+#include <chrono>
+#include <atomic>
+#include <cstdint>
+#include <memory>
 
 
 void processInput(GLFWwindow* window);
-unsigned int loadCubemap(const std::vector<std::string>& faces);
 void renderSkybox(unsigned int skyboxVAO,
                   Shader& skyboxShader,
                   unsigned int cubemapTexture,
                   const glm::mat4& view,
                   const glm::mat4& projection);
 
-unsigned int loadTexture2D(const std::string& path) {
-    int w=0, h=0, n=0;
-    std::printf("[TEX] loading '%s'\n", path.c_str());
-    unsigned char* data = stbi_load(path.c_str(), &w, &h, &n, STBI_rgb_alpha);
-    if (!data) {
-        std::printf("[TEX] stbi_load FAILED for '%s'\n", path.c_str());
-        return 0;
-    }
-    std::printf("[TEX] loaded '%s' w=%d h=%d orig_ch=%d (now RGBA)\n", path.c_str(), w, h, n);
-
-    unsigned int tex = 0;
-    glGenTextures(1, &tex);
-    if (!tex) { std::puts("[TEX] glGenTextures returned 0"); stbi_image_free(data); return 0; }
-
-    glBindTexture(GL_TEXTURE_2D, tex);
-
-    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
-    GLenum err = glGetError();
-    if (err != GL_NO_ERROR) {
-        std::printf("[TEX] glTexImage2D error=0x%X\n", err);
-        stbi_image_free(data);
-        return 0;
-    }
-
-    glGenerateMipmap(GL_TEXTURE_2D);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-    stbi_image_free(data);
-    std::printf("[TEX] OK '%s' -> id=%u\n", path.c_str(), tex);
-    return tex;
-}
-
 const unsigned int SCR_WIDTH = 1280;
 const unsigned int SCR_HEIGHT = 720;
 Camera camera(glm::vec3(0.0f, 1.5f, 5.0f));
@@ -77,8 +64,9 @@ std::vector<glm::vec3> lanternPositions;
 bool perspectiveBoat = true; //true = in-boat, false = aerial
 glm::vec3 castleLanternOrigin = glm::vec3(65.0f, 12.0f, -18.0f);
 
-bool gSpawnOverride = false;
+bool gSpawnOverride = false;     //bursts start at gSpawnOverridePos instead of the castle
 glm::vec3 gSpawnOverridePos(0.0f);
+bool gPickRequested = false;     //left click: cast a ray once this frame's view is known
 
 
 static float cockpitYawOff   = 0.0f; //left/right peek
@@ -108,43 +96,53 @@ inline glm::vec3 BoatForward() {
     return glm::vec3(sin(boatRotation), 0.0f, -cos(boatRotation));
 }
 
-struct Lantern {
-    glm::vec3 pos;
-    glm::vec3 vel;
-    float t;
-    float phase;
-};
-std::vector<Lantern> lanterns;
+LanternPool lanternPool;                       //CPU lanterns, ids are pool handles
+std::vector<Lantern>& lanterns = lanternPool.Live(); //packed live lanterns, read-only outside the pool
 bool keyCPressed = false;
-
-float frand(float a, float b) {
-    return a + (b - a) * (float)rand() / (float)RAND_MAX;
+bool gStochasticLights = false; //L toggles the many-light path
+bool gGpuLanterns = false;      //--gpu-lanterns: simulate on the GPU, `lanterns` stays empty
+GpuLanterns gpuLanterns;
+bool gAnalyticLanterns = false; //--analytic-lanterns: closed-form trajectories, `lanterns` stays empty
+AnalyticLanterns analyticLanterns;
+
+//spawn randomness is keyed on (seed, stream, spawn event, lantern), so a replay with the
+//same --seed and inputs gets the same swarm whatever thread initialises it
+uint32_t gRandomSeed = 12345;
+enum SpawnStream : uint32_t { STREAM_BOAT = 1, STREAM_CASTLE = 2 };
+uint32_t gBoatSpawns = 0, gCastleBursts = 0;
+ThreadPool* gWorkers = nullptr; //set once main has its pool, big bursts initialise on it
+
+//new lanterns go to the CPU list or are queued for the GPU ring
+void AddLantern(const Lantern& L) {
+    if (gAnalyticLanterns) analyticLanterns.Spawn(L, (float)glfwGetTime());
+    else if (gGpuLanterns) gpuLanterns.Spawn(L);
+    else lanternPool.Spawn(L); //dropped when the pool is full
 }
 
 inline void SpawnLantern() {
     glm::vec3 fwd = glm::vec3(sin(boatRotation), 0.0f, -cos(boatRotation));
 
-    static std::mt19937 rng{12345};
-    std::uniform_real_distribution<float> r01(0.f,1.f);
+    float r[4];
+    RandomFloats4({gRandomSeed, STREAM_BOAT, 0u}, gBoatSpawns++, 0u, r);
 
     glm::vec3 spawnPos = gSpawnOverride ? gSpawnOverridePos : castleLanternOrigin;
 
     Lantern L;
     L.pos = boatPosition + glm::vec3(0.0f, 1.25f, 0.2f);
-    L.vel = glm::vec3(0.0f, 0.7f, 0.0f) + fwd * 0.10f + glm::vec3(r01(rng)-0.5f, 0.0f, r01(rng)-0.5f) * 0.05f; // tiny sideways drift
+    L.vel = glm::vec3(0.0f, 0.7f, 0.0f) + fwd * 0.10f + glm::vec3(r[0]-0.5f, 0.0f, r[1]-0.5f) * 0.05f; // tiny sideways drift
     L.t = 0.0f;
-    L.phase = r01(rng) * 100.0f; //phase for each
-    lanterns.push_back(L);
+    L.phase = r[2] * 100.0f; //phase for each
+    AddLantern(L);
 }
 
-void SpawnLanternAtPos(const glm::vec3& pos) {
-    Lantern L;
+//burst lantern at pos drifting away from origin; swirl in [-0.1, 0.1], phase in [0, 100)
+void InitCastleLantern(Lantern& L, const glm::vec3& origin, const glm::vec3& pos, float swirlX, float swirlZ, float phase) {
     L.pos = pos;
 
     glm::vec3 baseV(0.0f, 0.01f, 0.0f);
 
     //horizontal movement i.e. spreading out
-    glm::vec3 delta = pos - castleLanternOrigin;
+    glm::vec3 delta = pos - origin;
     glm::vec2 d2(delta.x, delta.z);
     float r = glm::length(d2);
     glm::vec3 dir = (r > 1e-4f) ? glm::normalize(glm::vec3(d2.x, 0.0f, d2.y))
@@ -155,80 +153,210 @@ void SpawnLanternAtPos(const glm::vec3& pos) {
     glm::vec3 radialKick = dir * (k * r);
 
     //small random swirl
-    glm::vec3 swirl(frand(-0.1f,0.1f), 0.0f, frand(-0.1f,0.1f));
+    glm::vec3 swirl(swirlX, 0.0f, swirlZ);
 
     L.vel = baseV + radialKick + swirl;
     L.t = 0.0f;
-    L.phase = frand(0.0f, 100.0f);
-    lanterns.push_back(L);
+    L.phase = phase;
 }
 
-inline void SpawnLanternBurstFromCastle(int n = 50) {
-    for (int i = 0; i < n; ++i) {
-        glm::vec3 jitter(frand(-0.5f, 0.5f), frand(0.0f, 0.4f), frand(-0.5f, 0.5f));
-        SpawnLanternAtPos(castleLanternOrigin + jitter);
+//burst at the picked spot when there is one, at the castle otherwise
+inline void SpawnLanternBurst(int n = 50) {
+    const RandomKey key{gRandomSeed, STREAM_CASTLE, gCastleBursts++};
+    const size_t CHUNK = 64;
+    const glm::vec3 origin = gSpawnOverride ? gSpawnOverridePos : castleLanternOrigin;
+
+    //lanterns [first, first + count) of the burst; each depends only on its own index
+    auto initRange = [&](Lantern* out, size_t first, size_t count) {
+        float a[4 * CHUNK], b[4 * CHUNK]; //jitter xyz + swirl x, swirl z + phase
+        for (size_t c = 0; c < count; c += CHUNK) {
+            const size_t m = std::min(CHUNK, count - c);
+            RandomFloats4Batch(key, uint32_t(first + c), m, 0u, a);
+            RandomFloats4Batch(key, uint32_t(first + c), m, 1u, b);
+            for (size_t i = 0; i < m; ++i) {
+                glm::vec3 jitter(a[i] - 0.5f, 0.4f * a[m + i], a[2 * m + i] - 0.5f);
+                InitCastleLantern(out[c + i], origin, origin + jitter, 0.2f * a[3 * m + i] - 0.1f,
+                                  0.2f * b[i] - 0.1f, 100.0f * b[m + i]);
+            }
+        }
+    };
+
+    if (gGpuLanterns || gAnalyticLanterns) { //queued one by one, no CPU storage to fill
+        Lantern block[CHUNK];
+        for (int c = 0; c < n; c += (int)CHUNK) {
+            const int m = std::min((int)CHUNK, n - c);
+            initRange(block, c, m);
+            for (int i = 0; i < m; ++i) AddLantern(block[i]);
+        }
+        return;
     }
+    Lantern* batch = nullptr;
+    int spawned = lanternPool.SpawnBatch(n, batch); //fewer when the pool is nearly full
+    if (gWorkers && spawned > 4096)
+        gWorkers->ParallelFor(spawned, 1024, [&](size_t b, size_t e) { initRange(batch + b, b, e - b); });
+    else
+        initRange(batch, 0, spawned);
 }
 
+//world-space ray through window pixel (x, y), y pointing down
+void ScreenRay(double x, double y, const glm::mat4& view, const glm::mat4& proj, glm::vec3& origin, glm::vec3& dir) {
+    const glm::mat4 inv = glm::inverse(proj * view);
+    const float nx = float(2.0 * x / SCR_WIDTH - 1.0), ny = float(1.0 - 2.0 * y / SCR_HEIGHT);
+    glm::vec4 nearP = inv * glm::vec4(nx, ny, -1.0f, 1.0f);
+    glm::vec4 farP = inv * glm::vec4(nx, ny, 1.0f, 1.0f);
+    origin = glm::vec3(nearP) / nearP.w;
+    dir = glm::normalize(glm::vec3(farP) / farP.w - origin);
+}
 
-struct PointShadow {
-    GLuint fbo = 0;
-    GLuint cube = 0;
-    int size = 1024;
-    float nearP = 0.1f;
-    float farP  = 150.0f;
-    glm::vec3 lightPos{0,5,0};
-
-    void init() {
-        glGenFramebuffers(1, &fbo);
-        glGenTextures(1, &cube);
-        glBindTexture(GL_TEXTURE_CUBE_MAP, cube);
-        for (int i=0;i<6;++i) {
-            glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X+i, 0, GL_DEPTH_COMPONENT,
-                        size, size, 0, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
+//[0, 1]^3 with flat faces, stands in for a model that is still loading
+Mesh BoxMesh() {
+    std::vector<Vertex> vertices;
+    std::vector<unsigned int> indices;
+    for (int axis = 0; axis < 3; ++axis)
+        for (int side = 0; side < 2; ++side) {
+            glm::vec3 n(0.0f);
+            n[axis] = side ? 1.0f : -1.0f;
+            const int u = (axis + 1) % 3, v = (axis + 2) % 3;
+            const unsigned int base = (unsigned int)vertices.size();
+            for (int k = 0; k < 4; ++k) {
+                Vertex vert;
+                vert.Position = glm::vec3(0.0f);
+                vert.Position[axis] = float(side);
+                vert.Position[u] = float(k & 1);
+                vert.Position[v] = float(k >> 1);
+                vert.Normal = n;
+                vert.TexCoords = glm::vec2(float(k & 1), float(k >> 1));
+                vertices.push_back(vert);
+            }
+            const unsigned int quad[6] = { 0, 1, 3, 0, 3, 2 };
+            for (unsigned int q : quad) indices.push_back(base + q);
         }
-        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-
-        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
-        glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, cube, 0);
-        glDrawBuffer(GL_NONE);
-        glReadBuffer(GL_NONE);
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
-    }
-};
-
-
-std::array<glm::mat4,6> ShadowMatrices(const PointShadow& s) {
-    float aspect = 1.0f;
-    glm::mat4 P = glm::perspective(glm::radians(90.0f), aspect, s.nearP, s.farP);
-    glm::vec3 L = s.lightPos;
-    return {
-        P * glm::lookAt(L, L + glm::vec3( 1, 0, 0), glm::vec3(0,-1, 0)),
-        P * glm::lookAt(L, L + glm::vec3(-1, 0, 0), glm::vec3(0,-1, 0)),
-        P * glm::lookAt(L, L + glm::vec3( 0, 1, 0), glm::vec3(0, 0, 1)),
-        P * glm::lookAt(L, L + glm::vec3( 0,-1, 0), glm::vec3(0, 0,-1)),
-        P * glm::lookAt(L, L + glm::vec3( 0, 0, 1), glm::vec3(0,-1, 0)),
-        P * glm::lookAt(L, L + glm::vec3( 0, 0,-1), glm::vec3(0,-1, 0))
-    };
+    return Mesh(vertices, indices);
 }
 
-static int pickShadowLight(const std::vector<Lantern>& Ls, const glm::vec3& target) {
-    int best = -1;
-    float bestD2 = std::numeric_limits<float>::infinity();
-    for (int i = 0; i < (int)Ls.size(); ++i) {
-        float d2 = glm::dot(Ls[i].pos - target, Ls[i].pos - target); // no sqrt
-        if (d2 < bestD2) { bestD2 = d2; best = i; }
-    }
-    return best;
-}
 
-int main() {
+int main(int argc, char** argv) {
     std::puts("ENTER MAIN"); std::fflush(stdout);
+
+    //command line: --shadow-depth 16|24|32, --shadow-dp, --bench-shadows, --stochastic-lights, --no-glow,
+    //--gpu-lanterns, --analytic-lanterns, --bench-trajectories, --bench-pool, --bench-rng, --seed N,
+    //--no-separation, --bench-grid, --no-collision, --bench-bvh [model.obj], --no-lightmap, --bench-textures,
+    //--texture-bc7, --no-texture-compression, --stream-budget MB, --stream-ms MS, --mesh-draco,
+    //--draco-bits POSITION,NORMAL,UV, --bench-mesh-cache [model.obj], --bench-mesh-optimize
+    bool benchShadows = false;
+    bool benchTrajectories = false;
+    bool benchPool = false;
+    bool benchRandom = false;
+    bool lanternGlow = true;
+    bool lanternSeparation = true;
+    bool benchGrid = false;
+    bool lanternCollision = true;
+    bool staticLightmaps = true;
+    bool benchTextures = false;
+    TextureLoader::Compression textureCompression = TextureLoader::COMPRESS_S3TC;
+    AssetStreamer::Budget streamBudget;
+    const char* benchBvh = nullptr;
+    const char* benchMeshCache = nullptr;
+    bool benchMeshOptimize = false;
+    MeshCache::Encoding meshEncoding;
+    ShadowFormat shadowFormat;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--bench-shadows") benchShadows = true;
+        else if (arg == "--shadow-dp") shadowFormat.projection = SHADOW_DUAL_PARABOLOID;
+        else if (arg == "--stochastic-lights") gStochasticLights = true;
+        else if (arg == "--gpu-lanterns") gGpuLanterns = true;
+        else if (arg == "--analytic-lanterns") gAnalyticLanterns = true;
+        else if (arg == "--bench-trajectories") benchTrajectories = true;
+        else if (arg == "--bench-pool") benchPool = true;
+        else if (arg == "--bench-rng") benchRandom = true;
+        else if (arg == "--seed" && i + 1 < argc) gRandomSeed = (uint32_t)std::strtoul(argv[++i], nullptr, 10);
+        else if (arg == "--no-glow") lanternGlow = false;
+        else if (arg == "--no-separation") lanternSeparation = false;
+        else if (arg == "--bench-grid") benchGrid = true;
+        else if (arg == "--no-collision") lanternCollision = false;
+        else if (arg == "--no-lightmap") staticLightmaps = false;
+        else if (arg == "--bench-textures") benchTextures = true;
+        else if (arg == "--texture-bc7") textureCompression = TextureLoader::COMPRESS_BC7;
+        else if (arg == "--no-texture-compression") textureCompression = TextureLoader::COMPRESS_NONE;
+        else if (arg == "--stream-budget" && i + 1 < argc) streamBudget.bytesPerFrame = size_t(std::atof(argv[++i]) * 1048576.0);
+        else if (arg == "--stream-ms" && i + 1 < argc) streamBudget.msPerFrame = std::atof(argv[++i]);
+        else if (arg == "--mesh-draco") meshEncoding.draco = true;
+        else if (arg == "--bench-mesh-optimize") benchMeshOptimize = true;
+        else if (arg == "--draco-bits" && i + 1 < argc)
+            std::sscanf(argv[++i], "%d,%d,%d", &meshEncoding.positionBits, &meshEncoding.normalBits,
+                        &meshEncoding.texCoordBits);
+        else if (arg == "--bench-mesh-cache")
+            benchMeshCache = i + 1 < argc && argv[i + 1][0] != '-' ? argv[++i] : "assets/models/castle.obj";
+        else if (arg == "--bench-bvh")
+            benchBvh = i + 1 < argc && argv[i + 1][0] != '-' ? argv[++i] : "assets/models/castle.obj";
+        else if (arg == "--shadow-depth" && i + 1 < argc) {
+            int bits = std::atoi(argv[++i]);
+            shadowFormat.depthFormat = bits == 16 ? GL_DEPTH_COMPONENT16
+                                     : bits == 24 ? GL_DEPTH_COMPONENT24 : GL_DEPTH_COMPONENT32F;
+        }
+    }
+    //every image the scene uploads, the six skybox faces last
+    enum { TEX_BOAT, TEX_LANTERN, TEX_DIRT, TEX_GRASS, TEX_FLOWER, TEX_SKYBOX, TEX_COUNT = TEX_SKYBOX + 6 };
+    const std::vector<std::pair<std::string, TextureLoader::Kind>> textureFiles = {
+        {"assets/textures/boat_diffuse.png", TextureLoader::TEXTURE_2D},
+        {"assets/textures/emblem.jpg", TextureLoader::TEXTURE_2D},
+        {"assets/textures/dirtTex.jpg", TextureLoader::TEXTURE_2D},
+        {"assets/textures/grassTex.jpg", TextureLoader::TEXTURE_2D},
+        {"assets/textures/flowerTex.png", TextureLoader::TEXTURE_2D},
+        {"assets/skybox/right.png", TextureLoader::CUBE_FACE},
+        {"assets/skybox/left.png", TextureLoader::CUBE_FACE},
+        {"assets/skybox/top.png", TextureLoader::CUBE_FACE},
+        {"assets/skybox/bottom.png", TextureLoader::CUBE_FACE},
+        {"assets/skybox/front.png", TextureLoader::CUBE_FACE},
+        {"assets/skybox/back.png", TextureLoader::CUBE_FACE}
+    };
+
     std::cout << "== Boat-only debug build ==\n";
+    if (benchTrajectories || benchPool || benchRandom || benchGrid || benchBvh || benchTextures
+        || benchMeshCache || benchMeshOptimize) { //CPU only, no window needed
+        if (benchTrajectories) RunTrajectoryBenchmark();
+        if (benchPool) RunPoolBenchmark();
+        if (benchRandom) RunRandomBenchmark();
+        if (benchGrid) RunSpatialHashBenchmark();
+        if (benchBvh) RunTriangleBVHBenchmark(benchBvh);
+        if (benchTextures) RunTextureBenchmark(textureFiles);
+        if (benchMeshCache) RunMeshCacheBenchmark(benchMeshCache);
+        if (benchMeshOptimize)
+            RunMeshOptimizeBenchmark({"assets/models/boat.obj", "assets/models/lantern.obj", "assets/models/flower.obj",
+                                      "assets/models/castle.obj", "assets/models/island.obj"});
+        return 0;
+    }
+    if (gAnalyticLanterns) gGpuLanterns = false; //one lantern store at a time
+    MeshCache::SetEncoding(meshEncoding);
+
+    //assets.pack (cmake -DUSE_ASSET_PACK=ON) replaces assets/, shaders/ and cache/; without it
+    //everything is read from the files. What the first frame needs is paged in ahead of time
+    if (AssetPack::Open("assets.pack")) {
+        std::printf("[PACK] assets.pack mapped: %zu entries, %.2f MB\n", AssetPack::EntryCount(),
+                    AssetPack::MappedBytes() / (1024.0 * 1024.0));
+        for (const auto& file : textureFiles) { //the image itself only when its levels aren't packed
+            const std::string levels = MeshCache::PathFor(file.first, ".tex");
+            AssetPack::Prefetch(AssetPack::Find(levels) ? levels : file.first);
+        }
+        for (const char* model : {"assets/models/boat.obj", "assets/models/lantern.obj", "assets/models/flower.obj"})
+            AssetPack::Prefetch(MeshCache::PathFor(model));
+        for (const char* shader : {"lighting.vert", "lighting.frag", "skybox.vert", "skybox.frag", "water.vert",
+                                   "water.frag", "shadow.vert", "shadow.frag", "shadow.geom", "cascade.vert",
+                                   "cascade.frag"})
+            AssetPack::Prefetch(std::string("shaders/") + shader);
+    }
+
+    //worker threads come up first: the texture decodes run on them while the window,
+    //shaders and models are created, the uploads happen once the models are in
+    ThreadPool workers;
+    gWorkers = &workers;
+    TextureLoader textureLoader(workers, textureCompression);
+    //the lantern and flower textures wait for their models, which set their texel budgets
+    int textureTicket[TEX_COUNT];
+    for (int i = 0; i < TEX_COUNT; ++i)
+        if (i != TEX_LANTERN && i != TEX_FLOWER)
+            textureTicket[i] = textureLoader.Request(textureFiles[i].first, textureFiles[i].second);
 
     if (!glfwInit()) { std::cerr << "GLFW init failed\n"; return -1; }
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
@@ -264,8 +392,9 @@ int main() {
         }
     });
 
-    static const int MAX_SHADOW_CASTERS = 5;
-    PointShadow gPointShadows[MAX_SHADOW_CASTERS];
+    //shadow cubes are handed out per frame, see ShadowBudget
+    ShadowBudget shadowBudget;
+    shadowBudget.format = shadowFormat;
 
     std::puts("S3 before glewInit");
     glewExperimental = GL_TRUE;
@@ -280,44 +409,175 @@ int main() {
     Shader lit("shaders/lighting.vert", "shaders/lighting.frag");
     Shader skyboxShader("shaders/skybox.vert", "shaders/skybox.frag");
     Shader water("shaders/water.vert", "shaders/water.frag");
-    for (int i=0;i<MAX_SHADOW_CASTERS;++i) 
-        gPointShadows[i].init();
-    auto& sh = gPointShadows[0]; 
-    Shader shadowShader("shaders/shadow.vert", "shaders/shadow.frag");
-
-
-    std::puts("S6 before textures");
-    unsigned int boatTex = loadTexture2D("assets/textures/boat_diffuse.png");
-    unsigned int lanternTex = loadTexture2D("assets/textures/emblem.jpg");
-    unsigned int dirtTex = loadTexture2D("assets/textures/dirtTex.jpg");
-    unsigned int grassTex = loadTexture2D("assets/textures/grassTex.jpg");
-    unsigned int flowerTex = loadTexture2D("assets/textures/flowerTex.png");
-    
-    std::printf("S6a textures boat=%u lantern=%u\n", boatTex, lanternTex);
+    Shader shadowShader("shaders/shadow.vert", "shaders/shadow.frag", "shaders/shadow.geom");
+    Shader cascadeShader("shaders/cascade.vert", "shaders/cascade.frag");
+    CascadedShadow moonShadow;
+    moonShadow.init(1024);
+    StochasticLights manyLights;
+    manyLights.init();
+    if (gGpuLanterns) gpuLanterns.init();
+    if (gAnalyticLanterns) analyticLanterns.init();
+
+    //light tree over the lanterns, rebuilt/refit on the worker threads
+    LightBVH lightTree;
+    IrradianceVolume glow;
+    glow.enabled = lanternGlow;
+    glow.init();
+
+    //neighbour grid for crowd spacing, rebuilt every tick
+    const float SEPARATION_RADIUS = 0.6f;
+    const float SEPARATION_STRENGTH = 0.4f;
+    SpatialHash lanternGrid;
+    lanternGrid.cellSize = 2.0f * SEPARATION_RADIUS;
+    std::vector<glm::vec3> separation;
+
+
+    //loading camera
+    float boatYaw = 0.0f;
+    const float fovY = glm::radians(60.0f);
+    const float aspect = (float)SCR_WIDTH / (float)SCR_HEIGHT;
+    const float nearPlane = 0.05f;
+    glm::mat4 proj = glm::perspective(fovY, aspect, nearPlane, 200.0f);
 
     std::puts("S7 before models");
     std::cout << "Loading model: assets/models/boat.obj\n";
     Model boat("assets/models/boat.obj");
     std::cout << "Loading model: assets/models/lantern.obj\n";
     Model lantern("assets/models/lantern.obj");
-    std::cout << "Loading model: assets/models/castle.obj\n";
-    Model castle("assets/models/castle.obj");
-    std::cout << "Loading model: assets/models/island.obj\n";
-    Model island("assets/models/island.obj");
     std::cout << "Loading model: assets/models/flower.obj\n";
     Model flower("assets/models/flower.obj");
-    std::puts("S7a after models");
+
+    //texel budgets: lanterns spawn at the cockpit and rise away, so only their size on
+    //screen limits them; the flower orbits the boat, the cockpit eye sits 0.35 behind its centre.
+    //Their textures then decode while the castle and island import
+    const TextureDensity::Estimate lanternDensity = TextureDensity::Analyze(lantern, 0.06f, 0.0f, fovY, SCR_HEIGHT);
+    const TextureDensity::Estimate flowerDensity =
+        TextureDensity::Analyze(flower, gFlowerScale, gFlowerOrbitRadius - 0.35f, fovY, SCR_HEIGHT);
+    std::printf("[TEX] texel budget lantern %d (%.2f world/uv, %.2f away), flower %d (%.2f world/uv, %.2f away)\n",
+                lanternDensity.size, lanternDensity.worldPerUV, lanternDensity.closest,
+                flowerDensity.size, flowerDensity.worldPerUV, flowerDensity.closest);
+    textureTicket[TEX_LANTERN] = textureLoader.Request(textureFiles[TEX_LANTERN].first, TextureLoader::TEXTURE_2D,
+                                                       lanternDensity.size);
+    textureTicket[TEX_FLOWER] = textureLoader.Request(textureFiles[TEX_FLOWER].first, TextureLoader::TEXTURE_2D,
+                                                      flowerDensity.size);
 
     glm::vec3 islandPos = glm::vec3(65.0f, 0.0f, -30.0f);
     glm::vec3 castlePos = glm::vec3(65.0f, 1.4f, -19.0f);
     float castleScale = 0.32f;
     float islandScale = 2.0f;
 
-    //loading camera
-    float boatYaw = 0.0f;
-    glm::mat4 proj = glm::perspective(glm::radians(60.0f),
-                                      (float)SCR_WIDTH / (float)SCR_HEIGHT,
-                                      0.05f, 200.0f);
+    //island and castle never move
+    glm::mat4 I = glm::translate(glm::mat4(1), islandPos);
+    I = glm::scale(I, glm::vec3(islandScale * 2, 0.7 * islandScale, islandScale * 2));
+
+    glm::mat4 C = glm::translate(glm::mat4(1.f), castlePos);
+    C = glm::scale(C, glm::vec3(castleScale));
+
+    //moonlight
+    const glm::vec3 dirLightDir = glm::normalize(glm::vec3(-0.2f, -1.0f, -0.1f));
+    const glm::vec3 dirLightColor(0.55f, 0.50f, 0.65f);
+
+    //island green, castle meshes cycle pink / white / off-white
+    const glm::vec3 islandColor(31.0f / 255.0f, 94.0f / 255.0f, 31.0f / 255.0f);
+    auto castleColor = [](size_t mesh) {
+        const glm::vec3 colors[3] = { glm::vec3(1.0f, 0.819f, 0.863f), glm::vec3(1.0f), glm::vec3(1.0f, 0.992f, 0.921f) };
+        return colors[mesh % 3];
+    };
+
+    //castle + island: import and bakes run on a loader thread with its own GL context while
+    //the scene already runs, boxes of their cached bounds standing in; their data then goes
+    //up a slice per frame (see AssetStreamer). Without a shared context they load right here
+    const int LIGHTMAP_UNIT = 15;
+    const unsigned staticBake = MODEL_COLLISION | MODEL_AO | (staticLightmaps ? MODEL_LIGHTMAP : 0u);
+    std::unique_ptr<Model> castle, island;
+    unsigned int islandLightmap = 0, castleLightmap = 0;
+    int castleLightmapBatch = -1, islandLightmapBatch = -1;
+    std::vector<std::vector<uint8_t>> lightmapTexels; //read by the streamer until their batches are ready
+    std::atomic<bool> staticUploaded{false}; //the loader is done with everything above
+    const auto staticStart = std::chrono::steady_clock::now();
+    auto loadStaticWorld = [&](AssetStreamer* streamer) {
+        std::cout << "Loading model: assets/models/castle.obj\n";
+        castle.reset(new Model("assets/models/castle.obj", staticBake, &workers, streamer, C));
+        std::cout << "Loading model: assets/models/island.obj\n";
+        island.reset(new Model("assets/models/island.obj", staticBake, &workers, streamer, I));
+
+        //the moon never moves and neither do the castle and island: their moonlight (shadowed,
+        //one bounce) is baked once on the workers and cached, only lantern light stays per frame
+        if (staticLightmaps) {
+            CollisionScene bakeScene; //the main thread's scene is in use meanwhile
+            bakeScene.Add(castle->Collision(), C);
+            bakeScene.Add(island->Collision(), I);
+            std::vector<Lightmap::Target> targets(2);
+            targets[0] = {castle.get(), C, 0, {}};
+            for (size_t i = 0; i < castle->MeshCount(); ++i) targets[0].albedo.push_back(castleColor(i));
+            targets[1] = {island.get(), I, 1, {islandColor}};
+            Lightmap::Bake(targets, bakeScene, dirLightDir, dirLightColor, Lightmap::Settings(), workers, lightmapTexels);
+            //a batch each, ranked by the model's bounds (translate + scale, two corners do)
+            auto lightmapTexture = [&](const Model& m, const glm::mat4& toWorld, const std::vector<uint8_t>& texels, int& batch) {
+                if (streamer) {
+                    glm::vec3 bmin, bmax;
+                    m.Bounds(bmin, bmax);
+                    const glm::vec3 a = glm::vec3(toWorld * glm::vec4(bmin, 1.0f)), b = glm::vec3(toWorld * glm::vec4(bmax, 1.0f));
+                    streamer->BeginBatch(glm::min(a, b), glm::max(a, b));
+                }
+                const unsigned int tex = Lightmap::CreateTexture(texels, m.LightmapAtlas().size, streamer);
+                if (streamer) batch = streamer->EndBatch();
+                return tex;
+            };
+            castleLightmap = lightmapTexture(*castle, C, lightmapTexels[0], castleLightmapBatch);
+            islandLightmap = lightmapTexture(*island, I, lightmapTexels[1], islandLightmapBatch);
+        }
+        staticUploaded.store(true, std::memory_order_release);
+    };
+    AssetStreamer streamer;
+    streamer.SetBudget(streamBudget);
+    if (streamer.Start(window)) streamer.Post([&]{ loadStaticWorld(&streamer); });
+    else loadStaticWorld(nullptr);
+
+    //stand-ins sized from the mesh cache headers, nothing on a cold start
+    glm::vec3 castleBoxMin, castleBoxMax, islandBoxMin, islandBoxMax;
+    const bool castleBox = MeshCache::Peek("assets/models/castle.obj", castleBoxMin, castleBoxMax);
+    const bool islandBox = MeshCache::Peek("assets/models/island.obj", islandBoxMin, islandBoxMax);
+    Mesh placeholderBox = BoxMesh();
+    std::puts("S7a after models");
+
+    std::puts("S6 textures");
+    const auto textureWait = std::chrono::steady_clock::now();
+    unsigned int boatTex = textureLoader.Texture2D(textureTicket[TEX_BOAT]);
+    unsigned int lanternTex = textureLoader.Texture2D(textureTicket[TEX_LANTERN]);
+    unsigned int dirtTex = textureLoader.Texture2D(textureTicket[TEX_DIRT]);
+    unsigned int grassTex = textureLoader.Texture2D(textureTicket[TEX_GRASS]);
+    unsigned int flowerTex = textureLoader.Texture2D(textureTicket[TEX_FLOWER]);
+    unsigned int cubemapTexture = textureLoader.Cubemap(textureTicket[TEX_SKYBOX]);
+    std::printf("S6a textures boat=%u lantern=%u skybox=%u, %.1f ms on the main thread\n", boatTex, lanternTex,
+                cubemapTexture, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - textureWait).count());
+    textureLoader.PrintVramReport();
+
+    //mesh / impostor / point sprite per lantern, one instanced batch each
+    LanternLOD lanternLod;
+    lanternLod.init(lantern, lanternTex);
+
+    //static world for lantern collision (and picking)
+    const float LANTERN_RADIUS = 0.2f;
+    CollisionScene scene; //castle + island join once they have streamed in
+
+    if (benchShadows) {
+        glm::mat4 B = glm::translate(glm::mat4(1.0f), boatPosition);
+        B = glm::scale(B, glm::vec3(0.3f));
+        streamer.Stop(); //the static world has to be there, however long that takes
+        castle->CreateVertexArrays(&streamer);
+        island->CreateVertexArrays(&streamer);
+        RunShadowBenchmark(shadowShader, castleLanternOrigin + glm::vec3(0.0f, 3.0f, 0.0f), 1024, [&]() {
+            shadowShader.setMat4("model", C);
+            castle->Draw(shadowShader);
+            shadowShader.setMat4("model", I);
+            island->Draw(shadowShader);
+            shadowShader.setMat4("model", B);
+            boat.Draw(shadowShader);
+        });
+        glfwTerminate();
+        return 0;
+    }
 
     //water mesh
     unsigned int waterVAO=0, waterVBO=0, waterEBO=0;
@@ -375,17 +635,6 @@ int main() {
     glBindVertexArray(0);
     std::puts("S8a after skybox VAO");
 
-    std::vector<std::string> faces = {
-        "assets/skybox/right.png",
-        "assets/skybox/left.png",
-        "assets/skybox/top.png",
-        "assets/skybox/bottom.png",
-        "assets/skybox/front.png",
-        "assets/skybox/back.png"
-    };
-
-    std::puts("S9 before loadCubemap");
-    unsigned int cubemapTexture = loadCubemap(faces);
     std::puts("S10 before skybox uniform");
     skyboxShader.use();
     skyboxShader.setInt("skybox", 0);
@@ -396,6 +645,10 @@ int main() {
 
     //check timer for dt
     float lastTime = glfwGetTime();
+    bool staticArrived = false, staticReady = false; //models exist / everything streamed and in the collision scene
+    size_t castleWaiting = SIZE_MAX, islandWaiting = SIZE_MAX; //meshes without a vertex array yet
+    bool castleLightmapReady = false, islandLightmapReady = false, castleInScene = false, islandInScene = false;
+    double lastBacklogReport = 0.0;
 
     while (!glfwWindowShouldClose(window)) {
         glfwPollEvents();
@@ -436,6 +689,64 @@ int main() {
             view = camera.GetViewMatrix();
         }
 
+        //castle + island stream in mesh by mesh under the per-frame budget, what this view sees
+        //first: each mesh gets its vertex array once its batch has landed and the cached shadows
+        //redraw with it; a model joins the collision scene once it's whole
+        streamer.BeginFrame(proj * view, eye);
+        if (!staticArrived) staticArrived = staticUploaded.load(std::memory_order_acquire);
+        if (staticArrived && !staticReady) {
+            const size_t castleLeft = castle->CreateVertexArrays(&streamer), islandLeft = island->CreateVertexArrays(&streamer);
+            if (castleLeft != castleWaiting || islandLeft != islandWaiting) {
+                for (auto& slot : shadowBudget.slots) slot.cache.valid = false;
+                moonShadow.Invalidate();
+                castleWaiting = castleLeft;
+                islandWaiting = islandLeft;
+            }
+            if (!castleInScene && castleLeft == 0) { scene.Add(castle->Collision(), C); castleInScene = true; }
+            if (!islandInScene && islandLeft == 0) { scene.Add(island->Collision(), I); islandInScene = true; }
+            castleLightmapReady = castleLightmapReady || streamer.BatchReady(castleLightmapBatch);
+            islandLightmapReady = islandLightmapReady || streamer.BatchReady(islandLightmapBatch);
+
+            const AssetStreamer::Backlog backlog = streamer.Pending();
+            if (castleInScene && islandInScene && castleLightmapReady && islandLightmapReady) {
+                staticReady = true;
+                std::vector<std::vector<uint8_t>>().swap(lightmapTexels);
+                std::printf("[Stream] castle + island ready after %.0f ms: %.1f MB through %s staging over %d frames, "
+                            "at most %.2f MB / %.2f ms in one\n",
+                            std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - staticStart).count(),
+                            streamer.BytesStreamed() / 1048576.0, streamer.Persistent() ? "persistent" : "orphaned",
+                            backlog.frames, backlog.maxFrameBytes / 1048576.0, backlog.maxFrameMs);
+            } else if (backlog.bytes && glfwGetTime() - lastBacklogReport >= 1.0) {
+                lastBacklogReport = glfwGetTime();
+                std::printf("[Stream] backlog %.1f MB in %d batches, %zu castle / %zu island meshes to go\n",
+                            backlog.bytes / 1048576.0, backlog.batches, castleLeft, islandLeft);
+            }
+        }
+
+        //click-to-spawn: nearest of castle / island (through their BVHs) and the water plane
+        if (gPickRequested) {
+            gPickRequested = false;
+            auto pickStart = std::chrono::steady_clock::now();
+            double cx = SCR_WIDTH * 0.5, cy = SCR_HEIGHT * 0.5; //captured cursor: aim with the crosshair
+            if (glfwGetInputMode(window, GLFW_CURSOR) != GLFW_CURSOR_DISABLED) glfwGetCursorPos(window, &cx, &cy);
+            glm::vec3 o, d;
+            ScreenRay(cx, cy, view, proj, o, d);
+            float tHit = 200.0f;
+            glm::vec3 n(0.0f, 1.0f, 0.0f);
+            bool found = false;
+            if (d.y < 0.0f && -o.y / d.y < tHit) { tHit = -o.y / d.y; found = true; }
+            RayHit hit;
+            if (scene.Raycast(o, d, tHit, hit)) { tHit = hit.t; n = hit.normal; found = true; }
+            double pickUs = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - pickStart).count();
+            if (found) {
+                gSpawnOverride = true;
+                gSpawnOverridePos = o + d * tHit + n * 0.3f; //just off the surface
+                std::printf("[Pick] burst at (%.1f, %.1f, %.1f), ray took %.0f us\n",
+                            gSpawnOverridePos.x, gSpawnOverridePos.y, gSpawnOverridePos.z, pickUs);
+                SpawnLanternBurst(20);
+            }
+        }
+
         for (auto& L : lanterns) {
             L.t += deltaTime;
             L.vel.y += 0.01f * deltaTime;
@@ -450,21 +761,44 @@ int main() {
             L.pos += L.vel * deltaTime;
         }
 
-        lanterns.erase(std::remove_if(lanterns.begin(), lanterns.end(),
-            [&](const Lantern& L){
-                if (L.t > 40.0f) return true;
-                if (L.pos.y > 60.0f) return true;
-                if (glm::length(L.pos - boatPosition) > 200.0f) return true;
-                return false;
-            }), lanterns.end());
+        lanternPool.RemoveIf([&](const Lantern& L){
+            if (L.t > 40.0f) return true;
+            if (L.pos.y > 60.0f) return true;
+            if (glm::length(L.pos - boatPosition) > 200.0f) return true;
+            return false;
+        });
+        //lanterns closer than SEPARATION_RADIUS drift apart instead of passing through each other
+        if (lanternSeparation && lanterns.size() > 1) {
+            lanternGrid.Build(lanterns, workers);
+            lanternGrid.Separation(SEPARATION_RADIUS, SEPARATION_STRENGTH, separation, workers);
+            for (size_t i = 0; i < lanterns.size(); ++i) lanterns[i].vel += separation[i] * deltaTime;
+        }
+        //keep lanterns out of the castle and island: push out of the surface, drop the inward velocity
+        if (lanternCollision) {
+            workers.ParallelFor(lanterns.size(), 1024, [&](size_t b, size_t e) {
+                for (size_t i = b; i < e; ++i) {
+                    Lantern& L = lanterns[i];
+                    SphereContact c;
+                    if (!scene.SphereQuery(L.pos, LANTERN_RADIUS, c)) continue;
+                    L.pos += c.normal * c.depth;
+                    float into = glm::dot(L.vel, c.normal);
+                    if (into < 0.0f) L.vel -= c.normal * into;
+                }
+            });
+        }
+        if (gGpuLanterns) gpuLanterns.Step(deltaTime, boatPosition);
+        if (gAnalyticLanterns) {
+            analyticLanterns.Update();
+            //read after input and spawning: a lantern stamped later than the time the shaders
+            //get would have t < 0 and stay hidden for its first frame
+            const float lanternNow = static_cast<float>(glfwGetTime());
+            analyticLanterns.SetUniforms(lit, lanternNow, boatPosition);
+            analyticLanterns.SetUniforms(cascadeShader, lanternNow, boatPosition);
+        }
+        lightTree.Update(lanterns, workers);
+        glow.Update(lanterns, 0.5f * (boatPosition + castlePos), workers);
 
         //declaring the models
-        glm::mat4 I = glm::translate(glm::mat4(1), islandPos);
-        I = glm::scale(I, glm::vec3(islandScale * 2, 0.7 * islandScale, islandScale * 2));
-
-        glm::mat4 C = glm::translate(glm::mat4(1.f), castlePos);
-        C = glm::scale(C, glm::vec3(castleScale));
-
         glm::mat4 model = glm::translate(glm::mat4(1.0f), boatPosition);
         model = glm::rotate(model, boatRotation, glm::vec3(0,1,0));
         model = glm::scale(model, glm::vec3(0.3f));
@@ -498,41 +832,95 @@ int main() {
                         * glm::scale(glm::mat4(1.f), glm::vec3(0.06f)));
         }
 
-        //shadow
-        int idx = pickShadowLight(lanterns, boatPosition);
-        if (idx >= 0) {
-            sh.lightPos = lanterns[idx].pos + glm::vec3(0.0f, 0.2f, 0.0f);
-        } else {
-            sh.lightPos = glm::vec3(65.0f, 12.0f, -19.0f);
+        //GPU / analytic lanterns are only lit through the stochastic path, the CPU has no positions
+        const bool wantManyLights = gStochasticLights || gGpuLanterns || gAnalyticLanterns;
+        if (manyLights.enabled != wantManyLights) {
+            manyLights.enabled = wantManyLights;
+            manyLights.Reset(); //stale history from the last time it was on
         }
 
-        glViewport(0, 0, sh.size, sh.size);
-        glBindFramebuffer(GL_FRAMEBUFFER, sh.fbo);
-        glClear(GL_DEPTH_BUFFER_BIT);
+        //shadow: the budget picks which lanterns get a cube this frame.
+        //The stochastic path shades without shadows, so it lets every slot go idle.
+        static const std::vector<Lantern> noShadowCasters;
+        if (manyLights.enabled) shadowBudget.Update(noShadowCasters, proj * view, eye);
+        else shadowBudget.Update(lanterns, proj * view, eye, &lightTree);
+
+        //castle + island never move, they live in each slot's cached static layer
+        auto drawStaticCasters = [&]() {
+            if (!staticArrived) return;
+            shadowShader.setMat4("model", C);
+            castle->Draw(shadowShader);
+            shadowShader.setMat4("model", I);
+            island->Draw(shadowShader);
+        };
+        auto drawDynamicCasters = [&](int skipLantern) {
+            shadowShader.setMat4("model", model);
+            boat.Draw(shadowShader);
+            for (int i = 0; i < (int)Lmats.size(); ++i) {
+                if (i == skipLantern) continue; //a lantern doesn't shadow its own light
+                shadowShader.setMat4("model", Lmats[i]);
+                lantern.Draw(shadowShader);
+            }
+            shadowShader.setMat4("model", M);
+            flower.Draw(shadowShader);
+        };
+
         glEnable(GL_DEPTH_TEST);
         glEnable(GL_CULL_FACE);
         glCullFace(GL_FRONT);
 
-        shadowShader.use();
-        auto mats = ShadowMatrices(sh);
-        for (int i = 0; i < 6; ++i)
-            shadowShader.setMat4(("shadowMatrices[" + std::to_string(i) + "]").c_str(), mats[i]);
-        shadowShader.setVec3("lightPos", sh.lightPos);
-        shadowShader.setFloat("farPlane", sh.farP);
-
-        shadowShader.setMat4("model", C);       
-        castle.Draw(shadowShader);
-        shadowShader.setMat4("model", I);       
-        island.Draw(shadowShader);
-        shadowShader.setMat4("model", model);  
-        boat.Draw(shadowShader);
-        for (int i = 0; i < (int)Lmats.size(); ++i) {
-            if (i == idx) continue;
-            shadowShader.setMat4("model", Lmats[i]);
-            lantern.Draw(shadowShader);
+        //active slots are packed so the shaders see shadows 0..numShadows-1
+        ShadowSlot* shadowOrder[ShadowBudget::MAX_SLOTS];
+        int numShadows = 0;
+        for (auto& slot : shadowBudget.slots) {
+            if (!slot.active) continue;
+            PointShadow& sh = slot.shadow;
+            glm::vec3 lightPos = lanterns[slot.lanternIndex].pos + glm::vec3(0.0f, 0.2f, 0.0f);
+            //pins sh.lightPos to the cached origin until the lantern drifts too far
+            ShadowCacheUpdate up = slot.cache.Begin(sh, slot.lanternId, lightPos,
+                                                    boatPosition, gFlowerOrbitRadius + 1.0f);
+
+            if (up.staticDirty) {
+                BeginShadowPass(shadowShader, slot.cache.staticLayer, (1u << sh.views()) - 1u);
+                glClear(GL_DEPTH_BUFFER_BIT);
+                drawStaticCasters();
+            }
+
+            //refreshed faces = static depth + dynamic casters on top, the rest keep last frame's
+            CopyShadowViews(slot.cache.staticLayer, sh, up.faceMask);
+            BeginShadowPass(shadowShader, sh, up.faceMask);
+            drawDynamicCasters(slot.lanternIndex);
+
+            shadowOrder[numShadows++] = &slot;
+        }
+
+        //moon cascades: near one every frame, far ones (castle + island only) when the view left them
+        unsigned int cascadeMask = moonShadow.Update(view, fovY, aspect, nearPlane,
+                                                     perspectiveBoat ? 120.0f : 160.0f, dirLightDir);
+        if (cascadeMask) {
+            cascadeShader.use();
+            for (int c = 0; c < CascadedShadow::NUM_CASCADES; ++c) {
+                if (!(cascadeMask & (1u << c))) continue;
+                moonShadow.BeginCascade(c);
+                cascadeShader.setMat4("lightViewProj", moonShadow.cascades[c].viewProj);
+                if (staticArrived) {
+                    cascadeShader.setMat4("model", C);
+                    castle->Draw(cascadeShader);
+                    cascadeShader.setMat4("model", I);
+                    island->Draw(cascadeShader);
+                }
+                if (c != 0) continue;
+                cascadeShader.setMat4("model", model);
+                boat.Draw(cascadeShader);
+                cascadeShader.setMat4("model", M);
+                flower.Draw(cascadeShader);
+                for (const auto& Lm : Lmats) {
+                    cascadeShader.setMat4("model", Lm);
+                    lantern.Draw(cascadeShader);
+                }
+                if (gAnalyticLanterns) analyticLanterns.DrawCasters(cascadeShader, lantern);
+            }
         }
-        shadowShader.setMat4("model", M);
-        flower.Draw(shadowShader);
 
         glCullFace(GL_BACK);
         glBindFramebuffer(GL_FRAMEBUFFER, 0);
@@ -542,88 +930,151 @@ int main() {
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
         glDisable(GL_CULL_FACE); 
 
-        //bind depth cube for lighting
-        glActiveTexture(GL_TEXTURE0 + 5);
-        glBindTexture(GL_TEXTURE_CUBE_MAP, sh.cube);
-        
+        //bind depth cubes for lighting on units 5..9, dual-paraboloid arrays on 10..14
+        const bool shadowDP = shadowBudget.format.projection == SHADOW_DUAL_PARABOLOID;
+        int shadowSlotToShader[ShadowBudget::MAX_SLOTS];
+        for (int k = 0; k < ShadowBudget::MAX_SLOTS; ++k) shadowSlotToShader[k] = -1;
+        for (int k = 0; k < numShadows; ++k) {
+            glActiveTexture(GL_TEXTURE0 + (shadowDP ? 10 : 5) + k);
+            glBindTexture(shadowOrder[k]->shadow.target(), shadowOrder[k]->shadow.tex);
+            shadowSlotToShader[shadowOrder[k] - shadowBudget.slots] = k;
+        }
+        const float shadowFar = shadowBudget.slots[0].shadow.farP;
+
         water.use();
-        water.setInt("pointShadowMap", 5);
-        water.setFloat("shadowFarPlane", sh.farP);
-        water.setVec3("pointLightPos",  sh.lightPos);
+        water.setFloat("shadowFarPlane", shadowFar);
+        water.setBool("shadowDualParaboloid", shadowDP);
+        water.setInt("numPointShadows", numShadows);
+        for (int k = 0; k < ShadowBudget::MAX_SLOTS; ++k) {
+            water.setInt("pointShadowMaps[" + std::to_string(k) + "]", 5 + k);
+            water.setInt("pointShadowDP[" + std::to_string(k) + "]", 10 + k);
+            if (k < numShadows)
+                water.setVec3("pointLightPos[" + std::to_string(k) + "]", shadowOrder[k]->shadow.lightPos);
+        }
         
         lit.use();
         lit.setMat4("projection", proj);  
         lit.setMat4("view",      view);    
         lit.setVec3("viewPos",   eye); 
 
-        lit.setInt("pointShadowMap", 5);
-        lit.setFloat("shadowFarPlane", sh.farP);
-        lit.setInt("shadowedIndex", idx);  
-        lit.setVec3("pointLightPos", sh.lightPos);
+        lit.setFloat("shadowFarPlane", shadowFar);
+        lit.setBool("shadowDualParaboloid", shadowDP);
+        for (int k = 0; k < ShadowBudget::MAX_SLOTS; ++k) {
+            lit.setInt("pointShadowMaps[" + std::to_string(k) + "]", 5 + k);
+            lit.setInt("pointShadowDP[" + std::to_string(k) + "]", 10 + k);
+            if (k < numShadows)
+                lit.setVec3("pointLightPos[" + std::to_string(k) + "]", shadowOrder[k]->shadow.lightPos);
+        }
 
         //dirlight
-        lit.setVec3("dirLightDir", glm::normalize(glm::vec3(-0.2f, -1.0f, -0.1f)));
-        lit.setVec3("dirLightColor", glm::vec3(0.55f, 0.50f, 0.65f));
+        lit.setVec3("dirLightDir", dirLightDir);
+        lit.setVec3("dirLightColor", dirLightColor);
+
+        glActiveTexture(GL_TEXTURE0 + 4);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, moonShadow.tex);
+        lit.setBool("useDirShadow", true);
+        lit.setInt("dirShadowMap", 4);
+        for (int c = 0; c < CascadedShadow::NUM_CASCADES; ++c) {
+            std::string idx = "[" + std::to_string(c) + "]";
+            lit.setMat4("cascadeViewProj" + idx, moonShadow.cascades[c].viewProj);
+            lit.setFloat("cascadeSplits" + idx, moonShadow.cascades[c].splitFar);
+            lit.setFloat("cascadeTexel" + idx, moonShadow.cascades[c].texelWorld);
+        }
         lit.setFloat("iTime", (float)glfwGetTime());
 
+        //many-light mode: lantern tables on units 2/3, samplers bound either way
+        if (gGpuLanterns)
+            manyLights.UseExternalLights(gpuLanterns.StateTexture(), gpuLanterns.UsedSlots(),
+                                         GpuLanterns::RECORD_TEXELS);
+        else if (gAnalyticLanterns)
+            manyLights.UseExternalLights(analyticLanterns.RecordTexture(), analyticLanterns.UsedSlots(),
+                                         AnalyticLanterns::RECORD_TEXELS, true);
+        else if (manyLights.enabled)
+            manyLights.BuildLightTables(lanterns, eye);
+        manyLights.BindForShading(lit, 2, 3);
+        glow.Bind(lit, 1);
+        lit.setVec3("lanternColor", LANTERN_LIGHT_COLOR);
+        lit.setVec3("lanternAtten", glm::vec3(LANTERN_ATTEN_CONSTANT, LANTERN_ATTEN_LINEAR,
+                                              LANTERN_ATTEN_QUADRATIC));
+
         //lantern - lights, working wiht shadowing
         lit.use();
         
+        //lightcut around the boat: nearby lanterns one by one, far groups merged into
+        //one light each, shadow casters always on their own
         const int MAX_GPU_LIGHTS = 64;
-        std::vector<int> ids(lanterns.size());
-        std::iota(ids.begin(), ids.end(), 0);
-
-        //sort by distance to the boat
-        const int take = std::min((int)ids.size(), MAX_GPU_LIGHTS);
-        std::partial_sort(ids.begin(), ids.begin()+take, ids.end(),
-            [&](int a, int b){
-                float da = glm::dot(lanterns[a].pos - boatPosition, lanterns[a].pos - boatPosition);
-                float db = glm::dot(lanterns[b].pos - boatPosition, lanterns[b].pos - boatPosition);
-                return da < db;
-            });
+        std::vector<int> shadowCasters;
+        for (const auto& slot : shadowBudget.slots)
+            if (slot.active) shadowCasters.push_back(slot.lanternIndex);
+        std::vector<CutLight> cut;
+        if (!manyLights.enabled) lightTree.Cut(boatPosition, MAX_GPU_LIGHTS, shadowCasters, cut);
 
-        int n = take;
+        int n = std::min((int)cut.size(), MAX_GPU_LIGHTS);
         lit.setInt("numLanterns", n);
 
-        int shadowGlobal = pickShadowLight(lanterns, boatPosition);
-        int shadowLocal  = -1;
-        for (int i = 0; i < n; ++i) if (ids[i] == shadowGlobal) { shadowLocal = i; break; }
-        lit.setInt("shadowedIndex", shadowLocal);
-
         for (int i = 0; i < n; ++i) {
-            const auto& L = lanterns[ids[i]];
+            int slot = cut[i].lantern >= 0 ? shadowBudget.SlotOf(cut[i].lantern) : -1;
             std::string b = "lanterns[" + std::to_string(i) + "]";
-            lit.setVec3(b + ".position", lanterns[i].pos);
-            lit.setVec3(b + ".color", glm::vec3(1.0f, 0.62f, 0.28f));
-            lit.setFloat(b + ".constant", 1.0f);
-            lit.setFloat(b + ".linear", 0.14f);
-            lit.setFloat(b + ".quadratic", 0.07f);
+            lit.setVec3(b + ".position", cut[i].pos);
+            lit.setVec3(b + ".color", LANTERN_LIGHT_COLOR * cut[i].intensity);
+            lit.setFloat(b + ".constant", LANTERN_ATTEN_CONSTANT);
+            lit.setFloat(b + ".linear", LANTERN_ATTEN_LINEAR);
+            lit.setFloat(b + ".quadratic", LANTERN_ATTEN_QUADRATIC);
+            lit.setInt(b + ".shadowSlot", slot >= 0 ? shadowSlotToShader[slot] : -1);
         }
 
+        if (manyLights.enabled) manyLights.BeginScene(w, h);
+
         //<Drawing the Models :)>
-        //island
-        lit.setBool("useTexture", false);
-        lit.setMat4("model", I);
+        lit.setInt("lightmap", LIGHTMAP_UNIT);
+        if (staticArrived) { //meshes still streaming draw nothing
+            //island
+            lit.setBool("useTexture", false);
+            lit.setMat4("model", I);
 
-        glActiveTexture(GL_TEXTURE0);
-        lit.setVec3("baseColor", glm::vec3(31.0f / 255.0f, 94.0f / 255.0f, 31.0f / 255.0f)); 
-        island.Draw(lit);
+            glActiveTexture(GL_TEXTURE0 + LIGHTMAP_UNIT);
+            glBindTexture(GL_TEXTURE_2D, islandLightmap);
+            lit.setBool("useLightmap", islandLightmap != 0 && islandLightmapReady);
+            glActiveTexture(GL_TEXTURE0);
+            lit.setVec3("baseColor", islandColor);
+            lit.setBool("useVertexAO", island->HasVertexAO());
+            island->Draw(lit);
 
-        //castle
-        lit.use();
-        lit.setBool("useTexture", false);
-        lit.setMat4("model", C);
-        
-        for (size_t i = 0; i < castle.getMeshes().size(); i++) {
+            //castle
             lit.use();
             lit.setBool("useTexture", false);
-
-            if (i % 3 == 0) lit.setVec3("baseColor", glm::vec3(1.0f, 0.819f, 0.863f)); //pink
-            if (i % 3 == 1) lit.setVec3("baseColor", glm::vec3(1.0f)); //white
-            if (i % 3 == 2) lit.setVec3("baseColor", glm::vec3(1.0f, 0.992f, 0.921f)); //off-white
-
-            castle.getMeshes()[i].Draw(lit);
+            lit.setMat4("model", C);
+            lit.setBool("useVertexAO", castle->HasVertexAO());
+            glActiveTexture(GL_TEXTURE0 + LIGHTMAP_UNIT);
+            glBindTexture(GL_TEXTURE_2D, castleLightmap);
+            lit.setBool("useLightmap", castleLightmap != 0 && castleLightmapReady);
+            glActiveTexture(GL_TEXTURE0);
+
+            for (size_t i = 0; i < castle->getMeshes().size(); i++) {
+                lit.use();
+                lit.setBool("useTexture", false);
+                lit.setVec3("baseColor", castleColor(i));
+                castle->getMeshes()[i].Draw(lit);
+            }
         }
+        //flat boxes where they will be, until the first of their meshes is in
+        if (!staticReady) {
+            lit.setBool("useTexture", false);
+            lit.setBool("useLightmap", false);
+            lit.setBool("useVertexAO", false);
+            if (islandBox && (!staticArrived || islandWaiting == island->MeshCount())) {
+                lit.setMat4("model", I * glm::translate(glm::mat4(1.0f), islandBoxMin) * glm::scale(glm::mat4(1.0f), islandBoxMax - islandBoxMin));
+                lit.setVec3("baseColor", islandColor);
+                placeholderBox.Draw(lit);
+            }
+            if (castleBox && (!staticArrived || castleWaiting == castle->MeshCount())) {
+                lit.setMat4("model", C * glm::translate(glm::mat4(1.0f), castleBoxMin) * glm::scale(glm::mat4(1.0f), castleBoxMax - castleBoxMin));
+                lit.setVec3("baseColor", castleColor(0));
+                placeholderBox.Draw(lit);
+            }
+        }
+        lit.setBool("useVertexAO", false); //everything else has no baked AO
+        lit.setBool("useLightmap", false); //and is lit by the moon per fragment
 
         //boat
         lit.use();
@@ -661,16 +1112,21 @@ int main() {
         glActiveTexture(GL_TEXTURE0);
         glBindTexture(GL_TEXTURE_2D, lanternTex);
 
-        for (const auto& L : lanterns) {
-            glm::mat4 m = glm::translate(glm::mat4(1.0f), L.pos);
-            m = glm::scale(m, glm::vec3(0.06f));
-            lit.setMat4("model", m);
-            lantern.Draw(lit);
-        }
+        lanternLod.Classify(lanterns, view, proj, h, workers);
+        lanternLod.DrawMeshes(lit, lantern);
+        if (gGpuLanterns) gpuLanterns.DrawMeshes(lit, lantern);
+        if (gAnalyticLanterns) analyticLanterns.DrawMeshes(lit, lantern);
         lit.setBool("isLantern", false);
 
+        if (manyLights.enabled) {
+            manyLights.Resolve(proj * view);
+            glViewport(0, 0, w, h);
+        }
+        lanternLod.DrawImpostors(view, proj, eye);
+
         glm::mat4 skyView = glm::mat4(glm::mat3(view));
         renderSkybox(skyboxVAO, skyboxShader, cubemapTexture, skyView, proj);
+        lanternLod.DrawSprites(view, proj, h);
 
         //water
         glEnable(GL_BLEND);
@@ -707,6 +1163,7 @@ int main() {
         glfwSwapBuffers(window);
     }
 
+    streamer.Stop(); //a castle still loading is finished first, its context goes with the window
     glfwTerminate();
     return 0;
 }
@@ -761,52 +1218,27 @@ void processInput(GLFWwindow* window)
     static bool cWasDown = false;
     bool cDown = glfwGetKey(window, GLFW_KEY_C) == GLFW_PRESS;
     if (cDown && !cWasDown) {
-        std::cout << "[C] Castle burst!\n";
-        SpawnLanternBurstFromCastle(20);
+        std::cout << (gSpawnOverride ? "[C] Burst at picked spot!\n" : "[C] Castle burst!\n");
+        SpawnLanternBurst(20);
     }
     cWasDown = cDown;
-}
-
-unsigned int loadCubemap(const std::vector<std::string>& faces)
-{
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
-
-    stbi_set_flip_vertically_on_load(false); // cubemap faces should not be flipped
 
-    int width, height, nrChannels;
-    for (unsigned int i = 0; i < faces.size(); i++)
-    {
-        unsigned char *data = stbi_load(faces[i].c_str(), &width, &height, &nrChannels, 0);
-        if (data)
-        {
-            GLenum format = GL_RGB;
-            if (nrChannels == 1) format = GL_RED;
-            else if (nrChannels == 3) format = GL_RGB;
-            else if (nrChannels == 4) format = GL_RGBA;
-
-            glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i,
-                         0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-            stbi_image_free(data);
-        }
-        else
-        {
-            std::cout << "Cubemap texture failed to load at path: " << faces[i] << std::endl;
-            stbi_image_free(data);
-        }
+    //left click picks a burst spot (C reuses it), right click goes back to the castle
+    static bool leftWasDown = false;
+    bool leftDown = glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS;
+    if (leftDown && !leftWasDown) gPickRequested = true;
+    leftWasDown = leftDown;
+    if (glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_RIGHT) == GLFW_PRESS) gSpawnOverride = false;
+
+    static bool lWasDown = false;
+    bool lDown = glfwGetKey(window, GLFW_KEY_L) == GLFW_PRESS;
+    if (lDown && !lWasDown) {
+        gStochasticLights = !gStochasticLights;
+        std::cout << "[L] Stochastic lanterns " << (gStochasticLights ? "on" : "off") << "\n";
     }
-
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-
-    return textureID;
+    lWasDown = lDown;
 }
 
-
 void renderSkybox(unsigned int skyboxVAO,
                   Shader& skyboxShader,
                   unsigned int cubemapTexture,
@@ -0,0 +1,130 @@
+//Builds the asset pack the game maps at startup (see AssetPack.hpp).
+//  asset_packer <out.pack> [--draco] [--models a.obj ...] [--static-models ...] [--textures ...]
+//               [--cube-faces ...] [--files ...]
+//Run from the project root: every entry is named by its path relative to it, the same path
+//the game opens. Models are imported (and baked, for --static-models: collision, AO and
+//lightmap UVs, as the castle and island are) until their mesh cache is current, then the
+//cache is packed along with any lightmap bake a game run left in cache/. Textures are packed
+//as files plus their cache/ levels, built as block compressed when missing or stale;
+//--files go in raw (shaders). --draco packs the meshes Draco-encoded (see MeshCache): the
+//copies are written next to the caches and removed once packed, cache/ itself stays in the
+//encoding the game reads and writes.
+#include "AssetPack.hpp"
+#include "MeshCache.hpp"
+#include "Model.hpp"
+#include "TextureLoader.hpp"
+#include "ThreadPool.hpp"
+#include <sys/stat.h>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace {
+
+bool Exists(const std::string& path) {
+    struct stat st;
+    return stat(path.c_str(), &st) == 0;
+}
+
+size_t FileBytes(const std::string& path) {
+    struct stat st;
+    return stat(path.c_str(), &st) == 0 ? size_t(st.st_size) : 0;
+}
+
+} //namespace
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        std::fprintf(stderr, "usage: %s <out.pack> [--draco] [--models ...] [--static-models ...] [--textures ...] "
+                             "[--cube-faces ...] [--files ...]\n", argv[0]);
+        return 1;
+    }
+    const auto t0 = std::chrono::steady_clock::now();
+    ThreadPool pool;
+    std::vector<std::pair<std::string, std::string>> entries; //name, file
+    std::vector<std::string> staged; //Draco copies, removed once the pack is written
+    auto add = [&](const std::string& path) {
+        if (Exists(path)) entries.emplace_back(path, path);
+    };
+
+    enum { NONE, MODELS, STATIC_MODELS, TEXTURES, CUBE_FACES, FILES } mode = NONE;
+    bool draco = false;
+    bool ok = true;
+    for (int i = 2; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "--draco") { draco = true; continue; }
+        if (arg == "--models") { mode = MODELS; continue; }
+        if (arg == "--static-models") { mode = STATIC_MODELS; continue; }
+        if (arg == "--textures") { mode = TEXTURES; continue; }
+        if (arg == "--cube-faces") { mode = CUBE_FACES; continue; }
+        if (arg == "--files") { mode = FILES; continue; }
+        if (!Exists(arg)) {
+            std::printf("[PACK] skipping '%s': no such file\n", arg.c_str());
+            continue;
+        }
+        switch (mode) {
+        case MODELS:
+        case STATIC_MODELS: {
+            const unsigned bake = mode == STATIC_MODELS ? MODEL_COLLISION | MODEL_AO | MODEL_LIGHTMAP : 0u;
+            if (!Model::Prepare(arg, bake, &pool)) {
+                std::fprintf(stderr, "[PACK] can't import '%s'\n", arg.c_str());
+                ok = false;
+                break;
+            }
+            CachedModel cached;
+            if (draco && MeshCache::Read(arg, cached, &pool) && !cached.draco) {
+                MeshCache::Encoding encoding;
+                encoding.draco = true;
+                const std::string copy = MeshCache::PathFor(arg, ".mcache.draco");
+                if (!MeshCache::WriteAs(copy, arg, cached, encoding, &pool)) {
+                    std::fprintf(stderr, "[PACK] can't write '%s'\n", copy.c_str());
+                    ok = false;
+                    break;
+                }
+                staged.push_back(copy);
+                entries.emplace_back(MeshCache::PathFor(arg), copy); //packed under the cache's name
+            } else {
+                add(MeshCache::PathFor(arg));
+            }
+            add(MeshCache::PathFor(arg, ".lmap"));
+            break;
+        }
+        case TEXTURES:
+        case CUBE_FACES: {
+            const TextureLoader::Kind kind = mode == CUBE_FACES ? TextureLoader::CUBE_FACE : TextureLoader::TEXTURE_2D;
+            //a current cache is packed as it is, texel budget and all; otherwise the whole image
+            TextureLoader::Compression compression;
+            int maxSize;
+            if (!TextureLoader::CachedRequest(arg, compression, maxSize)) {
+                TextureLoader::Image image;
+                TextureLoader::Decode(arg, kind, TextureLoader::COMPRESS_S3TC, 0, false, &pool, image);
+                if (image.levels.empty()) ok = false;
+            }
+            add(arg);
+            add(MeshCache::PathFor(arg, ".tex"));
+            break;
+        }
+        case FILES:
+            add(arg);
+            break;
+        default:
+            std::fprintf(stderr, "[PACK] '%s' before any --models / --textures / --files\n", arg.c_str());
+            ok = false;
+        }
+    }
+    const bool written = ok && AssetPack::Write(argv[1], entries);
+    size_t bytes = 0;
+    for (const auto& e : entries) bytes += FileBytes(e.second);
+    for (const auto& copy : staged) std::remove(copy.c_str());
+    if (!ok) return 1;
+    if (!written) {
+        std::fprintf(stderr, "[PACK] couldn't write '%s'\n", argv[1]);
+        return 1;
+    }
+    const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+    std::printf("[PACK] %s: %zu entries, %.2f MB of data, %.2f MB file, %.0f ms\n", argv[1], entries.size(),
+                bytes / (1024.0 * 1024.0), FileBytes(argv[1]) / (1024.0 * 1024.0), ms);
+    return 0;
+}